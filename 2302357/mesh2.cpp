@@ -12,13 +12,28 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "../lib/shader_cache.h"
+#include "../lib/shader_variants.h"
+#include "../lib/stream_buffer.h"
+#include "../lib/texture_manager.h"
+#include "../lib/headless.h"
+#include "../lib/input_replay.h"
+#include "../lib/arcball.h"
+#include "../lib/frame_scheduler.h"
+#include "../lib/render_thread.h"
+#include "../lib/job_system.h"
+#include "../lib/startup.h"
+#include "../lib/profiler.h"
+#include "../lib/trace.h"
 
 // --- Variáveis Globais ---
-GLuint phongProgram, basicProgram, textureProgram;
+GLuint phongProgram, basicProgram;
 GLuint VAO, VBO;
 GLuint textureID;
+TextureManager textures;   // decodifica imagens em threads de fundo
+Profiler profiler;         // tempos por quadro (tecla p mostra, CG_PROFILE salva)
+int textureHandle = -1;
+Startup startup;           // etapas da inicialização (linha do tempo no primeiro quadro)
 std::vector<float> vertices;
 int drawMode = GL_FILL;
 bool usePhongLighting = false;
@@ -26,82 +41,93 @@ int textureMappingMode = 0;
 glm::vec3 center(0.0f), translation(0.0f);
 float scaleFactor = 1.0f;
 glm::quat rotationQuat = glm::quat(1, 0, 0, 0);
-bool leftMouseDown = false;
-glm::vec2 lastMousePos;
+// Trackball: os movimentos do mouse viram uma rotação só por quadro; soltar
+// com o mouse em movimento deixa o objeto girando (inércia)
+Arcball arcball(800, 600);
+void spin(double);
+FrameScheduler scheduler(spin);   // passos fixos da inércia
 
 glm::vec3 modelMinBounds = glm::vec3(0.0f);
 glm::vec3 modelMaxBounds = glm::vec3(0.0f);
 
 //shaders feitos em raw string literal
+
+// Blocos uniformes (std140) compartilhados por todos os programas.
+// Frame: dados da cena, escritos uma vez por quadro.
+// Object: dados do objeto, incluindo a matriz normal calculada na CPU.
+// Devem espelhar FrameUniforms e ObjectUniforms abaixo.
+#define UNIFORM_BLOCKS \
+"layout(std140) uniform Frame {\n" \
+"    mat4 view;\n" \
+"    mat4 projection;\n" \
+"    vec4 lightPos;\n" \
+"    vec4 lightColor;\n" \
+"    vec4 viewPos;\n" \
+"};\n" \
+"layout(std140) uniform Object {\n" \
+"    mat4 model;\n" \
+"    mat4 normalMatrix;\n" \
+"    mat4 mvp;\n" \
+"    vec4 objectColor;\n" \
+"    vec4 objectMinBounds;\n" \
+"    vec4 objectMaxBounds;\n" \
+"};\n"
+
 // Vertex Shader para iluminacao Phong (do modelo 3D)
-const char* phongVertexShader = R"(
-#version 330 core
+const char* phongVertexShader = "#version 330 core\n" UNIFORM_BLOCKS R"(
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 out vec3 fragPos;
 out vec3 normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
 void main() {
     fragPos = vec3(model * vec4(aPos, 1.0));
-    normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * vec4(fragPos, 1.0);
+    normal = mat3(normalMatrix) * aNormal;
+    gl_Position = mvp * vec4(aPos, 1.0);
 }
 )";
 
 // Fragment Shader para iluminacao Phong (do modelo 3D)
-const char *phongFragmentShader = R"(
-#version 330 core
+const char *phongFragmentShader = "#version 330 core\n" UNIFORM_BLOCKS R"(
 in vec3 normal; 
 in vec3 fragPos;
 out vec4 FragColor;
 
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-
 void main() {
     float ka = 0.1;
-    vec3 ambient = ka * lightColor;
+    vec3 ambient = ka * lightColor.rgb;
 
     // Componente Difuso
     float kd = 0.7; // Coeficiente difuso (intensidade da luz difusa)
     vec3 n = normalize(normal);
-    vec3 l = normalize(lightPos - fragPos);
+    vec3 l = normalize(lightPos.xyz - fragPos);
     float diff = max(dot(n,l), 0.0);
-    vec3 diffuse = kd * diff * lightColor;
+    vec3 diffuse = kd * diff * lightColor.rgb;
 
     // Componente Especular
     float ks = 0.5; // Coeficiente especular (intensidade da luz especular)
     float shininess = 32.0;
-    vec3 v = normalize(viewPos - fragPos);
+    vec3 v = normalize(viewPos.xyz - fragPos);
     vec3 r = reflect(-l, n);
     float spec = pow(max(dot(v, r), 0.0), shininess);
-    vec3 specular = ks * spec * lightColor;
+    vec3 specular = ks * spec * lightColor.rgb;
 
     // Combina os componentes e multiplica pela cor do objeto
-    vec3 resultLight = (ambient + diffuse + specular) * objectColor;
+    vec3 resultLight = (ambient + diffuse + specular) * objectColor.rgb;
     FragColor = vec4(resultLight, 1.0);
 }
 )";
 
 // Vertex Shader basico para visualizacao de cor
-const char *basicVertexShader = R"(
-#version 330 core
+const char *basicVertexShader = "#version 330 core\n" UNIFORM_BLOCKS R"(
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormalAsColor; 
 
 out vec3 vertexColor; 
 
-uniform mat4 transform;
-
 void main() {
     vertexColor = aNormalAsColor; 
-    gl_Position = transform * vec4(aPos, 1.0); 
+    gl_Position = mvp * vec4(aPos, 1.0); 
 }
 )";
 
@@ -124,49 +150,47 @@ void main() {
 
 // Vertex Shader para Textura
 // === Vertex Shader para Textura ===
-const char* textureVertexShader = R"(
-#version 330 core
+const char* textureVertexShader = "#version 330 core\n" UNIFORM_BLOCKS R"(
 layout(location = 0) in vec3 aPos; 
 layout(location = 1) in vec3 aNormal; 
 
 out vec2 TexCoord; 
-uniform mat4 model;      
-uniform mat4 view;
-uniform mat4 projection;
 
-uniform int textureMappingMode; 
-
-// NOVO: Uniforms para os limites do modelo no espaço do objeto
-uniform vec3 modelMinBounds;
-uniform vec3 modelMaxBounds;
+// Variantes: MAP_ORTHO, MAP_CYLINDRICAL ou MAP_SPHERICAL (definidas na compilacao)
 
 void main() {
+    // Limites do modelo no espaço do objeto (bloco Object)
+    vec3 modelMinBounds = objectMinBounds.xyz;
+    vec3 modelMaxBounds = objectMaxBounds.xyz;
+
     vec3 objectPos = aPos; 
     
     // Calcula as dimensões do bounding box no espaço do objeto
     vec3 bboxSize = modelMaxBounds - modelMinBounds;
     
-    if (textureMappingMode == 1) { // Ortográfica
-        // Normaliza as coordenadas X e Y do objeto para o intervalo [0, 1]
-        // (objectPos.x - modelMinBounds.x) -> offset para que o mínimo seja 0
-        // / bboxSize.x -> divide pelo tamanho para normalizar para [0,1]
-        TexCoord.s = (objectPos.x - modelMinBounds.x) / bboxSize.x;
-        TexCoord.t = (objectPos.y - modelMinBounds.y) / bboxSize.y;
-    } else if (textureMappingMode == 2) { // Cilíndrica
-        // s-coordinate: ângulo em torno do eixo Y
-        TexCoord.s = atan(objectPos.x - (modelMinBounds.x + modelMaxBounds.x) / 2.0, // Centraliza X no centro do bounding box
-                          objectPos.z - (modelMinBounds.z + modelMaxBounds.z) / 2.0) / (2.0 * 3.14159265359) + 0.5;
-        // t-coordinate: altura normalizada (Y)
-        TexCoord.t = (objectPos.y - modelMinBounds.y) / bboxSize.y;
-    } else if (textureMappingMode == 3) { // Esférica
-        // Centraliza o ponto do objeto antes de calcular os ângulos para mapeamento esférico
-        vec3 centeredObjectPos = objectPos - (modelMinBounds + modelMaxBounds) / 2.0;
-        
-        TexCoord.s = atan(centeredObjectPos.x, centeredObjectPos.z) / (2.0 * 3.14159265359) + 0.5;
-        TexCoord.t = asin(centeredObjectPos.y / length(centeredObjectPos.xyz)) / 3.14159265359 + 0.5;
-    }
+#if defined(MAP_ORTHO) // Ortográfica
+    // Normaliza as coordenadas X e Y do objeto para o intervalo [0, 1]
+    // (objectPos.x - modelMinBounds.x) -> offset para que o mínimo seja 0
+    // / bboxSize.x -> divide pelo tamanho para normalizar para [0,1]
+    TexCoord.s = (objectPos.x - modelMinBounds.x) / bboxSize.x;
+    TexCoord.t = (objectPos.y - modelMinBounds.y) / bboxSize.y;
+#elif defined(MAP_CYLINDRICAL) // Cilíndrica
+    // s-coordinate: ângulo em torno do eixo Y
+    TexCoord.s = atan(objectPos.x - (modelMinBounds.x + modelMaxBounds.x) / 2.0, // Centraliza X no centro do bounding box
+                      objectPos.z - (modelMinBounds.z + modelMaxBounds.z) / 2.0) / (2.0 * 3.14159265359) + 0.5;
+    // t-coordinate: altura normalizada (Y)
+    TexCoord.t = (objectPos.y - modelMinBounds.y) / bboxSize.y;
+#elif defined(MAP_SPHERICAL) // Esférica
+    // Centraliza o ponto do objeto antes de calcular os ângulos para mapeamento esférico
+    vec3 centeredObjectPos = objectPos - (modelMinBounds + modelMaxBounds) / 2.0;
     
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    TexCoord.s = atan(centeredObjectPos.x, centeredObjectPos.z) / (2.0 * 3.14159265359) + 0.5;
+    TexCoord.t = asin(centeredObjectPos.y / length(centeredObjectPos.xyz)) / 3.14159265359 + 0.5;
+#else
+    TexCoord = vec2(0.0);
+#endif
+    
+    gl_Position = mvp * vec4(aPos, 1.0);
 }
 )";
 
@@ -183,43 +207,105 @@ void main() {
 }
 )";
 
-// Converte coordenadas da tela para coordenadas normalizadas
-glm::vec2 getTrackballVector(int x, int y, int width, int height) {
-    float nx = (2.0f * x - width) / width;
-    float ny = (height - 2.0f * y) / height;
-    return glm::vec2(nx, ny);
+// Dados uniformes do quadro (layout std140 do bloco Frame)
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightPos;
+    glm::vec4 lightColor;
+    glm::vec4 viewPos;
+};
+
+// Dados uniformes do objeto (layout std140 do bloco Object)
+struct ObjectUniforms {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;
+    glm::mat4 mvp;
+    glm::vec4 objectColor;
+    glm::vec4 minBounds;
+    glm::vec4 maxBounds;
+};
+
+const GLuint FRAME_BINDING = 0;
+const GLuint OBJECT_BINDING = 1;
+
+// Buffer uniforme em anel (mapeado persistentemente, 3 regioes): cada quadro
+// escreve Frame + Object uma unica vez e todos os programas leem dele
+StreamBuffer uniformRing(GL_UNIFORM_BUFFER, 1024);
+GLintptr objectOffset = 0; // deslocamento do bloco Object dentro da regiao
+
+// Variantes do shader de textura, uma por modo de mapeamento (sem desvio por uniform)
+ShaderVariants textureVariants(textureVertexShader, textureFragmentShader);
+const char *textureMappingDefines[] = { "", "MAP_ORTHO", "MAP_CYLINDRICAL", "MAP_SPHERICAL" };
+
+// Inércia do trackball; a animação para quando o giro acaba
+void spin(double dt) {
+    if (!arcball.spin(dt)) scheduler.setAnimating(false);
 }
 
-// Carrega um modelo 3D
-void loadModel(const std::string& path) {
+// Lê um modelo 3D e monta os vértices. Só usa a CPU: roda numa tarefa do
+// job system enquanto a thread do GL cria a janela e compila os shaders
+// (o profiler é só da thread do GL; o tempo aparece na linha do tempo).
+// Devolve false se o arquivo não abre; quem trata o erro é a main, depois
+// da espera, porque exit() num job destruiria os globais em uso
+bool parseModel(const std::string& path) {
     Assimp::Importer importer;
 
+    traceBegin("assimp ReadFile");
     const aiScene* scene = importer.ReadFile(path,
         aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals);
+    traceEnd();
 
-    if (!scene || !scene->HasMeshes()) {
-        std::cerr << "Erro ao carregar modelo: " << path << std::endl;
-        exit(1);
-    }
+    if (!scene || !scene->HasMeshes())
+        return false;
 
     const aiMesh* mesh = scene->mMeshes[0];
-    vertices.clear();
-
-    aiVector3D minV(1e10f), maxV(-1e10f);
-
-    for (unsigned i = 0; i < mesh->mNumFaces; ++i) {
-        const aiFace& face = mesh->mFaces[i];
-        if (face.mNumIndices != 3) continue;
-
-        for (int j = 0; j < 3; ++j) {
-            unsigned int vertexIndex = face.mIndices[j];
-
-            aiVector3D pos = mesh->mVertices[vertexIndex];
-            aiVector3D normal;
-
-            for (unsigned i = 0; i < mesh->mNumFaces; ++i) {
-                // ... loop de vértices existente ...
-                // Dentro do loop de vértices:
+    const int faces = (int)mesh->mNumFaces;
+    const int grain = 4096; // faces por tarefa
+    const int chunks = (faces + grain - 1) / grain;
+
+    // Cada face escreve os seus 18 floats na própria posição do vetor, então
+    // as tarefas não disputam nada; os limites saem por bloco de faces e são
+    // juntados no fim
+    vertices.assign((size_t)faces * 18, 0.0f);
+    std::vector<char> isTriangle(faces);
+    std::vector<aiVector3D> chunkMin(chunks, aiVector3D(1e10f)), chunkMax(chunks, aiVector3D(-1e10f));
+
+    traceBegin("expand faces");
+    jobSystem().parallelFor(0, faces, grain, [&](int f0, int f1) {
+        aiVector3D &minV = chunkMin[f0 / grain], &maxV = chunkMax[f0 / grain];
+        for (int i = f0; i < f1; ++i) {
+            const aiFace& face = mesh->mFaces[i];
+            isTriangle[i] = face.mNumIndices == 3;
+            if (!isTriangle[i]) continue;
+
+            float *out = &vertices[(size_t)i * 18];
+            for (int j = 0; j < 3; ++j) {
+                unsigned int vertexIndex = face.mIndices[j];
+
+                aiVector3D pos = mesh->mVertices[vertexIndex];
+                aiVector3D normal;
+
+                if (mesh->HasNormals()) {
+                    normal = mesh->mNormals[vertexIndex];
+                } else {
+                    //calcula normal da face
+                    aiVector3D v0 = mesh->mVertices[face.mIndices[0]];
+                    aiVector3D v1 = mesh->mVertices[face.mIndices[1]];
+                    aiVector3D v2 = mesh->mVertices[face.mIndices[2]];
+                    normal = (v1 - v0) ^ (v2 - v0); // Produto vetorial para normal da face
+                    normal.Normalize();
+                }
+
+                *out++ = pos.x; // Coordenadas de posição
+                *out++ = pos.y;
+                *out++ = pos.z;
+
+                *out++ = normal.x; // Componentes da normal (usada como normal ou cor)
+                *out++ = normal.y;
+                *out++ = normal.z;
+
+                // Atualiza min/max para o cálculo do centro e escala
                 minV.x = std::min(minV.x, pos.x);
                 minV.y = std::min(minV.y, pos.y);
                 minV.z = std::min(minV.z, pos.z);
@@ -228,37 +314,34 @@ void loadModel(const std::string& path) {
                 maxV.y = std::max(maxV.y, pos.y);
                 maxV.z = std::max(maxV.z, pos.z);
             }
-
-            if (mesh->HasNormals()) {
-                normal = mesh->mNormals[vertexIndex];
-            } else {
-                //calcula normal da face
-                aiVector3D v0 = mesh->mVertices[face.mIndices[0]];
-                aiVector3D v1 = mesh->mVertices[face.mIndices[1]];
-                aiVector3D v2 = mesh->mVertices[face.mIndices[2]];
-                normal = (v1 - v0) ^ (v2 - v0); // Produto vetorial para normal da face
-                normal.Normalize();
-            }
-
-            vertices.push_back(pos.x); // Adiciona coordenadas de posição
-            vertices.push_back(pos.y);
-            vertices.push_back(pos.z);
-
-            vertices.push_back(normal.x); // Adiciona componentes da normal (usada como normal ou cor)
-            vertices.push_back(normal.y);
-            vertices.push_back(normal.z);
-
-            // Atualiza min/max para o cálculo do centro e escala
-            minV.x = std::min(minV.x, pos.x);
-            minV.y = std::min(minV.y, pos.y);
-            minV.z = std::min(minV.z, pos.z);
-
-            maxV.x = std::max(maxV.x, pos.x);
-            maxV.y = std::max(maxV.y, pos.y);
-            maxV.z = std::max(maxV.z, pos.z);
         }
+    });
+
+    // Pontos e linhas (raros depois do aiProcess_Triangulate) saem do vetor
+    if (std::find(isTriangle.begin(), isTriangle.end(), 0) != isTriangle.end()) {
+        size_t kept = 0;
+        for (int i = 0; i < faces; ++i) {
+            if (!isTriangle[i]) continue;
+            std::copy_n(&vertices[(size_t)i * 18], 18, &vertices[kept]);
+            kept += 18;
+        }
+        vertices.resize(kept);
     }
+
+    aiVector3D minV(1e10f), maxV(-1e10f);
+    for (int c = 0; c < chunks; ++c) {
+        minV.x = std::min(minV.x, chunkMin[c].x);
+        minV.y = std::min(minV.y, chunkMin[c].y);
+        minV.z = std::min(minV.z, chunkMin[c].z);
+
+        maxV.x = std::max(maxV.x, chunkMax[c].x);
+        maxV.y = std::max(maxV.y, chunkMax[c].y);
+        maxV.z = std::max(maxV.z, chunkMax[c].z);
+    }
+    traceEnd();
+
     // Calcula o centro do modelo para centralização
+    traceBegin("bounds");
     center = glm::vec3(
         (minV.x + maxV.x) / 2.0f,
         (minV.y + maxV.y) / 2.0f,
@@ -272,14 +355,25 @@ void loadModel(const std::string& path) {
     // NOVO: Armazenar os limites reais do modelo no espaço do objeto
     modelMinBounds = glm::vec3(minV.x, minV.y, minV.z);
     modelMaxBounds = glm::vec3(maxV.x, maxV.y, maxV.z);
+    traceEnd();
+    return true;
+}
 
+// Envia os vértices lidos por parseModel para a GPU
+void uploadModel() {
+    ProfileScope uploadScope(profiler, "uploadModel");
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     
+    profiler.begin("glBufferData", true);
+    traceBegin("glBufferData");
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    traceEnd();
+    profiler.end();
+    profiler.count(PROFILE_BUFFER_BYTES, vertices.size() * sizeof(float));
     
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -290,87 +384,13 @@ void loadModel(const std::string& path) {
     glBindVertexArray(0);
 }
 
-GLuint createShaderProgram(const char* vsSource, const char* fsSource) {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsSource, NULL);
-    glCompileShader(vs);
-
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vs, 512, NULL, infoLog);
-    }
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsSource, NULL);
-    glCompileShader(fs);
-
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fs, 512, NULL, infoLog);
-    }
-
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
-
-    glGetProgramiv(prog, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(prog, 512, NULL, infoLog);
-    }
-
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return prog;
-}
-
-void loadTexture(const std::string& path) {
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
-    // Descomente e use GL_CLAMP_TO_EDGE para que a textura não se repita
-    // Isso garante que a imagem "preencha" a área de 0 a 1 nas coordenadas de textura
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Garante que a textura não se repita na direção S (horizontal)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Garante que a textura não se repita na direção T (vertical)
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // Usar mipmaps para minificação
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Filtro linear para magnificação
-    glGenerateMipmap(GL_TEXTURE_2D);
-    int width, height, nrChannels;
-    
-    // Carrega a imagem com stb_image
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0); 
-    
-    if (data) {
-        GLenum internalFormat = GL_RGB;
-        GLenum dataFormat = GL_RGB;
-
-        if (nrChannels == 4) { // Imagem RGBA
-            internalFormat = GL_RGBA;
-            dataFormat = GL_RGBA;
-        } else if (nrChannels == 1) { // Imagem de 1 canal (tons de cinza)
-            internalFormat = GL_RED;   
-            dataFormat = GL_RED;       
-
-            // Configurar o swizzling da textura para tons de cinza
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ONE); 
-        }
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data); 
-        glGenerateMipmap(GL_TEXTURE_2D); // Gera mipmaps após carregar a imagem
-        std::cout << "Textura " << path << " carregada com sucesso. Dimensões: " << width << "x" << height << ", Canais: " << nrChannels << "\n";
-    } else {
-        std::cerr << "Falha ao carregar textura: " << path << ". Erro: " << stbi_failure_reason() << std::endl;
-    }
-    stbi_image_free(data); // Libera a memória da imagem
-}
-
 void display() {
+    TRACE_SCOPE("frame");
+    profiler.beginFrame();
+    scheduler.beginFrame();
+    arcball.apply();
+    const float *r = arcball.rotation();
+    rotationQuat = glm::quat(r[0], r[1], r[2], r[3]);
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -385,46 +405,68 @@ void display() {
     glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -5));
     glm::mat4 proj = glm::perspective(glm::radians(45.0f), 800.f / 600.f, 0.1f, 100.0f);
 
+    // Atualiza os blocos uniformes uma vez por quadro
+    char *ubo = (char *)uniformRing.begin();
+    FrameUniforms *frame = (FrameUniforms *)ubo;
+    frame->view = view;
+    frame->projection = proj;
+    frame->lightPos = glm::vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    frame->lightColor = glm::vec4(1.0f);
+    frame->viewPos = glm::vec4(0.0f, 0.0f, 5.0f, 1.0f);
+
+    ObjectUniforms *object = (ObjectUniforms *)(ubo + objectOffset);
+    object->model = model;
+    object->normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+    object->mvp = proj * view * model;
+    object->objectColor = glm::vec4(0.1f, 0.5f, 0.8f, 1.0f);
+    object->minBounds = glm::vec4(modelMinBounds, 1.0f);
+    object->maxBounds = glm::vec4(modelMaxBounds, 1.0f);
+    uniformRing.end();
+    profiler.count(PROFILE_UNIFORM_UPLOADS);
+    profiler.count(PROFILE_BUFFER_BYTES, objectOffset + sizeof(ObjectUniforms));
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, uniformRing.buffer(),
+                      uniformRing.offset(), sizeof(FrameUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, uniformRing.buffer(),
+                      uniformRing.offset() + objectOffset, sizeof(ObjectUniforms));
+
     glBindVertexArray(VAO);
 
     if (textureMappingMode != 0) {
+        GLuint textureProgram = textureVariants.get(textureMappingDefines[textureMappingMode]);
         glUseProgram(textureProgram);
-        glUniformMatrix4fv(glGetUniformLocation(textureProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(textureProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(textureProgram, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
         glUniform1i(glGetUniformLocation(textureProgram, "ourTexture"), 0);
-        glUniform1i(glGetUniformLocation(textureProgram, "textureMappingMode"), textureMappingMode);
-
-        // NOVO: Enviar os limites do bounding box para o shader
-        glUniform3f(glGetUniformLocation(textureProgram, "modelMinBounds"), modelMinBounds.x, modelMinBounds.y, modelMinBounds.z);
-        glUniform3f(glGetUniformLocation(textureProgram, "modelMaxBounds"), modelMaxBounds.x, modelMaxBounds.y, modelMaxBounds.z);
+        profiler.count(PROFILE_UNIFORM_UPLOADS);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textureID);
     }
     else if (usePhongLighting) {
         glUseProgram(phongProgram);
-        glUniformMatrix4fv(glGetUniformLocation(phongProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(phongProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(phongProgram, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
-        glUniform3f(glGetUniformLocation(phongProgram, "lightPos"), 2.0f, 2.0f, 2.0f);
-        glUniform3f(glGetUniformLocation(phongProgram, "viewPos"), 0.0f, 0.0f, 5.0f);
-        glUniform3f(glGetUniformLocation(phongProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
-        glUniform3f(glGetUniformLocation(phongProgram, "objectColor"), 0.1f, 0.5f, 0.8f);
     } else {
         glUseProgram(basicProgram);
-        glm::mat4 transform = proj * view * model;
-        glUniformMatrix4fv(glGetUniformLocation(basicProgram, "transform"), 1, GL_FALSE, glm::value_ptr(transform));
     }
 
+    profiler.begin("glDrawArrays", true);
+    traceBegin("glDrawArrays");
     glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 6);
-    glutSwapBuffers();
+    traceEnd();
+    profiler.end();
+    profiler.countDraw(GL_TRIANGLES, vertices.size() / 6);
+    uniformRing.fence();
+    profiler.endFrame();
+
+    profiler.drawOverlay();
+    swapBuffers();
+    startup.firstFrame();
+    scheduler.endFrame();
 }
 
 void keyboard(unsigned char key, int, int) {
     float step = 0.5f;
     switch (key) {
         case 'v': drawMode = (drawMode == GL_FILL ? GL_LINE : GL_FILL); break;
+        case 'p': profiler.setOverlay(!profiler.overlayVisible()); break;
         case '+': scaleFactor *= 1.1f; break;
         case '-': scaleFactor *= 0.9f; break;
         case '1':
@@ -453,12 +495,12 @@ void keyboard(unsigned char key, int, int) {
             textureMappingMode = 0;
             std::cout << "Mapeamento de Textura: DESATIVADO\n";
             break;
-        case 27: glutLeaveMainLoop(); break;
-        case 'q': case 'Q': glutLeaveMainLoop(); break; 
+        case 27: leaveMainLoop(); break;
+        case 'q': case 'Q': leaveMainLoop(); break; 
         case 'w': case 'W': translation.z += step; break;
         case 's': case 'S': translation.z -= step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void specialKeys(int key, int, int) {
@@ -469,35 +511,35 @@ void specialKeys(int key, int, int) {
         case GLUT_KEY_LEFT: translation.x -= step; break;
         case GLUT_KEY_RIGHT: translation.x += step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON) leftMouseDown = (state == GLUT_DOWN);
+    if (button == GLUT_LEFT_BUTTON) {
+        if (state == GLUT_DOWN) arcball.press(x, y, scheduler.time());
+        else if (arcball.release(x, y, scheduler.time())) scheduler.setAnimating(true);
+    }
     if (button == 3) scaleFactor *= 1.1f;
     if (button == 4) scaleFactor *= 0.9f;
-    lastMousePos = glm::vec2(x, y);
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void motion(int x, int y) {
-    if (!leftMouseDown) return;
-    glm::vec2 cur = getTrackballVector(x, y, 800, 600);
-    glm::vec2 prev = getTrackballVector(lastMousePos.x, lastMousePos.y, 800, 600);
-    glm::vec3 a = glm::vec3(prev, sqrtf(std::max(0.0f, 1 - glm::dot(prev, prev))));
-    glm::vec3 b = glm::vec3(cur, sqrtf(std::max(0.0f, 1 - glm::dot(cur, cur))));
-    glm::vec3 axis = glm::cross(a, b);
-    float angle = acosf(std::min(1.0f, glm::dot(glm::normalize(a), glm::normalize(b))));
-    
-    if (glm::length(axis) > 0.0001f && !std::isnan(angle)) {
-        rotationQuat = glm::normalize(glm::angleAxis(angle, glm::normalize(axis)) * rotationQuat);
-    }
-    lastMousePos = glm::vec2(x, y);
-    glutPostRedisplay();
+    if (!arcball.dragging()) return;
+    // Só guarda a posição: a rotação é calculada uma vez por quadro em display()
+    arcball.drag(x, y, scheduler.time());
+    postRedisplay();
 }
 
 // --- Função Principal ---
 int main(int argc, char** argv) {
+    // Sem janela: --headless WxH --frames N --out dir (veja lib/headless.h)
+    headlessInit(argc, argv);
+    // Gravação e reprodução da interação: --record arq / --replay arq (veja lib/input_replay.h)
+    inputReplayInit(argc, argv);
+    // Desenho numa thread própria: --render-thread (veja lib/render_thread.h)
+    renderThreadInit(argc, argv);
+
     const char *h = "-h";
     if (argc < 2 || (argc == 2 && strcmp(argv[1], h) == 0)) {
         std::cout << "CONTROLES DE MANIPULAÇÃO DA MALHA\n";
@@ -511,56 +553,126 @@ int main(int argc, char** argv) {
         std::cout << "Setas (cima, baixo, esquerda, direita): deslocamento do objeto\n";
         std::cout << "Botão esquerdo + movimento do mouse: rotação do objeto (trackball)\n";
         std::cout << "Scroll do mouse (+/-): aplica escala no objeto\n";
+        std::cout << "Letra p: mostra/esconde os tempos por quadro (CPU, GPU, draw calls)\n";
         std::cout << "ESC: Sair do programa\n";
+        std::cout << "CG_TEXTURE_COMPRESSION=bc|bc7[-hq]: comprime a textura (BC1/BC3 ou BC7) para economizar memória de vídeo\n";
+        std::cout << "CG_TEXTURE_OPS=resize=0.5,sharpen=0.3,gray,gamma=1.2,blur=2: processa a textura antes de enviar\n";
+        std::cout << "CG_PROFILE=perfil.csv|perfil.json: salva os tempos ao sair (CSV ou trace do Chrome)\n";
+        std::cout << "CG_TRACE=trace.json: grava carga, texturas, shaders e desenhos (abrir em ui.perfetto.dev)\n";
+        std::cout << "--headless 800x600 --frames 60 --out quadros --input 10:v,20:drag=40x0: desenha sem janela e salva os quadros\n";
+        std::cout << "--record sessao.txt: grava teclado e mouse; --replay sessao.txt [--replay-timing frames|original]: reproduz\n";
+        std::cout << "--render-thread: desenha numa thread separada; os callbacks do GLUT só enfileiram os eventos\n";
         return 1;
     }
+
+    // A leitura do modelo e a decodificação da textura rodam em jobs enquanto
+    // esta thread cria a janela e compila os shaders; só o envio para a GPU
+    // espera por elas
+    std::string modelPath = argv[1];
+    bool parsed = false;
+    JobHandle parse = startup.background("parse model", [modelPath, &parsed] { parsed = parseModel(modelPath); });
+    if (argc > 2) {
+        textureHandle = textures.request(argv[2], GL_CLAMP_TO_EDGE);
+    } else {
+        std::cout << "Nenhuma textura fornecida.\n";
+        std::cout << "Ex: ./mesh modelo.obj textura.png\n";
+    }
     
-    glutInit(&argc, argv);
-    glutInitContextVersion(3, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Visualizador 3D - Iluminacao e Texturas");
+    if (!headless()) {
+        startup.stage("create window", [&] {
+            glutInit(&argc, argv);
+            glutInitContextVersion(3, 3);
+            glutInitContextProfile(GLUT_CORE_PROFILE);
+            glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+            glutInitWindowSize(800, 600);
+            glutCreateWindow("Visualizador 3D - Iluminacao e Texturas");
+        });
+    }
 
+    // No pbuffer o GLEW (feito para GLX) carrega as funções mas não acha
+    // um display GLX e devolve erro
     glewExperimental = GL_TRUE;
-    if (glewInit() != GLEW_OK) {
+    GLenum glewStatus = glewInit();
+    if (glewStatus != GLEW_OK && !(headless() && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)) {
         std::cerr << "Falha ao inicializar GLEW\n";
         return 1;
     }
 
-    phongProgram = createShaderProgram(phongVertexShader, phongFragmentShader);
-    basicProgram = createShaderProgram(basicVertexShader, basicFragmentShader);
-    textureProgram = createShaderProgram(textureVertexShader, textureFragmentShader);
+    profiler.init();
 
-    loadModel(argv[1]);
-    if (argc > 2) { 
-        loadTexture(argv[2]);
-    } else {
-        std::cout << "Nenhuma textura fornecida.\n";
-        std::cout << "Ex: ./mesh modelo.obj textura.png\n";
-        
-        unsigned char defaultTex[] = {255, 255, 255};
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, defaultTex);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    startup.stage("compile shaders", [] {
+        // Programas vem do cache em disco quando possivel (pula o compilador GLSL)
+        phongProgram = createCachedShaderProgram(phongVertexShader, phongFragmentShader);
+        basicProgram = createCachedShaderProgram(basicVertexShader, basicFragmentShader);
+        textureVariants.bindBlock("Frame", FRAME_BINDING);
+        textureVariants.bindBlock("Object", OBJECT_BINDING);
+        textureVariants.prewarm({ "MAP_ORTHO", "MAP_CYLINDRICAL", "MAP_SPHERICAL" });
+
+        for (GLuint p : { phongProgram, basicProgram }) {
+            bindUniformBlock(p, "Frame", FRAME_BINDING);
+            bindUniformBlock(p, "Object", OBJECT_BINDING);
+        }
+    });
+    printShaderCacheStats();
+
+    // Bloco Object comeca no primeiro deslocamento alinhado apos Frame
+    GLint uboAlign = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlign);
+    objectOffset = (sizeof(FrameUniforms) + uboAlign - 1) / uboAlign * uboAlign;
+    uniformRing.init();
+
+    startup.wait("parse model", parse);
+    if (!parsed) {
+        std::cerr << "Erro ao carregar modelo: " << modelPath << std::endl;
+        return 1;
+    }
+    startup.stage("upload model", uploadModel);
+
+    // Sem textura: 1x1 branca
+    startup.stage("upload texture", [] {
+        textures.finish();
+        textureID = textures.texture(textureHandle);
+    });
+    // A decodificação rodou num job do TextureManager; entra na linha do tempo
+    std::chrono::steady_clock::time_point decodeStart, decodeEnd;
+    if (textures.decodeSpan(textureHandle, decodeStart, decodeEnd))
+        startup.background("decode texture", decodeStart, decodeEnd);
+    textures.printStats();
+
+    HeadlessCallbacks callbacks = renderThreadWrap(inputReplayWrap({display, nullptr, nullptr, keyboard, specialKeys, mouse, motion}));
+    if (headless()) {
+        int status = headlessRun(callbacks);
+        profiler.printStats();
+        arcball.printStats();
+        profiler.save();
+        return status;
     }
     
-    glutDisplayFunc(display);
-    glutKeyboardFunc(keyboard);
-    glutSpecialFunc(specialKeys);
-    glutMouseFunc(mouse);
-    glutMotionFunc(motion);
-
+    glutDisplayFunc(callbacks.display);
+    glutIdleFunc(callbacks.idle);
+    glutKeyboardFunc(callbacks.keyboard);
+    glutSpecialFunc(callbacks.special);
+    glutMouseFunc(callbacks.mouse);
+    glutMotionFunc(callbacks.motion);
+    if (callbacks.reshape) glutReshapeFunc(callbacks.reshape);
+
+    // glutMainLoop retorna ao sair (em vez de exit), para salvar o perfil
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+    renderThreadStart();
     glutMainLoop();
+    renderThreadPrintStats();
+    profiler.printStats();
+    arcball.printStats();
+    profiler.save();
     
     // Limpeza
     glDeleteProgram(phongProgram);
     glDeleteProgram(basicProgram);
-    glDeleteProgram(textureProgram);
+    textureVariants.release();
+    uniformRing.release();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    glDeleteTextures(1, &textureID);
+    textures.clear();
     
     return 0;
 }
\ No newline at end of file
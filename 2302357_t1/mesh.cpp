@@ -10,6 +10,8 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <glm/gtx/string_cast.hpp>
+#include "../lib/headless.h"
+#include "../lib/shader_cache.h"
 
 GLuint program, VAO, VBO;
 std::vector<float> vertices;
@@ -141,21 +143,8 @@ void loadModel(const std::string& path) {
 
 //carregar e compilars os shaders
 void compileShaders() {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vertexShaderSource, NULL);
-    glCompileShader(vs);
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fs);
-
-    program = glCreateProgram();
-    glAttachShader(program, vs);
-    glAttachShader(program, fs);
-    glLinkProgram(program);
-
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    // Binário do programa vem do cache em disco quando possível
+    program = createCachedShaderProgram(vertexShaderSource, fragmentShaderSource);
 }
 
 void display() {
@@ -180,7 +169,7 @@ void display() {
     //pular 6 pois inclui as cores no carregamento do objeto
     glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 6);
 
-    glutSwapBuffers();
+    swapBuffers();
 }
 
 void keyboard(unsigned char key, int x, int y) {
@@ -189,15 +178,15 @@ void keyboard(unsigned char key, int x, int y) {
         case 'v': drawMode = (drawMode == GL_FILL ? GL_LINE : GL_FILL); break;
         case '+': scaleFactor *= 1.1f; break;
         case '-': scaleFactor *= 0.9f; break;
-        case 27 : glutLeaveMainLoop(); //exit(0); break;
+        case 27 : leaveMainLoop(); //exit(0); break;
         case 'q':
-        case 'Q': glutLeaveMainLoop();
+        case 'Q': leaveMainLoop();
         case 'w':
         case 'W': translation.z += step; break;
         case 'S':
         case 's': translation.z -= step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void specialKeys(int key, int, int) {
@@ -208,7 +197,7 @@ void specialKeys(int key, int, int) {
         case GLUT_KEY_LEFT: translation.x -= step; break;
         case GLUT_KEY_RIGHT: translation.x += step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void mouse(int button, int state, int x, int y) {
@@ -218,7 +207,7 @@ void mouse(int button, int state, int x, int y) {
     if (button == 3) scaleFactor *= 1.1f; // Scroll cima
     if (button == 4) scaleFactor *= 0.9f; // Scroll baixo
 
-    glutPostRedisplay();
+    postRedisplay();
     lastMousePos = glm::vec2(x, y); //ultima posicao do mouse
 }
 
@@ -236,10 +225,13 @@ void motion(int x, int y) {
 
     rotationQuat = glm::normalize(glm::angleAxis(angle, axis) * rotationQuat); //gera o quaternion com o angulo
     lastMousePos = glm::vec2(x, y);
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 int main(int argc, char** argv) {
+    // Sem janela: --headless WxH --frames N --out dir (veja lib/headless.h)
+    headlessInit(argc, argv);
+
     const char *h = "-h";
     if(strcmp(argv[1], h) == 0){
         std::cout << "CONTROLES DE MANIPULAÇÃO DA MALHA\n";
@@ -253,16 +245,19 @@ int main(int argc, char** argv) {
         std::cout << "Seta para esquerda: deslocamento negativo de X\n";
         std::cout << "Botão esquerdo mais movimento do mouse: rotação do objeto\n";
         std::cout << "Usar scroll do mouse: aplica escala no objeto\n";
+        std::cout << "--headless 800x600 --frames 60 --out quadros --input 10:v,20:drag=40x0: desenha sem janela e salva os quadros\n";
     }else{
         if (argc < 2) {
             std::cerr << "Uso: " << argv[0] << " modelo.obj\n";
             return 1;
         }
     
-        glutInit(&argc, argv);
-        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-        glutInitWindowSize(800, 600);
-        glutCreateWindow("Visualizador 3D - Cor por Distância e Direção");
+        if (!headless()) {
+            glutInit(&argc, argv);
+            glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+            glutInitWindowSize(800, 600);
+            glutCreateWindow("Visualizador 3D - Cor por Distância e Direção");
+        }
     
         glewInit();
         glEnable(GL_DEPTH_TEST);
@@ -272,6 +267,8 @@ int main(int argc, char** argv) {
         
         loadModel(argv[1]);
         
+        if (headless())
+            return headlessRun({display, nullptr, nullptr, keyboard, specialKeys, mouse, motion});
     
         glutDisplayFunc(display);
         glutKeyboardFunc(keyboard);
@@ -12,13 +12,20 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "../lib/shader_cache.h"
+#include "../lib/texture_manager.h"
+#include "../lib/headless.h"
+#include "../lib/input_replay.h"
+#include "../lib/arcball.h"
+#include "../lib/frame_scheduler.h"
+#include "../lib/render_thread.h"
 
 // --- Variáveis Globais ---
 GLuint phongProgram, basicProgram, textureProgram;
 GLuint VAO, VBO;
 GLuint textureID;
+TextureManager textures;   // decodifica imagens em threads de fundo
+int textureHandle = -1;
 std::vector<float> vertices;
 int drawMode = GL_FILL;
 bool usePhongLighting = false;
@@ -26,8 +33,11 @@ int textureMappingMode = 0;
 glm::vec3 center(0.0f), translation(0.0f);
 float scaleFactor = 1.0f;
 glm::quat rotationQuat = glm::quat(1, 0, 0, 0);
-bool leftMouseDown = false;
-glm::vec2 lastMousePos;
+// Trackball: os movimentos do mouse viram uma rotação só por quadro; soltar
+// com o mouse em movimento deixa o objeto girando (inércia)
+Arcball arcball(800, 600);
+void spin(double);
+FrameScheduler scheduler(spin);   // passos fixos da inércia
 
 // Vertex Shader para iluminacao Phong (do modelo 3D)
 const char* phongVertexShader = R"(
@@ -161,11 +171,9 @@ void main() {
 }
 )";
 
-// Converte coordenadas da tela para coordenadas normalizadas
-glm::vec2 getTrackballVector(int x, int y, int width, int height) {
-    float nx = (2.0f * x - width) / width;
-    float ny = (height - 2.0f * y) / height;
-    return glm::vec2(nx, ny);
+// Inércia do trackball; a animação para quando o giro acaba
+void spin(double dt) {
+    if (!arcball.spin(dt)) scheduler.setAnimating(false);
 }
 
 // Carrega um modelo 3D
@@ -251,75 +259,16 @@ void loadModel(const std::string& path) {
     glBindVertexArray(0);
 }
 
+// Binário do programa vem do cache em disco quando possível (pula o compilador GLSL)
 GLuint createShaderProgram(const char* vsSource, const char* fsSource) {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsSource, NULL);
-    glCompileShader(vs);
-
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vs, 512, NULL, infoLog);
-    }
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsSource, NULL);
-    glCompileShader(fs);
-
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fs, 512, NULL, infoLog);
-    }
-
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
-
-    glGetProgramiv(prog, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(prog, 512, NULL, infoLog);
-    }
-
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return prog;
-}
-
-void loadTexture(const std::string& path) {
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Evita repetição horizontal
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Evita repetição vertical
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // Usar mipmaps
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); //
-
-    int width, height, nrChannels;
-    
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0); //
-    
-    if (data) {
-        GLenum internalFormat = GL_RGB;
-        GLenum dataFormat = GL_RGB;
-
-        if (nrChannels == 4) { // Imagem RGBA
-            internalFormat = GL_RGBA;
-            dataFormat = GL_RGBA;
-        }
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        std::cout << "Textura " << path << " carregada com sucesso. Dimensões: " << width << "x" << height << ", Canais: " << nrChannels << "\n";
-    } else {
-        std::cerr << "Falha ao carregar textura: " << path << ". Erro: " << stbi_failure_reason() << std::endl;
-    }
-    stbi_image_free(data);
+    return createCachedShaderProgram(vsSource, fsSource);
 }
 
 void display() {
+    scheduler.beginFrame();
+    arcball.apply();
+    const float *r = arcball.rotation();
+    rotationQuat = glm::quat(r[0], r[1], r[2], r[3]);
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -363,7 +312,8 @@ void display() {
     }
 
     glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 6);
-    glutSwapBuffers();
+    swapBuffers();
+    scheduler.endFrame();
 }
 
 void keyboard(unsigned char key, int, int) {
@@ -398,12 +348,12 @@ void keyboard(unsigned char key, int, int) {
             textureMappingMode = 0;
             std::cout << "Mapeamento de Textura: DESATIVADO\n";
             break;
-        case 27: glutLeaveMainLoop(); break;
-        case 'q': case 'Q': glutLeaveMainLoop(); break; 
+        case 27: leaveMainLoop(); break;
+        case 'q': case 'Q': leaveMainLoop(); break; 
         case 'w': case 'W': translation.z += step; break;
         case 's': case 'S': translation.z -= step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void specialKeys(int key, int, int) {
@@ -414,35 +364,35 @@ void specialKeys(int key, int, int) {
         case GLUT_KEY_LEFT: translation.x -= step; break;
         case GLUT_KEY_RIGHT: translation.x += step; break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON) leftMouseDown = (state == GLUT_DOWN);
+    if (button == GLUT_LEFT_BUTTON) {
+        if (state == GLUT_DOWN) arcball.press(x, y, scheduler.time());
+        else if (arcball.release(x, y, scheduler.time())) scheduler.setAnimating(true);
+    }
     if (button == 3) scaleFactor *= 1.1f;
     if (button == 4) scaleFactor *= 0.9f;
-    lastMousePos = glm::vec2(x, y);
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void motion(int x, int y) {
-    if (!leftMouseDown) return;
-    glm::vec2 cur = getTrackballVector(x, y, 800, 600);
-    glm::vec2 prev = getTrackballVector(lastMousePos.x, lastMousePos.y, 800, 600);
-    glm::vec3 a = glm::vec3(prev, sqrtf(std::max(0.0f, 1 - glm::dot(prev, prev))));
-    glm::vec3 b = glm::vec3(cur, sqrtf(std::max(0.0f, 1 - glm::dot(cur, cur))));
-    glm::vec3 axis = glm::cross(a, b);
-    float angle = acosf(std::min(1.0f, glm::dot(glm::normalize(a), glm::normalize(b))));
-    
-    if (glm::length(axis) > 0.0001f && !std::isnan(angle)) {
-        rotationQuat = glm::normalize(glm::angleAxis(angle, glm::normalize(axis)) * rotationQuat);
-    }
-    lastMousePos = glm::vec2(x, y);
-    glutPostRedisplay();
+    if (!arcball.dragging()) return;
+    // Só guarda a posição: a rotação é calculada uma vez por quadro em display()
+    arcball.drag(x, y, scheduler.time());
+    postRedisplay();
 }
 
 // --- Função Principal ---
 int main(int argc, char** argv) {
+    // Sem janela: --headless WxH --frames N --out dir (veja lib/headless.h)
+    headlessInit(argc, argv);
+    // Gravação e reprodução da interação: --record arq / --replay arq (veja lib/input_replay.h)
+    inputReplayInit(argc, argv);
+    // Desenho numa thread própria: --render-thread (veja lib/render_thread.h)
+    renderThreadInit(argc, argv);
+
     const char *h = "-h";
     if (argc < 2 || (argc == 2 && strcmp(argv[1], h) == 0)) {
         std::cout << "CONTROLES DE MANIPULAÇÃO DA MALHA\n";
@@ -457,18 +407,37 @@ int main(int argc, char** argv) {
         std::cout << "Botão esquerdo + movimento do mouse: rotação do objeto (trackball)\n";
         std::cout << "Scroll do mouse (+/-): aplica escala no objeto\n";
         std::cout << "ESC: Sair do programa\n";
+        std::cout << "CG_TEXTURE_COMPRESSION=bc|bc7[-hq]: comprime a textura (BC1/BC3 ou BC7) para economizar memória de vídeo\n";
+        std::cout << "CG_TEXTURE_OPS=resize=0.5,sharpen=0.3,gray,gamma=1.2,blur=2: processa a textura antes de enviar\n";
+        std::cout << "--headless 800x600 --frames 60 --out quadros --input 10:v,20:drag=40x0: desenha sem janela e salva os quadros\n";
+        std::cout << "--record sessao.txt: grava teclado e mouse; --replay sessao.txt [--replay-timing frames|original]: reproduz\n";
+        std::cout << "--render-thread: desenha numa thread separada; os callbacks do GLUT só enfileiram os eventos\n";
         return 1;
     }
+
+    // A textura começa a ser decodificada já, em paralelo com a criação da
+    // janela, a compilação dos shaders e a leitura do modelo
+    if (argc > 2) {
+        textureHandle = textures.request(argv[2]);
+    } else {
+        std::cout << "Nenhuma textura fornecida.\n";
+        std::cout << "Ex: ./mesh modelo.obj textura.png\n";
+    }
     
-    glutInit(&argc, argv);
-    glutInitContextVersion(3, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Visualizador 3D - Iluminacao e Texturas");
+    if (!headless()) {
+        glutInit(&argc, argv);
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(800, 600);
+        glutCreateWindow("Visualizador 3D - Iluminacao e Texturas");
+    }
 
+    // No pbuffer o GLEW (feito para GLX) carrega as funções mas não acha
+    // um display GLX e devolve erro
     glewExperimental = GL_TRUE;
-    if (glewInit() != GLEW_OK) {
+    GLenum glewStatus = glewInit();
+    if (glewStatus != GLEW_OK && !(headless() && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)) {
         std::cerr << "Falha ao inicializar GLEW\n";
         return 1;
     }
@@ -478,26 +447,27 @@ int main(int argc, char** argv) {
     textureProgram = createShaderProgram(textureVertexShader, textureFragmentShader);
 
     loadModel(argv[1]);
-    if (argc > 2) { 
-        loadTexture(argv[2]);
-    } else {
-        std::cout << "Nenhuma textura fornecida.\n";
-        std::cout << "Ex: ./mesh modelo.obj textura.png\n";
-        
-        unsigned char defaultTex[] = {255, 255, 255};
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, defaultTex);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    
-    glutDisplayFunc(display);
-    glutKeyboardFunc(keyboard);
-    glutSpecialFunc(specialKeys);
-    glutMouseFunc(mouse);
-    glutMotionFunc(motion);
 
+    // Só o envio para a GPU espera pela decodificação (sem textura: 1x1 branca)
+    textures.finish();
+    textureID = textures.texture(textureHandle);
+    textures.printStats();
+
+    HeadlessCallbacks callbacks = renderThreadWrap(inputReplayWrap({display, nullptr, nullptr, keyboard, specialKeys, mouse, motion}));
+    if (headless())
+        return headlessRun(callbacks);
+    
+    glutDisplayFunc(callbacks.display);
+    glutIdleFunc(callbacks.idle);
+    glutKeyboardFunc(callbacks.keyboard);
+    glutSpecialFunc(callbacks.special);
+    glutMouseFunc(callbacks.mouse);
+    glutMotionFunc(callbacks.motion);
+    if (callbacks.reshape) glutReshapeFunc(callbacks.reshape);
+
+    renderThreadStart();
     glutMainLoop();
+    renderThreadPrintStats();
     
     // Limpeza
     glDeleteProgram(phongProgram);
@@ -505,7 +475,7 @@ int main(int argc, char** argv) {
     glDeleteProgram(textureProgram);
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    glDeleteTextures(1, &textureID);
+    textures.clear();
     
     return 0;
 }
\ No newline at end of file
@@ -482,8 +482,11 @@ int main(int c,char**v){
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "../lib/shader_cache.h"
+#include "../lib/shader_variants.h"
+#include "../lib/texture_manager.h"
+#include "../lib/headless.h"
+#include "../lib/startup.h"
 
 GLuint program, VAO, VBO;
 int drawMode = GL_FILL;
@@ -500,12 +503,14 @@ glm::vec2 lastMouse;
 // Mouse trackball
 glm::vec2 screenToNDC(int x,int y){ return {2.0f*x/800-1.0f,1.0f-2.0f*y/600}; }
 
-// Carrega OBJ
+// Carrega OBJ (só CPU: roda num job enquanto a janela é criada). Devolve
+// false em caso de erro, tratado na main: exit() dentro do job destruiria
+// os globais ainda em uso
 std::vector<float> meshData;
-void loadModel(const std::string &path){
+bool loadModel(const std::string &path){
     Assimp::Importer imp;
     const aiScene* sc = imp.ReadFile(path, aiProcess_Triangulate|aiProcess_GenNormals);
-    if(!sc||!sc->HasMeshes()){std::cerr<<"Erro OBJ\n"; exit(1);}    
+    if(!sc||!sc->HasMeshes()) return false;
     const aiMesh* m = sc->mMeshes[0];
     aiVector3D minV(1e10f), maxV(-1e10f);
     meshData.clear();
@@ -532,30 +537,24 @@ void loadModel(const std::string &path){
     minY=minV.y; maxY=maxV.y;
     float ext = std::max({maxV.x-minV.x,maxV.y-minV.y,maxV.z-minV.z});
     scaleFactor = 2.0f/ext;
+    return true;
 }
 
-// Carrega textura
+// Textura: decodificada em threads de fundo (RGB), enviada no finish()
+TextureManager textures;
+int texHandle = -1;
 GLuint tex;
-void loadTexture(const char* img){
-    int w,h,ch;
-    unsigned char *data=stbi_load(img,&w,&h,&ch,3);
-    if(!data){std::cerr<<"Erro textura\n";exit(1);}    
-    glGenTextures(1,&tex);
-    glBindTexture(GL_TEXTURE_2D,tex);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,w,h,0,GL_RGB,GL_UNSIGNED_BYTE,data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-    stbi_image_free(data);
-}
 
-// Shaders
+// Etapas da inicialização; a linha do tempo sai depois do primeiro quadro
+Startup startup;
+
+// Shaders: o modo de mapeamento vira #define (MODE_ORTHO, MODE_CYLINDRICAL,
+// MODE_SPHERICAL ou MODE_BASIC), gerando um programa sem desvios por modo
 const char* vertSrc=R"(
 #version 330 core
 layout(location=0) in vec3 aPos;
 layout(location=1) in vec3 aNormal;
 uniform mat4 transform;
-uniform int uMode;
 uniform vec3 uCenter;
 uniform float uMinY,uMaxY;
 out vec3 Normal,FragPos;
@@ -565,19 +564,21 @@ void main(){
     FragPos=world.xyz;
     Normal=mat3(transform)*aNormal;
     // UV mapeamento
-    if(uMode==2){ // ortográfica XY
-        TexCoord = (aPos.xy - uCenter.xy) / (uMaxY - uMinY) + 0.5;
-    } else if(uMode==3){ // cilíndrica
-        float theta = atan(aPos.z-uCenter.z, aPos.x-uCenter.x);
-        TexCoord.s = (theta+3.14159)/6.28318;
-        TexCoord.t = (aPos.y - uMinY)/(uMaxY - uMinY);
-    } else if(uMode==4){ // esférica
-        vec3 p = normalize(aPos - uCenter);
-        float th = atan(p.z,p.x);
-        float ph = acos(p.y);
-        TexCoord.s = (th+3.14159)/6.28318;
-        TexCoord.t = ph/3.14159;
-    }
+#if defined(MODE_ORTHO) // ortográfica XY
+    TexCoord = (aPos.xy - uCenter.xy) / (uMaxY - uMinY) + 0.5;
+#elif defined(MODE_CYLINDRICAL) // cilíndrica
+    float theta = atan(aPos.z-uCenter.z, aPos.x-uCenter.x);
+    TexCoord.s = (theta+3.14159)/6.28318;
+    TexCoord.t = (aPos.y - uMinY)/(uMaxY - uMinY);
+#elif defined(MODE_SPHERICAL) // esférica
+    vec3 p = normalize(aPos - uCenter);
+    float th = atan(p.z,p.x);
+    float ph = acos(p.y);
+    TexCoord.s = (th+3.14159)/6.28318;
+    TexCoord.t = ph/3.14159;
+#else
+    TexCoord = vec2(0.0);
+#endif
     gl_Position=world;
 }
 )";
@@ -586,24 +587,27 @@ const char* fragSrc=R"(
 #version 330 core
 in vec3 Normal,FragPos;
 in vec2 TexCoord;
-uniform int uMode;
 uniform sampler2D uTex;
 out vec4 FragColor;
 void main(){
-    if(uMode>=2 && uMode<=4) {
-        FragColor=texture(uTex,TexCoord);
-    } else {
-        // modo Phong omitido
-        FragColor=vec4(1,1,1,1);
-    }
+#if defined(MODE_BASIC)
+    // modo Phong omitido
+    FragColor=vec4(1,1,1,1);
+#else
+    FragColor=texture(uTex,TexCoord);
+#endif
 }
 )";
 
+// Defines de cada modo (indice = tecla '1'..'4')
+const char* modeDefines[] = { "MODE_BASIC", "MODE_BASIC", "MODE_ORTHO", "MODE_CYLINDRICAL", "MODE_SPHERICAL" };
+ShaderVariants variants(vertSrc, fragSrc);
+
 GLuint compileProg(){
-    auto c=[&](GLenum t,const char*s){GLuint sh=glCreateShader(t);glShaderSource(sh,1,&s,0);glCompileShader(sh);return sh;};
-    GLuint vs=c(GL_VERTEX_SHADER,vertSrc),fs=c(GL_FRAGMENT_SHADER,fragSrc);
-    GLuint p=glCreateProgram();glAttachShader(p,vs);glAttachShader(p,fs);glLinkProgram(p);
-    glDeleteShader(vs);glDeleteShader(fs);return p;
+    // Compila só o modo inicial; os outros são gerados na primeira troca
+    GLuint p=variants.get(modeDefines[mode]);
+    printShaderCacheStats();
+    return p;
 }
 
 /*
@@ -622,9 +626,8 @@ void initGL(){
 }*/
 
 void initGL(){
-    program = compileProg();
-
-    // Aqui *não* carregamos mais modelo ou textura — só criamos VAO/VBO
+    // Aqui *não* carregamos mais modelo ou textura nem compilamos shaders —
+    // só criamos VAO/VBO
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
@@ -649,6 +652,7 @@ void initGL(){
 
 void display(){
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+    program = variants.get(modeDefines[mode]);
     glUseProgram(program);
     // transform
     glm::mat4 model=glm::scale(glm::translate(glm::mat4(1),-center),glm::vec3(scaleFactor));
@@ -656,7 +660,6 @@ void display(){
     glm::mat4 proj=glm::perspective(glm::radians(45.0f),800/600.0f,0.1f,100.0f);
     glm::mat4 transf=proj*view*model;
     glUniformMatrix4fv(glGetUniformLocation(program,"transform"),1,0,glm::value_ptr(transf));
-    glUniform1i(glGetUniformLocation(program,"uMode"),mode);
     glUniform3fv(glGetUniformLocation(program,"uCenter"),1,glm::value_ptr(center));
     glUniform1f(glGetUniformLocation(program,"uMinY"),minY);
     glUniform1f(glGetUniformLocation(program,"uMaxY"),maxY);
@@ -665,12 +668,13 @@ void display(){
     glUniform1i(glGetUniformLocation(program,"uTex"),0);
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES,0,meshData.size()/6);
-    glutSwapBuffers();
+    swapBuffers();
+    startup.firstFrame();
 }
 
 void keyboard(unsigned char k,int,int){
     if(k>='1'&&k<='4') mode=k-'0';
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 /*
@@ -688,26 +692,47 @@ int main(int c,char**v){
 }*/
 
 int main(int argc, char** argv){
+    // Sem janela: --headless WxH --frames N --out dir (veja lib/headless.h)
+    headlessInit(argc, argv);
     if(argc < 3){
         std::cerr<<"Uso: mesh2 <modelo.obj> <textura.png>\n";
         return 1;
     }
 
-    // 1) Inicializa GLUT/GLEW
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGBA|GLUT_DEPTH);
-    glutInitWindowSize(800,600);
-    glutCreateWindow("Mesh2 Textured");
+    // 0) Modelo e textura são lidos em jobs, em paralelo com o resto
+    std::string modelPath = argv[1];
+    bool parsed = false;
+    JobHandle parse = startup.background("parse model", [modelPath, &parsed]{ parsed = loadModel(modelPath); });
+    texHandle = textures.request(argv[2], GL_REPEAT, 3);
+
+    // 1) Inicializa GLUT/GLEW e compila o programa do modo inicial
+    if(!headless()){
+        startup.stage("create window", [&]{
+            glutInit(&argc, argv);
+            glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGBA|GLUT_DEPTH);
+            glutInitWindowSize(800,600);
+            glutCreateWindow("Mesh2 Textured");
+        });
+    }
     glewInit();
-
-    // 2) Carrega arquivo OBJ e textura *antes* de initGL
-    loadModel(argv[1]);
-    loadTexture(argv[2]);
-
-    // 3) Agora inicializa VAO/VBO (usa meshData preenchido em loadModel)
-    initGL();
-
-    // 4) Callbacks
+    startup.stage("compile shaders", []{ program = compileProg(); });
+
+    // 2) Só o envio para a GPU espera pelo modelo e pela textura
+    startup.wait("parse model", parse);
+    if(!parsed){std::cerr<<"Erro OBJ\n"; return 1;}
+    startup.stage("upload model", initGL);
+    startup.stage("upload texture", []{
+        textures.finish();
+        tex = textures.texture(texHandle);
+    });
+    // A decodificação rodou num job do TextureManager; entra na linha do tempo
+    std::chrono::steady_clock::time_point decodeStart, decodeEnd;
+    if(textures.decodeSpan(texHandle, decodeStart, decodeEnd))
+        startup.background("decode texture", decodeStart, decodeEnd);
+    textures.printStats();
+
+    // 3) Callbacks (ou os quadros sem janela)
+    if(headless()) return headlessRun({display, nullptr, nullptr, keyboard});
     glutDisplayFunc(display);
     glutKeyboardFunc(keyboard);
 
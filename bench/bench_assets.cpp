@@ -0,0 +1,403 @@
+// bench_assets.cpp
+// Mede as etapas de carga e desenho sobre os modelos e texturas do
+// repositório: leitura do OBJ (Assimp), geração de normais, cálculo dos
+// limites, montagem do buffer de vértices (como em loadModel), decodificação
+// das texturas, geração dos mipmaps e desenho sem janela (EGL).
+// Cada medida tem aquecimento e várias repetições; a saída mostra mediana e
+// percentil 95 e pode ser gravada em JSON (uma linha por medida) para
+// comparar entre commits:
+//   ./bench_assets --out antes.json
+//   ... muda o código ...
+//   ./bench_assets --compare antes.json
+// Compile com: make bench_assets
+//
+// Uso: ./bench_assets [--runs N] [--warmup N] [--suite parse,normals,...]
+//                     [--out arquivo.json] [--compare arquivo.json]
+//                     [--threshold PCT] [--no-render]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "../lib/stb_image.h"
+#include "../lib/mipmap.h"
+#include "../lib/headless.h"
+#include "../lib/utils.h"
+
+// Modelos e texturas medidos (relativos a bench/)
+const char *models[] = { "../2302357/Troll.obj", "../2302357/base.obj", "../2302357/meka.obj",
+                         "../2302357/cabecote.obj", "../2302357/esfera.obj" };
+const char *textures[] = { "../2302357/textura.png", "../2302357/babuino.png",
+                           "../2302357/images.jpeg", "../q9/rosa.jpeg" };
+const char *suites[] = { "parse", "normals", "bounds", "buffer", "decode", "mips", "render" };
+
+// Tamanho da imagem e quadros por repetição no desenho
+const int RENDER_W = 800, RENDER_H = 600;
+const int RENDER_FRAMES = 10;
+
+int runs = 15;
+int warmup = 2;
+
+// Resultado de uma medida
+struct Result {
+    std::string suite, asset;
+    int runs;
+    double median, p95, min, mean;
+};
+std::vector<Result> results;
+
+// Nome do arquivo, sem diretório
+std::string baseName(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Percentil p (0 a 1) de tempos ordenados, pelo posto mais próximo
+double percentile(const std::vector<double> &t, double p) {
+    size_t i = (size_t)std::ceil(p * t.size());
+    return t[std::min(std::max(i, (size_t)1), t.size()) - 1];
+}
+
+// Mede f: warmup execuções descartadas e runs medidas. prepare (opcional)
+// roda antes de cada execução, fora da medida.
+void measure(const char *suite, const std::string &asset, const std::function<void()> &f,
+             const std::function<void()> &prepare = nullptr) {
+    std::vector<double> t;
+    for (int i = 0; i < warmup + runs; i++) {
+        if (prepare)
+            prepare();
+        auto s = std::chrono::steady_clock::now();
+        f();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s).count();
+        if (i >= warmup)
+            t.push_back(ms);
+    }
+    std::sort(t.begin(), t.end());
+    double sum = 0.0;
+    for (double v : t)
+        sum += v;
+
+    Result r = { suite, baseName(asset), runs, percentile(t, 0.5), percentile(t, 0.95), t[0], sum / t.size() };
+    results.push_back(r);
+    printf("%-8s %-14s mediana %9.3f ms   p95 %9.3f ms   min %9.3f ms\n",
+           suite, r.asset.c_str(), r.median, r.p95, r.min);
+    fflush(stdout);
+}
+
+// Lê um arquivo inteiro
+bool readFile(const std::string &path, std::vector<unsigned char> &bytes) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !bytes.empty();
+}
+
+// Limites do modelo (todas as malhas)
+void bounds(const aiScene *scene, aiVector3D &minV, aiVector3D &maxV) {
+    minV = aiVector3D(1e10f);
+    maxV = aiVector3D(-1e10f);
+    for (unsigned m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh *mesh = scene->mMeshes[m];
+        for (unsigned i = 0; i < mesh->mNumVertices; i++) {
+            const aiVector3D &p = mesh->mVertices[i];
+            minV.x = std::min(minV.x, p.x);
+            minV.y = std::min(minV.y, p.y);
+            minV.z = std::min(minV.z, p.z);
+            maxV.x = std::max(maxV.x, p.x);
+            maxV.y = std::max(maxV.y, p.y);
+            maxV.z = std::max(maxV.z, p.z);
+        }
+    }
+}
+
+// Expande as faces em posição + normal intercaladas, como loadModel (sem índices)
+void buildBuffer(const aiScene *scene, std::vector<float> &vertices) {
+    vertices.clear();
+    for (unsigned m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh *mesh = scene->mMeshes[m];
+        for (unsigned i = 0; i < mesh->mNumFaces; i++) {
+            const aiFace &face = mesh->mFaces[i];
+            if (face.mNumIndices != 3)
+                continue;
+            for (int j = 0; j < 3; j++) {
+                unsigned v = face.mIndices[j];
+                const aiVector3D &p = mesh->mVertices[v];
+                aiVector3D n = mesh->HasNormals() ? mesh->mNormals[v] : aiVector3D(0.0f, 0.0f, 1.0f);
+                vertices.insert(vertices.end(), { p.x, p.y, p.z, n.x, n.y, n.z });
+            }
+        }
+    }
+}
+
+// Remove as normais lidas do arquivo, para que GenSmoothNormals as calcule
+void dropNormals(const aiScene *scene) {
+    for (unsigned m = 0; m < scene->mNumMeshes; m++) {
+        aiMesh *mesh = scene->mMeshes[m];
+        delete[] mesh->mNormals;
+        mesh->mNormals = nullptr;
+    }
+}
+
+// Shaders do desenho: modelo centralizado e escalado, normal como cor
+const char *vertexCode =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec3 normal;\n"
+    "uniform vec3 center;\n"
+    "uniform float scale;\n"
+    "out vec3 color;\n"
+    "void main() {\n"
+    "    vec3 p = (position - center) * scale;\n"
+    "    gl_Position = vec4(p.x, p.y, -p.z * 0.5, 1.0);\n"
+    "    color = normal * 0.5 + 0.5;\n"
+    "}\n";
+const char *fragmentCode =
+    "#version 330 core\n"
+    "in vec3 color;\n"
+    "out vec4 FragColor;\n"
+    "void main() { FragColor = vec4(color, 1.0); }\n";
+
+// Cria o contexto EGL sem janela (mesmo caminho das demos com --headless)
+bool initRender(std::string &renderer) {
+    char size[32];
+    snprintf(size, sizeof(size), "%dx%d", RENDER_W, RENDER_H);
+    char arg0[] = "bench_assets", arg1[] = "--headless";
+    char *args[] = { arg0, arg1, size, nullptr };
+    int n = 3;
+    if (!headlessInit(n, args))
+        return false;
+
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+    if (status != GLEW_OK && status != GLEW_ERROR_NO_GLX_DISPLAY) {
+        fprintf(stderr, "Erro ao inicializar GLEW\n");
+        return false;
+    }
+    renderer = (const char *)glGetString(GL_RENDERER);
+    glViewport(0, 0, RENDER_W, RENDER_H);
+    glEnable(GL_DEPTH_TEST);
+    return true;
+}
+
+// Desenha o modelo RENDER_FRAMES vezes por repetição (glFinish inclui o tempo da GPU)
+void benchRender(const std::string &path, const std::vector<float> &vertices, const aiVector3D &minV,
+                 const aiVector3D &maxV) {
+    static GLuint program = createShaderProgram(vertexCode, fragmentCode);
+
+    GLuint vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    aiVector3D c = (minV + maxV) * 0.5f;
+    float extent = std::max({ maxV.x - minV.x, maxV.y - minV.y, maxV.z - minV.z });
+    glUseProgram(program);
+    glUniform3f(glGetUniformLocation(program, "center"), c.x, c.y, c.z);
+    glUniform1f(glGetUniformLocation(program, "scale"), extent > 0.0f ? 1.8f / extent : 1.0f);
+    GLsizei count = vertices.size() / 6;
+
+    measure("render", path, [&] {
+        for (int f = 0; f < RENDER_FRAMES; f++) {
+            glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glDrawArrays(GL_TRIANGLES, 0, count);
+        }
+        glFinish();
+    });
+
+    glBindVertexArray(0);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+}
+
+// Grava os resultados em JSON, uma medida por linha (fácil de comparar com diff)
+bool writeJson(const std::string &path, const std::string &renderer) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "{\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"compiler\": \"%s\",\n  \"gl_renderer\": \"%s\",\n  \"results\": [\n",
+            runs, warmup, __VERSION__, renderer.c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(f, "    {\"suite\": \"%s\", \"asset\": \"%s\", \"runs\": %d, \"median_ms\": %.4f, \"p95_ms\": %.4f, "
+                   "\"min_ms\": %.4f, \"mean_ms\": %.4f}%s\n",
+                r.suite.c_str(), r.asset.c_str(), r.runs, r.median, r.p95, r.min, r.mean,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Lê as medianas de um JSON gravado por writeJson (chave: suíte/arquivo)
+bool readJson(const std::string &path, std::map<std::string, double> &medians) {
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        char suite[64], asset[256];
+        const char *m = strstr(line.c_str(), "\"median_ms\": ");
+        if (m && sscanf(line.c_str(), " {\"suite\": \"%63[^\"]\", \"asset\": \"%255[^\"]\"", suite, asset) == 2)
+            medians[std::string(suite) + "/" + asset] = atof(m + 13);
+    }
+    return true;
+}
+
+// Compara as medianas com as de outra execução; retorna o número de regressões
+int compare(const std::string &path, double threshold) {
+    std::map<std::string, double> old;
+    if (!readJson(path, old)) {
+        fprintf(stderr, "Não foi possível ler %s\n", path.c_str());
+        return -1;
+    }
+    int regressions = 0;
+    printf("\nComparação com %s (limite %.0f%%):\n", path.c_str(), threshold);
+    for (const Result &r : results) {
+        auto it = old.find(r.suite + "/" + r.asset);
+        if (it == old.end() || it->second <= 0.0)
+            continue;
+        double change = 100.0 * (r.median - it->second) / it->second;
+        bool worse = change > threshold;
+        regressions += worse;
+        printf("%-8s %-14s %9.3f -> %9.3f ms  %+7.1f%%%s\n", r.suite.c_str(), r.asset.c_str(), it->second, r.median,
+               change, worse ? "  REGRESSÃO" : change < -threshold ? "  melhor" : "");
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    std::string out, against, only;
+    double threshold = 10.0;
+    bool render = true;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool value = i + 1 < argc;
+        if (a == "--runs" && value)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (a == "--warmup" && value)
+            warmup = std::max(0, atoi(argv[++i]));
+        else if (a == "--suite" && value)
+            only = std::string(",") + argv[++i] + ",";
+        else if (a == "--out" && value)
+            out = argv[++i];
+        else if (a == "--compare" && value)
+            against = argv[++i];
+        else if (a == "--threshold" && value)
+            threshold = atof(argv[++i]);
+        else if (a == "--no-render")
+            render = false;
+        else {
+            printf("Uso: %s [--runs N] [--warmup N] [--suite parse,normals,bounds,buffer,decode,mips,render]\n"
+                   "       [--out arquivo.json] [--compare arquivo.json] [--threshold PCT] [--no-render]\n", argv[0]);
+            return 1;
+        }
+    }
+    auto enabled = [&](const char *suite) {
+        return (only.empty() || only.find(std::string(",") + suite + ",") != std::string::npos) &&
+               (render || strcmp(suite, "render") != 0);
+    };
+
+    std::string renderer = "none";
+    if (enabled("render") && !initRender(renderer)) {
+        fprintf(stderr, "Desenho sem janela indisponível; use --no-render\n");
+        return 1;
+    }
+    printf("%d repetições após %d de aquecimento%s%s\n\n", runs, warmup,
+           renderer != "none" ? "; GL: " : "", renderer != "none" ? renderer.c_str() : "");
+
+    const unsigned flags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices;
+    for (const char *path : models) {
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, flags | aiProcess_GenSmoothNormals);
+        if (!scene || !scene->HasMeshes()) {
+            fprintf(stderr, "Modelo ignorado: %s\n", path);
+            continue;
+        }
+
+        if (enabled("parse"))
+            measure("parse", path, [&] {
+                Assimp::Importer parser;
+                parser.ReadFile(path, flags);
+            });
+
+        if (enabled("normals")) {
+            // Cada repetição parte do modelo lido sem normais (leitura fora da medida)
+            Assimp::Importer parser;
+            measure("normals", path, [&] { parser.ApplyPostProcessing(aiProcess_GenSmoothNormals); },
+                    [&] {
+                        parser.ReadFile(path, flags);
+                        dropNormals(parser.GetScene());
+                    });
+        }
+
+        aiVector3D minV, maxV;
+        if (enabled("bounds"))
+            measure("bounds", path, [&] { bounds(scene, minV, maxV); });
+
+        std::vector<float> vertices;
+        if (enabled("buffer"))
+            measure("buffer", path, [&] { buildBuffer(scene, vertices); });
+
+        if (enabled("render")) {
+            bounds(scene, minV, maxV);
+            buildBuffer(scene, vertices);
+            benchRender(path, vertices, minV, maxV);
+        }
+    }
+
+    for (const char *path : textures) {
+        std::vector<unsigned char> bytes;
+        int w, h, n;
+        if (!readFile(path, bytes) || !stbi_info_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &n)) {
+            fprintf(stderr, "Textura ignorada: %s\n", path);
+            continue;
+        }
+
+        if (enabled("decode"))
+            measure("decode", path, [&] {
+                stbi_image_free(stbi_load_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &n, 0));
+            });
+
+        if (enabled("mips")) {
+            unsigned char *pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &n, 0);
+            MipChain chain;
+            measure("mips", path, [&] { chain.build(pixels, w, h, n); });
+            stbi_image_free(pixels);
+        }
+    }
+
+    if (!out.empty()) {
+        if (!writeJson(out, renderer)) {
+            fprintf(stderr, "Não foi possível gravar %s\n", out.c_str());
+            return 1;
+        }
+        printf("\nResultados gravados em %s\n", out.c_str());
+    }
+    if (!against.empty()) {
+        int regressions = compare(against, threshold);
+        if (regressions < 0)
+            return 1;
+        printf("%d regressão(ões)\n", regressions);
+        return regressions ? 2 : 0;
+    }
+    return 0;
+}
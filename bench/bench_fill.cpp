@@ -0,0 +1,128 @@
+// bench_fill.cpp
+// Compara o preenchimento por scanline (lib/scanline) com triangular o
+// polígono (lib/triangulate) e rasterizar os triângulos, ambos na CPU.
+// Compile com:
+// g++ -O2 -pthread bench_fill.cpp ../lib/scanline.cpp ../lib/triangulate.cpp ../lib/job_system.cpp ../lib/trace.cpp -o bench_fill
+//
+// Uso: ./bench_fill [largura altura]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "../lib/scanline.h"
+#include "../lib/triangulate.h"
+
+// Número de repetições medidas (após uma de aquecimento)
+const int RUNS = 9;
+
+// Mediana dos tempos (ms) de RUNS execuções
+double medianMs(const std::function<void()> &f) {
+    f(); // aquecimento
+    std::vector<double> t;
+    for (int i = 0; i < RUNS; i++) {
+        auto s = std::chrono::steady_clock::now();
+        f();
+        t.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s).count());
+    }
+    std::sort(t.begin(), t.end());
+    return t[RUNS / 2];
+}
+
+// Contorno côncavo com n vértices e até 24 lóbulos, centrado na imagem
+// (parecido com uma região de CAD: muitos vértices, poucas arestas por linha)
+std::vector<float> blobPolygon(int n, int w, int h) {
+    int lobes = std::min(n / 4, 24);
+    std::vector<float> xy;
+    for (int i = 0; i < n; i++) {
+        float a = 2.0f * M_PI * i / n;
+        float k = 0.38f + 0.1f * std::sin(lobes * a);
+        xy.push_back(w * (0.5f + k * std::cos(a)));
+        xy.push_back(h * (0.5f + k * std::sin(a)));
+    }
+    return xy;
+}
+
+// Rasteriza um triângulo (anti-horário) amostrando o centro dos pixels,
+// linha a linha, intersectando os três semiplanos
+void rasterTriangle(Framebuffer &fb, const float *a, const float *b, const float *c, uint32_t color) {
+    const float *v[3] = {a, b, c};
+    float ymin = std::min({a[1], b[1], c[1]}), ymax = std::max({a[1], b[1], c[1]});
+    int y0 = std::max(0, (int)std::ceil(ymin - 0.5f));
+    int y1 = std::min(fb.height, (int)std::ceil(ymax - 0.5f));
+
+    for (int y = y0; y < y1; y++) {
+        double py = y + 0.5, lo = 0.0, hi = fb.width;
+        for (int i = 0; i < 3; i++) {
+            const float *p = v[i], *q = v[(i + 1) % 3];
+            // (q - p) x (P - p) >= 0  ->  A*px + B >= 0
+            double A = -(q[1] - p[1]);
+            double B = (q[0] - p[0]) * (py - p[1]) + (q[1] - p[1]) * p[0];
+            if (A > 0)
+                lo = std::max(lo, -B / A);
+            else if (A < 0)
+                hi = std::min(hi, -B / A);
+            else if (B < 0)
+                hi = lo;
+        }
+        int x0 = std::max(0, (int)std::ceil(lo - 0.5));
+        int x1 = std::min(fb.width, (int)std::ceil(hi - 0.5));
+        if (x0 < x1)
+            std::fill_n(&fb.pixels[(size_t)y * fb.width + x0], x1 - x0, color);
+    }
+}
+
+// Conta pixels diferentes do fundo
+size_t countFilled(const Framebuffer &fb) {
+    return fb.pixels.size() - std::count(fb.pixels.begin(), fb.pixels.end(), 0u);
+}
+
+int main(int argc, char **argv) {
+    int w = 1920, h = 1080;
+    if (argc >= 3) {
+        w = atoi(argv[1]);
+        h = atoi(argv[2]);
+    }
+
+    Framebuffer fb;
+    fb.resize(w, h);
+    const uint32_t color = packRGBA(0, 200, 0);
+    ScanlineFiller filler;
+    Triangulator triangulator;
+    std::vector<unsigned> indices;
+
+    printf("%dx%d, mediana de %d execucoes\n", w, h, RUNS);
+    printf("%-10s %-22s %10s %10s %10s\n", "vertices", "metodo", "ms", "MPix/s", "pixels");
+
+    for (int n : {16, 1000, 100000}) {
+        std::vector<float> xy = blobPolygon(n, w, h);
+
+        auto report = [&](const char *name, const std::function<void()> &f) {
+            double ms = medianMs(f);
+            fb.clear(0);
+            f();
+            size_t px = countFilled(fb);
+            printf("%-10d %-22s %10.3f %10.1f %10zu\n", n, name, ms, px / (ms * 1000.0), px);
+        };
+
+        report("scanline 1 thread", [&] {
+            filler.clear();
+            filler.addRing(xy.data(), n);
+            filler.fill(fb, color, FILL_EVEN_ODD, 1);
+        });
+        report("scanline threads", [&] {
+            filler.clear();
+            filler.addRing(xy.data(), n);
+            filler.fill(fb, color, FILL_EVEN_ODD);
+        });
+        report("triangular+rasterizar", [&] {
+            triangulator.triangulate(xy.data(), n, indices);
+            for (size_t i = 0; i < indices.size(); i += 3)
+                rasterTriangle(fb, &xy[2 * indices[i]], &xy[2 * indices[i + 1]], &xy[2 * indices[i + 2]], color);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file arcball.cpp
+ * Trackball rotation with coalesced mouse motion and inertia.
+ *
+ * Implements the controller declared in arcball.h.
+ */
+
+#include "arcball.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+namespace
+{
+
+/** Motion before the release that sets the spin velocity (seconds). */
+const double velocity_window = 0.1;
+/** Slowest release that starts a spin (radians per second). */
+const float min_spin_speed = 1.0f;
+/** Speed below which the spin stops (radians per second). */
+const float stop_speed = 0.05f;
+/** Time for the spin to slow down by a factor e (seconds). */
+const double spin_decay = 0.4;
+
+}
+
+
+Arcball::Arcball(int width, int height) : width(width), height(height)
+{
+}
+
+
+void Arcball::resize(int w, int h)
+{
+    width = std::max(w, 1);
+    height = std::max(h, 1);
+}
+
+
+void Arcball::sphere(int x, int y, float *v) const
+{
+    v[0] = (2.0f * x - width) / width;
+    v[1] = (height - 2.0f * y) / height;
+    v[2] = std::sqrt(std::max(0.0f, 1.0f - v[0] * v[0] - v[1] * v[1]));
+}
+
+
+void Arcball::rotate(const float *u, float angle)
+{
+    float s = std::sin(angle * 0.5f);
+    float r[4] = {std::cos(angle * 0.5f), u[0] * s, u[1] * s, u[2] * s};
+    float p[4] = {
+        r[0] * q[0] - r[1] * q[1] - r[2] * q[2] - r[3] * q[3],
+        r[0] * q[1] + r[1] * q[0] + r[2] * q[3] - r[3] * q[2],
+        r[0] * q[2] - r[1] * q[3] + r[2] * q[0] + r[3] * q[1],
+        r[0] * q[3] + r[1] * q[2] - r[2] * q[1] + r[3] * q[0],
+    };
+    float n = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2] + p[3] * p[3]);
+    for (int i = 0; i < 4; i++)
+        q[i] = p[i] / n;
+}
+
+
+void Arcball::press(int x, int y, double t)
+{
+    held = true;
+    speed = 0.0f;
+    applied_x = latest_x = x;
+    applied_y = latest_y = y;
+    applied_t = latest_t = t;
+    samples.clear();
+    events++;
+}
+
+
+void Arcball::drag(int x, int y, double t)
+{
+    if (!held)
+        return;
+    latest_x = x;
+    latest_y = y;
+    latest_t = t;
+    events++;
+}
+
+
+bool Arcball::apply()
+{
+    if (!held || (latest_x == applied_x && latest_y == applied_y))
+        return false;
+
+    float a[3], b[3];
+    sphere(applied_x, applied_y, a);
+    sphere(latest_x, latest_y, b);
+    float la = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    float lb = std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+    float u[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    float lu = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    float angle = std::acos(std::min(1.0f, (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (la * lb)));
+
+    bool changed = lu > 0.0001f && !std::isnan(angle);
+    if (changed)
+    {
+        for (float &c : u)
+            c /= lu;
+        rotate(u, angle);
+        rotations++;
+
+        samples.push_back({applied_t, latest_t, {u[0] * angle, u[1] * angle, u[2] * angle}});
+        while (samples.front().end < latest_t - velocity_window)
+            samples.pop_front();
+    }
+    applied_x = latest_x;
+    applied_y = latest_y;
+    applied_t = latest_t;
+    return changed;
+}
+
+
+bool Arcball::release(int x, int y, double t)
+{
+    if (!held)
+        return false;
+    drag(x, y, t);
+    apply();
+    held = false;
+
+    // Mean angular velocity over the motion just before the release
+    float w[3] = {0.0f, 0.0f, 0.0f};
+    double start = t;
+    for (const Sample &s : samples)
+    {
+        if (s.end < t - velocity_window)
+            continue;
+        for (int i = 0; i < 3; i++)
+            w[i] += s.rotation[i];
+        start = std::min(start, s.start);
+    }
+    samples.clear();
+
+    double span = t - start;
+    float angle = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    speed = 0.0f;
+    if (span > 1e-3 && angle > 0.0f && angle / span >= min_spin_speed)
+    {
+        speed = (float)(angle / span);
+        for (int i = 0; i < 3; i++)
+            axis[i] = w[i] / angle;
+    }
+    return spinning();
+}
+
+
+bool Arcball::spin(double dt)
+{
+    if (speed <= 0.0f)
+        return false;
+    rotate(axis, speed * (float)dt);
+    speed *= (float)std::exp(-dt / spin_decay);
+    if (speed < stop_speed)
+        speed = 0.0f;
+    return spinning();
+}
+
+
+void Arcball::reset()
+{
+    q[0] = 1.0f;
+    q[1] = q[2] = q[3] = 0.0f;
+    speed = 0.0f;
+    held = false;
+    samples.clear();
+}
+
+
+void Arcball::printStats() const
+{
+    std::cout << "Arcball: " << events << " pointer event(s), " << rotations << " rotation(s) applied" << std::endl;
+}
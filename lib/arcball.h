@@ -0,0 +1,148 @@
+/**
+ * @file arcball.h
+ * Trackball rotation with coalesced mouse motion and inertia.
+ *
+ * Mice report motion far more often than frames are drawn. Instead of
+ * building and normalizing a quaternion for every event, drag() only
+ * stores the latest pointer position and its time; apply(), once per
+ * frame, turns everything since the previous frame into a single
+ * rotation. The rotation therefore lags the pointer by at most one frame.
+ *
+ * The timestamps of the coalesced rotations give the angular velocity at
+ * release; a fast flick keeps the model spinning, slowing down
+ * exponentially, advanced by spin() in fixed steps (see
+ * frame_scheduler.h).
+ *
+ * The pointer maps to the sphere as in the original viewers: x and y
+ * normalized to [-1, 1] and z = sqrt(1 - x^2 - y^2), or 0 outside the
+ * sphere. Rotations are composed on the left: q = r * q.
+ *
+ * Typical use:
+ *   void motion(int x, int y) { arcball.drag(x, y, scheduler.time()); postRedisplay(); }
+ *   void display() {
+ *       scheduler.beginFrame();        // spin() steps
+ *       arcball.apply();
+ *       const float *q = arcball.rotation();   // w, x, y, z
+ *       ...
+ *   }
+ */
+
+#ifndef ARCBALL_H
+#define ARCBALL_H
+
+#include <deque>
+
+
+/**
+ * Arcball controller.
+ */
+class Arcball
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param width Window width in pixels.
+     * @param height Window height in pixels.
+     */
+    Arcball(int = 800, int = 600);
+
+    /**
+     * Set the window size.
+     *
+     * @param width Width in pixels.
+     * @param height Height in pixels.
+     */
+    void resize(int, int);
+
+    /**
+     * Start dragging (button down); stops any spin.
+     *
+     * @param x Pointer x.
+     * @param y Pointer y.
+     * @param t Time in seconds.
+     */
+    void press(int, int, double);
+
+    /**
+     * Pointer moved while dragging. Only stores the position.
+     *
+     * @param x Pointer x.
+     * @param y Pointer y.
+     * @param t Time in seconds.
+     */
+    void drag(int, int, double);
+
+    /**
+     * Stop dragging (button up).
+     *
+     * Applies the pending motion and starts spinning if the pointer was
+     * moving fast enough just before.
+     *
+     * @param x Pointer x.
+     * @param y Pointer y.
+     * @param t Time in seconds.
+     * @return True if the arcball now spins (needs spin() steps).
+     */
+    bool release(int, int, double);
+
+    /** @return True while the button is held. */
+    bool dragging() const { return held; }
+    /** @return True while spinning after a release. */
+    bool spinning() const { return speed > 0.0f; }
+
+    /**
+     * Apply the motion received since the last call as one rotation.
+     *
+     * @return True if the rotation changed.
+     */
+    bool apply();
+
+    /**
+     * Advance the spin.
+     *
+     * @param dt Step in seconds.
+     * @return True while still spinning.
+     */
+    bool spin(double);
+
+    /** @return Current rotation as a unit quaternion (w, x, y, z). */
+    const float *rotation() const { return q; }
+
+    /** Stop spinning and reset the rotation to the identity. */
+    void reset();
+
+    /** Print motion events received and rotations applied. */
+    void printStats() const;
+
+private:
+    /** Rotation applied by apply(), for the release velocity. */
+    struct Sample
+    {
+        double start, end;
+        float rotation[3];   // axis * angle
+    };
+
+    int width, height;
+    float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+
+    bool held = false;
+    /** Position and time of the last applied point and of the newest one. */
+    int applied_x = 0, applied_y = 0;
+    double applied_t = 0.0;
+    int latest_x = 0, latest_y = 0;
+    double latest_t = 0.0;
+    std::deque<Sample> samples;
+
+    /** Spin axis (unit) and speed in radians per second. */
+    float axis[3] = {0.0f, 0.0f, 1.0f};
+    float speed = 0.0f;
+
+    long events = 0;
+    long rotations = 0;
+
+    void sphere(int, int, float *) const;
+    void rotate(const float *, float);
+};
+
+#endif
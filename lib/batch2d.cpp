@@ -0,0 +1,206 @@
+/**
+ * @file batch2d.cpp
+ * Batched 2D primitive renderer.
+ *
+ * Implements the renderer declared in batch2d.h.
+ */
+
+#include "batch2d.h"
+#include "utils.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+/** Vertex shader. */
+static const char *batch_vertex_code = R"(
+#version 330 core
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec4 color;
+uniform float pointSize;
+out vec4 vColor;
+void main()
+{
+    gl_Position = vec4(position, 0.0, 1.0);
+    gl_PointSize = pointSize;
+    vColor = color;
+}
+)";
+
+/** Fragment shader. */
+static const char *batch_fragment_code = R"(
+#version 330 core
+in vec4 vColor;
+out vec4 FragColor;
+void main()
+{
+    FragColor = vColor;
+}
+)";
+
+
+Batch2D::Batch2D(GLsizei capacity)
+    // drawList() splits at whole primitives, so a region must hold a triangle
+    : stream(sizeof(Vertex), std::max<GLsizei>(capacity, 3))
+{
+}
+
+
+void Batch2D::init()
+{
+    program = createShaderProgram(batch_vertex_code, batch_fragment_code);
+    point_size_loc = glGetUniformLocation(program, "pointSize");
+
+    stream.init();
+    stream.attribute(0, 2, GL_FLOAT, offsetof(Vertex, x));
+    stream.attribute(1, 4, GL_UNSIGNED_BYTE, offsetof(Vertex, rgba), GL_TRUE);
+    glBindVertexArray(0);
+}
+
+
+void Batch2D::release()
+{
+    stream.release();
+    glDeleteProgram(program);
+    program = 0;
+}
+
+
+void Batch2D::color(float r, float g, float b, float a)
+{
+    auto c = [](float v) { return (GLubyte)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    current[0] = c(r);
+    current[1] = c(g);
+    current[2] = c(b);
+    current[3] = c(a);
+}
+
+
+void Batch2D::pointSize(float size)
+{
+    point_size = size;
+}
+
+
+/**
+ * Make vertex with the current color.
+ *
+ * @param x X coordinate.
+ * @param y Y coordinate.
+ * @return Vertex.
+ */
+Batch2D::Vertex Batch2D::vertex(float x, float y) const
+{
+    Vertex v;
+    v.x = x;
+    v.y = y;
+    memcpy(v.rgba, current, 4);
+    return v;
+}
+
+
+void Batch2D::point(float x, float y)
+{
+    points.push_back(vertex(x, y));
+}
+
+
+void Batch2D::line(float x0, float y0, float x1, float y1)
+{
+    lines.push_back(vertex(x0, y0));
+    lines.push_back(vertex(x1, y1));
+}
+
+
+void Batch2D::polyline(const float *xy, int n, bool closed)
+{
+    for (int i = 0; i + 1 < n; i++)
+        line(xy[2*i], xy[2*i+1], xy[2*i+2], xy[2*i+3]);
+    if (closed && n > 2)
+        line(xy[2*(n-1)], xy[2*(n-1)+1], xy[0], xy[1]);
+}
+
+
+void Batch2D::triangle(float x0, float y0, float x1, float y1, float x2, float y2)
+{
+    triangles.push_back(vertex(x0, y0));
+    triangles.push_back(vertex(x1, y1));
+    triangles.push_back(vertex(x2, y2));
+}
+
+
+void Batch2D::polygon(const float *xy, int n)
+{
+    if (n < 3)
+        return;
+
+    if (!triangulator.triangulate(xy, n, fill_indices))
+    {
+        // Self-intersecting outline: triangle fan, like GL_POLYGON did.
+        for (int i = 1; i + 1 < n; i++)
+            triangle(xy[0], xy[1], xy[2*i], xy[2*i+1], xy[2*i+2], xy[2*i+3]);
+        return;
+    }
+
+    for (unsigned i : fill_indices)
+        triangles.push_back(vertex(xy[2*i], xy[2*i+1]));
+}
+
+
+/**
+ * Stream and draw one primitive list.
+ *
+ * Splits the list over several regions if it does not fit in the space
+ * left in the current one.
+ *
+ * @param list Vertices.
+ * @param mode Primitive type.
+ */
+void Batch2D::drawList(const std::vector<Vertex> &list, GLenum mode)
+{
+    // Keep whole primitives together when splitting.
+    GLsizei unit = (mode == GL_TRIANGLES) ? 3 : (mode == GL_LINES) ? 2 : 1;
+    GLsizei max_count = stream.maxVertices() / unit * unit;
+
+    size_t done = 0;
+    while (done < list.size())
+    {
+        GLsizei count = (GLsizei)std::min<size_t>(list.size() - done, max_count);
+        GLint first;
+        Vertex *dst = stream.allocate<Vertex>(count, first);
+        if (!dst)
+        {
+            // Region full: move on to the next one.
+            stream.endFrame();
+            continue;
+        }
+        memcpy(dst, list.data() + done, count * sizeof(Vertex));
+        stream.draw(mode, first, count);
+        draw_calls++;
+        done += count;
+    }
+}
+
+
+void Batch2D::flush()
+{
+    draw_calls = 0;
+    if (points.empty() && lines.empty() && triangles.empty())
+        return;
+
+    glUseProgram(program);
+    glUniform1f(point_size_loc, point_size);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    // Filled areas first so outlines and points stay on top.
+    drawList(triangles, GL_TRIANGLES);
+    drawList(lines, GL_LINES);
+    drawList(points, GL_POINTS);
+    stream.endFrame();
+    glBindVertexArray(0);
+
+    // clear() keeps the capacity, so steady state frames do not allocate.
+    points.clear();
+    lines.clear();
+    triangles.clear();
+}
@@ -0,0 +1,146 @@
+/**
+ * @file batch2d.h
+ * Batched 2D primitive renderer.
+ *
+ * Replaces immediate mode (glBegin/glEnd) drawing of points, lines and
+ * polygons. Primitives are collected during the frame into one list per
+ * primitive type and flush() streams them in a single buffer region,
+ * issuing one draw call per type (points, lines, triangles).
+ *
+ * Coordinates are in normalized device coordinates ([-1, 1]).
+ */
+
+#ifndef BATCH2D_H
+#define BATCH2D_H
+
+#include <vector>
+#include <GL/glew.h>
+#include "stream_buffer.h"
+#include "triangulate.h"
+
+
+/**
+ * 2D batch renderer.
+ */
+class Batch2D
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Vertices that fit in one stream region (at least 3);
+     * larger frames are split over several regions.
+     */
+    Batch2D(GLsizei = 1 << 18);
+
+    /**
+     * Create program and buffers (needs a GL context).
+     */
+    void init();
+
+    /**
+     * Delete program and buffers.
+     */
+    void release();
+
+    /**
+     * Set color for the next primitives.
+     *
+     * @param r Red in [0, 1].
+     * @param g Green in [0, 1].
+     * @param b Blue in [0, 1].
+     * @param a Alpha in [0, 1].
+     */
+    void color(float, float, float, float = 1.0f);
+
+    /**
+     * Set point size used for all points of the frame.
+     *
+     * @param size Size in pixels.
+     */
+    void pointSize(float);
+
+    /**
+     * Add a point.
+     *
+     * @param x X coordinate.
+     * @param y Y coordinate.
+     */
+    void point(float, float);
+
+    /**
+     * Add a line segment.
+     *
+     * @param x0 X of first end point.
+     * @param y0 Y of first end point.
+     * @param x1 X of second end point.
+     * @param y1 Y of second end point.
+     */
+    void line(float, float, float, float);
+
+    /**
+     * Add a polyline.
+     *
+     * @param xy Interleaved coordinates (x0, y0, x1, y1, ...).
+     * @param n Number of points.
+     * @param closed Also connect the last point to the first (line loop).
+     */
+    void polyline(const float *, int, bool = false);
+
+    /**
+     * Add a filled polygon.
+     *
+     * The polygon may be concave; it is triangulated on the CPU.
+     *
+     * @param xy Interleaved coordinates (x0, y0, x1, y1, ...).
+     * @param n Number of points.
+     */
+    void polygon(const float *, int);
+
+    /**
+     * Add a filled triangle.
+     */
+    void triangle(float, float, float, float, float, float);
+
+    /**
+     * Draw everything added since the last flush.
+     *
+     * Issues at most one draw call per primitive type while the frame fits
+     * in a stream region.
+     */
+    void flush();
+
+    /** @return Draw calls issued by the last flush. */
+    int drawCalls() const { return draw_calls; }
+
+private:
+    /** Vertex as stored in the stream (12 bytes). */
+    struct Vertex
+    {
+        float x, y;
+        GLubyte rgba[4];
+    };
+
+    /** Vertices of each primitive type. */
+    std::vector<Vertex> points, lines, triangles;
+    /** Current color. */
+    GLubyte current[4] = {255, 255, 255, 255};
+    /** Point size in pixels. */
+    float point_size = 1.0f;
+    /** Program. */
+    GLuint program = 0;
+    /** Location of the point size uniform. */
+    GLint point_size_loc = -1;
+    /** Vertex stream. */
+    StreamVertexArray stream;
+    /** Polygon triangulator and its output (reused between calls). */
+    Triangulator triangulator;
+    std::vector<unsigned> fill_indices;
+    /** Draw calls issued by the last flush. */
+    int draw_calls = 0;
+
+    Vertex vertex(float, float) const;
+    void drawList(const std::vector<Vertex> &, GLenum);
+};
+
+#endif
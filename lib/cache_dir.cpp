@@ -0,0 +1,45 @@
+/**
+ * @file cache_dir.cpp
+ * On-disk cache location.
+ *
+ * Implements the helpers declared in cache_dir.h.
+ */
+
+#include "cache_dir.h"
+
+#include <cstdlib>
+#include <sys/stat.h>
+
+
+std::string cacheDir(const char *name)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    std::string base;
+    if (xdg && *xdg)
+        base = xdg;
+    else if (home && *home)
+        base = std::string(home) + "/.cache";
+    else
+        base = "/tmp";
+    return base + "/cg2025/" + name;
+}
+
+
+bool makeDirs(const std::string &path)
+{
+    for (size_t i = 1; i <= path.size(); i++)
+        if (i == path.size() || path[i] == '/')
+            mkdir(path.substr(0, i).c_str(), 0755);
+
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+bool cacheDisabled(const char *var)
+{
+    const char *off = getenv(var);
+    return off && *off && *off != '0';
+}
@@ -0,0 +1,42 @@
+/**
+ * @file cache_dir.h
+ * On-disk cache location.
+ *
+ * Helpers shared by the caches that keep derived data between runs
+ * (program binaries, mip chains, ...). Everything lives under
+ * $XDG_CACHE_HOME/cg2025 (or ~/.cache/cg2025).
+ */
+
+#ifndef CACHE_DIR_H
+#define CACHE_DIR_H
+
+#include <string>
+
+
+/**
+ * Cache directory.
+ *
+ * @param name Subdirectory (e.g. "shaders").
+ * @return Directory path (no trailing slash). It may not exist yet.
+ */
+std::string cacheDir(const char *);
+
+/**
+ * Create directories.
+ *
+ * Creates every missing component of path (like mkdir -p).
+ *
+ * @param path Directory to create.
+ * @return True if the directory exists at the end.
+ */
+bool makeDirs(const std::string &);
+
+/**
+ * Check whether a cache is disabled.
+ *
+ * @param var Environment variable (e.g. "CG_NO_SHADER_CACHE").
+ * @return True if the variable is set to something other than 0.
+ */
+bool cacheDisabled(const char *);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file frame_scheduler.cpp
+ * Render-on-demand frame scheduling.
+ *
+ * Implements the scheduler declared in frame_scheduler.h.
+ */
+
+#include "frame_scheduler.h"
+#include "headless.h"
+
+#include <GL/freeglut.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+
+namespace
+{
+
+/** Longest stretch of simulation caught up in one frame (seconds). */
+const double max_catch_up = 0.25;
+
+/** Scheduler waiting for its timer (GLUT timers carry only an int). */
+FrameScheduler *waiting = nullptr;
+
+}
+
+
+FrameScheduler::FrameScheduler(void (*update)(double), double step)
+    : update(update), step(step), interval(1.0 / 60.0)
+{
+    if (const char *fps = getenv("CG_FPS"))
+        setFrameRate(atof(fps));
+}
+
+
+void FrameScheduler::setFrameRate(double fps)
+{
+    interval = fps > 0.0 ? 1.0 / fps : 0.0;
+}
+
+
+double FrameScheduler::now() const
+{
+    if (headless())
+        return virtual_time;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void FrameScheduler::setAnimating(bool on)
+{
+    if (on == running)
+        return;
+    running = on;
+    // Time spent stopped is not simulated
+    last = now();
+    accumulator = 0.0;
+    if (running)
+        invalidate();
+}
+
+
+void FrameScheduler::invalidate()
+{
+    postRedisplay();
+}
+
+
+void FrameScheduler::beginFrame()
+{
+    // Headless frames are exactly one interval apart, without clock drift
+    double elapsed = 0.0;
+    if (headless() && frame_count > 0)
+    {
+        elapsed = interval > 0.0 ? interval : step;
+        virtual_time += elapsed;
+    }
+
+    double t = now();
+    if (!headless())
+        elapsed = t - last;
+    if (frame_count == 0)
+        first_frame = t;
+    frame_start = t;
+    frame_count++;
+    last = t;
+
+    if (!running)
+        return;
+
+    accumulator += std::min(elapsed, max_catch_up);
+    while (accumulator >= step)
+    {
+        if (update)
+            update(step);
+        accumulator -= step;
+        step_count++;
+    }
+}
+
+
+void FrameScheduler::endFrame()
+{
+    // Headless rendering draws every frame anyway
+    if (!running || timer_pending || headless())
+        return;
+
+    // Rounded down: the timer and the redisplay add their own latency
+    double wait = interval - (now() - frame_start);
+    unsigned ms = wait > 0.0 ? (unsigned)(wait * 1000.0) : 0;
+    if (ms == 0)
+    {
+        // Late, or paced by vsync: the swap already waited for the refresh
+        postRedisplay();
+        return;
+    }
+    if (displayRedirected())
+    {
+        // Off the GLUT thread (render_thread.h): no timers, that thread can wait
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        postRedisplay();
+        return;
+    }
+    timer_pending = true;
+    waiting = this;
+    glutTimerFunc(ms, tick, 0);
+}
+
+
+void FrameScheduler::tick(int)
+{
+    FrameScheduler *s = waiting;
+    waiting = nullptr;
+    if (!s)
+        return;
+    s->timer_pending = false;
+    if (s->running)
+        postRedisplay();
+}
+
+
+void FrameScheduler::printStats() const
+{
+    double seconds = now() - first_frame;
+    std::cout << "Scheduler: " << frame_count << " frame(s), " << step_count << " simulation step(s)";
+    if (frame_count > 1 && seconds > 0.0)
+        std::cout << ", " << (frame_count - 1) / seconds << " frames/s over " << seconds << " s";
+    std::cout << std::endl;
+}
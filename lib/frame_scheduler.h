@@ -0,0 +1,131 @@
+/**
+ * @file frame_scheduler.h
+ * Render-on-demand frame scheduling.
+ *
+ * Replaces the idle callback that posts a redisplay unconditionally (which
+ * keeps a core busy even when nothing moves) and animation that advances
+ * once per drawn frame (whose speed then depends on the frame rate).
+ *
+ * The simulation advances in fixed steps (1/60 s by default) through an
+ * update callback, independent of how often frames are drawn. Frames are
+ * drawn only when something asks for one: invalidate() after a state
+ * change (input, reshape) draws once; while an animation runs
+ * (setAnimating(true)) frames are paced to the target frame rate with GLUT
+ * timers. With nothing to do no callback is registered and GLUT sleeps in
+ * its event loop.
+ *
+ * The target rate is 60 frames per second, or CG_FPS if set. CG_FPS=0
+ * posts the next frame right after the swap, leaving the pacing to vsync
+ * (the swap blocks until the next refresh).
+ *
+ * When rendering headless (headless.h) every frame advances the clock by
+ * exactly one frame interval, so runs are reproducible.
+ *
+ * On a render thread (render_thread.h) the pacing sleeps on that thread
+ * instead of using GLUT timers.
+ *
+ * A demo uses it like this:
+ *   void update(double dt) { angle += speed * dt; }
+ *   FrameScheduler scheduler(update);
+ *
+ *   void display() {
+ *       scheduler.beginFrame();   // runs the steps that are due
+ *       ... draw ...
+ *       swapBuffers();
+ *       scheduler.endFrame();     // schedules the next frame if animating
+ *   }
+ *   void keyboard(...) { ... change state ...; scheduler.invalidate(); }
+ *
+ *   scheduler.setAnimating(true);   // in main()
+ */
+
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+
+/**
+ * Fixed-timestep update and frame pacing.
+ */
+class FrameScheduler
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param update Called with the step (seconds) for each simulation step;
+     *        may be null.
+     * @param step Simulation step in seconds.
+     */
+    explicit FrameScheduler(void (*)(double) = nullptr, double = 1.0 / 60.0);
+
+    /**
+     * Start or stop the animation.
+     *
+     * While stopped the simulation does not advance and frames are drawn
+     * only on invalidate().
+     *
+     * @param on True to animate.
+     */
+    void setAnimating(bool);
+    /** @return True while animating. */
+    bool animating() const { return running; }
+
+    /** Request one frame (state changed). */
+    void invalidate();
+
+    /**
+     * Start a frame: run the simulation steps due since the last one.
+     *
+     * At most a quarter of a second is caught up after a stall.
+     */
+    void beginFrame();
+
+    /** End a frame (after the swap): schedule the next one while animating. */
+    void endFrame();
+
+    /**
+     * @return Fraction of a step elapsed since the last update (0 to 1), to
+     *         interpolate between simulation states.
+     */
+    double alpha() const { return accumulator / step; }
+
+    /**
+     * Set the target frame rate.
+     *
+     * @param fps Frames per second; 0 leaves the pacing to vsync.
+     */
+    void setFrameRate(double);
+
+    /**
+     * @return Scheduler clock in seconds (the frame clock when headless), to
+     *         timestamp input.
+     */
+    double time() const { return now(); }
+
+    /** Print frames drawn, simulation steps and the average frame rate. */
+    void printStats() const;
+
+private:
+    void (*update)(double);
+    double step;
+    /** Seconds between animated frames (0: right after the swap). */
+    double interval;
+    bool running = false;
+    bool timer_pending = false;
+
+    /** Times in seconds, from the clock of now(). */
+    double last = 0.0;
+    double frame_start = 0.0;
+    double first_frame = 0.0;
+    /** Clock when headless: advances one interval per frame. */
+    double virtual_time = 0.0;
+    double accumulator = 0.0;
+
+    long frame_count = 0;
+    long step_count = 0;
+
+    double now() const;
+    static void tick(int);
+};
+
+#endif
@@ -0,0 +1,422 @@
+/**
+ * @file headless.cpp
+ * Offscreen rendering without a window.
+ *
+ * Implements the EGL pbuffer context and the frame loop declared in
+ * headless.h.
+ */
+
+#include "headless.h"
+#include "cache_dir.h"
+
+#define EGL_NO_X11
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+namespace
+{
+
+/** Scripted input event. */
+struct Event
+{
+    enum Kind { KEY, SPECIAL, DRAG } kind;
+    int frame;
+    int key;
+    int dx, dy;
+};
+
+bool active = false;
+bool leave = false;
+int width = 0, height = 0;
+int frames = 60;
+std::string out_dir;
+std::vector<Event> events;
+
+EGLDisplay display = EGL_NO_DISPLAY;
+EGLSurface surface = EGL_NO_SURFACE;
+EGLContext context = EGL_NO_CONTEXT;
+
+/** Display functions of the calling thread, when it is not GLUT's. */
+thread_local const DisplayRedirect *redirect = nullptr;
+
+
+[[noreturn]] void fail(const std::string &message)
+{
+    std::cerr << "Headless: " << message << std::endl;
+    exit(1);
+}
+
+
+/** Parse one "FRAME:EVENT" item of --input. */
+bool parseEvent(const std::string &item, Event &e)
+{
+    size_t colon = item.find(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == item.size())
+        return false;
+    char *end;
+    e.frame = (int)strtol(item.c_str(), &end, 10);
+    if (end != item.c_str() + colon || e.frame < 0)
+        return false;
+
+    std::string name = item.substr(colon + 1);
+    static const struct { const char *name; int key; } special[] = {
+        {"left", GLUT_KEY_LEFT}, {"right", GLUT_KEY_RIGHT}, {"up", GLUT_KEY_UP},
+        {"down", GLUT_KEY_DOWN}, {"pageup", GLUT_KEY_PAGE_UP}, {"pagedown", GLUT_KEY_PAGE_DOWN},
+        {"home", GLUT_KEY_HOME}, {"end", GLUT_KEY_END}};
+    for (const auto &s : special)
+        if (name == s.name)
+        {
+            e.kind = Event::SPECIAL;
+            e.key = s.key;
+            return true;
+        }
+
+    e.kind = Event::KEY;
+    if (name == "esc")
+        e.key = 27;
+    else if (name == "space")
+        e.key = ' ';
+    else if (name == "enter")
+        e.key = '\r';
+    else if (name.compare(0, 5, "drag=") == 0)
+    {
+        e.kind = Event::DRAG;
+        char x;
+        return sscanf(name.c_str() + 5, "%d%c%d", &e.dx, &x, &e.dy) == 3 && x == 'x';
+    }
+    else if (name.size() == 1)
+        e.key = (unsigned char)name[0];
+    else
+        return false;
+    return true;
+}
+
+
+void parseInput(const std::string &script)
+{
+    size_t start = 0;
+    while (start <= script.size())
+    {
+        size_t comma = script.find(',', start);
+        if (comma == std::string::npos)
+            comma = script.size();
+        std::string item = script.substr(start, comma - start);
+        Event e;
+        if (!item.empty())
+        {
+            if (!parseEvent(item, e))
+                fail("invalid input event \"" + item + "\"");
+            events.push_back(e);
+        }
+        start = comma + 1;
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event &a, const Event &b) { return a.frame < b.frame; });
+}
+
+
+/** Display on Mesa's surfaceless platform, or the default one. */
+EGLDisplay openDisplay()
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+        EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+            return d;
+    }
+    EGLDisplay d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+        return d;
+    return EGL_NO_DISPLAY;
+}
+
+
+void createContext()
+{
+    display = openDisplay();
+    if (display == EGL_NO_DISPLAY)
+        fail("cannot open an EGL display");
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE};
+    EGLConfig config;
+    EGLint count = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &count) || count == 0)
+        fail("no EGL config for an OpenGL pbuffer");
+
+    const EGLint surface_attribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, surface_attribs);
+    if (surface == EGL_NO_SURFACE)
+        fail("cannot create a " + std::to_string(width) + "x" + std::to_string(height) + " pbuffer");
+
+    // Compatibility profile: runs the core profile demos and the ones that
+    // still use fixed-function calls
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint compat[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE};
+    const EGLint core[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+    for (const EGLint *attribs : {compat, core, (const EGLint *)NULL})
+    {
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, attribs);
+        if (context != EGL_NO_CONTEXT)
+            break;
+    }
+    if (context == EGL_NO_CONTEXT)
+        fail("cannot create an OpenGL context");
+    if (!eglMakeCurrent(display, surface, surface, context))
+        fail("cannot make the context current");
+}
+
+
+/** Write the default framebuffer as a binary PPM, top row first. */
+bool saveFrame(int frame, std::vector<unsigned char> &pixels)
+{
+    GLint read_fbo, pack_buffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    pixels.resize((size_t)width * height * 3);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%04d.ppm", frame);
+    std::string path = out_dir + name;
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    size_t row = (size_t)width * 3;
+    bool ok = true;
+    for (int y = height - 1; y >= 0 && ok; y--)
+        ok = fwrite(&pixels[y * row], 1, row, f) == row;
+    return fclose(f) == 0 && ok;
+}
+
+} // namespace
+
+
+bool headlessInit(int &argc, char **argv)
+{
+    bool requested = false;
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool option = arg == "--headless" || arg == "--frames" || arg == "--out" || arg == "--input";
+        if (!option)
+        {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (i + 1 == argc)
+            fail(arg + " needs a value");
+        const char *value = argv[++i];
+
+        if (arg == "--headless")
+        {
+            char x;
+            if (sscanf(value, "%d%c%d", &width, &x, &height) != 3 || x != 'x' || width <= 0 || height <= 0)
+                fail("size must be WxH, not \"" + std::string(value) + "\"");
+            requested = true;
+        }
+        else if (arg == "--frames")
+        {
+            frames = atoi(value);
+            if (frames <= 0)
+                fail("--frames must be positive");
+        }
+        else if (arg == "--out")
+            out_dir = value;
+        else
+            parseInput(value);
+    }
+    argc = kept;
+    argv[argc] = NULL;
+
+    if (!requested)
+        return false;
+    if (!out_dir.empty() && !makeDirs(out_dir))
+        fail("cannot create " + out_dir);
+    createContext();
+    active = true;
+    return true;
+}
+
+
+bool headless()
+{
+    return active;
+}
+
+
+int headlessRun(const HeadlessCallbacks &callbacks)
+{
+    std::cout << "Headless: " << width << "x" << height << ", " << frames << " frame(s) on "
+              << glGetString(GL_RENDERER) << std::endl;
+
+    glViewport(0, 0, width, height);
+    if (callbacks.reshape)
+        callbacks.reshape(width, height);
+
+    GLuint query = 0;
+    bool timer = GLEW_ARB_timer_query;
+    if (timer)
+        glGenQueries(1, &query);
+
+    std::vector<unsigned char> pixels;
+    std::vector<double> cpu_ms, gpu_ms;
+    size_t next = 0;
+    int status = 0;
+    std::cout << std::fixed << std::setprecision(3);
+
+    for (int frame = 0; frame < frames && !leave; frame++)
+    {
+        // Events happen at the pbuffer center, like a click in the window
+        int cx = width / 2, cy = height / 2;
+        for (; next < events.size() && events[next].frame <= frame; next++)
+        {
+            const Event &e = events[next];
+            if (e.kind == Event::KEY && callbacks.keyboard)
+                callbacks.keyboard((unsigned char)e.key, cx, cy);
+            else if (e.kind == Event::SPECIAL && callbacks.special)
+                callbacks.special(e.key, cx, cy);
+            else if (e.kind == Event::DRAG && callbacks.mouse)
+            {
+                callbacks.mouse(GLUT_LEFT_BUTTON, GLUT_DOWN, cx, cy);
+                if (callbacks.motion)
+                    callbacks.motion(cx + e.dx, cy + e.dy);
+                callbacks.mouse(GLUT_LEFT_BUTTON, GLUT_UP, cx + e.dx, cy + e.dy);
+            }
+        }
+        if (leave)
+            break;
+
+        if (timer)
+            glBeginQuery(GL_TIME_ELAPSED, query);
+        auto start = std::chrono::steady_clock::now();
+        callbacks.display();
+        cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (timer)
+            glEndQuery(GL_TIME_ELAPSED);
+
+        if (!out_dir.empty() && !saveFrame(frame, pixels))
+        {
+            std::cerr << "Headless: cannot write frame " << frame << " to " << out_dir << std::endl;
+            status = 1;
+            break;
+        }
+
+        std::cout << "frame " << std::setw(4) << frame << "  cpu " << std::setw(8) << cpu_ms.back() << " ms";
+        if (timer)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            // The GPU cannot have spent longer than the frame took; llvmpipe
+            // reports a bogus first interval
+            double ms = ns / 1e6;
+            if (ms <= std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+            {
+                gpu_ms.push_back(ms);
+                std::cout << "  gpu " << std::setw(8) << ms << " ms";
+            }
+            else
+                std::cout << "  gpu      n/a";
+        }
+        else
+            glFinish();
+        std::cout << std::endl;
+
+        if (callbacks.idle)
+            callbacks.idle();
+    }
+
+    auto summary = [](const char *name, std::vector<double> t) {
+        if (t.empty())
+            return;
+        double sum = 0.0;
+        for (double v : t)
+            sum += v;
+        std::sort(t.begin(), t.end());
+        std::cout << name << ": mean " << sum / t.size() << " ms, median " << t[t.size() / 2]
+                  << " ms, max " << t.back() << " ms" << std::endl;
+    };
+    std::cout << "Headless: " << cpu_ms.size() << " frame(s)" << std::endl;
+    summary("CPU", cpu_ms);
+    summary("GPU", gpu_ms);
+    std::cout.unsetf(std::ios::floatfield);
+
+    if (timer)
+        glDeleteQueries(1, &query);
+    // The context stays current, so the caller can still release its GL
+    // objects (TextureManager::clear(), release()); the process exit frees
+    // whatever it does not
+    return status;
+}
+
+
+void swapBuffers()
+{
+    if (redirect)
+        redirect->swap();
+    // The frame is read back once display() returns
+    else if (!active)
+        glutSwapBuffers();
+}
+
+
+void postRedisplay()
+{
+    if (redirect)
+        redirect->redisplay();
+    else if (!active)
+        glutPostRedisplay();
+}
+
+
+void leaveMainLoop()
+{
+    if (redirect)
+        redirect->leave();
+    else if (active)
+        leave = true;
+    else
+        glutLeaveMainLoop();
+}
+
+
+void redirectDisplay(const DisplayRedirect *functions)
+{
+    redirect = functions;
+}
+
+
+bool displayRedirected()
+{
+    return redirect != nullptr;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file headless.h
+ * Offscreen rendering without a window.
+ *
+ * Lets the GLUT demos run where there is no display (CI, render servers):
+ * with "--headless WxH" on the command line the GL context is an EGL
+ * pbuffer instead of a GLUT window, which works on Mesa's software
+ * rasterizer (llvmpipe) without a GPU. The demo's display callback is then
+ * called for a fixed number of frames with scripted input, each frame can
+ * be written to disk as a PPM image, and the CPU and GPU time of every
+ * frame is printed.
+ *
+ * Options (removed from argv by headlessInit()):
+ *   --headless WxH      render offscreen at W x H
+ *   --frames N          number of frames (default 60)
+ *   --out DIR           write DIR/frame_0000.ppm, ... (default: no images)
+ *   --input SCRIPT      events, "FRAME:EVENT" separated by commas, where
+ *                       EVENT is a key ("a", "esc", "space"), a special key
+ *                       ("left", "right", "up", "down", "pageup",
+ *                       "pagedown", "home", "end") or a mouse drag
+ *                       ("drag=DXxDY", left button, in pixels)
+ *
+ * A demo uses it like this:
+ *   if (!headlessInit(argc, argv)) {
+ *       glutInit(&argc, argv);
+ *       ... create the window ...
+ *   }
+ *   glewInit();
+ *   ... set up ...
+ *   if (headless())
+ *       return headlessRun({display, idle, reshape, keyboard});
+ *   glutDisplayFunc(display); ...
+ *
+ * and calls swapBuffers(), postRedisplay() and leaveMainLoop() instead of
+ * the GLUT functions, which need a window.
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+
+/** Demo callbacks, with the signatures GLUT uses. Any but display may be null. */
+struct HeadlessCallbacks
+{
+    void (*display)();
+    void (*idle)() = nullptr;
+    void (*reshape)(int, int) = nullptr;
+    void (*keyboard)(unsigned char, int, int) = nullptr;
+    void (*special)(int, int, int) = nullptr;
+    void (*mouse)(int, int, int, int) = nullptr;
+    void (*motion)(int, int) = nullptr;
+};
+
+
+/**
+ * Set up headless rendering if requested.
+ *
+ * Looks for the headless options, removes them from argv and, if
+ * "--headless" is present, creates an EGL pbuffer context and makes it
+ * current. On errors (bad options, no EGL) the program exits.
+ *
+ * @param argc Argument count (updated).
+ * @param argv Arguments (updated).
+ * @return True if rendering is headless; the caller must not create a
+ *         GLUT window then.
+ */
+bool headlessInit(int &, char **);
+
+/** @return True if headlessInit() created an offscreen context. */
+bool headless();
+
+/**
+ * Render the frames.
+ *
+ * Calls reshape once with the pbuffer size, then, for every frame,
+ * delivers the scripted events, times display() (CPU and, with
+ * ARB_timer_query, GPU), reads the frame back and saves it, and calls
+ * idle. Stops early if leaveMainLoop() is called. The context is still
+ * current on return.
+ *
+ * @param callbacks Demo callbacks.
+ * @return Exit status for main().
+ */
+int headlessRun(const HeadlessCallbacks &);
+
+/** glutSwapBuffers(); nothing when headless (frames are read back after display). */
+void swapBuffers();
+/** glutPostRedisplay(); headless rendering draws every frame anyway. */
+void postRedisplay();
+/** glutLeaveMainLoop(), or stop after the current frame when headless. */
+void leaveMainLoop();
+
+/** Replacements for the three functions above on a thread other than GLUT's. */
+struct DisplayRedirect
+{
+    void (*swap)();
+    void (*redisplay)();
+    void (*leave)();
+};
+
+/**
+ * Redirect swapBuffers(), postRedisplay() and leaveMainLoop() on the
+ * calling thread (used by render_thread.h, whose thread owns the context
+ * but must not call GLUT).
+ *
+ * @param redirect Functions to call instead; null restores GLUT.
+ */
+void redirectDisplay(const DisplayRedirect *);
+
+/** @return True if the calling thread has its display functions redirected. */
+bool displayRedirected();
+
+#endif
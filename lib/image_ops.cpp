@@ -0,0 +1,513 @@
+/**
+ * @file image_ops.cpp
+ * Image processing on decoded textures.
+ *
+ * Implements the kernels declared in image_ops.h.
+ */
+
+#include "image_ops.h"
+#include "mipmap.h"
+#include "job_system.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Minimum rows per band; smaller bands are not worth a job. */
+static const int min_band_rows = 16;
+
+/** Rows convolved together, so the intermediate rows stay in cache. */
+static const int strip_rows = 32;
+
+
+/**
+ * Float RGBA image (4 lanes per pixel whatever the channel count).
+ *
+ * Storage is left uninitialized: every kernel writes all of its output.
+ */
+struct FloatImage
+{
+    int width = 0, height = 0;
+    std::unique_ptr<float[]> data;
+
+    void allocate(int w, int h) { width = w; height = h; data.reset(new float[(size_t)w * h * 4]); }
+    float *row(int y) { return data.get() + (size_t)y * width * 4; }
+    const float *row(int y) const { return data.get() + (size_t)y * width * 4; }
+    void swap(FloatImage &o) { std::swap(width, o.width); std::swap(height, o.height); data.swap(o.data); }
+};
+
+
+/**
+ * Run a function over bands of rows on the job system.
+ *
+ * @param rows Number of rows.
+ * @param threads Bands at most (0 = one per job system thread).
+ * @param band Called as band(y0, y1) for rows [y0, y1).
+ */
+template <class Band>
+static void parallelRows(int rows, int threads, Band band)
+{
+    if (threads <= 0)
+        threads = jobSystem().workers() + 1;
+    threads = std::max(1, std::min(threads, rows / min_band_rows));
+
+    // Bands cover disjoint rows, so jobs never write the same pixel.
+    jobSystem().parallelFor(0, rows, (rows + threads - 1) / threads, band);
+}
+
+
+/**
+ * Weighted sum of pixels: out = sum of w[i] * src[i].
+ *
+ * @param out Output pixel (4 floats).
+ * @param src First pixel.
+ * @param w Weights.
+ * @param count Number of pixels.
+ */
+static inline void pixelSum(float *out, const float *src, const float *w, int count)
+{
+#ifdef __SSE2__
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < count; i++)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + 4 * i), _mm_set1_ps(w[i])));
+    _mm_storeu_ps(out, acc);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < count; i++)
+        for (int c = 0; c < 4; c++)
+            acc[c] += src[4 * i + c] * w[i];
+    std::copy(acc, acc + 4, out);
+#endif
+}
+
+/**
+ * Scaled row sum: dst += k * src, or dst = k * src if first.
+ *
+ * @param n Number of floats.
+ */
+static inline void rowAdd(float *dst, const float *src, float k, size_t n, bool first)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 kk = _mm_set1_ps(k);
+    if (first)
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), kk));
+    else
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), kk)));
+#endif
+    for (; i < n; i++)
+        dst[i] = (first ? 0.0f : dst[i]) + k * src[i];
+}
+
+
+/** @return True if channel c of an n channel image is alpha. */
+static inline bool isAlpha(int c, int n)
+{
+    return (n == 2 || n == 4) && c == n - 1;
+}
+
+/** 8-bit image to float, color in linear light. */
+static void toFloat(const Image &src, FloatImage &dst, int threads)
+{
+    dst.allocate(src.width, src.height);
+    int n = src.channels;
+    float decode[256];
+    for (int i = 0; i < 256; i++)
+        decode[i] = srgbToLinear((unsigned char)i);
+    parallelRows(src.height, threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+        {
+            const unsigned char *in = &src.pixels[(size_t)y * src.width * n];
+            float *out = dst.row(y);
+            for (int x = 0; x < src.width; x++)
+            {
+                out[4 * x + 1] = out[4 * x + 2] = out[4 * x + 3] = 0.0f;
+                for (int c = 0; c < n; c++)
+                {
+                    unsigned char v = in[x * n + c];
+                    out[4 * x + c] = isAlpha(c, n) ? v / 255.0f : decode[v];
+                }
+            }
+        }
+    });
+}
+
+/** Float image back to 8 bits (values clamped to [0, 1]). */
+static void fromFloat(const FloatImage &src, Image &dst, int threads)
+{
+    int n = dst.channels;
+    dst.width = src.width;
+    dst.height = src.height;
+    dst.pixels.resize((size_t)src.width * src.height * n);
+    // Finer than 8 bits near black, where sRGB steps are small.
+    const int steps = 4096;
+    std::vector<unsigned char> encode(steps);
+    for (int i = 0; i < steps; i++)
+        encode[i] = linearToSrgb(i / float(steps - 1));
+    parallelRows(src.height, threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+        {
+            const float *in = src.row(y);
+            unsigned char *out = &dst.pixels[(size_t)y * src.width * n];
+            for (int x = 0; x < src.width; x++)
+                for (int c = 0; c < n; c++)
+                {
+                    // The max also turns NaN into 0.
+                    float v = std::min(std::max(0.0f, in[4 * x + c]), 1.0f);
+                    out[x * n + c] = isAlpha(c, n) ? (unsigned char)(v * 255.0f + 0.5f)
+                                                   : encode[(int)(v * (steps - 1) + 0.5f)];
+                }
+        }
+    });
+}
+
+
+/**
+ * Separable convolution with a symmetric kernel (edges clamped).
+ *
+ * Each band of rows is done in strips: the rows a strip needs are filtered
+ * horizontally into a small buffer, then combined vertically, so the
+ * intermediate image never exists in full.
+ *
+ * @param src Source.
+ * @param dst Receives the result (same size).
+ * @param k Kernel, 2 * radius + 1 taps.
+ * @param threads Threads.
+ */
+static void convolve(const FloatImage &src, FloatImage &dst, const std::vector<float> &k, int threads)
+{
+    int w = src.width, h = src.height, radius = (int)k.size() / 2;
+    dst.allocate(w, h);
+
+    parallelRows(h, threads, [&](int y0, int y1) {
+        // Each row is copied with its edge pixels repeated radius times, so
+        // the inner loop has no bounds checks.
+        std::vector<float> pad((size_t)(w + 2 * radius) * 4);
+        std::vector<float> strip((size_t)(strip_rows + 2 * radius) * w * 4);
+        for (int ys = y0; ys < y1; ys += strip_rows)
+        {
+            int ye = std::min(ys + strip_rows, y1);
+            int ra = std::max(ys - radius, 0), rb = std::min(ye + radius, h);
+            for (int y = ra; y < rb; y++)
+            {
+                const float *in = src.row(y);
+                for (int x = -radius; x < w + radius; x++)
+                    std::copy_n(in + 4 * std::min(std::max(x, 0), w - 1), 4, &pad[(size_t)(x + radius) * 4]);
+                float *out = &strip[(size_t)(y - ra) * w * 4];
+                for (int x = 0; x < w; x++)
+                    pixelSum(out + 4 * x, &pad[(size_t)x * 4], k.data(), (int)k.size());
+            }
+            for (int y = ys; y < ye; y++)
+                for (int j = -radius; j <= radius; j++)
+                {
+                    int r = std::min(std::max(y + j, ra), rb - 1) - ra;
+                    rowAdd(dst.row(y), &strip[(size_t)r * w * 4], k[j + radius], (size_t)w * 4, j == -radius);
+                }
+        }
+    });
+}
+
+
+/** Normalized Gaussian kernel (radius 3 sigma). */
+static std::vector<float> gaussian(float sigma)
+{
+    int radius = std::max(1, (int)std::ceil(3.0f * sigma));
+    std::vector<float> k(2 * radius + 1);
+    float sum = 0.0f;
+    for (int i = -radius; i <= radius; i++)
+        sum += k[i + radius] = std::exp(-0.5f * i * i / (sigma * sigma));
+    for (float &v : k)
+        v /= sum;
+    return k;
+}
+
+static void blur(FloatImage &img, float sigma, int threads)
+{
+    if (sigma <= 0.0f)
+        return;
+    FloatImage out;
+    convolve(img, out, gaussian(sigma), threads);
+    img.swap(out);
+}
+
+static void sharpen(FloatImage &img, float amount, float sigma, int threads)
+{
+    FloatImage blurred;
+    convolve(img, blurred, gaussian(sigma), threads);
+    parallelRows(img.height, threads, [&](int y0, int y1) {
+        size_t n = (size_t)img.width * 4;
+        for (int y = y0; y < y1; y++)
+        {
+            // img + amount * (img - blurred)
+            float *out = img.row(y);
+            const float *b = blurred.row(y);
+            for (size_t i = 0; i < n; i++)
+                out[i] = out[i] * (1.0f + amount) - b[i] * amount;
+        }
+    });
+}
+
+
+/** Lanczos-3 kernel. */
+static float lanczos3(float x)
+{
+    if (x == 0.0f)
+        return 1.0f;
+    if (std::fabs(x) >= 3.0f)
+        return 0.0f;
+    float px = (float)M_PI * x;
+    return 3.0f * std::sin(px) * std::sin(px / 3.0f) / (px * px);
+}
+
+/** Resampling weights along one axis. */
+struct Resampler
+{
+    /** First source pixel and number of taps of each target pixel. */
+    std::vector<int> first, count;
+    /** Weights, stride per target pixel. */
+    std::vector<float> weights;
+    int stride;
+
+    Resampler(int src, int dst)
+    {
+        float scale = (float)dst / src;
+        // Shrinking widens the filter to cover the source pixels of one
+        // target pixel.
+        float squeeze = std::min(scale, 1.0f), support = 3.0f / squeeze;
+        stride = (int)std::ceil(2.0f * support) + 3;
+        first.resize(dst);
+        count.resize(dst);
+        weights.assign((size_t)dst * stride, 0.0f);
+        for (int o = 0; o < dst; o++)
+        {
+            float center = (o + 0.5f) / scale;
+            int a = std::max(0, (int)std::floor(center - support));
+            int b = std::min(src - 1, (int)std::ceil(center + support));
+            float *w = &weights[(size_t)o * stride], sum = 0.0f;
+            for (int i = a; i <= b; i++)
+                sum += w[i - a] = lanczos3((i + 0.5f - center) * squeeze);
+            // Taps outside the image are dropped and the rest renormalized.
+            for (int i = a; i <= b; i++)
+                w[i - a] /= sum;
+            first[o] = a;
+            count[o] = b - a + 1;
+        }
+    }
+};
+
+static void resize(FloatImage &img, int width, int height, int threads)
+{
+    if (width == img.width && height == img.height)
+        return;
+
+    // Rows first, then columns.
+    Resampler rx(img.width, width), ry(img.height, height);
+    FloatImage tmp;
+    tmp.allocate(width, img.height);
+    parallelRows(img.height, threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+        {
+            const float *src = img.row(y);
+            float *out = tmp.row(y);
+            for (int x = 0; x < width; x++)
+                pixelSum(out + 4 * x, src + 4 * rx.first[x], &rx.weights[(size_t)x * rx.stride], rx.count[x]);
+        }
+    });
+
+    img.allocate(width, height);
+    parallelRows(height, threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+        {
+            float *out = img.row(y);
+            const float *w = &ry.weights[(size_t)y * ry.stride];
+            for (int j = 0; j < ry.count[y]; j++)
+                rowAdd(out, tmp.row(ry.first[y] + j), w[j], (size_t)width * 4, j == 0);
+        }
+    });
+}
+
+
+static void grayscale(Image &img, int threads)
+{
+    int n = img.channels;
+    if (n < 3)
+        return;
+    parallelRows(img.height, threads, [&](int y0, int y1) {
+        unsigned char *p = &img.pixels[(size_t)y0 * img.width * n];
+        for (size_t i = 0, count = (size_t)(y1 - y0) * img.width; i < count; i++, p += n)
+        {
+            // 0.299, 0.587, 0.114 in 8-bit fixed point.
+            unsigned char g = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+            p[0] = p[1] = p[2] = g;
+        }
+    });
+}
+
+static void gamma(Image &img, float g, int threads)
+{
+    unsigned char table[256];
+    for (int i = 0; i < 256; i++)
+        table[i] = (unsigned char)std::lround(255.0f * std::pow(i / 255.0f, 1.0f / g));
+
+    int n = img.channels;
+    parallelRows(img.height, threads, [&](int y0, int y1) {
+        unsigned char *p = &img.pixels[(size_t)y0 * img.width * n];
+        for (size_t i = 0, count = (size_t)(y1 - y0) * img.width; i < count; i++, p += n)
+            for (int c = 0; c < n; c++)
+                if (!isAlpha(c, n))
+                    p[c] = table[p[c]];
+    });
+}
+
+
+void applyImageOps(Image &image, const std::vector<ImageOp> &ops, int threads)
+{
+    if (image.width <= 0 || image.height <= 0)
+        return;
+
+    FloatImage f;
+    bool in_float = false;
+    for (const ImageOp &op : ops)
+    {
+        bool convolution = op.type == IMAGE_BLUR || op.type == IMAGE_SHARPEN || op.type == IMAGE_RESIZE;
+        if (convolution && !in_float)
+            toFloat(image, f, threads);
+        else if (!convolution && in_float)
+            fromFloat(f, image, threads);
+        in_float = convolution;
+
+        switch (op.type)
+        {
+        case IMAGE_BLUR:
+            blur(f, op.amount, threads);
+            break;
+        case IMAGE_SHARPEN:
+            sharpen(f, op.amount, 1.0f, threads);
+            break;
+        case IMAGE_RESIZE:
+            if (op.width > 0)
+                resize(f, op.width, op.height, threads);
+            else
+                resize(f, std::max(1, (int)std::lround(f.width * op.amount)),
+                       std::max(1, (int)std::lround(f.height * op.amount)), threads);
+            break;
+        case IMAGE_GRAYSCALE:
+            grayscale(image, threads);
+            break;
+        case IMAGE_GAMMA:
+            gamma(image, op.amount, threads);
+            break;
+        }
+    }
+    if (in_float)
+        fromFloat(f, image, threads);
+}
+
+
+void blurImage(Image &image, float sigma, int threads)
+{
+    applyImageOps(image, {{IMAGE_BLUR, sigma, 0, 0}}, threads);
+}
+
+
+void sharpenImage(Image &image, float amount, float sigma, int threads)
+{
+    if (image.width <= 0 || image.height <= 0)
+        return;
+    FloatImage f;
+    toFloat(image, f, threads);
+    sharpen(f, amount, sigma, threads);
+    fromFloat(f, image, threads);
+}
+
+
+void resizeImage(Image &image, int width, int height, int threads)
+{
+    applyImageOps(image, {{IMAGE_RESIZE, 1.0f, width, height}}, threads);
+}
+
+
+void grayscaleImage(Image &image, int threads)
+{
+    grayscale(image, threads);
+}
+
+
+void gammaImage(Image &image, float g, int threads)
+{
+    gamma(image, g, threads);
+}
+
+
+bool parseImageOps(const std::string &text, std::vector<ImageOp> &ops, std::string *error)
+{
+    ops.clear();
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string item = text.substr(start, end - start);
+        start = end + 1;
+
+        size_t eq = item.find('=');
+        std::string name = item.substr(0, eq), value = eq == std::string::npos ? "" : item.substr(eq + 1);
+        if (name.empty() && value.empty())
+            continue;
+
+        ImageOp op = {IMAGE_BLUR, 0.0f, 0, 0};
+        char *rest = nullptr;
+        float number = value.empty() ? 0.0f : strtof(value.c_str(), &rest);
+        bool number_ok = !value.empty() && *rest == '\0' && number > 0.0f;
+        bool ok = true;
+
+        if (name == "blur" || name == "sharpen" || name == "gamma")
+        {
+            op.type = name == "blur" ? IMAGE_BLUR : name == "sharpen" ? IMAGE_SHARPEN : IMAGE_GAMMA;
+            op.amount = number;
+            ok = number_ok;
+        }
+        else if (name == "resize")
+        {
+            op.type = IMAGE_RESIZE;
+            size_t x = value.find('x');
+            if (x == std::string::npos)
+            {
+                op.amount = number;
+                ok = number_ok;
+            }
+            else
+            {
+                op.width = (int)strtol(value.c_str(), &rest, 10);
+                ok = rest == value.c_str() + x;
+                op.height = (int)strtol(value.c_str() + x + 1, &rest, 10);
+                ok = ok && *rest == '\0' && op.width > 0 && op.height > 0;
+            }
+        }
+        else if ((name == "gray" || name == "grayscale") && value.empty())
+            op.type = IMAGE_GRAYSCALE;
+        else
+        {
+            if (error)
+                *error = "unknown operation \"" + item + "\"";
+            return false;
+        }
+
+        if (!ok)
+        {
+            if (error)
+                *error = "bad value in \"" + item + "\"";
+            return false;
+        }
+        ops.push_back(op);
+    }
+    return true;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file image_ops.h
+ * Image processing on decoded textures.
+ *
+ * Kernels to preprocess images before they are uploaded: Gaussian blur,
+ * sharpening (unsharp mask), Lanczos resizing, grayscale and gamma.
+ *
+ * Blur, sharpen and resize are separable convolutions run in float RGBA
+ * (4 lanes, SSE) on linear light, like the mip filter in mipmap.h; the
+ * last channel of 2 and 4 channel images is alpha and is filtered as is.
+ * Grayscale and gamma are per-pixel transforms on the stored 8-bit values.
+ *
+ * Every kernel splits the image into bands of rows processed in parallel
+ * on the shared job system (job_system.h).
+ *
+ * Chains of operations can be written as text, e.g.
+ * "resize=1024x1024,sharpen=0.5,gamma=1.2" (see parseImageOps()); the
+ * texture manager applies such a chain on its workers (setImageOps()).
+ */
+
+#ifndef IMAGE_OPS_H
+#define IMAGE_OPS_H
+
+#include <string>
+#include <vector>
+
+
+/** 8-bit image with 1 to 4 channels, rows tightly packed. */
+struct Image
+{
+    int width = 0, height = 0, channels = 0;
+    std::vector<unsigned char> pixels;
+};
+
+
+/** Operation kinds. */
+enum ImageOpType
+{
+    IMAGE_BLUR,       ///< Gaussian blur, amount = sigma in pixels.
+    IMAGE_SHARPEN,    ///< Unsharp mask (sigma 1), amount = strength.
+    IMAGE_RESIZE,     ///< Lanczos-3 resize to width x height.
+    IMAGE_GRAYSCALE,  ///< Luma (0.299, 0.587, 0.114) in every color channel.
+    IMAGE_GAMMA       ///< Values raised to 1 / amount.
+};
+
+/** One operation of a chain. */
+struct ImageOp
+{
+    ImageOpType type;
+    float amount;
+    /** Target size of IMAGE_RESIZE. */
+    int width, height;
+};
+
+
+/**
+ * Gaussian blur.
+ *
+ * @param image Image (modified).
+ * @param sigma Standard deviation in pixels.
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void blurImage(Image &, float, int = 0);
+
+/**
+ * Sharpen with an unsharp mask: image + amount * (image - blurred).
+ *
+ * @param image Image (modified).
+ * @param amount Strength (0 = unchanged).
+ * @param sigma Blur radius of the mask.
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void sharpenImage(Image &, float, float = 1.0f, int = 0);
+
+/**
+ * Resize with a Lanczos-3 filter.
+ *
+ * When shrinking, the filter is widened to the source pixels covered by
+ * one target pixel, so there is no aliasing.
+ *
+ * @param image Image (modified).
+ * @param width New width.
+ * @param height New height.
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void resizeImage(Image &, int, int, int = 0);
+
+/**
+ * Replace color by its luma, as the grayscale shaders do.
+ *
+ * The channel count is kept (RGB stays RGB); 1 and 2 channel images are
+ * left as they are.
+ *
+ * @param image Image (modified).
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void grayscaleImage(Image &, int = 0);
+
+/**
+ * Gamma correction: v' = v^(1 / gamma) on values in [0, 1].
+ *
+ * Gamma above 1 brightens the midtones. Alpha is left as it is.
+ *
+ * @param image Image (modified).
+ * @param gamma Gamma.
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void gammaImage(Image &, float, int = 0);
+
+
+/**
+ * Parse a chain of operations.
+ *
+ * Comma-separated list of "blur=SIGMA", "sharpen=AMOUNT",
+ * "resize=WxH" or "resize=SCALE", "gray" and "gamma=GAMMA".
+ *
+ * @param text Chain.
+ * @param ops Receives the operations.
+ * @param error Receives a message on failure (optional).
+ * @return False if the text is invalid.
+ */
+bool parseImageOps(const std::string &, std::vector<ImageOp> &, std::string * = nullptr);
+
+/**
+ * Apply a chain of operations.
+ *
+ * Consecutive convolutions share one float copy of the image.
+ *
+ * @param image Image (modified).
+ * @param ops Operations, in order.
+ * @param threads Bands at most (0 = one per job system thread; 1 = this thread only).
+ */
+void applyImageOps(Image &, const std::vector<ImageOp> &, int = 0);
+
+#endif
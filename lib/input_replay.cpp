@@ -0,0 +1,284 @@
+/**
+ * @file input_replay.cpp
+ * Input recording and replay.
+ *
+ * Implements the recorder and player declared in input_replay.h.
+ */
+
+#include "input_replay.h"
+
+#include <GL/freeglut.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+/** Recorded input event. */
+struct Event
+{
+    enum Kind { KEY, SPECIAL, MOUSE, MOTION } kind;
+    long frame;
+    double ms;
+    int a, b;
+    int x, y;
+};
+
+const char *kind_names[] = {"key", "special", "mouse", "motion"};
+
+HeadlessCallbacks app;
+
+std::ofstream record;
+std::string record_path;
+
+std::vector<Event> replay;
+size_t next_event = 0;
+bool original_timing = false;
+bool replay_done = false;
+
+/** Frames drawn so far. */
+long frame = 0;
+std::chrono::steady_clock::time_point first_frame;
+
+
+[[noreturn]] void fail(const std::string &message)
+{
+    std::cerr << "Input replay: " << message << std::endl;
+    exit(1);
+}
+
+
+double sinceFirstFrame()
+{
+    if (frame == 0)
+        return 0.0;
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - first_frame).count();
+}
+
+
+void recordEvent(Event::Kind kind, int a, int b, int x, int y)
+{
+    if (!record.is_open())
+        return;
+    char line[96];
+    snprintf(line, sizeof(line), "%ld %.3f %s ", frame, sinceFirstFrame(), kind_names[kind]);
+    record << line;
+    if (kind == Event::MOTION)
+        record << x << ' ' << y << '\n';
+    else if (kind == Event::MOUSE)
+        record << a << ' ' << b << ' ' << x << ' ' << y << '\n';
+    else
+        record << a << ' ' << x << ' ' << y << '\n';
+}
+
+
+void load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        fail("cannot read " + path);
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream s(line);
+        std::string kind;
+        Event e = {};
+        s >> e.frame >> e.ms >> kind;
+        if (kind == "key" || kind == "special")
+        {
+            e.kind = kind == "key" ? Event::KEY : Event::SPECIAL;
+            s >> e.a >> e.x >> e.y;
+        }
+        else if (kind == "mouse")
+        {
+            e.kind = Event::MOUSE;
+            s >> e.a >> e.b >> e.x >> e.y;
+        }
+        else if (kind == "motion")
+        {
+            e.kind = Event::MOTION;
+            s >> e.x >> e.y;
+        }
+        else
+            s.setstate(std::ios::failbit);
+        if (!s)
+            fail(path + ":" + std::to_string(number) + ": bad event \"" + line + "\"");
+        replay.push_back(e);
+    }
+}
+
+
+/** Deliver the replayed events that are due before this frame. */
+void deliver()
+{
+    double now = sinceFirstFrame();
+    for (; next_event < replay.size(); next_event++)
+    {
+        const Event &e = replay[next_event];
+        if (original_timing ? e.ms > now : e.frame > frame)
+            break;
+        if (e.kind == Event::KEY && app.keyboard)
+            app.keyboard((unsigned char)e.a, e.x, e.y);
+        else if (e.kind == Event::SPECIAL && app.special)
+            app.special(e.a, e.x, e.y);
+        else if (e.kind == Event::MOUSE && app.mouse)
+            app.mouse(e.a, e.b, e.x, e.y);
+        else if (e.kind == Event::MOTION && app.motion)
+            app.motion(e.x, e.y);
+    }
+}
+
+
+void display()
+{
+    if (frame == 0)
+        first_frame = std::chrono::steady_clock::now();
+
+    bool replaying = next_event < replay.size();
+    if (replaying)
+        deliver();
+
+    app.display();
+    frame++;
+
+    // The frame after the last event shows its effect; then stop
+    if (replaying && next_event == replay.size() && !replay_done)
+    {
+        replay_done = true;
+        std::cout << "Input replay: " << replay.size() << " event(s) over " << frame << " frame(s), "
+                  << sinceFirstFrame() << " ms" << std::endl;
+        leaveMainLoop();
+    }
+}
+
+
+void idle()
+{
+    // Frames must keep coming for the replay to advance
+    if (next_event < replay.size())
+        postRedisplay();
+    if (app.idle)
+        app.idle();
+}
+
+
+void keyboard(unsigned char key, int x, int y)
+{
+    recordEvent(Event::KEY, key, 0, x, y);
+    app.keyboard(key, x, y);
+}
+
+
+void special(int key, int x, int y)
+{
+    recordEvent(Event::SPECIAL, key, 0, x, y);
+    app.special(key, x, y);
+}
+
+
+void mouse(int button, int state, int x, int y)
+{
+    recordEvent(Event::MOUSE, button, state, x, y);
+    app.mouse(button, state, x, y);
+}
+
+
+void motion(int x, int y)
+{
+    recordEvent(Event::MOTION, 0, 0, x, y);
+    app.motion(x, y);
+}
+
+}
+
+
+bool inputReplayInit(int &argc, char **argv)
+{
+    std::string replay_path;
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool option = arg == "--record" || arg == "--replay" || arg == "--replay-timing";
+        if (!option)
+        {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (i + 1 == argc)
+            fail(arg + " needs a value");
+        std::string value = argv[++i];
+
+        if (arg == "--record")
+            record_path = value;
+        else if (arg == "--replay")
+            replay_path = value;
+        else if (value == "frames" || value == "original")
+            original_timing = value == "original";
+        else
+            fail("--replay-timing must be frames or original, not \"" + value + "\"");
+    }
+    argc = kept;
+    argv[argc] = NULL;
+
+    if (!replay_path.empty())
+    {
+        load(replay_path);
+        std::cout << "Input replay: " << replay.size() << " event(s) from " << replay_path << " ("
+                  << (original_timing ? "original timing" : "one frame per recorded frame") << ")" << std::endl;
+    }
+    if (!record_path.empty())
+    {
+        record.open(record_path);
+        if (!record)
+            fail("cannot write " + record_path);
+        record << "# frame time_ms event args\n";
+        std::cout << "Input replay: recording to " << record_path << std::endl;
+    }
+    return !replay.empty() || record.is_open();
+}
+
+
+bool inputRecording()
+{
+    return record.is_open();
+}
+
+
+bool inputReplaying()
+{
+    return next_event < replay.size();
+}
+
+
+HeadlessCallbacks inputReplayWrap(const HeadlessCallbacks &callbacks)
+{
+    if (replay.empty() && !record.is_open())
+        return callbacks;
+
+    app = callbacks;
+    HeadlessCallbacks wrapped = callbacks;
+    wrapped.display = display;
+    if (!replay.empty())
+        wrapped.idle = idle;
+    if (callbacks.keyboard)
+        wrapped.keyboard = keyboard;
+    if (callbacks.special)
+        wrapped.special = special;
+    if (callbacks.mouse)
+        wrapped.mouse = mouse;
+    if (callbacks.motion)
+        wrapped.motion = motion;
+    return wrapped;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file input_replay.h
+ * Input recording and replay.
+ *
+ * Records the keyboard and mouse events a demo receives, with the frame
+ * and the time at which they arrived, and plays them back later. Combined
+ * with headless rendering (headless.h) this turns a real interactive
+ * session (trackball drags, zoom with the wheel, mode keys) into a
+ * repeatable benchmark: the same frames are drawn in every run and build.
+ *
+ * Options (removed from argv by inputReplayInit()):
+ *   --record FILE            write the session's events to FILE
+ *   --replay FILE            play the events of FILE back
+ *   --replay-timing MODE     "frames" (default): each event is delivered
+ *                            before the same frame number it was recorded
+ *                            at, independent of speed; "original": at the
+ *                            same time since the first frame
+ *
+ * The program leaves the main loop after the frame that follows the last
+ * replayed event (when headless, pass --frames large enough for the whole
+ * session). Live input still works during a replay but is not recorded.
+ *
+ * The file is text, one event per line:
+ *   FRAME TIME_MS key KEY X Y
+ *   FRAME TIME_MS special KEY X Y
+ *   FRAME TIME_MS mouse BUTTON STATE X Y
+ *   FRAME TIME_MS motion X Y
+ * FRAME counts the frames drawn before the event; TIME_MS is measured from
+ * the first frame. Lines starting with '#' are comments.
+ *
+ * A demo routes its callbacks through inputReplayWrap():
+ *   inputReplayInit(argc, argv);
+ *   ...
+ *   HeadlessCallbacks callbacks = inputReplayWrap({display, idle, reshape, keyboard, special, mouse, motion});
+ *   if (headless())
+ *       return headlessRun(callbacks);
+ *   glutDisplayFunc(callbacks.display); ...
+ */
+
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include "headless.h"
+
+
+/**
+ * Parse the record and replay options.
+ *
+ * Opens the recording or loads the replay; on errors (unreadable file,
+ * bad line) the program exits.
+ *
+ * @param argc Argument count (updated).
+ * @param argv Arguments (updated).
+ * @return True if recording or replaying.
+ */
+bool inputReplayInit(int &, char **);
+
+/** @return True while events are being recorded. */
+bool inputRecording();
+
+/** @return True while a replay has events left. */
+bool inputReplaying();
+
+/**
+ * Wrap the demo callbacks.
+ *
+ * The returned callbacks record the input events before passing them on
+ * or, when replaying, deliver the recorded events before each frame. They
+ * must be the ones given to GLUT or headlessRun(). Without recording or
+ * replay the callbacks are returned unchanged.
+ *
+ * @param callbacks Demo callbacks.
+ * @return Callbacks to register.
+ */
+HeadlessCallbacks inputReplayWrap(const HeadlessCallbacks &);
+
+#endif
@@ -0,0 +1,312 @@
+/**
+ * @file job_system.cpp
+ * Work-stealing job system.
+ *
+ * Implements the job system declared in job_system.h.
+ */
+
+#include "job_system.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+
+/** Submitted job and the jobs waiting for it. */
+struct JobHandle::Job
+{
+    std::function<void()> function;
+    /** Unfinished dependencies, plus one until run() is done with it. */
+    std::atomic<int> pending{1};
+    std::atomic<bool> finished{false};
+    /** Guards dependents and the switch of finished. */
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Job>> dependents;
+};
+
+
+namespace
+{
+
+/** Job system of the calling worker thread (null elsewhere) and its index. */
+thread_local JobSystem *worker_of = nullptr;
+thread_local int worker_index = -1;
+
+/** Longest sleep of a thread in wait() before it checks its condition again. */
+const std::chrono::milliseconds wait_poll(1);
+
+}
+
+
+bool JobHandle::done() const
+{
+    return !job || job->finished.load(std::memory_order_acquire);
+}
+
+
+JobSystem::JobSystem(int count)
+{
+    if (count <= 0)
+        if (const char *env = getenv("CG_JOBS"))
+            count = atoi(env);
+    if (count <= 0)
+        count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+    for (int i = 0; i < count; i++)
+        queues.emplace_back(new Queue);
+    for (int i = 0; i < count; i++)
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+}
+
+
+JobHandle JobSystem::run(std::function<void()> function, const std::vector<JobHandle> &after)
+{
+    JobHandle handle;
+    handle.job = std::make_shared<JobHandle::Job>();
+    JobHandle::Job &job = *handle.job;
+    job.function = std::move(function);
+    job.pending += (int)after.size();
+
+    for (const JobHandle &h : after)
+    {
+        if (!h.job)
+        {
+            job.pending--;
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(h.job->mutex);
+        if (h.job->finished)
+            job.pending--;
+        else
+            h.job->dependents.push_back(handle.job);
+    }
+
+    if (--job.pending == 0)
+        push(handle.job);
+    return handle;
+}
+
+
+/**
+ * Queue a job that is ready to run.
+ *
+ * Workers push to the back of their own deque, other threads to the shared
+ * queue.
+ */
+void JobSystem::push(std::shared_ptr<JobHandle::Job> job)
+{
+    Queue &q = worker_of == this ? *queues[worker_index] : shared;
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.jobs.push_back(std::move(job));
+    }
+    queued++;
+    {
+        // Taken so a worker cannot miss the job between its check and its wait
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+    if (waiting > 0)
+        finished.notify_all();
+}
+
+
+/**
+ * Take a job: the newest of the own deque, the oldest of the shared queue,
+ * or the oldest of another worker's deque.
+ *
+ * @param self Index of the calling worker (-1 if it is not one).
+ * @return Job, or null if every queue is empty.
+ */
+std::shared_ptr<JobHandle::Job> JobSystem::take(int self)
+{
+    std::shared_ptr<JobHandle::Job> job;
+    if (self >= 0)
+    {
+        Queue &q = *queues[self];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.jobs.empty())
+        {
+            job = std::move(q.jobs.back());
+            q.jobs.pop_back();
+        }
+    }
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        if (!shared.jobs.empty())
+        {
+            job = std::move(shared.jobs.front());
+            shared.jobs.pop_front();
+        }
+    }
+
+    int n = (int)queues.size();
+    for (int i = 1; !job && i <= n; i++)
+    {
+        int victim = (std::max(self, 0) + i) % n;
+        if (victim == self)
+            continue;
+        Queue &q = *queues[victim];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.jobs.empty())
+        {
+            job = std::move(q.jobs.front());
+            q.jobs.pop_front();
+            stolen++;
+        }
+    }
+
+    if (job)
+        queued--;
+    return job;
+}
+
+
+/**
+ * Run a job, then release the jobs that were waiting only for it.
+ */
+void JobSystem::execute(const std::shared_ptr<JobHandle::Job> &job)
+{
+    job->function();
+    // Captures may hold large buffers; drop them now rather than with the last handle
+    job->function = nullptr;
+
+    std::vector<std::shared_ptr<JobHandle::Job>> ready;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished.store(true, std::memory_order_release);
+        ready.swap(job->dependents);
+    }
+    for (std::shared_ptr<JobHandle::Job> &d : ready)
+        if (--d->pending == 0)
+            push(std::move(d));
+
+    executed++;
+    if (waiting > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        finished.notify_all();
+    }
+}
+
+
+/**
+ * Run one queued job on the calling thread, if there is one.
+ */
+bool JobSystem::runOne()
+{
+    std::shared_ptr<JobHandle::Job> job = take(worker_of == this ? worker_index : -1);
+    if (!job)
+        return false;
+    helped++;
+    execute(job);
+    return true;
+}
+
+
+void JobSystem::workerLoop(int index)
+{
+    worker_of = this;
+    worker_index = index;
+    traceThreadName("job worker");
+
+    for (;;)
+    {
+        std::shared_ptr<JobHandle::Job> job = take(index);
+        if (job)
+        {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+
+void JobSystem::wait(const JobHandle &handle)
+{
+    wait([&handle] { return handle.done(); });
+}
+
+
+void JobSystem::wait(const std::function<bool()> &ready)
+{
+    for (;;)
+    {
+        // Read before the check: a job finishing after it ends the sleep
+        long seen = executed;
+        if (ready())
+            return;
+        if (runOne())
+            continue;
+
+        // The condition is not checked under sleep_mutex: it may take locks
+        // that are held while jobs are submitted
+        waiting++;
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            finished.wait_for(lock, wait_poll, [&] { return queued > 0 || executed != seen; });
+        }
+        waiting--;
+    }
+}
+
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body)
+{
+    int n = end - begin;
+    if (n <= 0)
+        return;
+    if (grain <= 0)
+        grain = std::max(1, n / (4 * (workers() + 1)));
+    int chunks = (n + grain - 1) / grain;
+    if (chunks == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    std::atomic<int> remaining(chunks - 1);
+    for (int c = 1; c < chunks; c++)
+    {
+        int i0 = begin + c * grain, i1 = std::min(end, i0 + grain);
+        run([&body, &remaining, i0, i1] {
+            body(i0, i1);
+            remaining--;
+        });
+    }
+    body(begin, begin + grain);
+    wait([&remaining] { return remaining == 0; });
+}
+
+
+void JobSystem::printStats() const
+{
+    std::cout << "Jobs: " << executed << " run on " << workers() << " worker(s), " << stolen << " stolen, "
+              << helped << " run by waiting threads" << std::endl;
+}
+
+
+JobSystem &jobSystem()
+{
+    static JobSystem *system = new JobSystem();
+    return *system;
+}
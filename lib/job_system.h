@@ -0,0 +1,168 @@
+/**
+ * @file job_system.h
+ * Work-stealing job system.
+ *
+ * One pool of worker threads shared by everything that runs in parallel
+ * (texture decoding, image kernels, block compression, scanline fills,
+ * mesh processing), instead of each of them starting threads of its own
+ * and oversubscribing the cores when they overlap.
+ *
+ * Every worker has its own deque of jobs: it pushes and pops at the back
+ * (the newest job, whose data is still in its cache) and, when its deque
+ * is empty, steals from the front of another worker's deque (the oldest
+ * job, usually the largest piece of work left). Jobs submitted from other
+ * threads go to a shared queue that the workers also take from.
+ *
+ * A thread that waits for a job (wait(), parallelFor()) runs queued jobs
+ * meanwhile instead of sleeping, so waiting inside a job cannot deadlock
+ * and the GL thread helps while it waits for a decode.
+ *
+ * Jobs can depend on others: run(job, {a, b}) starts job only after a and
+ * b finished.
+ *
+ * The number of workers is the number of cores minus one (the submitting
+ * thread works too), at least one, or CG_JOBS if set.
+ *
+ * Typical use:
+ *   JobSystem &jobs = jobSystem();
+ *   JobHandle a = jobs.run([] { decode(); });
+ *   JobHandle b = jobs.run([] { build(); }, {a});   // after a
+ *   jobs.parallelFor(0, rows, 16, [&](int y0, int y1) { ... rows [y0, y1) ... });
+ *   jobs.wait(b);
+ */
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class JobSystem;
+
+
+/**
+ * Handle of a submitted job.
+ *
+ * A default-constructed handle counts as finished.
+ */
+class JobHandle
+{
+public:
+    /** @return True once the job has run. */
+    bool done() const;
+
+private:
+    friend class JobSystem;
+    struct Job;
+    std::shared_ptr<Job> job;
+};
+
+
+/**
+ * Pool of workers with per-worker deques and work stealing.
+ */
+class JobSystem
+{
+public:
+    /**
+     * Constructor; starts the workers.
+     *
+     * @param workers Worker threads (0 = CG_JOBS, or one per core minus one).
+     */
+    explicit JobSystem(int = 0);
+
+    /** Destructor; runs the jobs still queued and stops the workers. */
+    ~JobSystem();
+
+    /**
+     * Submit a job.
+     *
+     * @param function Work to run on some thread.
+     * @param after Jobs that must finish first.
+     * @return Handle to wait for.
+     */
+    JobHandle run(std::function<void()>, const std::vector<JobHandle> & = {});
+
+    /**
+     * Wait for a job, running other jobs meanwhile.
+     *
+     * @param handle Job to wait for.
+     */
+    void wait(const JobHandle &);
+
+    /**
+     * Wait for a condition, running jobs meanwhile.
+     *
+     * The condition is checked after each job and at least every
+     * millisecond while there is nothing to run.
+     *
+     * @param ready Returns true when the wait is over.
+     */
+    void wait(const std::function<bool()> &);
+
+    /**
+     * Run a loop in parallel and wait for it.
+     *
+     * The range is split into chunks of grain iterations (the last may be
+     * shorter); the calling thread runs chunks too.
+     *
+     * @param begin First index.
+     * @param end One past the last index.
+     * @param grain Iterations per chunk (0 = about four chunks per thread).
+     * @param body Called as body(i0, i1) for the indices [i0, i1).
+     */
+    void parallelFor(int, int, int, const std::function<void(int, int)> &);
+
+    /** @return Number of worker threads. */
+    int workers() const { return (int)queues.size(); }
+
+    /** Print jobs run, stolen and run by waiting threads. */
+    void printStats() const;
+
+private:
+    /** Jobs of one worker; the owner uses the back, thieves the front. */
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<JobHandle::Job>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    /** Jobs submitted by threads that are not workers. */
+    Queue shared;
+    std::vector<std::thread> threads;
+
+    /** Jobs queued and not taken yet, to let idle workers sleep. */
+    std::atomic<int> queued{0};
+    std::mutex sleep_mutex;
+    /** Idle workers wait on wake, threads in wait() on finished. */
+    std::condition_variable wake, finished;
+    std::atomic<int> waiting{0};
+    bool stopping = false;
+
+    std::atomic<long> executed{0}, stolen{0}, helped{0};
+
+    void push(std::shared_ptr<JobHandle::Job>);
+    std::shared_ptr<JobHandle::Job> take(int);
+    bool runOne();
+    void execute(const std::shared_ptr<JobHandle::Job> &);
+    void workerLoop(int);
+};
+
+
+/**
+ * The job system shared by the library.
+ *
+ * Started on first use and never destroyed, so jobs may still be waited
+ * for by destructors of other globals at exit.
+ */
+JobSystem &jobSystem();
+
+#endif
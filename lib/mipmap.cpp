@@ -0,0 +1,320 @@
+/**
+ * @file mipmap.cpp
+ * CPU mipmap generation and mip chain container.
+ *
+ * Implements the mip chain declared in mipmap.h.
+ */
+
+#include "mipmap.h"
+#include "cache_dir.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Container magic and version. */
+static const char mip_magic[4] = {'C', 'G', 'M', 'P'};
+static const uint32_t mip_version = 2;
+
+/** Container header. */
+struct MipHeader
+{
+    char magic[4];
+    uint32_t version, width, height, channels, levels, format;
+};
+
+/** Container level table entry. */
+struct MipEntry
+{
+    uint32_t width, height;
+    uint64_t offset, size;
+};
+
+/** Entries of the linear to sRGB table. */
+static const int encode_steps = 4096;
+
+
+/**
+ * Conversion tables.
+ *
+ * decode: 8-bit sRGB to linear. encode: linear (in encode_steps steps) to
+ * 8-bit sRGB.
+ */
+struct SrgbTables
+{
+    float decode[256];
+    unsigned char encode[encode_steps];
+
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < encode_steps; i++)
+        {
+            float l = i / float(encode_steps - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            encode[i] = (unsigned char)std::lround(c * 255.0f);
+        }
+    }
+};
+
+static const SrgbTables &srgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+
+/**
+ * Halve a float RGBA image.
+ *
+ * Averages 2x2 blocks; odd edges reuse the last row/column.
+ *
+ * @param src Source (4 floats per pixel).
+ * @param sw Source width.
+ * @param sh Source height.
+ * @param dst Destination (4 floats per pixel).
+ * @param dw Destination width.
+ * @param dh Destination height.
+ */
+static void downsample(const float *src, int sw, int sh, float *dst, int dw, int dh)
+{
+    for (int y = 0; y < dh; y++)
+    {
+        const float *r0 = src + (size_t)(2 * y) * sw * 4;
+        const float *r1 = src + (size_t)std::min(2 * y + 1, sh - 1) * sw * 4;
+        float *out = dst + (size_t)y * dw * 4;
+        for (int x = 0; x < dw; x++)
+        {
+            int x0 = 2 * x * 4, x1 = std::min(2 * x + 1, sw - 1) * 4;
+#ifdef __SSE2__
+            __m128 s = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(r0 + x0), _mm_loadu_ps(r0 + x1)),
+                                  _mm_add_ps(_mm_loadu_ps(r1 + x0), _mm_loadu_ps(r1 + x1)));
+            _mm_storeu_ps(out + 4 * x, _mm_mul_ps(s, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; c++)
+                out[4*x+c] = 0.25f * (r0[x0+c] + r0[x1+c] + r1[x0+c] + r1[x1+c]);
+#endif
+        }
+    }
+}
+
+
+void MipChain::build(const unsigned char *pixels, int width, int height, int channels, bool srgb)
+{
+    const SrgbTables &t = srgbTables();
+
+    // Alpha is the last channel of 2 and 4 channel images.
+    bool linear[4] = {!srgb, !srgb, !srgb, !srgb};
+    if (channels == 2 || channels == 4)
+        linear[channels - 1] = true;
+
+    std::vector<MipLevel> layout;
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        layout.push_back({w, h, nullptr, (size_t)w * h * channels});
+        if (w == 1 && h == 1)
+            break;
+    }
+    memcpy(allocate(layout, channels), pixels, layout[0].size);
+
+    // Filter in float RGBA (4 lanes) whatever the channel count.
+    std::vector<float> a((size_t)width * height * 4, 0.0f), b;
+    for (size_t i = 0, n = (size_t)width * height; i < n; i++)
+        for (int c = 0; c < channels; c++)
+        {
+            unsigned char v = pixels[i * channels + c];
+            a[4*i+c] = linear[c] ? v / 255.0f : t.decode[v];
+        }
+
+    float scale[4];
+    for (int c = 0; c < 4; c++)
+        scale[c] = linear[c] ? 255.0f : float(encode_steps - 1);
+
+    for (size_t li = 1; li < level_list.size(); li++)
+    {
+        const MipLevel &src = level_list[li - 1];
+        MipLevel &dst = level_list[li];
+        b.resize((size_t)dst.width * dst.height * 4);
+        downsample(a.data(), src.width, src.height, b.data(), dst.width, dst.height);
+
+        unsigned char *out = storage.data() + (dst.data - storage.data());
+        for (size_t i = 0, n = (size_t)dst.width * dst.height; i < n; i++)
+        {
+            int q[4];
+#ifdef __SSE2__
+            __m128 v = _mm_mul_ps(_mm_loadu_ps(&b[4*i]), _mm_loadu_ps(scale));
+            v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_loadu_ps(scale));
+            _mm_storeu_si128((__m128i *)q, _mm_cvtps_epi32(v));
+#else
+            for (int c = 0; c < 4; c++)
+                q[c] = (int)std::lround(std::min(std::max(b[4*i+c] * scale[c], 0.0f), scale[c]));
+#endif
+            for (int c = 0; c < channels; c++)
+                out[i * channels + c] = linear[c] ? (unsigned char)q[c] : t.encode[q[c]];
+        }
+        a.swap(b);
+    }
+}
+
+
+unsigned char *MipChain::allocate(const std::vector<MipLevel> &layout, int channels, unsigned format)
+{
+    release();
+    components = channels;
+    block_format = format;
+    level_list = layout;
+
+    size_t total = 0;
+    for (const MipLevel &l : level_list)
+        total += l.size;
+    storage.resize(total);
+    size_t offset = 0;
+    for (MipLevel &l : level_list)
+    {
+        l.data = storage.data() + offset;
+        offset += l.size;
+    }
+    return storage.data();
+}
+
+
+bool MipChain::load(const std::string &path)
+{
+    release();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(MipHeader))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    map = p;
+    map_size = st.st_size;
+
+    // Validate everything before handing out pointers into the file.
+    const unsigned char *base = (const unsigned char *)map;
+    MipHeader h;
+    memcpy(&h, base, sizeof(h));
+    size_t table_end = sizeof(MipHeader) + (size_t)h.levels * sizeof(MipEntry);
+    if (memcmp(h.magic, mip_magic, 4) != 0 || h.version != mip_version ||
+        h.channels < 1 || h.channels > 4 || h.levels == 0 || h.levels > 32 || table_end > map_size)
+    {
+        release();
+        return false;
+    }
+
+    components = h.channels;
+    block_format = h.format;
+    for (uint32_t i = 0; i < h.levels; i++)
+    {
+        MipEntry e;
+        memcpy(&e, base + sizeof(MipHeader) + i * sizeof(MipEntry), sizeof(e));
+        if (e.offset > map_size || e.size > map_size - e.offset || e.size == 0 ||
+            (!h.format && e.size != (uint64_t)e.width * e.height * h.channels))
+        {
+            release();
+            return false;
+        }
+        level_list.push_back({(int)e.width, (int)e.height, base + e.offset, (size_t)e.size});
+    }
+    return true;
+}
+
+
+bool MipChain::save(const std::string &path) const
+{
+    if (level_list.empty())
+        return false;
+
+    MipHeader h;
+    memcpy(h.magic, mip_magic, 4);
+    h.version = mip_version;
+    h.width = level_list[0].width;
+    h.height = level_list[0].height;
+    h.channels = components;
+    h.levels = level_list.size();
+    h.format = block_format;
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    out.write((const char *)&h, sizeof(h));
+    uint64_t offset = sizeof(MipHeader) + level_list.size() * sizeof(MipEntry);
+    for (const MipLevel &l : level_list)
+    {
+        MipEntry e = {(uint32_t)l.width, (uint32_t)l.height, offset, l.size};
+        out.write((const char *)&e, sizeof(e));
+        offset += l.size;
+    }
+    for (const MipLevel &l : level_list)
+        out.write((const char *)l.data, l.size);
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+void MipChain::release()
+{
+    if (map)
+        munmap(map, map_size);
+    map = nullptr;
+    map_size = 0;
+    storage.clear();
+    storage.shrink_to_fit();
+    level_list.clear();
+    components = 0;
+    block_format = 0;
+}
+
+
+void MipChain::swap(MipChain &other)
+{
+    storage.swap(other.storage);
+    std::swap(map, other.map);
+    std::swap(map_size, other.map_size);
+    level_list.swap(other.level_list);
+    std::swap(components, other.components);
+    std::swap(block_format, other.block_format);
+}
+
+
+float srgbToLinear(unsigned char c)
+{
+    return srgbTables().decode[c];
+}
+
+
+unsigned char linearToSrgb(float l)
+{
+    return srgbTables().encode[(int)std::lround(std::min(std::max(l, 0.0f), 1.0f) * (encode_steps - 1))];
+}
+
+
+std::string mipCacheDir()
+{
+    return cacheDir("mips");
+}
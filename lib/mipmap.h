@@ -0,0 +1,134 @@
+/**
+ * @file mipmap.h
+ * CPU mipmap generation and mip chain container.
+ *
+ * Builds every mip level of an 8-bit image on the CPU with a 2x2 box
+ * filter (SSE). Color channels are treated as sRGB: they are converted to
+ * linear light, averaged and converted back, so dark and bright texels mix
+ * as they do on screen (glGenerateMipmap averages the encoded values, which
+ * darkens high-contrast textures). Alpha is averaged as is.
+ *
+ * A chain can be saved to a compact container (header, level table, raw
+ * levels) and later mapped with mmap, so the levels are uploaded straight
+ * from the page cache without decoding the source image again. The same
+ * container holds block-compressed chains (see texture_compress.h); those
+ * are tagged with their GL internal format.
+ */
+
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/** One mip level (tightly packed rows, or 4x4 blocks if compressed). */
+struct MipLevel
+{
+    int width, height;
+    const unsigned char *data;
+    size_t size;
+};
+
+
+/**
+ * Mip chain of an 8-bit image with 1 to 4 channels.
+ */
+class MipChain
+{
+public:
+    MipChain() = default;
+    MipChain(const MipChain &) = delete;
+    MipChain &operator=(const MipChain &) = delete;
+    ~MipChain() { release(); }
+
+    /**
+     * Build all levels.
+     *
+     * @param pixels Level 0 (copied).
+     * @param width Width in pixels.
+     * @param height Height in pixels.
+     * @param channels Channels per pixel (1 to 4); the last channel of 2 and
+     *                 4 channel images is alpha.
+     * @param srgb Filter color channels in linear light.
+     */
+    void build(const unsigned char *, int, int, int, bool = true);
+
+    /**
+     * Allocate empty levels.
+     *
+     * The levels are stored one after the other in a single buffer.
+     *
+     * @param layout Width, height and size of each level (data is ignored).
+     * @param channels Channels of the source image.
+     * @param format GL internal format of compressed levels (0 = raw pixels).
+     * @return Start of level 0, to be filled in by the caller.
+     */
+    unsigned char *allocate(const std::vector<MipLevel> &, int, unsigned = 0);
+
+    /**
+     * Map a container file.
+     *
+     * @param path Container written by save().
+     * @return False if the file is missing or invalid.
+     */
+    bool load(const std::string &);
+
+    /**
+     * Write a container file.
+     *
+     * Writes to a temporary file and renames it, so readers never see a
+     * partial file.
+     *
+     * @param path Destination.
+     * @return True on success.
+     */
+    bool save(const std::string &) const;
+
+    /**
+     * Free the levels (or unmap the file).
+     */
+    void release();
+
+    /** Exchange contents with another chain. */
+    void swap(MipChain &);
+
+    /** @return Channels per pixel. */
+    int channels() const { return components; }
+    /** @return GL internal format of compressed levels, 0 for raw pixels. */
+    unsigned format() const { return block_format; }
+    /** @return Number of levels (0 if empty). */
+    int levels() const { return (int)level_list.size(); }
+    /** @return Level i (0 is the full image). */
+    const MipLevel &level(int i) const { return level_list[i]; }
+    /** @return True if the levels come from a mapped file. */
+    bool mapped() const { return map != nullptr; }
+
+private:
+    /** Levels built in memory. */
+    std::vector<unsigned char> storage;
+    /** Mapped container. */
+    void *map = nullptr;
+    size_t map_size = 0;
+    std::vector<MipLevel> level_list;
+    int components = 0;
+    unsigned block_format = 0;
+};
+
+
+/** @return 8-bit sRGB value in linear light (0 to 1). */
+float srgbToLinear(unsigned char);
+
+/** @return Linear value (0 to 1) encoded as 8-bit sRGB. */
+unsigned char linearToSrgb(float);
+
+
+/**
+ * Mip container directory.
+ *
+ * @return $XDG_CACHE_HOME/cg2025/mips (or ~/.cache/...).
+ */
+std::string mipCacheDir();
+
+#endif
@@ -0,0 +1,613 @@
+/**
+ * @file profiler.cpp
+ * Frame profiler.
+ *
+ * Implements the profiler declared in profiler.h.
+ */
+
+#include "profiler.h"
+#include "batch2d.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+
+namespace
+{
+
+/** Frames averaged by the overlay. */
+const int overlay_frames = 60;
+/** Frames in the overlay graph. */
+const int graph_frames = 120;
+/** Screen pixels per font pixel. */
+const float text_scale = 2.0f;
+
+/** Glyph of the 5x7 overlay font: 5 columns, bit 0 at the top. */
+struct Glyph
+{
+    char c;
+    unsigned char columns[5];
+};
+
+const Glyph font[] = {
+    {'0', {0x3E, 0x51, 0x49, 0x45, 0x3E}}, {'1', {0x00, 0x42, 0x7F, 0x40, 0x00}},
+    {'2', {0x42, 0x61, 0x51, 0x49, 0x46}}, {'3', {0x21, 0x41, 0x45, 0x4B, 0x31}},
+    {'4', {0x18, 0x14, 0x12, 0x7F, 0x10}}, {'5', {0x27, 0x45, 0x45, 0x45, 0x39}},
+    {'6', {0x3C, 0x4A, 0x49, 0x49, 0x30}}, {'7', {0x01, 0x71, 0x09, 0x05, 0x03}},
+    {'8', {0x36, 0x49, 0x49, 0x49, 0x36}}, {'9', {0x06, 0x49, 0x49, 0x29, 0x1E}},
+    {'A', {0x7E, 0x11, 0x11, 0x11, 0x7E}}, {'B', {0x7F, 0x49, 0x49, 0x49, 0x36}},
+    {'C', {0x3E, 0x41, 0x41, 0x41, 0x22}}, {'D', {0x7F, 0x41, 0x41, 0x22, 0x1C}},
+    {'E', {0x7F, 0x49, 0x49, 0x49, 0x41}}, {'F', {0x7F, 0x09, 0x09, 0x09, 0x01}},
+    {'G', {0x3E, 0x41, 0x49, 0x49, 0x7A}}, {'H', {0x7F, 0x08, 0x08, 0x08, 0x7F}},
+    {'I', {0x00, 0x41, 0x7F, 0x41, 0x00}}, {'J', {0x20, 0x40, 0x41, 0x3F, 0x01}},
+    {'K', {0x7F, 0x08, 0x14, 0x22, 0x41}}, {'L', {0x7F, 0x40, 0x40, 0x40, 0x40}},
+    {'M', {0x7F, 0x02, 0x0C, 0x02, 0x7F}}, {'N', {0x7F, 0x04, 0x08, 0x10, 0x7F}},
+    {'O', {0x3E, 0x41, 0x41, 0x41, 0x3E}}, {'P', {0x7F, 0x09, 0x09, 0x09, 0x06}},
+    {'Q', {0x3E, 0x41, 0x51, 0x21, 0x5E}}, {'R', {0x7F, 0x09, 0x19, 0x29, 0x46}},
+    {'S', {0x46, 0x49, 0x49, 0x49, 0x31}}, {'T', {0x01, 0x01, 0x7F, 0x01, 0x01}},
+    {'U', {0x3F, 0x40, 0x40, 0x40, 0x3F}}, {'V', {0x1F, 0x20, 0x40, 0x20, 0x1F}},
+    {'W', {0x3F, 0x40, 0x38, 0x40, 0x3F}}, {'X', {0x63, 0x14, 0x08, 0x14, 0x63}},
+    {'Y', {0x07, 0x08, 0x70, 0x08, 0x07}}, {'Z', {0x61, 0x51, 0x49, 0x45, 0x43}},
+    {'.', {0x00, 0x60, 0x60, 0x00, 0x00}}, {',', {0x00, 0x50, 0x30, 0x00, 0x00}},
+    {':', {0x00, 0x36, 0x36, 0x00, 0x00}}, {'-', {0x08, 0x08, 0x08, 0x08, 0x08}},
+    {'_', {0x40, 0x40, 0x40, 0x40, 0x40}}, {'=', {0x14, 0x14, 0x14, 0x14, 0x14}},
+    {'/', {0x20, 0x10, 0x08, 0x04, 0x02}}, {'%', {0x23, 0x13, 0x08, 0x64, 0x62}},
+    {'(', {0x00, 0x1C, 0x22, 0x41, 0x00}}, {')', {0x00, 0x41, 0x22, 0x1C, 0x00}},
+};
+
+const char *counter_names[PROFILE_COUNTERS] = {"draw_calls", "triangles", "uniform_uploads", "buffer_bytes"};
+
+
+/** Value at fraction q of sorted values. */
+double percentile(std::vector<double> v, double q)
+{
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(q * v.size()))];
+}
+
+
+double mean(const std::vector<double> &v)
+{
+    double sum = 0.0;
+    for (double x : v)
+        sum += x;
+    return v.empty() ? 0.0 : sum / v.size();
+}
+
+
+std::string jsonString(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            c = ' ';
+        out += c;
+    }
+    return out + "\"";
+}
+
+
+std::string csvString(const std::string &s)
+{
+    if (s.find_first_of(",\"\n") == std::string::npos)
+        return s;
+    std::string out = "\"";
+    for (char c : s)
+        out += c == '"' ? std::string("\"\"") : std::string(1, c);
+    return out + "\"";
+}
+
+
+std::string format(const char *fmt, double v)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), fmt, v);
+    return buf;
+}
+
+} // namespace
+
+
+Profiler::Profiler(int max_frames, int queries)
+    : max_frames(std::max(max_frames, 1)), query_count(queries), epoch(0.0)
+{
+    epoch = now();
+    setup.number = -1;
+    setup.start_ms = 0.0;
+
+    const char *path = getenv("CG_PROFILE");
+    if (path && *path)
+        output = path;
+}
+
+
+Profiler::~Profiler()
+{
+}
+
+
+double Profiler::now() const
+{
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(t).count() - epoch;
+}
+
+
+void Profiler::init()
+{
+    timer = GLEW_ARB_timer_query;
+    if (timer && free_queries.empty())
+    {
+        free_queries.resize(query_count);
+        glGenQueries(query_count, free_queries.data());
+    }
+}
+
+
+void Profiler::release()
+{
+    for (const Pending &p : pending)
+        free_queries.push_back(p.query);
+    pending.clear();
+    if (!free_queries.empty())
+        glDeleteQueries((GLsizei)free_queries.size(), free_queries.data());
+    free_queries.clear();
+    timer = false;
+
+    if (batch)
+    {
+        batch->release();
+        batch.reset();
+    }
+}
+
+
+int Profiler::intern(const char *name)
+{
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return (int)i;
+    names.push_back(name);
+    return (int)names.size() - 1;
+}
+
+
+Profiler::Frame &Profiler::current()
+{
+    return in_frame ? frames.back() : setup;
+}
+
+
+Profiler::Frame *Profiler::frame(long number)
+{
+    if (number < 0)
+        return &setup;
+    if (frames.empty() || number < frames.front().number || number > frames.back().number)
+        return nullptr;
+    return &frames[number - frames.front().number];
+}
+
+
+void Profiler::beginFrame()
+{
+    collect();
+
+    Frame f;
+    f.number = next_frame++;
+    f.start_ms = now();
+    frames.push_back(std::move(f));
+    if ((int)frames.size() > max_frames)
+        frames.pop_front();
+    in_frame = true;
+}
+
+
+void Profiler::endFrame()
+{
+    if (!in_frame)
+        return;
+    frames.back().cpu_ms = now() - frames.back().start_ms;
+    in_frame = false;
+    collect();
+}
+
+
+void Profiler::begin(const char *name, bool gpu)
+{
+    Frame &f = current();
+    f.events.push_back({intern(name), (int)open.size(), now(), 0.0, -1.0});
+
+    Open o = {f.events.size() - 1, 0};
+    GLint running = active_query;
+    if (gpu && timer && !running)
+        glGetQueryiv(GL_TIME_ELAPSED, GL_CURRENT_QUERY, &running);
+    if (gpu && timer && !running && !free_queries.empty())
+    {
+        o.query = free_queries.back();
+        free_queries.pop_back();
+        glBeginQuery(GL_TIME_ELAPSED, o.query);
+        active_query = o.query;
+    }
+    open.push_back(o);
+}
+
+
+void Profiler::end()
+{
+    if (open.empty())
+        return;
+    Open o = open.back();
+    open.pop_back();
+
+    Frame &f = current();
+    Event &e = f.events[o.event];
+    e.cpu_ms = now() - e.start_ms;
+    if (o.query)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        active_query = 0;
+        pending.push_back({o.query, f.number, o.event});
+        f.pending++;
+    }
+}
+
+
+void Profiler::collect()
+{
+    // Results arrive in submission order; stop at the first one not ready
+    while (!pending.empty())
+    {
+        Pending p = pending.front();
+        GLint available = 0;
+        glGetQueryObjectiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &ns);
+        if (Frame *f = frame(p.frame))
+        {
+            f->events[p.event].gpu_ms = ns / 1e6;
+            f->gpu_ms += ns / 1e6;
+            f->pending--;
+        }
+        free_queries.push_back(p.query);
+        pending.pop_front();
+    }
+}
+
+
+void Profiler::count(ProfileCounter counter, double amount)
+{
+    current().counters[counter] += amount;
+}
+
+
+void Profiler::countDraw(GLenum mode, GLsizei vertices, GLsizei instances)
+{
+    GLsizei triangles = 0;
+    switch (mode)
+    {
+    case GL_TRIANGLES:
+        triangles = vertices / 3;
+        break;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+        triangles = std::max(vertices - 2, 0);
+        break;
+    case GL_QUADS:
+        triangles = vertices / 4 * 2;
+        break;
+    }
+    Frame &f = current();
+    f.counters[PROFILE_DRAW_CALLS] += 1;
+    f.counters[PROFILE_TRIANGLES] += (double)triangles * instances;
+}
+
+
+void Profiler::rect(float x, float y, float w, float h)
+{
+    // Pixels from the top left corner to normalized device coordinates
+    float sx = 2.0f / viewport[2], sy = 2.0f / viewport[3];
+    float x0 = x * sx - 1.0f, x1 = (x + w) * sx - 1.0f;
+    float y0 = 1.0f - y * sy, y1 = 1.0f - (y + h) * sy;
+    batch->triangle(x0, y0, x1, y0, x1, y1);
+    batch->triangle(x0, y0, x1, y1, x0, y1);
+}
+
+
+void Profiler::drawText(float x, float y, const std::string &text)
+{
+    for (char c : text)
+    {
+        char u = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+        for (const Glyph &g : font)
+            if (g.c == u)
+            {
+                for (int col = 0; col < 5; col++)
+                    for (int row = 0; row < 7; row++)
+                        if (g.columns[col] >> row & 1)
+                            rect(x + col * text_scale, y + row * text_scale, text_scale, text_scale);
+                break;
+            }
+        x += 6 * text_scale;
+    }
+}
+
+
+void Profiler::drawOverlay()
+{
+    if (!overlay)
+        return;
+    if (!batch)
+    {
+        batch.reset(new Batch2D());
+        batch->init();
+    }
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] <= 0 || viewport[3] <= 0)
+        return;
+
+    // Average of the last frames whose GPU results are all in
+    std::vector<double> cpu, gpu;
+    double counters[PROFILE_COUNTERS] = {};
+    std::vector<double> scope_cpu(names.size(), 0.0), scope_gpu(names.size(), 0.0);
+    std::vector<bool> scope_timed(names.size(), false);
+    for (auto f = frames.rbegin(); f != frames.rend() && (int)cpu.size() < overlay_frames; ++f)
+    {
+        if (f->pending || (in_frame && &*f == &frames.back()))
+            continue;
+        cpu.push_back(f->cpu_ms);
+        gpu.push_back(f->gpu_ms);
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+            counters[c] += f->counters[c];
+        for (const Event &e : f->events)
+        {
+            scope_cpu[e.name] += e.cpu_ms;
+            if (e.gpu_ms >= 0.0)
+            {
+                scope_gpu[e.name] += e.gpu_ms;
+                scope_timed[e.name] = true;
+            }
+        }
+    }
+    double n = std::max<size_t>(cpu.size(), 1);
+
+    std::vector<std::string> lines;
+    lines.push_back("CPU " + format("%.2f", mean(cpu)) + " MS  GPU " + format("%.2f", mean(gpu)) + " MS");
+    lines.push_back("DRAWS " + format("%.0f", counters[PROFILE_DRAW_CALLS] / n) + "  TRIS " +
+                    format("%.0f", counters[PROFILE_TRIANGLES] / n));
+    lines.push_back("UNIFORMS " + format("%.0f", counters[PROFILE_UNIFORM_UPLOADS] / n) + "  BUFFERS " +
+                    format("%.1f", counters[PROFILE_BUFFER_BYTES] / n / 1024.0) + " KB");
+    if (!names.empty())
+        lines.push_back("SCOPES (CPU / GPU MS)");
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (scope_cpu[i] == 0.0 && !scope_timed[i])
+            continue;
+        std::string line = "  " + names[i] + " " + format("%.2f", scope_cpu[i] / n);
+        if (scope_timed[i])
+            line += " / " + format("%.2f", scope_gpu[i] / n);
+        lines.push_back(line);
+    }
+
+    // Panel, text, then the graph of frame times (line at 16.7 ms)
+    const float margin = 8.0f, line_height = 9 * text_scale, graph_height = 50.0f;
+    size_t columns = 0;
+    for (const std::string &l : lines)
+        columns = std::max(columns, l.size());
+    float width = std::max(columns * 6 * text_scale, (float)graph_frames * 2) + 2 * margin;
+    float height = lines.size() * line_height + graph_height + 3 * margin;
+
+    GLint program, vao, polygon_mode[2];
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+    GLboolean depth = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND), cull = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    batch->color(0.0f, 0.0f, 0.0f, 0.6f);
+    rect(0.0f, 0.0f, width, height);
+    batch->color(1.0f, 1.0f, 1.0f);
+    for (size_t i = 0; i < lines.size(); i++)
+        drawText(margin, margin + i * line_height, lines[i]);
+
+    float base = height - margin;
+    float ms_to_px = graph_height / 33.3f;
+    int first = std::max(0, (int)frames.size() - graph_frames - 1);
+    for (int i = first, x = 0; i < (int)frames.size() - 1; i++, x++)
+    {
+        const Frame &f = frames[i];
+        float h = std::min((float)f.cpu_ms * ms_to_px, graph_height);
+        batch->color(0.3f, 0.9f, 0.3f);
+        rect(margin + x * 2, base - h, 2, h);
+        if (!f.pending && f.gpu_ms > 0.0)
+        {
+            float g = std::min((float)f.gpu_ms * ms_to_px, graph_height);
+            batch->color(1.0f, 0.6f, 0.1f);
+            rect(margin + x * 2, base - g, 2, 2);
+        }
+    }
+    batch->color(1.0f, 1.0f, 1.0f, 0.5f);
+    rect(margin, base - 16.7f * ms_to_px, graph_frames * 2, 1);
+    batch->flush();
+
+    glPolygonMode(GL_FRONT_AND_BACK, polygon_mode[0]);
+    if (!blend)
+        glDisable(GL_BLEND);
+    if (cull)
+        glEnable(GL_CULL_FACE);
+    if (depth)
+        glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(vao);
+    glUseProgram(program);
+}
+
+
+bool Profiler::writeCsv(const std::string &path) const
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "frame,start_ms,cpu_ms,gpu_ms");
+    for (const char *c : counter_names)
+        fprintf(f, ",%s", c);
+    for (const std::string &n : names)
+        fprintf(f, ",%s,%s", csvString(n + " cpu_ms").c_str(), csvString(n + " gpu_ms").c_str());
+    fprintf(f, "\n");
+
+    auto row = [&](const Frame &fr) {
+        if (fr.number < 0)
+            fprintf(f, "setup,0,,");
+        else
+        {
+            fprintf(f, "%ld,%.4f,%.4f,", fr.number, fr.start_ms, fr.cpu_ms);
+            if (!fr.pending && fr.gpu_ms > 0.0)
+                fprintf(f, "%.4f", fr.gpu_ms);
+        }
+        for (double c : fr.counters)
+            fprintf(f, ",%.0f", c);
+
+        std::vector<double> cpu(names.size(), -1.0), gpu(names.size(), -1.0);
+        for (const Event &e : fr.events)
+        {
+            cpu[e.name] = std::max(cpu[e.name], 0.0) + e.cpu_ms;
+            if (e.gpu_ms >= 0.0)
+                gpu[e.name] = std::max(gpu[e.name], 0.0) + e.gpu_ms;
+        }
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            fprintf(f, ",");
+            if (cpu[i] >= 0.0)
+                fprintf(f, "%.4f", cpu[i]);
+            fprintf(f, ",");
+            if (gpu[i] >= 0.0)
+                fprintf(f, "%.4f", gpu[i]);
+        }
+        fprintf(f, "\n");
+    };
+
+    if (!setup.events.empty())
+        row(setup);
+    for (const Frame &fr : frames)
+        if (&fr != &frames.back() || !in_frame)
+            row(fr);
+    return fclose(f) == 0;
+}
+
+
+bool Profiler::writeChromeTrace(const std::string &path) const
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+    auto span = [&](const std::string &name, int tid, double start, double dur) {
+        fprintf(f, ",\n{\"name\":%s,\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                jsonString(name).c_str(), tid, start * 1000.0, dur * 1000.0);
+    };
+    auto events = [&](const Frame &fr) {
+        for (const Event &e : fr.events)
+        {
+            span(names[e.name], 1, e.start_ms, e.cpu_ms);
+            if (e.gpu_ms >= 0.0)
+                span(names[e.name], 2, e.start_ms, e.gpu_ms);
+        }
+    };
+
+    events(setup);
+    for (const Frame &fr : frames)
+    {
+        if (&fr == &frames.back() && in_frame)
+            break;
+        span("frame " + std::to_string(fr.number), 1, fr.start_ms, fr.cpu_ms);
+        events(fr);
+        fprintf(f, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", fr.start_ms * 1000.0);
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+            fprintf(f, "%s\"%s\":%.0f", c ? "," : "", counter_names[c], fr.counters[c]);
+        fprintf(f, "}}");
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+
+bool Profiler::save() const
+{
+    if (output.empty())
+        return true;
+    bool json = output.size() >= 5 && output.compare(output.size() - 5, 5, ".json") == 0;
+    bool ok = json ? writeChromeTrace(output) : writeCsv(output);
+    if (ok)
+        std::cout << "Profile written to " << output << std::endl;
+    else
+        std::cerr << "Cannot write profile to " << output << std::endl;
+    return ok;
+}
+
+
+void Profiler::printStats() const
+{
+    std::vector<double> cpu, gpu;
+    std::vector<double> scope_cpu(names.size(), 0.0), scope_gpu(names.size(), 0.0);
+    std::vector<int> scope_frames(names.size(), 0), scope_timed(names.size(), 0);
+    for (const Frame &fr : frames)
+    {
+        if (&fr == &frames.back() && in_frame)
+            break;
+        cpu.push_back(fr.cpu_ms);
+        if (!fr.pending && fr.gpu_ms > 0.0)
+            gpu.push_back(fr.gpu_ms);
+        std::vector<bool> seen(names.size(), false), timed(names.size(), false);
+        for (const Event &e : fr.events)
+        {
+            scope_cpu[e.name] += e.cpu_ms;
+            seen[e.name] = true;
+            if (e.gpu_ms >= 0.0)
+            {
+                scope_gpu[e.name] += e.gpu_ms;
+                timed[e.name] = true;
+            }
+        }
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            scope_frames[i] += seen[i];
+            scope_timed[i] += timed[i];
+        }
+    }
+
+    std::cout << "Profile: " << cpu.size() << " frame(s), CPU mean " << mean(cpu) << " ms, median "
+              << percentile(cpu, 0.5) << " ms, p95 " << percentile(cpu, 0.95) << " ms";
+    if (!gpu.empty())
+        std::cout << "; GPU mean " << mean(gpu) << " ms, median " << percentile(gpu, 0.5) << " ms, p95 "
+                  << percentile(gpu, 0.95) << " ms";
+    std::cout << std::endl;
+
+    for (const Event &e : setup.events)
+        std::cout << "  " << std::string(e.depth * 2, ' ') << names[e.name] << ": " << e.cpu_ms << " ms"
+                  << (e.gpu_ms >= 0.0 ? " (GPU " + format("%.3f", e.gpu_ms) + " ms)" : std::string()) << std::endl;
+    for (size_t i = 0; i < names.size(); i++)
+        if (scope_frames[i])
+        {
+            std::cout << "  " << names[i] << " per frame: CPU " << scope_cpu[i] / scope_frames[i] << " ms";
+            if (scope_timed[i])
+                std::cout << ", GPU " << scope_gpu[i] / scope_timed[i] << " ms";
+            std::cout << std::endl;
+        }
+}
@@ -0,0 +1,258 @@
+/**
+ * @file profiler.h
+ * Frame profiler.
+ *
+ * Measures what a frame costs: scoped CPU timers, GPU timers and per-frame
+ * counters (draw calls, triangles, uniform uploads, buffer bytes), shown
+ * as a text overlay and written to CSV or Chrome trace JSON (load the file
+ * in chrome://tracing or ui.perfetto.dev).
+ *
+ * GPU timers are GL_TIME_ELAPSED queries taken from a ring; results are
+ * collected when the driver reports them available, a few frames later,
+ * so reading them never stalls the pipeline. When every query is in
+ * flight the scope is simply not timed on the GPU. Elapsed-time queries
+ * cannot nest: a GPU scope opened inside another one, or while someone
+ * else's elapsed-time query runs (the frame timer of headless.h), is timed
+ * on the CPU only. The GPU time of a frame is the sum of its GPU scopes.
+ *
+ * Scopes outside beginFrame()/endFrame() (model loading, uploads at
+ * startup) are kept in a separate "setup" record.
+ *
+ * All methods must be called from the GL thread.
+ *
+ * Typical use:
+ *   profiler.beginFrame();
+ *   {
+ *       ProfileScope scope(profiler, "draw", true);   // CPU and GPU
+ *       glDrawArrays(GL_TRIANGLES, 0, n);
+ *       profiler.countDraw(GL_TRIANGLES, n);
+ *   }
+ *   profiler.endFrame();
+ *   profiler.drawOverlay();
+ *
+ * Setting CG_PROFILE=file.csv (or file.json) makes save() write there.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+class Batch2D;
+
+
+/** Per-frame counters. */
+enum ProfileCounter
+{
+    PROFILE_DRAW_CALLS,
+    PROFILE_TRIANGLES,
+    PROFILE_UNIFORM_UPLOADS,
+    PROFILE_BUFFER_BYTES,
+    PROFILE_COUNTERS
+};
+
+
+/**
+ * Frame profiler.
+ */
+class Profiler
+{
+public:
+    /**
+     * Constructor.
+     *
+     * Does not touch GL; queries are created by init().
+     *
+     * @param max_frames Frames kept for export (older ones are dropped).
+     * @param queries GPU queries in the ring.
+     */
+    explicit Profiler(int = 36000, int = 64);
+    ~Profiler();
+
+    /**
+     * Create the GPU queries (needs a GL context).
+     *
+     * Without ARB_timer_query only CPU times are measured.
+     */
+    void init();
+
+    /** Delete queries and overlay resources. */
+    void release();
+
+    /** Start a frame. */
+    void beginFrame();
+    /** End the frame and collect GPU results that became available. */
+    void endFrame();
+
+    /**
+     * Open a scope.
+     *
+     * @param name Scope name.
+     * @param gpu Also time the GL commands issued inside it.
+     */
+    void begin(const char *, bool = false);
+    /** Close the innermost scope. */
+    void end();
+
+    /**
+     * Add to a counter of the current frame.
+     *
+     * @param counter Counter.
+     * @param amount Amount.
+     */
+    void count(ProfileCounter, double = 1.0);
+
+    /**
+     * Count a draw call and its triangles.
+     *
+     * @param mode Primitive mode.
+     * @param vertices Vertices drawn.
+     * @param instances Instances drawn.
+     */
+    void countDraw(GLenum, GLsizei, GLsizei = 1);
+
+    /** Show or hide the overlay. */
+    void setOverlay(bool on) { overlay = on; }
+    /** @return True if the overlay is shown. */
+    bool overlayVisible() const { return overlay; }
+
+    /**
+     * Draw the overlay in the top left corner of the viewport.
+     *
+     * Averages of the last frames with complete GPU results, the counters,
+     * the scopes and a graph of frame times. Does nothing while hidden.
+     */
+    void drawOverlay();
+
+    /**
+     * Write frames as CSV.
+     *
+     * One row per frame: times, counters and the CPU and GPU time of each
+     * scope name; a "setup" row holds the scopes outside frames.
+     *
+     * @param path File.
+     * @return False if the file cannot be written.
+     */
+    bool writeCsv(const std::string &) const;
+
+    /**
+     * Write frames as Chrome trace JSON.
+     *
+     * Frames and CPU scopes on one track, GPU scopes on another (placed at
+     * the time they were submitted), counters as counter tracks.
+     *
+     * @param path File.
+     * @return False if the file cannot be written.
+     */
+    bool writeChromeTrace(const std::string &) const;
+
+    /**
+     * Write to the CG_PROFILE file, if set (.json: Chrome trace, CSV
+     * otherwise).
+     *
+     * @return False if writing failed.
+     */
+    bool save() const;
+
+    /** Print a summary of the frames (mean, median, 95th percentile). */
+    void printStats() const;
+
+private:
+    /** One scope occurrence. */
+    struct Event
+    {
+        int name;
+        int depth;
+        double start_ms;
+        double cpu_ms;
+        /** Negative until (or unless) the GPU result arrives. */
+        double gpu_ms;
+    };
+
+    /** One frame (or the setup record). */
+    struct Frame
+    {
+        long number;
+        double start_ms;
+        double cpu_ms = 0.0;
+        double gpu_ms = 0.0;
+        /** GPU results still in flight. */
+        int pending = 0;
+        double counters[PROFILE_COUNTERS] = {};
+        std::vector<Event> events;
+    };
+
+    /** Query in flight. */
+    struct Pending
+    {
+        GLuint query;
+        long frame;
+        size_t event;
+    };
+
+    /** Open scope. */
+    struct Open
+    {
+        size_t event;
+        GLuint query;
+    };
+
+    int max_frames;
+    int query_count;
+    double epoch;
+    bool timer = false;
+    bool overlay = false;
+    std::string output;
+
+    std::vector<std::string> names;
+    Frame setup;
+    std::deque<Frame> frames;
+    bool in_frame = false;
+    long next_frame = 0;
+
+    std::vector<GLuint> free_queries;
+    std::deque<Pending> pending;
+    std::vector<Open> open;
+    GLuint active_query = 0;
+
+    std::unique_ptr<Batch2D> batch;
+    GLint viewport[4] = {0, 0, 0, 0};
+
+    double now() const;
+    int intern(const char *);
+    Frame &current();
+    Frame *frame(long);
+    void collect();
+    void drawText(float, float, const std::string &);
+    void rect(float, float, float, float);
+};
+
+
+/**
+ * Scope timer: begin() on construction, end() on destruction.
+ */
+class ProfileScope
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param profiler Profiler.
+     * @param name Scope name.
+     * @param gpu Also time on the GPU.
+     */
+    ProfileScope(Profiler &p, const char *name, bool gpu = false) : profiler(p) { profiler.begin(name, gpu); }
+    ~ProfileScope() { profiler.end(); }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    Profiler &profiler;
+};
+
+#endif
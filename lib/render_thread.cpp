@@ -0,0 +1,341 @@
+/**
+ * @file render_thread.cpp
+ * Rendering on a thread of its own.
+ *
+ * Implements the render thread declared in render_thread.h.
+ */
+
+#include "render_thread.h"
+#include "spsc_queue.h"
+#include "trace.h"
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <GL/glx.h>
+#include <X11/Xlib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+namespace
+{
+
+/** Event handed from the GLUT thread to the render thread. */
+struct Command
+{
+    enum Kind { KEY, SPECIAL, MOUSE, MOTION, RESHAPE, REDISPLAY } kind;
+    int a, b;
+    int x, y;
+};
+
+/** Commands the GLUT thread can get ahead of the render thread. */
+const size_t queue_capacity = 1024;
+/** How often the GLUT thread checks whether the render thread asked to quit. */
+const unsigned quit_poll_ms = 50;
+
+bool requested = false;
+std::atomic<bool> active(false);
+HeadlessCallbacks app;
+
+SpscQueue<Command, queue_capacity> queue;
+/** Never deleted: exit() must not destroy a thread that is still running. */
+std::thread *thread = nullptr;
+std::mutex mutex;
+std::condition_variable wake;
+bool signalled = false;
+bool stopping = false;
+/** Set by leaveMainLoop() on the render thread, seen by the GLUT thread. */
+std::atomic<bool> quit(false);
+
+Display *x_display = nullptr;
+GLXDrawable drawable = 0;
+GLXContext context = nullptr;
+
+/** Render thread only (read by the GLUT thread after the join). */
+bool redraw = false;
+long frames = 0;
+long executed = 0;
+/** GLUT thread only. */
+long queued = 0;
+long dropped = 0;
+
+
+[[noreturn]] void fail(const std::string &message)
+{
+    std::cerr << "Render thread: " << message << std::endl;
+    exit(1);
+}
+
+
+/** Queue a command and wake the render thread (GLUT thread). */
+void send(const Command &command)
+{
+    while (!queue.push(command))
+    {
+        // A later motion event supersedes this one; anything else must arrive
+        if (command.kind == Command::MOTION)
+        {
+            dropped++;
+            return;
+        }
+        std::this_thread::yield();
+    }
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        signalled = true;
+    }
+    wake.notify_one();
+}
+
+
+void display()
+{
+    send({Command::REDISPLAY, 0, 0, 0, 0});
+}
+
+
+void reshape(int w, int h)
+{
+    send({Command::RESHAPE, 0, 0, w, h});
+}
+
+
+void keyboard(unsigned char key, int x, int y)
+{
+    send({Command::KEY, key, 0, x, y});
+}
+
+
+void special(int key, int x, int y)
+{
+    send({Command::SPECIAL, key, 0, x, y});
+}
+
+
+void mouse(int button, int state, int x, int y)
+{
+    send({Command::MOUSE, button, state, x, y});
+}
+
+
+void motion(int x, int y)
+{
+    send({Command::MOTION, 0, 0, x, y});
+}
+
+
+/* Display functions of the render thread */
+
+void swap()
+{
+    glXSwapBuffers(x_display, drawable);
+}
+
+
+void redisplay()
+{
+    redraw = true;
+}
+
+
+void leave()
+{
+    quit = true;
+}
+
+const DisplayRedirect redirect = {swap, redisplay, leave};
+
+
+void execute(const Command &c)
+{
+    switch (c.kind)
+    {
+    case Command::KEY:
+        app.keyboard((unsigned char)c.a, c.x, c.y);
+        break;
+    case Command::SPECIAL:
+        app.special(c.a, c.x, c.y);
+        break;
+    case Command::MOUSE:
+        app.mouse(c.a, c.b, c.x, c.y);
+        break;
+    case Command::MOTION:
+        app.motion(c.x, c.y);
+        break;
+    case Command::RESHAPE:
+        if (app.reshape)
+            app.reshape(c.x, c.y);
+        else
+            glViewport(0, 0, c.x, c.y);
+        redraw = true;
+        break;
+    case Command::REDISPLAY:
+        redraw = true;
+        break;
+    }
+    executed++;
+}
+
+
+void run()
+{
+    traceThreadName("render thread");
+    if (!glXMakeCurrent(x_display, drawable, context))
+        fail("cannot make the context current");
+    redirectDisplay(&redirect);
+
+    while (true)
+    {
+        {
+            // Sleep only when no frame is due
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!redraw)
+                wake.wait(lock, [] { return signalled || stopping; });
+            signalled = false;
+            if (stopping)
+                break;
+        }
+
+        Command c;
+        while (queue.pop(c))
+            execute(c);
+
+        if (quit)
+            redraw = false;
+        if (redraw)
+        {
+            redraw = false;
+            app.display();
+            frames++;
+            if (app.idle)
+                app.idle();
+        }
+    }
+
+    redirectDisplay(nullptr);
+    glXMakeCurrent(x_display, None, NULL);
+}
+
+
+/** Join the render thread and take the context back (GLUT thread). */
+void stop()
+{
+    if (!active)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread->join();
+    active = false;
+    glXMakeCurrent(x_display, drawable, context);
+}
+
+
+void poll(int)
+{
+    if (!active)
+        return;
+    if (quit)
+    {
+        stop();
+        glutLeaveMainLoop();
+        return;
+    }
+    glutTimerFunc(quit_poll_ms, poll, 0);
+}
+
+}
+
+
+bool renderThreadInit(int &argc, char **argv)
+{
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--render-thread")
+            requested = true;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    argv[argc] = NULL;
+
+    // Both threads talk to the X server (events here, swaps there)
+    if (requested)
+        XInitThreads();
+    return requested;
+}
+
+
+bool renderThreadActive()
+{
+    return active;
+}
+
+
+HeadlessCallbacks renderThreadWrap(const HeadlessCallbacks &callbacks)
+{
+    if (!requested || headless())
+        return callbacks;
+
+    app = callbacks;
+    HeadlessCallbacks wrapped = callbacks;
+    wrapped.display = display;
+    wrapped.idle = nullptr;
+    wrapped.reshape = reshape;
+    if (callbacks.keyboard)
+        wrapped.keyboard = keyboard;
+    if (callbacks.special)
+        wrapped.special = special;
+    if (callbacks.mouse)
+        wrapped.mouse = mouse;
+    if (callbacks.motion)
+        wrapped.motion = motion;
+    return wrapped;
+}
+
+
+void renderThreadStart()
+{
+    if (!requested)
+        return;
+    if (headless())
+    {
+        std::cout << "Render thread: ignored when headless" << std::endl;
+        return;
+    }
+
+    x_display = glXGetCurrentDisplay();
+    drawable = glXGetCurrentDrawable();
+    context = glXGetCurrentContext();
+    if (!x_display || !context)
+        fail("no current GLX context (the window must be created first)");
+    glXMakeCurrent(x_display, None, NULL);
+
+    // The thread must be stopped before GLUT destroys the window
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+    glutCloseFunc(stop);
+    glutTimerFunc(quit_poll_ms, poll, 0);
+
+    active = true;
+    thread = new std::thread(run);
+    std::cout << "Render thread: started" << std::endl;
+}
+
+
+void renderThreadPrintStats()
+{
+    if (!requested || headless())
+        return;
+    std::cout << "Render thread: " << frames << " frame(s), " << executed << " of " << queued
+              << " command(s) executed, " << dropped << " motion event(s) dropped" << std::endl;
+}
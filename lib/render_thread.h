@@ -0,0 +1,80 @@
+/**
+ * @file render_thread.h
+ * Rendering on a thread of its own.
+ *
+ * Normally the GLUT thread handles input, runs the demo's callbacks and
+ * draws, so a slow callback delays the next frame and a slow frame delays
+ * input. With "--render-thread" on the command line a dedicated thread
+ * takes over the GL context after the setup: the GLUT callbacks only turn
+ * events (keys, mouse, motion, reshape, redisplay requests) into commands
+ * pushed to a lock-free queue (spsc_queue.h), and the render thread drains
+ * the queue, runs the demo's callbacks with the commands and draws. All
+ * demo state is then touched by the render thread only, so the callbacks
+ * need no locking.
+ *
+ * On the render thread swapBuffers(), postRedisplay() and leaveMainLoop()
+ * (headless.h) swap the window directly, request another frame from the
+ * render thread and stop GLUT, without calling GLUT from the wrong thread.
+ * The idle callback runs on the render thread after each frame. Motion
+ * commands are dropped (and counted) if the queue is full; other commands
+ * wait for room.
+ *
+ * The window is a GLX window (Xlib is switched to thread-safe mode by
+ * renderThreadInit(), before glutInit()). When rendering headless the
+ * option is ignored: the frame loop already runs on one thread.
+ *
+ * A demo uses it like this:
+ *   renderThreadInit(argc, argv);   // before glutInit()
+ *   ... create the window, compile shaders, load the model ...
+ *   HeadlessCallbacks callbacks = renderThreadWrap({display, idle, reshape, keyboard, special, mouse, motion});
+ *   glutDisplayFunc(callbacks.display); ...
+ *   renderThreadStart();   // hands the context to the render thread
+ *   glutMainLoop();
+ *
+ * When the main loop ends (leaveMainLoop() or closing the window) the
+ * render thread is stopped first and the context is current on the GLUT
+ * thread again.
+ */
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "headless.h"
+
+
+/**
+ * Parse "--render-thread" (removed from argv).
+ *
+ * @param argc Argument count (updated).
+ * @param argv Arguments (updated).
+ * @return True if a render thread was requested.
+ */
+bool renderThreadInit(int &, char **);
+
+/** @return True while the render thread owns the context. */
+bool renderThreadActive();
+
+/**
+ * Wrap the demo callbacks.
+ *
+ * The returned callbacks push commands for the render thread and must be
+ * the ones given to GLUT. Without "--render-thread", or when headless, the
+ * callbacks are returned unchanged.
+ *
+ * @param callbacks Demo callbacks.
+ * @return Callbacks to register.
+ */
+HeadlessCallbacks renderThreadWrap(const HeadlessCallbacks &);
+
+/**
+ * Start the render thread, if requested (before glutMainLoop()).
+ *
+ * Releases the context on the calling thread, which must not use GL
+ * afterwards, and sets GLUT to return from glutMainLoop() on exit.
+ */
+void renderThreadStart();
+
+/** Print frames drawn and commands executed, queued and dropped. */
+void renderThreadPrintStats();
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file scanline.cpp
+ * Scanline polygon filling.
+ *
+ * Implements the filler declared in scanline.h.
+ */
+
+#include "scanline.h"
+#include "job_system.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+/** Minimum rows per band; smaller bands are not worth a job. */
+static const int min_band_rows = 64;
+
+
+void ScanlineFiller::clear()
+{
+    edges.clear();
+    sorted = true;
+}
+
+
+void ScanlineFiller::addRing(const float *xy, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int j = (i + 1) % n;
+        float xa = xy[2*i], ya = xy[2*i+1];
+        float xb = xy[2*j], yb = xy[2*j+1];
+        if (ya == yb)
+            continue;
+
+        Edge e;
+        e.dir = yb > ya ? 1 : -1;
+        if (yb < ya)
+        {
+            std::swap(xa, xb);
+            std::swap(ya, yb);
+        }
+        // Rows whose center lies in [ya, yb).
+        e.y0 = (int)std::ceil(ya - 0.5);
+        e.y1 = (int)std::ceil(yb - 0.5);
+        if (e.y0 >= e.y1)
+            continue;
+        e.dxdy = (double)(xb - xa) / (yb - ya);
+        e.x = xa + (e.y0 + 0.5 - ya) * e.dxdy;
+        edges.push_back(e);
+        sorted = false;
+    }
+}
+
+
+/**
+ * Sort the edge table by first row.
+ */
+void ScanlineFiller::sortEdges()
+{
+    if (!sorted)
+        std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.y0 < b.y0; });
+    sorted = true;
+}
+
+
+/**
+ * Scan a band of rows.
+ *
+ * Starts the active edge list at row ya (edges that began below are
+ * advanced to it) and then updates it incrementally row by row.
+ *
+ * @param ya First row.
+ * @param yb Row after the last one.
+ * @param width Clip width.
+ * @param rule Fill rule.
+ * @param act Active edge list to use.
+ * @param emit Called as emit(y, x0, x1) for each span.
+ */
+template <class Emit>
+void ScanlineFiller::scan(int ya, int yb, int width, FillRule rule, std::vector<Edge> &act, Emit emit) const
+{
+    act.clear();
+    auto it = std::lower_bound(edges.begin(), edges.end(), ya,
+                               [](const Edge &e, int y) { return e.y0 < y; });
+    for (auto e = edges.begin(); e != it; ++e)
+        if (e->y1 > ya)
+        {
+            act.push_back(*e);
+            act.back().x += (ya - e->y0) * e->dxdy;
+        }
+
+    auto span = [&](int y, double xa, double xb) {
+        int x0 = std::max(0, (int)std::ceil(xa - 0.5));
+        int x1 = std::min(width, (int)std::ceil(xb - 0.5));
+        if (x0 < x1)
+            emit(y, x0, x1);
+    };
+
+    for (int y = ya; y < yb; y++)
+    {
+        for (; it != edges.end() && it->y0 == y; ++it)
+            act.push_back(*it);
+
+        // Drop finished edges, then restore x order. Edges rarely cross, so
+        // insertion sort is close to linear.
+        size_t n = 0;
+        for (size_t i = 0; i < act.size(); i++)
+            if (act[i].y1 > y)
+                act[n++] = act[i];
+        act.resize(n);
+        for (size_t i = 1; i < n; i++)
+        {
+            Edge e = act[i];
+            size_t j = i;
+            for (; j > 0 && act[j-1].x > e.x; j--)
+                act[j] = act[j-1];
+            act[j] = e;
+        }
+
+        if (rule == FILL_EVEN_ODD)
+        {
+            for (size_t i = 0; i + 1 < n; i += 2)
+                span(y, act[i].x, act[i+1].x);
+        }
+        else
+        {
+            int wind = 0;
+            double start = 0.0;
+            for (size_t i = 0; i < n; i++)
+            {
+                int before = wind;
+                wind += act[i].dir;
+                if (before == 0 && wind != 0)
+                    start = act[i].x;
+                else if (before != 0 && wind == 0)
+                    span(y, start, act[i].x);
+            }
+        }
+
+        for (Edge &e : act)
+            e.x += e.dxdy;
+    }
+}
+
+
+void ScanlineFiller::spans(FillRule rule, int width, int height, std::vector<Span> &out)
+{
+    out.clear();
+    sortEdges();
+    if (edges.empty())
+        return;
+
+    int ya = std::max(0, edges.front().y0), yb = 0;
+    for (const Edge &e : edges)
+        yb = std::max(yb, e.y1);
+    yb = std::min(yb, height);
+
+    scan(ya, yb, width, rule, active, [&](int y, int x0, int x1) { out.push_back({y, x0, x1}); });
+}
+
+
+void ScanlineFiller::fill(Framebuffer &fb, uint32_t color, FillRule rule, int threads)
+{
+    sortEdges();
+    if (edges.empty())
+        return;
+
+    int ya = std::max(0, edges.front().y0), yb = 0;
+    for (const Edge &e : edges)
+        yb = std::max(yb, e.y1);
+    yb = std::min(yb, fb.height);
+    int rows = yb - ya;
+    if (rows <= 0)
+        return;
+
+    if (threads <= 0)
+        threads = jobSystem().workers() + 1;
+    threads = std::max(1, std::min(threads, rows / min_band_rows));
+
+    auto band = [&](int y0, int y1, std::vector<Edge> &act) {
+        scan(y0, y1, fb.width, rule, act, [&](int y, int x0, int x1) {
+            std::fill_n(&fb.pixels[(size_t)y * fb.width + x0], x1 - x0, color);
+        });
+    };
+    if (threads == 1)
+    {
+        band(ya, yb, active);
+        return;
+    }
+
+    // Bands cover disjoint rows, so jobs never write the same pixel; each
+    // has its own active edge list.
+    jobSystem().parallelFor(ya, yb, (rows + threads - 1) / threads, [&](int y0, int y1) {
+        std::vector<Edge> act;
+        band(y0, y1, act);
+    });
+}
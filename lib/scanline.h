@@ -0,0 +1,134 @@
+/**
+ * @file scanline.h
+ * Scanline polygon filling.
+ *
+ * CPU polygon fill with a sorted edge table and an incremental active edge
+ * list. Pixels are sampled at their centers, so polygons sharing an edge
+ * never overlap or leave gaps. Rows can be split into bands filled in
+ * parallel on the job system (job_system.h).
+ *
+ * Coordinates are in pixels, with y = 0 at the bottom row (same convention
+ * as glDrawPixels and gluOrtho2D(0, w, 0, h)).
+ */
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/** Rule deciding which regions of a self-overlapping polygon are inside. */
+enum FillRule
+{
+    FILL_EVEN_ODD,  ///< Inside if crossed an odd number of times.
+    FILL_NON_ZERO   ///< Inside if the winding number is not zero.
+};
+
+
+/** Horizontal run of pixels [x0, x1) on row y. */
+struct Span
+{
+    int y, x0, x1;
+};
+
+
+/**
+ * RGBA8 image in memory.
+ */
+struct Framebuffer
+{
+    int width = 0, height = 0;
+    std::vector<uint32_t> pixels;
+
+    /** Resize (contents are undefined afterwards). */
+    void resize(int w, int h) { width = w; height = h; pixels.resize((size_t)w * h); }
+    /** Fill with one color. */
+    void clear(uint32_t c) { pixels.assign(pixels.size(), c); }
+};
+
+
+/**
+ * Pack a color.
+ *
+ * @return Pixel with the bytes r, g, b, a in memory order.
+ */
+inline uint32_t packRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255)
+{
+    return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+}
+
+
+/**
+ * Scanline polygon filler.
+ *
+ * Usage:
+ *   filler.clear();
+ *   filler.addRing(xy, n);       // outline, holes, more polygons...
+ *   filler.fill(fb, color, FILL_EVEN_ODD);
+ */
+class ScanlineFiller
+{
+public:
+    /**
+     * Remove all edges.
+     */
+    void clear();
+
+    /**
+     * Add a closed ring.
+     *
+     * Rings are combined according to the fill rule, so holes are added as
+     * further rings (reversed for FILL_NON_ZERO).
+     *
+     * @param xy Interleaved coordinates in pixels (x0, y0, x1, y1, ...).
+     * @param n Number of points.
+     */
+    void addRing(const float *, int);
+
+    /**
+     * Compute spans.
+     *
+     * @param rule Fill rule.
+     * @param width Clip width in pixels.
+     * @param height Clip height in pixels.
+     * @param spans Receives the spans, bottom row first (cleared first).
+     */
+    void spans(FillRule, int, int, std::vector<Span> &);
+
+    /**
+     * Fill into a framebuffer.
+     *
+     * @param fb Target framebuffer.
+     * @param color Packed color (packRGBA).
+     * @param rule Fill rule.
+     * @param threads Bands at most (0 = one per job system thread; 1 =
+     *                this thread only). Small fills use fewer bands.
+     */
+    void fill(Framebuffer &, uint32_t, FillRule, int = 0);
+
+private:
+    /** Edge of the edge table, over rows [y0, y1). */
+    struct Edge
+    {
+        int y0, y1;
+        /** X at the center of row y0 and its increment per row. */
+        double x, dxdy;
+        /** +1 going up, -1 going down. */
+        int dir;
+    };
+
+    /** Edge table, sorted by first row when filling. */
+    std::vector<Edge> edges;
+    /** Whether edges is sorted. */
+    bool sorted = true;
+    /** Active edge list for the calling thread. */
+    std::vector<Edge> active;
+
+    void sortEdges();
+    template <class Emit>
+    void scan(int, int, int, FillRule, std::vector<Edge> &, Emit) const;
+};
+
+#endif
@@ -0,0 +1,321 @@
+/**
+ * @file shader_cache.cpp
+ * On-disk shader program cache.
+ *
+ * Implements the program binary cache declared in shader_cache.h.
+ */
+
+#include "shader_cache.h"
+#include "cache_dir.h"
+#include "trace.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+
+/** File magic for cached binaries. */
+static const char cache_magic[4] = {'C', 'G', 'P', 'B'};
+
+/** Number of programs loaded from the cache. */
+static int cache_hits = 0;
+/** Number of programs compiled from source. */
+static int cache_misses = 0;
+/** Total time spent in createCachedShaderProgram (ms). */
+static double cache_time_ms = 0.0;
+/** Cache files to write once a pending program finishes linking. */
+static std::map<GLuint, std::string> pending_binaries;
+/** Whether the driver compiles shaders on background threads. */
+static bool parallel_compile = false;
+
+
+/**
+ * FNV-1a hash.
+ *
+ * Accumulates a string (including its terminator) into a 64-bit hash.
+ *
+ * @param h Current hash value.
+ * @param s String to hash (NULL is treated as empty).
+ * @return Updated hash value.
+ */
+static uint64_t fnv1a(uint64_t h, const char *s)
+{
+    if (s)
+        for (; *s; s++)
+        {
+            h ^= (unsigned char)*s;
+            h *= 1099511628211ULL;
+        }
+    h ^= 0xff;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+/**
+ * Check driver support.
+ *
+ * @return True if program binaries can be retrieved and loaded.
+ */
+static bool binariesSupported()
+{
+    static int supported = -1;
+
+    if (supported < 0)
+    {
+        GLint formats = 0;
+        if (GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0 && !cacheDisabled("CG_NO_SHADER_CACHE");
+    }
+    return supported;
+}
+
+/**
+ * Compile shader.
+ *
+ * @param type Shader type.
+ * @param code Shader source.
+ * @return Shader object.
+ */
+static GLuint compileShader(GLenum type, const char *code)
+{
+    int success;
+    char error[512];
+
+    TRACE_SCOPE(type == GL_VERTEX_SHADER ? "compile vertex shader" : "compile fragment shader");
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+
+    // Querying the status would block on the background compiler threads.
+    if (parallel_compile)
+        return shader;
+
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, error);
+        std::cout << "ERROR: Shader comilation error: " << error << std::endl;
+    }
+    return shader;
+}
+
+/**
+ * Compile and link program.
+ *
+ * Same as createShaderProgram, but asks the driver to keep the binary
+ * retrievable when caching is enabled and does not wait for the link.
+ *
+ * @param vertex_code String with code for vertex shader.
+ * @param fragment_code String with code for fragment shader.
+ * @return Linked program.
+ */
+static GLuint linkFromSource(const char *vertex_code, const char *fragment_code)
+{
+    GLuint program  = glCreateProgram();
+    GLuint vertex   = compileShader(GL_VERTEX_SHADER, vertex_code);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragment_code);
+
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+
+    if (binariesSupported())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    // Link status is queried in finishCachedShaderProgram, so drivers with
+    // parallel compilation can keep working in the background.
+    traceBegin("link program");
+    glLinkProgram(program);
+    traceEnd();
+
+    glDetachShader(program, vertex);
+    glDetachShader(program, fragment);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    return program;
+}
+
+/**
+ * Load program binary.
+ *
+ * @param path Cache file.
+ * @return Linked program, or 0 if the file is missing or was rejected.
+ */
+static GLuint loadBinary(const std::string &path)
+{
+    TRACE_SCOPE("load program binary");
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return 0;
+
+    char magic[4];
+    uint32_t format = 0, length = 0;
+    in.read(magic, 4);
+    in.read((char *)&format, sizeof(format));
+    in.read((char *)&length, sizeof(length));
+    if (!in || memcmp(magic, cache_magic, 4) != 0 || length == 0)
+        return 0;
+
+    std::vector<char> data(length);
+    in.read(data.data(), length);
+    if (!in)
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, data.data(), length);
+
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // Driver update or corrupted entry: drop it and recompile.
+        glDeleteProgram(program);
+        std::remove(path.c_str());
+        return 0;
+    }
+    return program;
+}
+
+/**
+ * Store program binary.
+ *
+ * Writes to a temporary file first so concurrent runs never read a
+ * partially written entry.
+ *
+ * @param path Cache file.
+ * @param program Linked program.
+ */
+static void storeBinary(const std::string &path, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> data(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, data.data());
+    if (length <= 0)
+        return;
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    uint32_t f = format, n = length;
+    out.write(cache_magic, 4);
+    out.write((const char *)&f, sizeof(f));
+    out.write((const char *)&n, sizeof(n));
+    out.write(data.data(), length);
+    out.close();
+
+    if (out)
+        std::rename(tmp.c_str(), path.c_str());
+    else
+        std::remove(tmp.c_str());
+}
+
+
+std::string shaderCacheDir()
+{
+    return cacheDir("shaders");
+}
+
+
+bool enableParallelShaderCompile()
+{
+    if (!parallel_compile && GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        parallel_compile = true;
+    }
+    return parallel_compile;
+}
+
+
+GLuint beginCachedShaderProgram(const char *vertex_code, const char *fragment_code)
+{
+    TRACE_SCOPE("beginCachedShaderProgram");
+    auto start = std::chrono::steady_clock::now();
+    GLuint program = 0;
+
+    if (binariesSupported())
+    {
+        uint64_t h = 14695981039346656037ULL;
+        h = fnv1a(h, (const char *)glGetString(GL_VENDOR));
+        h = fnv1a(h, (const char *)glGetString(GL_RENDERER));
+        h = fnv1a(h, (const char *)glGetString(GL_VERSION));
+        h = fnv1a(h, vertex_code);
+        h = fnv1a(h, fragment_code);
+
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)h);
+        std::string path = shaderCacheDir() + name;
+
+        program = loadBinary(path);
+        if (program)
+            cache_hits++;
+        else
+        {
+            program = linkFromSource(vertex_code, fragment_code);
+            pending_binaries[program] = path;
+            cache_misses++;
+        }
+    }
+    else
+    {
+        program = linkFromSource(vertex_code, fragment_code);
+        cache_misses++;
+    }
+
+    cache_time_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    return program;
+}
+
+
+GLuint finishCachedShaderProgram(GLuint program)
+{
+    TRACE_SCOPE("finishCachedShaderProgram");
+    auto start = std::chrono::steady_clock::now();
+    int success;
+    char error[512];
+
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, error);
+        std::cout << "ERROR: Program link error: " << error << std::endl;
+    }
+
+    auto it = pending_binaries.find(program);
+    if (it != pending_binaries.end())
+    {
+        std::string dir = shaderCacheDir();
+        if (success && makeDirs(dir))
+            storeBinary(it->second, program);
+        pending_binaries.erase(it);
+    }
+
+    cache_time_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    return program;
+}
+
+
+GLuint createCachedShaderProgram(const char *vertex_code, const char *fragment_code)
+{
+    return finishCachedShaderProgram(beginCachedShaderProgram(vertex_code, fragment_code));
+}
+
+
+void printShaderCacheStats()
+{
+    std::cout << "Shader cache: " << cache_hits << " hit(s), "
+              << cache_misses << " miss(es), " << cache_time_ms << " ms"
+              << (binariesSupported() ? "" : " (disabled)") << std::endl;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file shader_cache.h
+ * On-disk shader program cache.
+ *
+ * Keeps linked program binaries (glGetProgramBinary) in the user cache
+ * directory so later runs load them with glProgramBinary instead of
+ * compiling GLSL again. Binaries are keyed by a hash of the shader sources
+ * and the driver vendor/renderer/version strings.
+ *
+ * Cache location is $XDG_CACHE_HOME/cg2025/shaders (or ~/.cache/...).
+ * Set CG_NO_SHADER_CACHE=1 to bypass it (useful to time cold starts).
+ */
+
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <string>
+#include <GL/glew.h>
+
+
+/**
+ * Create program using the binary cache.
+ *
+ * Loads the program binary from disk when a matching entry exists and the
+ * driver accepts it. Otherwise compiles the sources, links the program and
+ * stores its binary for the next run.
+ *
+ * @param vertex_code String with code for vertex shader.
+ * @param fragment_code String with code for fragment shader.
+ * @return Linked program.
+ */
+GLuint createCachedShaderProgram(const char *, const char *);
+
+/**
+ * Start creating a program.
+ *
+ * Like createCachedShaderProgram, but does not wait for the link to finish.
+ * Issuing several programs before finishing them lets drivers with parallel
+ * shader compilation build them concurrently.
+ *
+ * @param vertex_code String with code for vertex shader.
+ * @param fragment_code String with code for fragment shader.
+ * @return Program, possibly still linking.
+ */
+GLuint beginCachedShaderProgram(const char *, const char *);
+
+/**
+ * Finish creating a program.
+ *
+ * Waits for the link, reports errors and stores the binary in the cache if
+ * the program was compiled from source.
+ *
+ * @param program Program returned by beginCachedShaderProgram.
+ * @return The same program.
+ */
+GLuint finishCachedShaderProgram(GLuint);
+
+/**
+ * Enable parallel compilation.
+ *
+ * Lets the driver compile on background threads (KHR_parallel_shader_compile)
+ * when available. Compile errors are then reported only through the link log.
+ *
+ * @return True if parallel compilation is enabled.
+ */
+bool enableParallelShaderCompile();
+
+/**
+ * Cache directory.
+ *
+ * @return Directory where program binaries are stored (no trailing slash).
+ */
+std::string shaderCacheDir();
+
+/**
+ * Print cache statistics.
+ *
+ * Prints hits, misses and the total time spent creating programs.
+ */
+void printShaderCacheStats();
+
+#endif
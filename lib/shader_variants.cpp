@@ -0,0 +1,156 @@
+/**
+ * @file shader_variants.cpp
+ * Shader permutations.
+ *
+ * Implements the variant cache declared in shader_variants.h.
+ */
+
+#include "shader_variants.h"
+#include "shader_cache.h"
+#include "stream_buffer.h"
+
+#include <sstream>
+#include <algorithm>
+
+
+std::string injectDefines(const char *code, const std::string &defines)
+{
+    std::string src(code);
+    std::string block;
+
+    std::istringstream in(defines);
+    std::string def;
+    while (in >> def)
+    {
+        size_t eq = def.find('=');
+        if (eq == std::string::npos)
+            block += "#define " + def + " 1\n";
+        else
+            block += "#define " + def.substr(0, eq) + " " + def.substr(eq + 1) + "\n";
+    }
+
+    // #version must stay the first directive of the shader.
+    size_t pos = src.find("#version");
+    if (pos == std::string::npos)
+        return block + src;
+
+    pos = src.find('\n', pos);
+    if (pos == std::string::npos)
+        return src + "\n" + block;
+    return src.insert(pos + 1, block);
+}
+
+
+ShaderVariants::ShaderVariants(const char *vertex_code, const char *fragment_code)
+    : vertex_code(vertex_code), fragment_code(fragment_code)
+{
+}
+
+
+/**
+ * Normalize key.
+ *
+ * Sorts the entries so "A B" and "B A" map to the same program.
+ *
+ * @param defines Space separated list of defines.
+ * @return Normalized key.
+ */
+std::string ShaderVariants::normalize(const std::string &defines) const
+{
+    std::istringstream in(defines);
+    std::vector<std::string> items;
+    std::string def;
+    while (in >> def)
+        items.push_back(def);
+    std::sort(items.begin(), items.end());
+
+    std::string key;
+    for (const auto &d : items)
+        key += (key.empty() ? "" : " ") + d;
+    return key;
+}
+
+
+/**
+ * Start building a variant.
+ *
+ * @param key Normalized define set.
+ * @return Program, possibly still linking.
+ */
+GLuint ShaderVariants::begin(const std::string &key)
+{
+    std::string vs = injectDefines(vertex_code.c_str(), key);
+    std::string fs = injectDefines(fragment_code.c_str(), key);
+    return beginCachedShaderProgram(vs.c_str(), fs.c_str());
+}
+
+
+GLuint ShaderVariants::get(const std::string &defines)
+{
+    if (last_program && defines == last_key)
+        return last_program;
+
+    std::string key = normalize(defines);
+    auto it = programs.find(key);
+    GLuint program;
+    if (it != programs.end())
+        program = it->second;
+    else
+    {
+        program = finishCachedShaderProgram(begin(key));
+        applyBlocks(program);
+        programs[key] = program;
+    }
+
+    last_key = defines;
+    last_program = program;
+    return program;
+}
+
+
+void ShaderVariants::prewarm(const std::vector<std::string> &keys)
+{
+    enableParallelShaderCompile();
+
+    std::vector<std::string> issued;
+    for (const auto &k : keys)
+    {
+        std::string key = normalize(k);
+        if (programs.count(key))
+            continue;
+        programs[key] = begin(key);
+        issued.push_back(key);
+    }
+    for (const auto &key : issued)
+        applyBlocks(finishCachedShaderProgram(programs[key]));
+}
+
+
+/**
+ * Apply uniform block bindings.
+ *
+ * @param program Program.
+ */
+void ShaderVariants::applyBlocks(GLuint program) const
+{
+    for (const auto &b : blocks)
+        bindUniformBlock(program, b.first.c_str(), b.second);
+}
+
+
+void ShaderVariants::bindBlock(const char *name, GLuint binding)
+{
+    blocks.push_back({ name, binding });
+    for (const auto &p : programs)
+        bindUniformBlock(p.second, name, binding);
+}
+
+
+void ShaderVariants::release()
+{
+    for (auto &p : programs)
+        glDeleteProgram(p.second);
+    programs.clear();
+    last_key.clear();
+    last_program = 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file shader_variants.h
+ * Shader permutations.
+ *
+ * Builds specialized programs from a single pair of shader sources by
+ * injecting #define lines after the #version directive, so the shader code
+ * selects its path with #if at compile time instead of branching on a
+ * uniform for every vertex and fragment. Programs are created on first use
+ * and cached by their define set.
+ */
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+
+/**
+ * Inject defines.
+ *
+ * Inserts one "#define NAME VALUE" line per entry right after the #version
+ * line of the shader (or at the top if there is none).
+ *
+ * @param code Shader source.
+ * @param defines Space separated list of NAME or NAME=VALUE entries.
+ * @return Shader source with the defines.
+ */
+std::string injectDefines(const char *, const std::string &);
+
+/**
+ * Set of programs generated from the same sources.
+ */
+class ShaderVariants
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param vertex_code String with code for vertex shader.
+     * @param fragment_code String with code for fragment shader.
+     */
+    ShaderVariants(const char *, const char *);
+
+    /**
+     * Get variant.
+     *
+     * Returns the program for a define set, compiling it (through the
+     * program binary cache) the first time it is requested.
+     *
+     * @param defines Space separated list of NAME or NAME=VALUE entries.
+     * @return Linked program.
+     */
+    GLuint get(const std::string &);
+
+    /**
+     * Build variants ahead of time.
+     *
+     * Issues every missing variant before waiting for any of them, so
+     * drivers with parallel shader compilation build them concurrently.
+     *
+     * @param keys Define sets to build.
+     */
+    void prewarm(const std::vector<std::string> &);
+
+    /**
+     * Bind uniform block on every variant.
+     *
+     * Applies to programs already built and to those built later.
+     *
+     * @param name Block name.
+     * @param binding Uniform buffer binding point.
+     */
+    void bindBlock(const char *, GLuint);
+
+    /**
+     * Delete all programs.
+     */
+    void release();
+
+private:
+    /** Vertex shader source. */
+    std::string vertex_code;
+    /** Fragment shader source. */
+    std::string fragment_code;
+    /** Programs by normalized define set. */
+    std::map<std::string, GLuint> programs;
+    /** Uniform block bindings applied to every program. */
+    std::vector<std::pair<std::string, GLuint>> blocks;
+    /** Last requested key and program (avoids the lookup when unchanged). */
+    std::string last_key;
+    GLuint last_program = 0;
+
+    std::string normalize(const std::string &) const;
+    GLuint begin(const std::string &);
+    void applyBlocks(GLuint) const;
+};
+
+#endif
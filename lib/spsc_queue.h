@@ -0,0 +1,103 @@
+/**
+ * @file spsc_queue.h
+ * Lock-free single-producer single-consumer queue.
+ *
+ * A fixed-size ring for handing small values from one thread to another
+ * without locks: the producer only moves the tail, the consumer only moves
+ * the head, and each side keeps a cached copy of the other's index so it
+ * touches the shared cache line only when the cached value says the queue
+ * looks full (or empty). push() and pop() never block; when the queue is
+ * full push() fails and the producer decides what to do.
+ *
+ * Exactly one thread may push and exactly one thread may pop.
+ *
+ * Typical use:
+ *   SpscQueue<Command, 1024> queue;
+ *   // producer
+ *   if (!queue.push(command)) ... full ...
+ *   // consumer
+ *   Command c;
+ *   while (queue.pop(c)) execute(c);
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+
+/**
+ * Bounded SPSC ring.
+ *
+ * @tparam T Element type (copied in and out).
+ * @tparam N Capacity, a power of two.
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    /**
+     * Append a value (producer thread).
+     *
+     * @param value Value to copy in.
+     * @return False if the queue is full.
+     */
+    bool push(const T &value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache == N)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache == N)
+                return false;
+        }
+        items[t & (N - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest value (consumer thread).
+     *
+     * @param value Receives the value.
+     * @return False if the queue is empty.
+     */
+    bool pop(T &value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache)
+                return false;
+        }
+        value = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @return Values waiting; exact only on the consumer thread. */
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    /** @return Capacity. */
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T items[N];
+
+    /** Next slot to pop, and the consumer's copy of tail. */
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+
+    /** Next slot to fill, and the producer's copy of head. */
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+};
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file startup.cpp
+ * Concurrent startup with a timeline.
+ *
+ * Implements the orchestrator declared in startup.h.
+ */
+
+#include "startup.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+
+namespace
+{
+
+/** Width of the timeline bars in characters. */
+const int bar_width = 40;
+
+}
+
+
+Startup::Startup() : origin(std::chrono::steady_clock::now())
+{
+}
+
+
+double Startup::now() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+
+void Startup::record(const Stage &s)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.push_back(s);
+}
+
+
+JobHandle Startup::background(const char *name, std::function<void()> function)
+{
+    return jobSystem().run([this, name, function] {
+        double start = now();
+        traceBegin(name);
+        function();
+        traceEnd();
+        record({name, start, now(), true, false});
+    });
+}
+
+
+void Startup::background(const char *name, std::chrono::steady_clock::time_point start,
+                         std::chrono::steady_clock::time_point end)
+{
+    auto ms = [this](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(t - origin).count();
+    };
+    record({name, ms(start), ms(end), true, false});
+}
+
+
+void Startup::stage(const char *name, const std::function<void()> &function)
+{
+    double start = now();
+    traceBegin(name);
+    function();
+    traceEnd();
+    record({name, start, now(), false, false});
+}
+
+
+void Startup::wait(const char *name, const JobHandle &handle)
+{
+    if (handle.done())
+        return;
+    double start = now();
+    traceBegin("wait");
+    jobSystem().wait(handle);
+    traceEnd();
+    record({name, start, now(), false, true});
+}
+
+
+void Startup::firstFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (first_frame >= 0.0)
+            return;
+        first_frame = now();
+    }
+    print();
+}
+
+
+void Startup::print() const
+{
+    std::vector<Stage> sorted;
+    double frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = stages;
+        frame = first_frame;
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Stage &a, const Stage &b) { return a.start < b.start; });
+
+    double total = std::max(frame, 0.0), sum = 0.0, longest = 0.0;
+    const char *longest_name = "";
+    for (const Stage &s : sorted)
+    {
+        total = std::max(total, s.end);
+        if (s.wait)
+            continue;
+        sum += s.end - s.start;
+        if (s.end - s.start > longest)
+        {
+            longest = s.end - s.start;
+            longest_name = s.name;
+        }
+    }
+    if (total <= 0.0)
+        return;
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << "Startup timeline (ms):" << std::endl << std::fixed << std::setprecision(1);
+    for (const Stage &s : sorted)
+    {
+        int a = (int)(s.start / total * bar_width), b = (int)(s.end / total * bar_width + 0.5);
+        b = std::max(b, a + 1);
+        std::string bar(bar_width, ' ');
+        std::fill(bar.begin() + std::min(a, bar_width), bar.begin() + std::min(b, bar_width), s.wait ? '.' : '#');
+        std::string name = s.wait ? std::string("wait ") + s.name : s.name;
+        std::cout << "  " << std::left << std::setw(22) << name << " " << std::setw(4) << (s.background ? "job" : "main")
+                  << std::right << std::setw(10) << s.start << std::setw(10) << s.end << "  |" << bar << "|" << std::endl;
+    }
+    if (frame >= 0.0)
+        std::cout << "Startup: first frame at " << frame << " ms; longest stage " << longest << " ms (" << longest_name
+                  << "); stages add up to " << sum << " ms" << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file startup.h
+ * Concurrent startup with a timeline.
+ *
+ * A viewer's startup has stages that need the GL thread (creating the
+ * window, compiling shaders, uploading buffers and textures) and stages
+ * that do not (parsing the model, decoding images). Run one after the
+ * other, the time to the first frame is their sum; with the CPU stages
+ * started first on the job system (job_system.h) and joined only where
+ * their result is uploaded, it approaches the slowest single stage.
+ *
+ * Startup runs the stages and records when each ran and on which thread;
+ * after the first frame it prints the timeline, with the time to the first
+ * frame against the longest stage and the sum of all stages. Stages also
+ * appear as spans in the pipeline trace (trace.h).
+ *
+ * Stage names are stored as pointers: use string literals.
+ *
+ * A viewer uses it like this:
+ *   Startup startup;   // global: the clock starts with the program
+ *
+ *   JobHandle parse = startup.background("parse model", [&] { parseModel(path); });
+ *   startup.stage("create window", [&] { ... });
+ *   startup.stage("compile shaders", [&] { ... });
+ *   startup.wait("parse model", parse);
+ *   startup.stage("upload model", uploadModel);
+ *   if (textures.decodeSpan(texture, start, end))
+ *       startup.background("decode texture", start, end);
+ *
+ *   void display() { ... swapBuffers(); startup.firstFrame(); }
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "job_system.h"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+/**
+ * Startup orchestrator and timeline.
+ */
+class Startup
+{
+public:
+    /** Constructor; the timeline starts now. */
+    Startup();
+
+    /**
+     * Start a stage on the job system.
+     *
+     * @param name Stage name.
+     * @param function Stage body; must not use GL.
+     * @return Handle for wait().
+     */
+    JobHandle background(const char *, std::function<void()>);
+
+    /**
+     * Record a stage that ran on the job system outside Startup, such as
+     * the decode jobs of TextureManager (see TextureManager::decodeSpan()).
+     *
+     * @param name Stage name.
+     * @param start When the stage started.
+     * @param end When it finished.
+     */
+    void background(const char *, std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point);
+
+    /**
+     * Run a stage on the calling thread.
+     *
+     * @param name Stage name.
+     * @param function Stage body.
+     */
+    void stage(const char *, const std::function<void()> &);
+
+    /**
+     * Wait for a background stage, running jobs meanwhile. The time spent
+     * blocked is recorded as a stage of its own.
+     *
+     * @param name Stage waited for (shown as "wait NAME").
+     * @param handle Handle from background().
+     */
+    void wait(const char *, const JobHandle &);
+
+    /**
+     * Mark the first frame as drawn (call after its swap) and print the
+     * timeline. Later calls do nothing.
+     */
+    void firstFrame();
+
+    /** Print the stages recorded so far. */
+    void print() const;
+
+private:
+    struct Stage
+    {
+        const char *name;
+        double start, end;   // ms since construction
+        bool background;
+        bool wait;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Stage> stages;
+    double first_frame = -1.0;
+
+    double now() const;
+    void record(const Stage &);
+};
+
+#endif
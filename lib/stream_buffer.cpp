@@ -0,0 +1,212 @@
+/**
+ * @file stream_buffer.cpp
+ * Streaming buffer.
+ *
+ * Implements the ring buffer declared in stream_buffer.h.
+ */
+
+#include "stream_buffer.h"
+
+#include <cstddef>
+
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr region_size, int regions)
+    : target(target), region_size(region_size), regions(regions)
+{
+}
+
+
+void StreamBuffer::init()
+{
+    GLint align = 1;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    else
+        align = 4;
+    region_size = (region_size + align - 1) / align * align;
+
+    fences.assign(regions, (GLsync)0);
+    current = 0;
+
+    glGenBuffers(1, &id);
+    glBindBuffer(target, id);
+
+    GLsizeiptr total = region_size * regions;
+    if (GLEW_ARB_buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, total, NULL, flags);
+        mapped = (char *)glMapBufferRange(target, 0, total, flags);
+    }
+    else
+    {
+        glBufferData(target, total, NULL, GL_STREAM_DRAW);
+        staging.resize(region_size);
+    }
+
+    glBindBuffer(target, 0);
+}
+
+
+void StreamBuffer::release()
+{
+    for (GLsync &f : fences)
+        if (f)
+        {
+            glDeleteSync(f);
+            f = 0;
+        }
+
+    if (mapped)
+    {
+        glBindBuffer(target, id);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &id);
+    id = 0;
+}
+
+
+/**
+ * Wait for region.
+ *
+ * Blocks until the GPU finished the commands fenced on the region.
+ *
+ * @param region Region index.
+ */
+void StreamBuffer::wait(int region)
+{
+    GLsync &f = fences[region];
+    if (!f)
+        return;
+
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for (;;)
+    {
+        GLenum r = glClientWaitSync(f, flags, 1000000);
+        if (r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED || r == GL_WAIT_FAILED)
+            break;
+        flags = 0;
+    }
+    glDeleteSync(f);
+    f = 0;
+}
+
+
+void *StreamBuffer::begin()
+{
+    wait(current);
+
+    if (mapped)
+        return mapped + offset();
+    return staging.data();
+}
+
+
+void StreamBuffer::flush(GLintptr from, GLsizeiptr bytes)
+{
+    if (mapped || bytes <= 0)
+        return;
+
+    // Fallback: the fence already guarantees the region is free, so the
+    // driver can copy without waiting for the GPU.
+    glBindBuffer(target, id);
+    glBufferSubData(target, offset() + from, bytes, staging.data() + from);
+    glBindBuffer(target, 0);
+}
+
+
+void StreamBuffer::end()
+{
+    flush(0, region_size);
+}
+
+
+void StreamBuffer::fence()
+{
+    if (fences[current])
+        glDeleteSync(fences[current]);
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % regions;
+}
+
+
+void bindUniformBlock(GLuint program, const char *name, GLuint binding)
+{
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, binding);
+}
+
+
+StreamVertexArray::StreamVertexArray(GLsizei stride, GLsizei capacity, int regions)
+    : buffer(GL_ARRAY_BUFFER, (GLsizeiptr)stride * capacity, regions),
+      stride(stride), capacity(capacity)
+{
+}
+
+
+void StreamVertexArray::init()
+{
+    buffer.init();
+    glGenVertexArrays(1, &array);
+    glBindVertexArray(array);
+}
+
+
+void StreamVertexArray::attribute(GLuint index, GLint size, GLenum type, size_t offset,
+                                  GLboolean normalized)
+{
+    glBindVertexArray(array);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.buffer());
+    glVertexAttribPointer(index, size, type, normalized, stride, (void *)offset);
+    glEnableVertexAttribArray(index);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void *StreamVertexArray::allocateBytes(GLsizei count, GLint &first)
+{
+    if (!base)
+        base = (char *)buffer.begin();
+    if (count > capacity - used)
+        return nullptr;
+
+    // Regions are a whole number of vertices, so the offset maps to a vertex.
+    first = (GLint)(buffer.offset() / stride) + used;
+    void *p = base + (size_t)used * stride;
+    used += count;
+    return p;
+}
+
+
+void StreamVertexArray::draw(GLenum mode, GLint first, GLsizei count)
+{
+    if (used > flushed)
+    {
+        buffer.flush((GLintptr)flushed * stride, (GLsizeiptr)(used - flushed) * stride);
+        flushed = used;
+    }
+    glBindVertexArray(array);
+    glDrawArrays(mode, first, count);
+}
+
+
+void StreamVertexArray::endFrame()
+{
+    if (!base)
+        return;
+    buffer.fence();
+    base = nullptr;
+    used = flushed = 0;
+}
+
+
+void StreamVertexArray::release()
+{
+    buffer.release();
+    glDeleteVertexArrays(1, &array);
+    array = 0;
+}
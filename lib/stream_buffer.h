@@ -0,0 +1,230 @@
+/**
+ * @file stream_buffer.h
+ * Streaming buffer.
+ *
+ * Ring of buffer regions for data rewritten every frame (uniforms, dynamic
+ * vertices). The buffer is allocated once with glBufferStorage and stays
+ * persistently mapped; each frame writes to the next region and a fence
+ * marks when the GPU is done with it, so the CPU never overwrites data in
+ * flight and the driver never has to reallocate or copy.
+ *
+ * Without ARB_buffer_storage the region is written to a CPU staging copy and
+ * uploaded with glBufferSubData, with the fences providing the
+ * synchronization.
+ */
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+
+/**
+ * Persistently mapped ring buffer.
+ *
+ * Typical frame:
+ *   void *p = buf.begin();   // waits until the region is free
+ *   ... write up to buf.regionSize() bytes to p ...
+ *   buf.end();               // or buf.flush() for the bytes written
+ *   ... draw using buf.buffer() at buf.offset() ...
+ *   buf.fence();             // GPU still reads this region; move on
+ */
+class StreamBuffer
+{
+public:
+    /**
+     * Constructor.
+     *
+     * Does not touch GL; call init() once a context exists.
+     *
+     * @param target Buffer target (GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, ...).
+     * @param region_size Bytes available per frame.
+     * @param regions Number of regions (3 allows two frames in flight).
+     */
+    StreamBuffer(GLenum, GLsizeiptr, int = 3);
+
+    /**
+     * Create the buffer.
+     *
+     * Rounds the region size up to the offset alignment required by the
+     * target and maps the storage when persistent mapping is available.
+     */
+    void init();
+
+    /**
+     * Delete the buffer and pending fences.
+     */
+    void release();
+
+    /**
+     * Start writing the current region.
+     *
+     * @return Pointer to regionSize() writable bytes.
+     */
+    void *begin();
+
+    /**
+     * Make written bytes visible to the GPU.
+     *
+     * No-op when persistently mapped (the mapping is coherent).
+     *
+     * @param from Byte offset inside the current region.
+     * @param bytes Number of bytes written.
+     */
+    void flush(GLintptr, GLsizeiptr);
+
+    /**
+     * Finish writing the current region.
+     *
+     * Same as flushing the whole region.
+     */
+    void end();
+
+    /**
+     * Fence the current region and advance to the next one.
+     *
+     * Call after the draws that read the region were issued.
+     */
+    void fence();
+
+    /** @return Buffer object. */
+    GLuint buffer() const { return id; }
+    /** @return Byte offset of the current region in the buffer. */
+    GLintptr offset() const { return (GLintptr)current * region_size; }
+    /** @return Bytes per region (after alignment). */
+    GLsizeiptr regionSize() const { return region_size; }
+    /** @return True if the buffer is persistently mapped. */
+    bool persistent() const { return mapped != nullptr; }
+
+private:
+    /** Buffer target. */
+    GLenum target;
+    /** Bytes per region. */
+    GLsizeiptr region_size;
+    /** Number of regions. */
+    int regions;
+    /** Buffer object. */
+    GLuint id = 0;
+    /** Persistent mapping of the whole buffer (null in fallback mode). */
+    char *mapped = nullptr;
+    /** Region being written. */
+    int current = 0;
+    /** Fence per region (0 when free). */
+    std::vector<GLsync> fences;
+    /** CPU copy of one region (fallback mode only). */
+    std::vector<char> staging;
+
+    void wait(int);
+};
+
+/**
+ * Streaming vertex array.
+ *
+ * Vertex array fed by a StreamBuffer, for geometry rebuilt every frame.
+ * Vertices are sub-allocated from the current region, so several draws per
+ * frame share one buffer and nothing is allocated after init():
+ *
+ *   GLint first;
+ *   float *v = sva.allocate<float>(n, first);
+ *   ... write n vertices ...
+ *   sva.draw(GL_LINES, first, n);
+ *   ...
+ *   sva.endFrame();
+ */
+class StreamVertexArray
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param stride Bytes per vertex (multiple of 4).
+     * @param capacity Maximum vertices per frame.
+     * @param regions Number of regions in the ring.
+     */
+    StreamVertexArray(GLsizei, GLsizei, int = 3);
+
+    /**
+     * Create the buffer and vertex array.
+     */
+    void init();
+
+    /**
+     * Describe an attribute.
+     *
+     * @param index Attribute location.
+     * @param size Number of components.
+     * @param type Component type.
+     * @param offset Byte offset inside the vertex.
+     * @param normalized Map integer components to [0, 1] / [-1, 1].
+     */
+    void attribute(GLuint, GLint, GLenum, size_t, GLboolean = GL_FALSE);
+
+    /**
+     * Reserve vertices for this frame.
+     *
+     * @param count Number of vertices.
+     * @param first Receives the index to pass to draw().
+     * @return Pointer to write the vertices, or null if the frame is full.
+     */
+    void *allocateBytes(GLsizei, GLint &);
+
+    /** Typed version of allocateBytes. */
+    template <typename T>
+    T *allocate(GLsizei count, GLint &first) { return (T *)allocateBytes(count, first); }
+
+    /**
+     * Draw vertices allocated this frame.
+     *
+     * @param mode Primitive type.
+     * @param first Index returned by allocate().
+     * @param count Number of vertices.
+     */
+    void draw(GLenum, GLint, GLsizei);
+
+    /**
+     * Fence the frame's region and move to the next one.
+     */
+    void endFrame();
+
+    /**
+     * Delete the buffer and vertex array.
+     */
+    void release();
+
+    /** @return Vertex array object. */
+    GLuint vao() const { return array; }
+    /** @return Maximum vertices per frame. */
+    GLsizei maxVertices() const { return capacity; }
+
+private:
+    /** Ring buffer holding the vertices. */
+    StreamBuffer buffer;
+    /** Bytes per vertex. */
+    GLsizei stride;
+    /** Vertices per region. */
+    GLsizei capacity;
+    /** Vertex array object. */
+    GLuint array = 0;
+    /** Start of the current region (null outside a frame). */
+    char *base = nullptr;
+    /** Vertices allocated this frame. */
+    GLsizei used = 0;
+    /** Vertices already flushed to the GPU this frame. */
+    GLsizei flushed = 0;
+};
+
+/**
+ * Bind uniform block.
+ *
+ * Associates a named std140 block of program with a uniform buffer binding
+ * point. Does nothing if the program has no such block.
+ *
+ * @param program Program.
+ * @param name Block name.
+ * @param binding Binding point.
+ */
+void bindUniformBlock(GLuint, const char *, GLuint);
+
+#endif
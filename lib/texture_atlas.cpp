@@ -0,0 +1,371 @@
+/**
+ * @file texture_atlas.cpp
+ * Texture atlas and texture array packing.
+ *
+ * Implements the packers declared in texture_atlas.h.
+ */
+
+#include "texture_atlas.h"
+#include "mipmap.h"
+#include "trace.h"
+#include "stb_image.h"
+
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <algorithm>
+
+
+/**
+ * Load an image file as RGBA.
+ *
+ * @return False if the file cannot be read.
+ */
+static bool loadImage(const std::string &path, std::vector<AtlasImage> &list)
+{
+    int w, h, n;
+    traceBegin("stbi_load");
+    unsigned char *pixels = stbi_load(path.c_str(), &w, &h, &n, 4);
+    traceEnd();
+    if (!pixels)
+    {
+        std::cerr << "Cannot read " << path << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    list.push_back({w, h, std::vector<unsigned char>(pixels, pixels + (size_t)w * h * 4)});
+    stbi_image_free(pixels);
+    return true;
+}
+
+
+/**
+ * Resize an RGBA image (bilinear, color in linear light).
+ */
+static std::vector<unsigned char> resize(const AtlasImage &src, int dw, int dh)
+{
+    std::vector<float> linear((size_t)src.width * src.height * 4);
+    for (size_t i = 0; i < linear.size(); i++)
+        linear[i] = i % 4 == 3 ? src.pixels[i] / 255.0f : srgbToLinear(src.pixels[i]);
+
+    std::vector<unsigned char> out((size_t)dw * dh * 4);
+    for (int y = 0; y < dh; y++)
+    {
+        float fy = std::min(std::max((y + 0.5f) * src.height / dh - 0.5f, 0.0f), src.height - 1.0f);
+        int y0 = (int)fy, y1 = std::min(y0 + 1, src.height - 1);
+        float ty = fy - y0;
+        for (int x = 0; x < dw; x++)
+        {
+            float fx = std::min(std::max((x + 0.5f) * src.width / dw - 0.5f, 0.0f), src.width - 1.0f);
+            int x0 = (int)fx, x1 = std::min(x0 + 1, src.width - 1);
+            float tx = fx - x0;
+            const float *a = &linear[((size_t)y0 * src.width + x0) * 4], *b = &linear[((size_t)y0 * src.width + x1) * 4];
+            const float *c = &linear[((size_t)y1 * src.width + x0) * 4], *d = &linear[((size_t)y1 * src.width + x1) * 4];
+            unsigned char *o = &out[((size_t)y * dw + x) * 4];
+            for (int k = 0; k < 4; k++)
+            {
+                float v = (a[k] * (1 - tx) + b[k] * tx) * (1 - ty) + (c[k] * (1 - tx) + d[k] * tx) * ty;
+                o[k] = k == 3 ? (unsigned char)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f) : linearToSrgb(v);
+            }
+        }
+    }
+    return out;
+}
+
+
+void SkylinePacker::reset(int width, int height)
+{
+    bin_w = width;
+    bin_h = height;
+    skyline.assign(1, {0, 0, width});
+}
+
+
+/**
+ * Height at which a rectangle fits starting at a segment.
+ *
+ * @param i Segment index (the rectangle's left edge is its start).
+ * @return Bottom edge, or -1 if it does not fit.
+ */
+int SkylinePacker::fit(size_t i, int w, int h) const
+{
+    if (skyline[i].x + w > bin_w)
+        return -1;
+    int y = 0;
+    for (int left = w; left > 0; left -= skyline[i].width, i++)
+    {
+        y = std::max(y, skyline[i].y);
+        if (y + h > bin_h)
+            return -1;
+    }
+    return y;
+}
+
+
+bool SkylinePacker::insert(int w, int h, int &x, int &y)
+{
+    int best_top = INT_MAX, best_x = INT_MAX;
+    size_t best = 0;
+    for (size_t i = 0; i < skyline.size(); i++)
+    {
+        int top = fit(i, w, h);
+        if (top < 0)
+            continue;
+        top += h;
+        if (top < best_top || (top == best_top && skyline[i].x < best_x))
+        {
+            best_top = top;
+            best_x = skyline[i].x;
+            best = i;
+        }
+    }
+    if (best_top == INT_MAX)
+        return false;
+
+    x = best_x;
+    y = best_top - h;
+    skyline.insert(skyline.begin() + best, {x, best_top, w});
+
+    // Cut the segments now under the rectangle.
+    for (size_t i = best + 1; i < skyline.size();)
+    {
+        int end = skyline[i - 1].x + skyline[i - 1].width;
+        if (skyline[i].x >= end)
+            break;
+        int cut = end - skyline[i].x;
+        skyline[i].x += cut;
+        skyline[i].width -= cut;
+        if (skyline[i].width > 0)
+            break;
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Merge neighbours at the same height.
+    for (size_t i = 1; i < skyline.size();)
+    {
+        if (skyline[i - 1].y == skyline[i].y)
+        {
+            skyline[i - 1].width += skyline[i].width;
+            skyline.erase(skyline.begin() + i);
+        }
+        else
+            i++;
+    }
+    return true;
+}
+
+
+TextureAtlas::TextureAtlas(int padding)
+{
+    // Power of two, so aligned rectangles stay aligned at every safe level.
+    this->padding = 1;
+    safe_levels = 0;
+    while (this->padding < padding)
+    {
+        this->padding *= 2;
+        safe_levels++;
+    }
+}
+
+
+int TextureAtlas::add(const unsigned char *pixels, int width, int height)
+{
+    image_list.push_back({width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * 4)});
+    return (int)image_list.size() - 1;
+}
+
+
+int TextureAtlas::add(const std::string &path)
+{
+    return loadImage(path, image_list) ? (int)image_list.size() - 1 : -1;
+}
+
+
+bool TextureAtlas::pack(int max_size)
+{
+    int n = (int)image_list.size();
+    if (n == 0)
+        return false;
+
+    // Slot of each image: image plus gutter, rounded up to the alignment.
+    std::vector<int> slot_w(n), slot_h(n), order(n);
+    double area = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        slot_w[i] = (image_list[i].width + 2 * padding + padding - 1) / padding * padding;
+        slot_h[i] = (image_list[i].height + 2 * padding + padding - 1) / padding * padding;
+        area += (double)slot_w[i] * slot_h[i];
+        order[i] = i;
+    }
+    // Tall images first pack tighter on a skyline.
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return slot_h[a] != slot_h[b] ? slot_h[a] > slot_h[b] : slot_w[a] > slot_w[b];
+    });
+
+    int w = 1, h = 1;
+    while ((double)w * h < area)
+        (w <= h ? w : h) *= 2;
+
+    SkylinePacker packer;
+    place_x.assign(n, 0);
+    place_y.assign(n, 0);
+    for (; w <= max_size && h <= max_size; (w <= h ? w : h) *= 2)
+    {
+        packer.reset(w, h);
+        bool all = true;
+        for (int i : order)
+            if (!(all = packer.insert(slot_w[i], slot_h[i], place_x[i], place_y[i])))
+                break;
+        if (!all)
+            continue;
+
+        atlas_w = w;
+        atlas_h = h;
+        regions.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            AtlasRegion &r = regions[i];
+            r.u0 = float(place_x[i] + padding) / w;
+            r.v0 = float(place_y[i] + padding) / h;
+            r.u1 = float(place_x[i] + padding + image_list[i].width) / w;
+            r.v1 = float(place_y[i] + padding + image_list[i].height) / h;
+            r.layer = 0;
+        }
+        std::cout << "Atlas: " << n << " image(s) in " << w << "x" << h << ", "
+                  << int(occupancy() * 100.0f + 0.5f) << "% used" << std::endl;
+        return true;
+    }
+    std::cerr << "Atlas: images do not fit in " << max_size << "x" << max_size << std::endl;
+    return false;
+}
+
+
+GLuint TextureAtlas::upload() const
+{
+    // Gutters repeat the edge texels of each image.
+    std::vector<unsigned char> atlas((size_t)atlas_w * atlas_h * 4, 0);
+    for (size_t i = 0; i < image_list.size(); i++)
+    {
+        const AtlasImage &img = image_list[i];
+        int x0 = place_x[i], y0 = place_y[i];
+        int x1 = std::min(x0 + img.width + 2 * padding, atlas_w), y1 = std::min(y0 + img.height + 2 * padding, atlas_h);
+        for (int y = y0; y < y1; y++)
+        {
+            int sy = std::min(std::max(y - y0 - padding, 0), img.height - 1);
+            for (int x = x0; x < x1; x++)
+            {
+                int sx = std::min(std::max(x - x0 - padding, 0), img.width - 1);
+                memcpy(&atlas[((size_t)y * atlas_w + x) * 4], &img.pixels[((size_t)sy * img.width + sx) * 4], 4);
+            }
+        }
+    }
+
+    MipChain mips;
+    mips.build(atlas.data(), atlas_w, atlas_h, 4);
+    // Past log2(padding) levels the images would blend into each other.
+    int levels = std::min(safe_levels + 1, mips.levels());
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    for (int i = 0; i < levels; i++)
+    {
+        const MipLevel &l = mips.level(i);
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, l.data);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+
+void TextureAtlas::remap(float *uv, size_t count, size_t stride, int image) const
+{
+    const AtlasRegion &r = regions[image];
+    for (size_t i = 0; i < count; i++, uv += stride)
+    {
+        float u = std::min(std::max(uv[0], 0.0f), 1.0f), v = std::min(std::max(uv[1], 0.0f), 1.0f);
+        uv[0] = r.u0 + u * (r.u1 - r.u0);
+        uv[1] = r.v0 + v * (r.v1 - r.v0);
+    }
+}
+
+
+float TextureAtlas::occupancy() const
+{
+    if (!atlas_w)
+        return 0.0f;
+    double used = 0.0;
+    for (const AtlasImage &img : image_list)
+        used += (double)img.width * img.height;
+    return float(used / ((double)atlas_w * atlas_h));
+}
+
+
+int TextureArray::add(const unsigned char *pixels, int width, int height)
+{
+    image_list.push_back({width, height, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * 4)});
+    return (int)image_list.size() - 1;
+}
+
+
+int TextureArray::add(const std::string &path)
+{
+    return loadImage(path, image_list) ? (int)image_list.size() - 1 : -1;
+}
+
+
+GLuint TextureArray::upload(int width, int height, GLint wrap) const
+{
+    int widest = 1, tallest = 1;
+    for (const AtlasImage &img : image_list)
+    {
+        widest = std::max(widest, img.width);
+        tallest = std::max(tallest, img.height);
+    }
+    if (width <= 0)
+        width = widest;
+    if (height <= 0)
+        height = tallest;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    int layers = (int)image_list.size();
+    for (int i = 0; i < layers; i++)
+    {
+        const AtlasImage &img = image_list[i];
+        MipChain mips;
+        if (img.width == width && img.height == height)
+            mips.build(img.pixels.data(), width, height, 4);
+        else
+            mips.build(resize(img, width, height).data(), width, height, 4);
+
+        if (i == 0)
+        {
+            // Storage for every level of every layer.
+            for (int l = 0; l < mips.levels(); l++)
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8, mips.level(l).width, mips.level(l).height, layers,
+                             0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mips.levels() - 1);
+        }
+        for (int l = 0; l < mips.levels(); l++)
+        {
+            const MipLevel &m = mips.level(l);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, i, m.width, m.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, m.data);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    std::cout << "Texture array: " << layers << " layer(s) of " << width << "x" << height << std::endl;
+    return texture;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file texture_atlas.h
+ * Texture atlas and texture array packing.
+ *
+ * Scenes with one texture per material bind a different texture for every
+ * object. Packing the images into one texture lets them draw with a single
+ * binding:
+ *
+ * - TextureAtlas packs the images side by side in one 2D texture (skyline
+ *   bottom-left packer) and gives each one a UV rectangle; remap() moves a
+ *   mesh's UVs into it. Every image is surrounded by a gutter of repeated
+ *   edge texels, and rectangles are aligned so that mip levels up to
+ *   log2(padding) never mix texels of two images. Wrapping is clamp only.
+ *
+ * - TextureArray stores the images as layers of a GL_TEXTURE_2D_ARRAY,
+ *   resized to a common size. UVs stay as they are (repeat works) and the
+ *   layer is picked in the shader.
+ *
+ * Images are RGBA; color is treated as sRGB when filtering (see mipmap.h).
+ * Loading from files uses the stb_image implementation compiled in
+ * texture_manager.cpp.
+ */
+
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <GL/glew.h>
+
+
+/** Where an image ended up. */
+struct AtlasRegion
+{
+    /** UV rectangle (0 to 1 for array layers). */
+    float u0, v0, u1, v1;
+    /** Layer (0 in an atlas). */
+    int layer;
+};
+
+/** An image to pack (RGBA). */
+struct AtlasImage
+{
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+
+/**
+ * Skyline rectangle packer (bottom-left heuristic).
+ *
+ * The skyline is the upper outline of the placed rectangles; each new
+ * rectangle goes where its top ends lowest, then leftmost.
+ */
+class SkylinePacker
+{
+public:
+    /**
+     * Start packing.
+     *
+     * @param width Bin width.
+     * @param height Bin height.
+     */
+    void reset(int, int);
+
+    /**
+     * Place a rectangle.
+     *
+     * @param w Width.
+     * @param h Height.
+     * @param x Receives the left edge.
+     * @param y Receives the bottom edge.
+     * @return False if it does not fit.
+     */
+    bool insert(int, int, int &, int &);
+
+private:
+    /** Skyline segment: [x, x + width) at height y. */
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    int bin_w = 0, bin_h = 0;
+    std::vector<Segment> skyline;
+
+    int fit(size_t, int, int) const;
+};
+
+
+/**
+ * Texture atlas.
+ */
+class TextureAtlas
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param padding Gutter around each image in texels (rounded up to a
+     *                power of two); mip levels up to log2(padding) are safe.
+     */
+    explicit TextureAtlas(int = 8);
+
+    /**
+     * Add an image.
+     *
+     * @param pixels RGBA pixels (copied).
+     * @param width Width.
+     * @param height Height.
+     * @return Image index.
+     */
+    int add(const unsigned char *, int, int);
+
+    /**
+     * Add an image file.
+     *
+     * @param path Image file.
+     * @return Image index, or -1 if the file cannot be read.
+     */
+    int add(const std::string &);
+
+    /**
+     * Pack the images.
+     *
+     * Tries power-of-two sizes from the smallest that could hold them up to
+     * max_size.
+     *
+     * @param max_size Largest atlas side.
+     * @return False if the images do not fit.
+     */
+    bool pack(int = 8192);
+
+    /**
+     * Create the GL texture.
+     *
+     * Builds the mip levels that the gutters keep separate.
+     *
+     * @return Texture name.
+     */
+    GLuint upload() const;
+
+    /** @return Region of image i (valid after pack). */
+    const AtlasRegion &region(int i) const { return regions[i]; }
+
+    /**
+     * Move UVs into an image's region.
+     *
+     * UVs are clamped to [0, 1] first (atlases cannot repeat).
+     *
+     * @param uv First UV pair.
+     * @param count Number of vertices.
+     * @param stride Floats from one UV pair to the next.
+     * @param image Image index.
+     */
+    void remap(float *, size_t, size_t, int) const;
+
+    /** @return Atlas width (after pack). */
+    int width() const { return atlas_w; }
+    /** @return Atlas height (after pack). */
+    int height() const { return atlas_h; }
+    /** @return Number of images. */
+    int images() const { return (int)image_list.size(); }
+    /** @return Fraction of the atlas covered by images. */
+    float occupancy() const;
+
+private:
+    int padding, safe_levels;
+    std::vector<AtlasImage> image_list;
+    std::vector<AtlasRegion> regions;
+    /** Placement (texels, gutter included) of each image. */
+    std::vector<int> place_x, place_y;
+    int atlas_w = 0, atlas_h = 0;
+};
+
+
+/**
+ * Texture array.
+ */
+class TextureArray
+{
+public:
+    /** @copydoc TextureAtlas::add(const unsigned char *, int, int) */
+    int add(const unsigned char *, int, int);
+    /** @copydoc TextureAtlas::add(const std::string &) */
+    int add(const std::string &);
+
+    /**
+     * Create the GL texture.
+     *
+     * Images of another size are resized (bilinear, in linear light).
+     *
+     * @param width Layer width (0 = widest image).
+     * @param height Layer height (0 = tallest image).
+     * @param wrap Wrap mode for S and T.
+     * @return Texture name (GL_TEXTURE_2D_ARRAY).
+     */
+    GLuint upload(int = 0, int = 0, GLint = GL_REPEAT) const;
+
+    /** @return Region of image i (whole layer i). */
+    AtlasRegion region(int i) const { return {0.0f, 0.0f, 1.0f, 1.0f, i}; }
+    /** @return Number of layers. */
+    int layers() const { return (int)image_list.size(); }
+
+private:
+    std::vector<AtlasImage> image_list;
+};
+
+#endif
@@ -0,0 +1,609 @@
+/**
+ * @file texture_compress.cpp
+ * Block texture compression.
+ *
+ * Implements the encoders declared in texture_compress.h.
+ */
+
+#include "texture_compress.h"
+#include "job_system.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+
+/** Pixels of one 4x4 block, RGBA. */
+typedef uint8_t Block[16][4];
+
+/** BC7 4-bit index weights (out of 64). */
+static const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+
+/**
+ * Read one block, repeating the last row/column past the image edges.
+ */
+static void fetchBlock(const unsigned char *pixels, int width, int height, int channels,
+                       int bx, int by, Block px)
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const unsigned char *p = pixels + ((size_t)sy * width + sx) * channels;
+            uint8_t *d = px[y * 4 + x];
+            d[0] = p[0];
+            d[1] = p[1];
+            d[2] = p[2];
+            d[3] = channels == 4 ? p[3] : 255;
+        }
+    }
+}
+
+
+/**
+ * Principal axis of the block colors.
+ *
+ * Power iteration on the covariance matrix of the first n channels.
+ *
+ * @param px Block.
+ * @param n Channels (3 or 4).
+ * @param iterations Power iterations.
+ * @param mean Receives the mean color.
+ * @param axis Receives the unit axis (zero if the block is flat).
+ */
+static void principalAxis(const Block px, int n, int iterations, float mean[4], float axis[4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        float s = 0.0f;
+        for (int i = 0; i < 16; i++)
+            s += px[i][c];
+        mean[c] = s / 16.0f;
+        axis[c] = 0.0f;
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float d[4];
+        for (int c = 0; c < n; c++)
+            d[c] = px[i][c] - mean[c];
+        for (int a = 0; a < n; a++)
+            for (int b = a; b < n; b++)
+                cov[a][b] += d[a] * d[b];
+    }
+    for (int a = 0; a < n; a++)
+        for (int b = 0; b < a; b++)
+            cov[a][b] = cov[b][a];
+
+    // Start from the channel with the largest variance.
+    int start = 0;
+    for (int c = 1; c < n; c++)
+        if (cov[c][c] > cov[start][start])
+            start = c;
+    if (cov[start][start] < 1e-3f)
+        return;
+
+    float v[4] = {};
+    for (int c = 0; c < n; c++)
+        v[c] = cov[start][c];
+    for (int it = 0; it < iterations; it++)
+    {
+        float w[4] = {}, len = 0.0f;
+        for (int a = 0; a < n; a++)
+        {
+            for (int b = 0; b < n; b++)
+                w[a] += cov[a][b] * v[b];
+            len = std::max(len, std::fabs(w[a]));
+        }
+        if (len < 1e-9f)
+            return;
+        for (int c = 0; c < n; c++)
+            v[c] = w[c] / len;
+    }
+
+    float len = 0.0f;
+    for (int c = 0; c < n; c++)
+        len += v[c] * v[c];
+    len = std::sqrt(len);
+    for (int c = 0; c < n; c++)
+        axis[c] = v[c] / len;
+}
+
+
+/**
+ * Endpoints at the extremes of the block along an axis.
+ *
+ * @param inset Pull both endpoints in by this fraction of the range.
+ */
+static void axisEndpoints(const Block px, int n, const float mean[4], const float axis[4],
+                          float inset, float e0[4], float e1[4])
+{
+    float lo = 0.0f, hi = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < n; c++)
+            t += (px[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    float d = (hi - lo) * inset;
+    for (int c = 0; c < 4; c++)
+    {
+        e0[c] = std::min(std::max(mean[c] + (hi - d) * axis[c], 0.0f), 255.0f);
+        e1[c] = std::min(std::max(mean[c] + (lo + d) * axis[c], 0.0f), 255.0f);
+    }
+}
+
+
+/**
+ * Least squares endpoints for fixed interpolation weights.
+ *
+ * Minimizes sum |w_i e0 + (1 - w_i) e1 - px_i|^2.
+ *
+ * @param w Weight of e0 for each pixel.
+ * @return False if the weights do not determine both endpoints.
+ */
+static bool leastSquares(const Block px, int n, const float w[16], float e0[4], float e1[4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float a = w[i], b = 1.0f - w[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < n; c++)
+        {
+            ax[c] += a * px[i][c];
+            bx[c] += b * px[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < n; c++)
+    {
+        e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / det, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+
+/** Quantize to RGB 5:6:5. */
+static int to565(const float c[4])
+{
+    int r = (int)std::lround(c[0] * 31.0f / 255.0f);
+    int g = (int)std::lround(c[1] * 63.0f / 255.0f);
+    int b = (int)std::lround(c[2] * 31.0f / 255.0f);
+    return (r << 11) | (g << 5) | b;
+}
+
+/** Expand RGB 5:6:5 to 8 bits per channel. */
+static void from565(int v, int c[3])
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+
+/**
+ * Best BC1 indices for two endpoints (four color mode, c0 > c1).
+ *
+ * @param indices Receives 2 bits per pixel.
+ * @return Squared error.
+ */
+static int fitBC1(const Block px, int c0, int c1, uint32_t &indices)
+{
+    int pal[4][3];
+    from565(c0, pal[0]);
+    from565(c1, pal[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+        pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+    }
+    int colors = c0 == c1 ? 1 : 4;
+
+    int err = 0;
+    indices = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, best_d = INT32_MAX;
+        for (int k = 0; k < colors; k++)
+        {
+            int dr = px[i][0] - pal[k][0], dg = px[i][1] - pal[k][1], db = px[i][2] - pal[k][2];
+            int d = dr * dr + dg * dg + db * db;
+            if (d < best_d)
+            {
+                best_d = d;
+                best = k;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+        err += best_d;
+    }
+    return err;
+}
+
+
+/**
+ * Encode the color part of a BC1/BC3 block (8 bytes).
+ */
+static void encodeBC1(const Block px, CompressQuality quality, uint8_t *out)
+{
+    float mean[4], axis[4], e0[4], e1[4];
+    principalAxis(px, 3, quality == COMPRESS_QUALITY ? 8 : 3, mean, axis);
+    axisEndpoints(px, 3, mean, axis, 1.0f / 16.0f, e0, e1);
+
+    int c0 = to565(e0), c1 = to565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    uint32_t indices;
+    int err = fitBC1(px, c0, c1, indices);
+
+    if (quality == COMPRESS_QUALITY)
+    {
+        static const float weight_of[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        for (int it = 0; it < 2 && err > 0; it++)
+        {
+            float w[16];
+            for (int i = 0; i < 16; i++)
+                w[i] = weight_of[(indices >> (2 * i)) & 3];
+            if (!leastSquares(px, 3, w, e0, e1))
+                break;
+            int n0 = to565(e0), n1 = to565(e1);
+            if (n0 < n1)
+                std::swap(n0, n1);
+            uint32_t n_indices;
+            int n_err = fitBC1(px, n0, n1, n_indices);
+            if (n_err >= err)
+                break;
+            c0 = n0;
+            c1 = n1;
+            indices = n_indices;
+            err = n_err;
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+
+/**
+ * Encode the alpha part of a BC3 block (8 bytes).
+ *
+ * Uses the eight level mode between the smallest and largest alpha.
+ */
+static void encodeAlpha(const Block px, uint8_t *out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        a0 = std::max(a0, (int)px[i][3]);
+        a1 = std::min(a1, (int)px[i][3]);
+    }
+
+    int pal[8] = {a0, a1};
+    for (int k = 1; k < 7; k++)
+        pal[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+
+    uint64_t indices = 0;
+    if (a0 != a1)
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, best_d = 256;
+            for (int k = 0; k < 8; k++)
+            {
+                int d = std::abs(px[i][3] - pal[k]);
+                if (d < best_d)
+                {
+                    best_d = d;
+                    best = k;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+
+/** BC7 endpoint: 7 bits per channel plus a shared p-bit. */
+struct Bc7Endpoint
+{
+    int q[4], p;
+
+    /** Decoded 8-bit value of channel c. */
+    int value(int c) const { return (q[c] << 1) | p; }
+};
+
+/** Quantize an endpoint with a given p-bit. */
+static Bc7Endpoint quantizeBC7(const float e[4], int p)
+{
+    Bc7Endpoint r;
+    r.p = p;
+    for (int c = 0; c < 4; c++)
+        r.q[c] = std::min(std::max((int)std::lround((e[c] - p) * 0.5f), 0), 127);
+    return r;
+}
+
+/** Quantize an endpoint, choosing the p-bit with the smaller error. */
+static Bc7Endpoint quantizeBC7(const float e[4], bool opaque)
+{
+    Bc7Endpoint best = quantizeBC7(e, 1);
+    if (opaque)
+        return best;
+    Bc7Endpoint other = quantizeBC7(e, 0);
+    float eb = 0.0f, eo = 0.0f;
+    for (int c = 0; c < 4; c++)
+    {
+        eb += (best.value(c) - e[c]) * (best.value(c) - e[c]);
+        eo += (other.value(c) - e[c]) * (other.value(c) - e[c]);
+    }
+    return eo < eb ? other : best;
+}
+
+
+/**
+ * Best BC7 mode 6 indices for two endpoints.
+ *
+ * Projects each pixel onto the endpoint segment and checks the nearest
+ * three weights.
+ *
+ * @param indices Receives one 4-bit index per pixel.
+ * @return Squared error.
+ */
+static int fitBC7(const Block px, const Bc7Endpoint &a, const Bc7Endpoint &b, uint8_t indices[16])
+{
+    int pal[16][4];
+    for (int k = 0; k < 16; k++)
+        for (int c = 0; c < 4; c++)
+            pal[k][c] = ((64 - bc7_weights[k]) * a.value(c) + bc7_weights[k] * b.value(c) + 32) >> 6;
+
+    float d[4], dd = 0.0f;
+    for (int c = 0; c < 4; c++)
+    {
+        d[c] = float(b.value(c) - a.value(c));
+        dd += d[c] * d[c];
+    }
+
+    int err = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int guess = 0;
+        if (dd > 0.0f)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < 4; c++)
+                t += (px[i][c] - a.value(c)) * d[c];
+            guess = std::min(std::max((int)std::lround(t / dd * 15.0f), 0), 15);
+        }
+        int best = guess, best_d = INT32_MAX;
+        for (int k = std::max(guess - 1, 0); k <= std::min(guess + 1, 15); k++)
+        {
+            int s = 0;
+            for (int c = 0; c < 4; c++)
+                s += (px[i][c] - pal[k][c]) * (px[i][c] - pal[k][c]);
+            if (s < best_d)
+            {
+                best_d = s;
+                best = k;
+            }
+        }
+        indices[i] = best;
+        err += best_d;
+    }
+    return err;
+}
+
+
+/** Little-endian bit writer for one 128-bit block. */
+struct BitWriter
+{
+    uint8_t *out;
+    int pos = 0;
+
+    explicit BitWriter(uint8_t *o) : out(o) { memset(out, 0, 16); }
+
+    void put(unsigned value, int bits)
+    {
+        for (int i = 0; i < bits; i++, pos++)
+            if ((value >> i) & 1)
+                out[pos >> 3] |= 1 << (pos & 7);
+    }
+};
+
+
+/**
+ * Encode a BC7 block in mode 6 (one subset, RGBA 7.7.7.7 + p-bit
+ * endpoints, 4-bit indices).
+ */
+static void encodeBC7(const Block px, CompressQuality quality, uint8_t *out)
+{
+    bool opaque = true;
+    for (int i = 0; i < 16; i++)
+        opaque = opaque && px[i][3] == 255;
+
+    float mean[4], axis[4], e0[4], e1[4];
+    principalAxis(px, 4, quality == COMPRESS_QUALITY ? 8 : 3, mean, axis);
+    axisEndpoints(px, 4, mean, axis, 0.0f, e0, e1);
+
+    Bc7Endpoint a = quantizeBC7(e0, opaque), b = quantizeBC7(e1, opaque);
+    uint8_t indices[16];
+    int err = fitBC7(px, a, b, indices);
+
+    if (quality == COMPRESS_QUALITY)
+    {
+        for (int it = 0; it < 2 && err > 0; it++)
+        {
+            float w[16];
+            for (int i = 0; i < 16; i++)
+                w[i] = 1.0f - bc7_weights[indices[i]] / 64.0f;
+            if (!leastSquares(px, 4, w, e0, e1))
+                break;
+
+            // Try every p-bit pair.
+            bool improved = false;
+            for (int p = opaque ? 3 : 0; p < 4; p++)
+            {
+                Bc7Endpoint na = quantizeBC7(e0, p & 1), nb = quantizeBC7(e1, p >> 1);
+                uint8_t n_indices[16];
+                int n_err = fitBC7(px, na, nb, n_indices);
+                if (n_err < err)
+                {
+                    a = na;
+                    b = nb;
+                    memcpy(indices, n_indices, 16);
+                    err = n_err;
+                    improved = true;
+                }
+            }
+            if (!improved)
+                break;
+        }
+    }
+
+    // The first index is stored with 3 bits; its top bit must be zero.
+    if (indices[0] & 8)
+    {
+        std::swap(a, b);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    BitWriter bits(out);
+    bits.put(1 << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        bits.put(a.q[c], 7);
+        bits.put(b.q[c], 7);
+    }
+    bits.put(a.p, 1);
+    bits.put(b.p, 1);
+    bits.put(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        bits.put(indices[i], 4);
+}
+
+
+int blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+
+size_t compressedSize(int width, int height, BlockFormat format)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+
+GLenum blockGLFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BLOCK_BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+    }
+}
+
+
+bool blockFormatSupported(BlockFormat format)
+{
+    if (format == BLOCK_BC7)
+        return GLEW_ARB_texture_compression_bptc;
+    return GLEW_EXT_texture_compression_s3tc;
+}
+
+
+void compressImage(const unsigned char *pixels, int width, int height, int channels,
+                   BlockFormat format, CompressQuality quality, unsigned char *out, int threads)
+{
+    int bw = (width + 3) / 4, bh = (height + 3) / 4;
+    size_t row_bytes = (size_t)bw * blockBytes(format);
+
+    auto work = [&](int row0, int row1)
+    {
+        Block px;
+        for (int by = row0; by < row1; by++)
+        {
+            uint8_t *dst = out + by * row_bytes;
+            for (int bx = 0; bx < bw; bx++)
+            {
+                fetchBlock(pixels, width, height, channels, bx, by, px);
+                switch (format)
+                {
+                case BLOCK_BC1:
+                    encodeBC1(px, quality, dst);
+                    dst += 8;
+                    break;
+                case BLOCK_BC3:
+                    encodeAlpha(px, dst);
+                    encodeBC1(px, quality, dst + 8);
+                    dst += 16;
+                    break;
+                case BLOCK_BC7:
+                    encodeBC7(px, quality, dst);
+                    dst += 16;
+                    break;
+                }
+            }
+        }
+    };
+
+    if (threads <= 0)
+        threads = jobSystem().workers() + 1;
+    // Small levels are not worth a job each.
+    threads = std::min(threads, std::max(1, bh / 16));
+    if (threads == 1)
+    {
+        work(0, bh);
+        return;
+    }
+
+    // Several chunks per thread, so stealing evens out rows that cost more
+    // than others.
+    jobSystem().parallelFor(0, bh, std::max(1, bh / (4 * threads)), work);
+}
+
+
+void compressMipChain(const MipChain &src, BlockFormat format, CompressQuality quality,
+                      MipChain &dst, int threads)
+{
+    std::vector<MipLevel> layout;
+    for (int i = 0; i < src.levels(); i++)
+    {
+        const MipLevel &l = src.level(i);
+        layout.push_back({l.width, l.height, nullptr, compressedSize(l.width, l.height, format)});
+    }
+
+    unsigned char *out = dst.allocate(layout, src.channels(), blockGLFormat(format));
+    for (int i = 0; i < src.levels(); i++)
+    {
+        const MipLevel &l = src.level(i);
+        compressImage(l.data, l.width, l.height, src.channels(), format, quality, out, threads);
+        out += layout[i].size;
+    }
+}
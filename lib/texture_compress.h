@@ -0,0 +1,95 @@
+/**
+ * @file texture_compress.h
+ * Block texture compression.
+ *
+ * CPU encoders for the block formats GPUs sample directly:
+ *   BC1 (DXT1)  RGB,  8 bytes per 4x4 block (0.5 byte per texel),
+ *   BC3 (DXT5)  RGBA, 16 bytes per block (BC1 color + 8-level alpha),
+ *   BC7         RGBA, 16 bytes per block, much better color (mode 6 only).
+ *
+ * Fast mode fits endpoints to the principal axis of the block colors;
+ * quality mode also refines them by least squares and, for BC7, searches
+ * the p-bits. Images are split into rows of blocks encoded in parallel on
+ * the job system (job_system.h).
+ */
+
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <cstddef>
+#include <GL/glew.h>
+#include "mipmap.h"
+
+
+/** Block formats. */
+enum BlockFormat
+{
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC7
+};
+
+/** Encoder effort. */
+enum CompressQuality
+{
+    COMPRESS_FAST,
+    COMPRESS_QUALITY
+};
+
+
+/**
+ * Bytes per 4x4 block.
+ */
+int blockBytes(BlockFormat);
+
+/**
+ * Compressed size of an image.
+ *
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param format Block format.
+ * @return Bytes (partial blocks at the edges count as whole blocks).
+ */
+size_t compressedSize(int, int, BlockFormat);
+
+/**
+ * GL internal format of a block format.
+ */
+GLenum blockGLFormat(BlockFormat);
+
+/**
+ * Check driver support.
+ *
+ * Needs a current context.
+ *
+ * @return True if textures in the format can be uploaded.
+ */
+bool blockFormatSupported(BlockFormat);
+
+/**
+ * Compress an image.
+ *
+ * @param pixels Pixels, rows tightly packed.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param channels 3 (RGB) or 4 (RGBA).
+ * @param format Block format.
+ * @param quality Encoder effort.
+ * @param out Receives compressedSize(width, height, format) bytes.
+ * @param threads Parallelism (0 = all job system threads; 1 = this thread only).
+ */
+void compressImage(const unsigned char *, int, int, int, BlockFormat, CompressQuality,
+                   unsigned char *, int = 0);
+
+/**
+ * Compress every level of a mip chain.
+ *
+ * @param src Raw chain with 3 or 4 channels.
+ * @param format Block format.
+ * @param quality Encoder effort.
+ * @param dst Receives the compressed chain (format() is the GL format).
+ * @param threads Parallelism (0 = all job system threads; 1 = this thread only).
+ */
+void compressMipChain(const MipChain &, BlockFormat, CompressQuality, MipChain &, int = 0);
+
+#endif
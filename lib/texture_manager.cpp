@@ -0,0 +1,582 @@
+/**
+ * @file texture_manager.cpp
+ * Asynchronous texture loading.
+ *
+ * Implements the texture manager declared in texture_manager.h.
+ */
+
+#include "texture_manager.h"
+#include "cache_dir.h"
+#include "job_system.h"
+#include "trace.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+
+/** Milliseconds elapsed since start. */
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * FNV-1a hash of a byte buffer.
+ *
+ * @param data Bytes.
+ * @param size Number of bytes.
+ * @param seed Initial value (mixes in options that change the result).
+ * @return 64-bit hash.
+ */
+static uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t seed)
+{
+    uint64_t h = 14695981039346656037ULL ^ seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+/** Mip container path for a hash. */
+static std::string cachePath(const std::string &dir, uint64_t h)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.mip", (unsigned long long)h);
+    return dir + name;
+}
+
+
+TextureManager::TextureManager(int threads) : thread_count(threads)
+{
+
+    if (const char *mode = getenv("CG_TEXTURE_COMPRESSION"))
+    {
+        std::string m = mode;
+        CompressQuality quality = COMPRESS_FAST;
+        size_t hq = m.find("-hq");
+        if (hq != std::string::npos)
+        {
+            quality = COMPRESS_QUALITY;
+            m.erase(hq);
+        }
+        if (m == "bc")
+            setCompression(COMPRESSION_BC, quality);
+        else if (m == "bc7")
+            setCompression(COMPRESSION_BC7, quality);
+        else if (m != "" && m != "none")
+            std::cerr << "CG_TEXTURE_COMPRESSION: unknown mode " << mode << std::endl;
+    }
+    if (const char *ops = getenv("CG_TEXTURE_OPS"))
+        setImageOps(ops);
+}
+
+
+TextureManager::~TextureManager()
+{
+    stop();
+}
+
+
+/**
+ * Drop the queued requests and wait for the decodes in progress.
+ */
+void TextureManager::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobSystem().wait([this] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return running == 0;
+    });
+    stopping = false;
+}
+
+
+/**
+ * Submit decode jobs for queued entries while fewer than thread_count run
+ * (mutex held).
+ */
+void TextureManager::launch()
+{
+    // Resolved here: managers are often globals, constructed before main()
+    if (thread_count <= 0)
+        thread_count = std::min(4, jobSystem().workers() + 1);
+    while (!stopping && running < thread_count && !jobs.empty())
+    {
+        Entry *e = jobs.front();
+        jobs.pop_front();
+        running++;
+        jobSystem().run([this, e] { decode(e); });
+    }
+}
+
+
+/**
+ * Read and decode one file (decode job).
+ *
+ * Files whose contents match one already seen are not decoded again; the
+ * entry is marked as a duplicate instead.
+ *
+ * @param e Entry to decode.
+ */
+void TextureManager::decode(Entry *e)
+{
+    TRACE_SCOPE("decode texture");
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char> bytes;
+
+    std::ifstream in(e->path, std::ios::binary | std::ios::ate);
+    if (in)
+    {
+        std::streamsize size = in.tellg();
+        if (size > 0 && size < INT_MAX)
+        {
+            bytes.resize(size);
+            in.seekg(0);
+            in.read((char *)bytes.data(), size);
+        }
+    }
+
+    if (bytes.empty() || !in)
+        e->error = "cannot read file";
+    else
+    {
+        // Processed images get their own key (unprocessed keys are unchanged).
+        uint64_t seed = e->ops.empty() ? 0 : hashBytes((const unsigned char *)e->ops.data(), e->ops.size(), 0);
+        uint64_t h = hashBytes(bytes.data(), bytes.size(), e->channels ^ seed);
+        // Duplicates share the GL texture, so they must also agree on the
+        // settings baked into it; h alone still names the cached levels.
+        const int settings[] = {e->wrap, e->compression, e->quality};
+        uint64_t same = h ^ hashBytes((const unsigned char *)settings, sizeof(settings), 0);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = by_hash.find(same);
+            if (it != by_hash.end() && it->second != e)
+                e->duplicate_of = it->second;
+            else
+                by_hash[same] = e;
+        }
+
+        if (!e->duplicate_of)
+        {
+            // Mapped levels from an earlier run, or decode and build them.
+            // Compressed chains are cached under a key that also covers the
+            // compression settings; the raw chain is still cached, so a
+            // change of settings only re-encodes.
+            std::string dir = mipCacheDir();
+            bool use_cache = !cacheDisabled("CG_NO_MIP_CACHE");
+            std::string packed_path;
+            if (e->compression != COMPRESSION_NONE)
+                packed_path = cachePath(dir, h ^ (0x9e3779b97f4a7c15ULL * (2 * e->compression + e->quality)));
+
+            e->from_cache = use_cache && !packed_path.empty() && e->mips.load(packed_path);
+            if (!e->from_cache)
+                e->from_cache = use_cache && e->mips.load(cachePath(dir, h));
+            if (!e->from_cache)
+            {
+                int w, hgt, n;
+                traceBegin("stbi_load");
+                unsigned char *pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(),
+                                                              &w, &hgt, &n, e->channels);
+                traceEnd();
+                if (!pixels)
+                    e->error = stbi_failure_reason();
+                else
+                {
+                    int channels = e->channels ? e->channels : n;
+                    if (e->op_list.empty())
+                        e->mips.build(pixels, w, hgt, channels);
+                    else
+                    {
+                        Image image;
+                        image.width = w;
+                        image.height = hgt;
+                        image.channels = channels;
+                        image.pixels.assign(pixels, pixels + (size_t)w * hgt * channels);
+                        auto ops_start = std::chrono::steady_clock::now();
+                        traceBegin("image ops");
+                        applyImageOps(image, e->op_list);
+                        traceEnd();
+                        e->ops_ms = elapsedMs(ops_start);
+                        e->mips.build(image.pixels.data(), image.width, image.height, channels);
+                    }
+                    stbi_image_free(pixels);
+                    if (use_cache && makeDirs(dir))
+                        e->mips.save(cachePath(dir, h));
+                }
+            }
+
+            int n = e->mips.channels();
+            if (!packed_path.empty() && !e->mips.format() && (n == 3 || n == 4))
+            {
+                BlockFormat format = e->compression == COMPRESSION_BC7 ? BLOCK_BC7
+                                     : n == 3                         ? BLOCK_BC1
+                                                                      : BLOCK_BC3;
+                auto encode_start = std::chrono::steady_clock::now();
+                MipChain packed;
+                traceBegin("compress");
+                compressMipChain(e->mips, format, e->quality, packed);
+                traceEnd();
+                for (int i = 0; i < e->mips.levels(); i++)
+                    e->encoded_pixels += (size_t)e->mips.level(i).width * e->mips.level(i).height;
+                e->mips.swap(packed);
+                e->encode_ms = elapsedMs(encode_start);
+                if (use_cache && makeDirs(dir))
+                    e->mips.save(packed_path);
+            }
+        }
+    }
+    e->decode_start = start;
+    e->decode_end = std::chrono::steady_clock::now();
+    e->decode_ms = std::chrono::duration<double, std::milli>(e->decode_end - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    done.push_back(e);
+    running--;
+    launch();
+}
+
+
+int TextureManager::request(const std::string &path, GLint wrap, int channels)
+{
+    requests++;
+
+    // Same file under different relative paths maps to the same entry.
+    char *real = realpath(path.c_str(), NULL);
+    std::string key = (real ? std::string(real) : path) + "#" + std::to_string(channels) + "#" + std::to_string(wrap)
+                      + "#" + std::to_string(compression) + "#" + std::to_string(compress_quality) + "#" + image_ops;
+    free(real);
+
+    auto it = by_path.find(key);
+    if (it != by_path.end())
+        return it->second;
+
+    int handle = (int)entries.size();
+    entries.emplace_back();
+    Entry &e = entries.back();
+    e.path = path;
+    e.wrap = wrap;
+    e.channels = channels;
+    e.compression = compression;
+    e.quality = compress_quality;
+    e.ops = image_ops;
+    e.op_list = image_op_list;
+    by_path[key] = handle;
+    outstanding++;
+    enqueue(&e);
+    return handle;
+}
+
+
+/**
+ * Queue an entry for decoding.
+ */
+void TextureManager::enqueue(Entry *e)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(e);
+    launch();
+}
+
+
+bool TextureManager::setImageOps(const std::string &ops)
+{
+    std::vector<ImageOp> list;
+    std::string error;
+    if (!parseImageOps(ops, list, &error))
+    {
+        std::cerr << "Image operations: " << error << std::endl;
+        return false;
+    }
+    image_ops = list.empty() ? "" : ops;
+    image_op_list = list;
+    return true;
+}
+
+
+void TextureManager::setCompression(TextureCompression mode, CompressQuality quality)
+{
+    compression = mode;
+    compress_quality = quality;
+}
+
+
+/**
+ * Upload one decoded entry (GL thread).
+ *
+ * @param e Entry taken from the done queue.
+ */
+void TextureManager::upload(Entry *e)
+{
+    GLenum block_format = e->mips.format();
+    if (block_format)
+    {
+        bool supported = block_format == blockGLFormat(BLOCK_BC7) ? GLEW_ARB_texture_compression_bptc
+                                                                   : GLEW_EXT_texture_compression_s3tc;
+        if (!supported)
+        {
+            // Load it again without compression (the raw chain is usually
+            // in the cache already).
+            std::cerr << "Texture compression not supported by the driver; disabled" << std::endl;
+            compression = COMPRESSION_NONE;
+            e->compression = COMPRESSION_NONE;
+            e->mips.release();
+            e->encoded_pixels = 0;
+            enqueue(e);
+            return;
+        }
+    }
+
+    outstanding--;
+    decode_ms += e->decode_ms;
+    encode_ms += e->encode_ms;
+    ops_ms += e->ops_ms;
+    encoded_pixels += e->encoded_pixels;
+
+    if (e->duplicate_of)
+    {
+        e->link = e->duplicate_of;
+        e->state = READY;
+        duplicates++;
+        completed++;
+        return;
+    }
+    if (!e->mips.levels())
+    {
+        std::cerr << "Failed to load texture " << e->path << ": " << e->error << std::endl;
+        e->state = FAILED;
+        failures++;
+        completed++;
+        return;
+    }
+
+    TRACE_SCOPE("upload texture");
+    auto start = std::chrono::steady_clock::now();
+    static const GLenum formats[] = {GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    int components = e->mips.channels();
+    GLenum format = formats[std::min(std::max(components, 1), 4)];
+
+    glGenTextures(1, &e->texture);
+    glBindTexture(GL_TEXTURE_2D, e->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, e->wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, e->wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, e->mips.levels() - 1);
+    if (components == 1)
+    {
+        // Grayscale: replicate red into green and blue.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (upload_budget)
+    {
+        // Levels follow a few tiles per poll().
+        if (!uploader)
+            uploader.reset(new TextureUploader(upload_budget));
+        uploader->add(e->texture, e->mips, [this, e] { uploaded(e); });
+        upload_ms += elapsedMs(start);
+        return;
+    }
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, e->texture);
+    // Levels were built on the worker; no glGenerateMipmap.
+    traceBegin("glTexImage2D");
+    for (int i = 0; i < e->mips.levels(); i++)
+    {
+        const MipLevel &l = e->mips.level(i);
+        if (block_format)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, block_format, l.width, l.height, 0, l.size, l.data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, format, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, l.data);
+    }
+    traceEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    upload_ms += elapsedMs(start);
+    uploaded(e);
+}
+
+
+/**
+ * Finish an entry whose levels are all on the GPU (GL thread).
+ *
+ * @param e Uploaded entry.
+ */
+void TextureManager::uploaded(Entry *e)
+{
+    int width = e->mips.level(0).width, height = e->mips.level(0).height;
+    int levels = e->mips.levels(), components = e->mips.channels();
+    bool compressed = e->mips.format() != 0;
+    for (int i = 0; i < levels; i++)
+    {
+        const MipLevel &l = e->mips.level(i);
+        texture_bytes += l.size;
+        raw_bytes += (size_t)l.width * l.height * components;
+    }
+    e->mips.release();
+    e->state = READY;
+    completed++;
+    if (e->from_cache)
+        cached++;
+    else
+        decoded++;
+
+    std::cout << "Texture " << e->path << ": " << width << "x" << height << ", " << components
+              << " channel(s), " << levels << " level(s), " << (compressed ? "compressed, " : "")
+              << (e->from_cache ? "mapped from cache" : "decoded") << " in " << e->decode_ms << " ms" << std::endl;
+}
+
+
+void TextureManager::setUploadBudget(size_t bytes)
+{
+    upload_budget = bytes;
+}
+
+
+int TextureManager::poll(int max_uploads)
+{
+    int before = completed;
+    std::vector<Entry *> ready_now;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = max_uploads < 0 ? done.size() : std::min(done.size(), (size_t)max_uploads);
+        ready_now.assign(done.begin(), done.begin() + n);
+        done.erase(done.begin(), done.begin() + n);
+    }
+    for (Entry *e : ready_now)
+        upload(e);
+    if (uploader && !uploader->idle())
+    {
+        auto start = std::chrono::steady_clock::now();
+        uploader->step();
+        upload_ms += elapsedMs(start);
+    }
+    return completed - before;
+}
+
+
+void TextureManager::finish()
+{
+    while (outstanding > 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        jobSystem().wait([this] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return !done.empty();
+        });
+        wait_ms += elapsedMs(start);
+        poll();
+    }
+    if (uploader)
+        uploader->flush();
+}
+
+
+GLuint TextureManager::texture(int handle)
+{
+    if (handle >= 0 && handle < (int)entries.size())
+    {
+        const Entry *e = &entries[handle];
+        while (e->link)
+            e = e->link;
+        if (e->state == READY)
+            return e->texture;
+    }
+
+    if (!placeholder)
+    {
+        const unsigned char white[] = {255, 255, 255, 255};
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return placeholder;
+}
+
+
+bool TextureManager::ready(int handle) const
+{
+    if (handle < 0 || handle >= (int)entries.size())
+        return false;
+    const Entry *e = &entries[handle];
+    while (e->link)
+        e = e->link;
+    return e->state == READY;
+}
+
+
+bool TextureManager::decodeSpan(int handle, std::chrono::steady_clock::time_point &start,
+                                std::chrono::steady_clock::time_point &end) const
+{
+    if (handle < 0 || handle >= (int)entries.size())
+        return false;
+    // The decode job writes the times before the entry enters the done
+    // queue; they are safe to read once the GL thread has taken it out.
+    const Entry &e = entries[handle];
+    if (e.state == PENDING)
+        return false;
+    start = e.decode_start;
+    end = e.decode_end;
+    return true;
+}
+
+
+void TextureManager::clear()
+{
+    finish();
+    if (uploader)
+        uploader->release();
+    for (Entry &e : entries)
+        if (e.texture)
+            glDeleteTextures(1, &e.texture);
+    if (placeholder)
+        glDeleteTextures(1, &placeholder);
+    placeholder = 0;
+    entries.clear();
+    by_path.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    by_hash.clear();
+}
+
+
+void TextureManager::printStats() const
+{
+    std::cout << "Textures: " << requests << " request(s), " << decoded << " decoded, "
+              << cached << " from mip cache (" << decode_ms << " ms, up to " << thread_count << " at once), "
+              << duplicates << " duplicate(s), " << failures << " failure(s), upload "
+              << upload_ms << " ms, waited " << wait_ms << " ms" << std::endl;
+    if (ops_ms > 0.0)
+        std::cout << "Image operations: " << ops_ms << " ms" << std::endl;
+    if (uploader)
+        std::cout << "Texture streaming: " << uploader->bytesUploaded() / 1048576.0 << " MB in "
+                  << uploader->steps() << " frame(s), longest " << uploader->maxStepMs() << " ms" << std::endl;
+    if (texture_bytes < raw_bytes)
+        std::cout << "Texture memory: " << texture_bytes / 1048576.0 << " MB ("
+                  << (raw_bytes - texture_bytes) / 1048576.0 << " MB saved by compression)" << std::endl;
+    if (encoded_pixels)
+        std::cout << "Texture compression: " << encoded_pixels / 1e6 << " Mpixels encoded in " << encode_ms
+                  << " ms (" << encoded_pixels / 1e3 / std::max(encode_ms, 1e-3) << " MPix/s)" << std::endl;
+}
@@ -0,0 +1,276 @@
+/**
+ * @file texture_manager.h
+ * Asynchronous texture loading.
+ *
+ * Image files are read and decoded (stb_image) as jobs on the shared job
+ * system (job_system.h) while the GL thread keeps working; finished images
+ * wait in a completion queue until the GL thread uploads them with poll()
+ * or finish(). While finish() waits, the GL thread runs decode jobs too.
+ *
+ * Requests are deduplicated by path and settings (wrap, channels,
+ * compression, image operations), and files with identical contents and
+ * settings share one decode and one GL texture. Loaded textures stay cached, so
+ * requesting the same file again (e.g. when reloading a model) is free.
+ *
+ * Mip levels are built on the workers (sRGB-correct, see mipmap.h) and
+ * kept in the mip cache, keyed by the file contents; later runs map the
+ * cached levels and skip decoding. Set CG_NO_MIP_CACHE=1 to bypass it.
+ *
+ * Optionally the levels are block-compressed on the workers (see
+ * texture_compress.h) and uploaded with glCompressedTexImage2D, which cuts
+ * texture memory to 1/6 (BC1) or 1/4 (BC3, BC7) of raw RGB/RGBA. The
+ * compressed chains are cached like the raw ones. Compression is chosen
+ * with setCompression() or the CG_TEXTURE_COMPRESSION variable: "bc"
+ * (BC1/BC3), "bc7", with a "-hq" suffix for the quality encoder.
+ *
+ * Images can be preprocessed on the workers before their mip levels are
+ * built (blur, sharpen, resize, grayscale, gamma; see image_ops.h), with
+ * setImageOps() or the CG_TEXTURE_OPS variable, e.g.
+ * CG_TEXTURE_OPS=resize=0.5,sharpen=0.3. Processed images are cached
+ * under a key that covers the operations.
+ *
+ * Uploads normally happen whole in poll()/finish(). With an upload budget
+ * (setUploadBudget) they go through a PBO ring instead and are spread over
+ * the following poll() calls, a few tiles per frame (see texture_upload.h).
+ *
+ * This file owns the stb_image implementation; programs using it must not
+ * define STB_IMAGE_IMPLEMENTATION themselves.
+ */
+
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <GL/glew.h>
+#include "mipmap.h"
+#include "texture_compress.h"
+#include "texture_upload.h"
+#include "image_ops.h"
+
+
+/** Texture compression modes. */
+enum TextureCompression
+{
+    COMPRESSION_NONE,
+    /** BC1 for RGB images, BC3 for RGBA images. */
+    COMPRESSION_BC,
+    /** BC7 for RGB and RGBA images. */
+    COMPRESSION_BC7
+};
+
+
+/**
+ * Texture manager.
+ *
+ * All methods except the constructor must be called from the GL thread.
+ *
+ * Typical use:
+ *   int h = textures.request("wood.png");   // decoding starts now
+ *   ... compile shaders, load models ...
+ *   textures.finish();                       // upload (waits if needed)
+ *   glBindTexture(GL_TEXTURE_2D, textures.texture(h));
+ */
+class TextureManager
+{
+public:
+    /**
+     * Constructor.
+     *
+     * Compression and image operations start as set by
+     * CG_TEXTURE_COMPRESSION and CG_TEXTURE_OPS (none if unset).
+     *
+     * @param threads Most files decoded at once (0 = one per job system
+     *        thread, up to 4); bounds the memory held by decoded images.
+     */
+    explicit TextureManager(int = 0);
+
+    /**
+     * Destructor.
+     *
+     * Drops queued requests and waits for the decodes in progress. GL
+     * textures are not deleted; call clear() while the context still
+     * exists.
+     */
+    ~TextureManager();
+
+    /**
+     * Request a texture.
+     *
+     * Returns at once; the file is decoded in the background.
+     *
+     * @param path Image file (PNG, JPEG, BMP, TGA, ...).
+     * @param wrap Wrap mode for S and T.
+     * @param channels Channels to convert to (0 = as stored in the file).
+     * @return Handle for texture(); the same handle for the same file and
+     *         settings.
+     */
+    int request(const std::string &, GLint = GL_REPEAT, int = 0);
+
+    /**
+     * Choose the compression of later requests.
+     *
+     * Images with 1 or 2 channels are never compressed. If the driver turns
+     * out to lack the format, the manager warns, switches compression off
+     * and loads the image raw.
+     *
+     * @param mode Compression mode.
+     * @param quality Encoder effort.
+     */
+    void setCompression(TextureCompression, CompressQuality = COMPRESS_FAST);
+
+    /**
+     * Choose the image operations of later requests.
+     *
+     * @param ops Chain of operations (see parseImageOps()); empty for none.
+     * @return False if the chain is invalid (the previous one is kept).
+     */
+    bool setImageOps(const std::string &);
+
+    /**
+     * Spread uploads over frames.
+     *
+     * Takes effect for textures uploaded later. Each poll() then moves at
+     * most about this many bytes to the GPU through pixel buffer objects;
+     * a texture becomes ready once all its levels are in. finish() still
+     * uploads everything at once.
+     *
+     * @param bytes Bytes per poll() (0 = upload whole textures, the default).
+     */
+    void setUploadBudget(size_t);
+
+    /**
+     * Upload finished images.
+     *
+     * Call once per frame; with an upload budget, also advances the
+     * incremental uploads.
+     *
+     * @param max_uploads Maximum number of textures to start uploading (-1 = all).
+     * @return Number of requests completed by this call.
+     */
+    int poll(int = -1);
+
+    /**
+     * Wait for all requests and upload them.
+     */
+    void finish();
+
+    /**
+     * GL texture of a handle.
+     *
+     * @param handle Handle from request (-1 for none).
+     * @return Texture name, or a 1x1 white texture while the image is not
+     *         loaded yet, failed to load or no handle is given.
+     */
+    GLuint texture(int);
+
+    /** @return True if the texture of the handle was uploaded. */
+    bool ready(int) const;
+
+    /**
+     * When the decode job of a texture ran.
+     *
+     * @param handle Handle from request().
+     * @param start Receives when the job started.
+     * @param end Receives when it finished.
+     * @return False if the handle is invalid or the texture is not loaded yet.
+     */
+    bool decodeSpan(int, std::chrono::steady_clock::time_point &, std::chrono::steady_clock::time_point &) const;
+
+    /**
+     * Delete all textures.
+     *
+     * Waits for pending decodes; handles become invalid.
+     */
+    void clear();
+
+    /**
+     * Print statistics.
+     *
+     * Prints requests, decodes, duplicates and the time spent decoding on
+     * the workers, uploading and waiting on the GL thread; with compression,
+     * also the texture memory saved and the encoder throughput.
+     */
+    void printStats() const;
+
+private:
+    enum State { PENDING, READY, FAILED };
+
+    /** One requested file. */
+    struct Entry
+    {
+        std::string path;
+        GLint wrap;
+        int channels;
+        TextureCompression compression;
+        CompressQuality quality;
+        std::string ops;
+        std::vector<ImageOp> op_list;
+
+        // Written by the decode job before the entry enters the done queue.
+        MipChain mips;
+        bool from_cache = false;
+        Entry *duplicate_of = nullptr;
+        std::string error;
+        double decode_ms = 0.0;
+        std::chrono::steady_clock::time_point decode_start, decode_end;
+        double encode_ms = 0.0;
+        double ops_ms = 0.0;
+        size_t encoded_pixels = 0;
+
+        // GL thread only.
+        State state = PENDING;
+        GLuint texture = 0;
+        Entry *link = nullptr;
+    };
+
+    /** Requested entries (stable addresses; handle = index). */
+    std::deque<Entry> entries;
+    /** Handle for each path and settings. */
+    std::map<std::string, int> by_path;
+    /** Most decode jobs at once (0 until the first request: one per job system thread, up to 4). */
+    int thread_count;
+    /** 1x1 white texture. */
+    GLuint placeholder = 0;
+    /** Requests not uploaded yet. */
+    int outstanding = 0;
+    /** Compression of new requests. */
+    TextureCompression compression = COMPRESSION_NONE;
+    CompressQuality compress_quality = COMPRESS_FAST;
+    /** Image operations of new requests. */
+    std::string image_ops;
+    std::vector<ImageOp> image_op_list;
+    /** Incremental uploads (budget 0 = off). */
+    size_t upload_budget = 0;
+    std::unique_ptr<TextureUploader> uploader;
+
+    // Shared with the decode jobs, protected by mutex.
+    std::mutex mutex;
+    /** Entries waiting for a free decode slot. */
+    std::deque<Entry *> jobs;
+    /** Decode jobs submitted and not finished. */
+    int running = 0;
+    std::vector<Entry *> done;
+    std::map<uint64_t, Entry *> by_hash;
+    bool stopping = false;
+
+    /** Statistics. */
+    int requests = 0, decoded = 0, cached = 0, duplicates = 0, failures = 0, completed = 0;
+    double decode_ms = 0.0, upload_ms = 0.0, wait_ms = 0.0, encode_ms = 0.0, ops_ms = 0.0;
+    size_t encoded_pixels = 0, texture_bytes = 0, raw_bytes = 0;
+
+    void launch();
+    void decode(Entry *);
+    void upload(Entry *);
+    void uploaded(Entry *);
+    void enqueue(Entry *);
+    void stop();
+};
+
+#endif
@@ -0,0 +1,428 @@
+/**
+ * @file texture_sampler.cpp
+ * CPU texture sampler.
+ *
+ * Implements the sampler declared in texture_sampler.h.
+ */
+
+#include "texture_sampler.h"
+#include "mipmap.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Bits of x spread to the even bit positions (x < 8). */
+static const uint8_t morton_spread[8] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+
+/**
+ * Round down.
+ *
+ * Inlined, unlike std::floor without SSE4.1. Floats of 2^23 and more have
+ * no fraction and are returned as they are.
+ */
+static inline float floorFast(float x)
+{
+    if (!(std::fabs(x) < 8388608.0f))
+        return x;
+    float t = (float)(int)x;
+    return t > x ? t - 1.0f : t;
+}
+
+
+/**
+ * Index of texel (x, y) in a level: texelRow(y) + texelColumn(x).
+ *
+ * Both layouts split into a row part and a column part, so the four texels
+ * of a footprint need two of each.
+ *
+ * @param pitch Tiles per row (Morton) or texels per row.
+ */
+template <bool morton>
+static inline size_t texelRow(int pitch, int y)
+{
+    if (!morton)
+        return (size_t)y * pitch;
+    return ((size_t)(y >> 3) * pitch << 6) | morton_spread[y & 7] << 1;
+}
+
+/** @copydoc texelRow */
+template <bool morton>
+static inline size_t texelColumn(int x)
+{
+    if (!morton)
+        return (size_t)x;
+    return (size_t)(x >> 3) << 6 | morton_spread[x & 7];
+}
+
+
+/**
+ * Weighted sum of texels.
+ *
+ * @param texels Packed RGBA texels.
+ * @param weights Weights, summing to 1 << 14.
+ * @param taps Number of texels (4 or 8).
+ * @return Packed RGBA.
+ */
+static inline uint32_t blend(const uint32_t *texels, const int16_t *weights, int taps)
+{
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128(), acc = zero;
+    for (int t = 0; t < taps; t += 4)
+    {
+        // Texels 0 and 1 (then 2 and 3) as r0 r1 g0 g1 b0 b1 a0 a1,
+        // multiplied by w0 w1 and added in pairs.
+        __m128i v = _mm_loadu_si128((const __m128i *)(texels + t));
+        __m128i even = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i odd = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 0, 3, 1));
+        __m128i pairs = _mm_unpacklo_epi8(even, odd);
+        __m128i w = _mm_loadl_epi64((const __m128i *)(weights + t));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(pairs, zero), _mm_shuffle_epi32(w, 0)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(pairs, zero), _mm_shuffle_epi32(w, 0x55)));
+    }
+    acc = _mm_srli_epi32(_mm_add_epi32(acc, _mm_set1_epi32(1 << 13)), 14);
+    acc = _mm_packs_epi32(acc, acc);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+#else
+    uint32_t result = 0;
+    for (int c = 0; c < 4; c++)
+    {
+        int sum = 1 << 13;
+        for (int t = 0; t < taps; t++)
+            sum += (int)(texels[t] >> (8 * c) & 0xff) * weights[t];
+        result |= (uint32_t)std::min(sum >> 14, 255) << (8 * c);
+    }
+    return result;
+#endif
+}
+
+
+/** Bilinear footprints of a block. */
+struct Footprint
+{
+    /** Texel columns and rows, wrapped. */
+    alignas(16) int32_t x0[TextureSampler::lanes], x1[TextureSampler::lanes];
+    alignas(16) int32_t y0[TextureSampler::lanes], y1[TextureSampler::lanes];
+    /** Weights of (x0, y0), (x1, y0), (x0, y1) and (x1, y1). */
+    alignas(16) int32_t w[4][TextureSampler::lanes];
+};
+
+
+#ifdef __SSE2__
+/** Clamp 4 indices to [0, top]. */
+static inline __m128i clampIndex(__m128i i, __m128i top)
+{
+    i = _mm_andnot_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), i);
+    __m128i over = _mm_cmpgt_epi32(i, top);
+    return _mm_or_si128(_mm_and_si128(over, top), _mm_andnot_si128(over, i));
+}
+
+/**
+ * Wrap 4 coordinates and find their texel pairs along one axis.
+ *
+ * @param c Coordinates.
+ * @param size Level sizes along the axis.
+ * @param repeat Repeat or clamp.
+ * @param lo Receives the lower texels.
+ * @param hi Receives the upper texels.
+ * @return Fractions between the two.
+ */
+static inline __m128 axis(__m128 c, __m128i size, bool repeat, int32_t *lo, int32_t *hi)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    if (repeat)
+    {
+        // c - floor(c); huge values (no fraction, or out of int range) and
+        // NaN end up as 0.
+        __m128 fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(c));
+        fl = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, c), one));
+        __m128 small = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), c), _mm_set1_ps(8388608.0f));
+        c = _mm_min_ps(_mm_max_ps(_mm_and_ps(small, _mm_sub_ps(c, fl)), _mm_setzero_ps()), one);
+    }
+    else
+    {
+        // Keeps the texel coordinates well inside int range (NaN gives -1).
+        c = _mm_min_ps(_mm_max_ps(c, _mm_set1_ps(-1.0f)), _mm_set1_ps(2.0f));
+    }
+
+    __m128 x = _mm_sub_ps(_mm_mul_ps(c, _mm_cvtepi32_ps(size)), _mm_set1_ps(0.5f));
+    __m128i i0 = _mm_cvttps_epi32(x);
+    __m128 fl = _mm_cvtepi32_ps(i0);
+    __m128 up = _mm_cmpgt_ps(fl, x);
+    i0 = _mm_add_epi32(i0, _mm_castps_si128(up));
+    fl = _mm_sub_ps(fl, _mm_and_ps(up, one));
+    __m128i i1 = _mm_sub_epi32(i0, _mm_set1_epi32(-1));
+
+    if (repeat)
+    {
+        // c is in [0, 1], so one step back or forward at most.
+        i0 = _mm_add_epi32(i0, _mm_and_si128(_mm_cmplt_epi32(i0, _mm_setzero_si128()), size));
+        i1 = _mm_sub_epi32(i1, _mm_andnot_si128(_mm_cmpgt_epi32(size, i1), size));
+    }
+    else
+    {
+        __m128i top = _mm_sub_epi32(size, _mm_set1_epi32(1));
+        i0 = clampIndex(i0, top);
+        i1 = clampIndex(i1, top);
+    }
+    _mm_store_si128((__m128i *)lo, i0);
+    _mm_store_si128((__m128i *)hi, i1);
+    return _mm_sub_ps(x, fl);
+}
+#else
+/** Scalar version of the SSE2 axis(), one coordinate. */
+static inline float axis(float c, int size, bool repeat, int32_t &lo, int32_t &hi)
+{
+    if (repeat)
+    {
+        float fl = floorFast(c);
+        c = std::abs(c) < 8388608.0f ? std::min(std::max(c - fl, 0.0f), 1.0f) : 0.0f;
+    }
+    else
+        c = std::min(std::max(-1.0f, c), 2.0f);
+
+    float x = c * size - 0.5f, fl = floorFast(x);
+    lo = (int)fl;
+    hi = lo + 1;
+    if (repeat)
+    {
+        lo += lo < 0 ? size : 0;
+        hi -= hi >= size ? size : 0;
+    }
+    else
+    {
+        lo = std::min(std::max(lo, 0), size - 1);
+        hi = std::min(std::max(hi, 0), size - 1);
+    }
+    return x - fl;
+}
+#endif
+
+
+/**
+ * Footprints of 4 lanes.
+ *
+ * @param u Coordinates u.
+ * @param v Coordinates v.
+ * @param width Level widths.
+ * @param height Level heights.
+ * @param scale Level weights (the 4 bilinear weights sum to it).
+ * @param repeat Repeat or clamp.
+ * @param fp Receives lanes g to g + 3.
+ * @param g First lane.
+ */
+static inline void footprint(const float *u, const float *v, const int32_t *width, const int32_t *height,
+                             const float *scale, bool repeat, Footprint &fp, int g)
+{
+#ifdef __SSE2__
+    __m128 fx = axis(_mm_load_ps(u), _mm_load_si128((const __m128i *)width), repeat, fp.x0 + g, fp.x1 + g);
+    __m128 fy = axis(_mm_load_ps(v), _mm_load_si128((const __m128i *)height), repeat, fp.y0 + g, fp.y1 + g);
+    __m128 one = _mm_set1_ps(1.0f), k = _mm_load_ps(scale);
+    __m128 gx = _mm_sub_ps(one, fx), gy = _mm_mul_ps(_mm_sub_ps(one, fy), k);
+    fy = _mm_mul_ps(fy, k);
+    _mm_store_si128((__m128i *)(fp.w[0] + g), _mm_cvtps_epi32(_mm_mul_ps(gx, gy)));
+    _mm_store_si128((__m128i *)(fp.w[1] + g), _mm_cvtps_epi32(_mm_mul_ps(fx, gy)));
+    _mm_store_si128((__m128i *)(fp.w[2] + g), _mm_cvtps_epi32(_mm_mul_ps(gx, fy)));
+    _mm_store_si128((__m128i *)(fp.w[3] + g), _mm_cvtps_epi32(_mm_mul_ps(fx, fy)));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        int j = g + i;
+        float fx = axis(u[i], width[i], repeat, fp.x0[j], fp.x1[j]);
+        float fy = axis(v[i], height[i], repeat, fp.y0[j], fp.y1[j]);
+        fp.w[0][j] = (int32_t)std::lround((1 - fx) * (1 - fy) * scale[i]);
+        fp.w[1][j] = (int32_t)std::lround(fx * (1 - fy) * scale[i]);
+        fp.w[2][j] = (int32_t)std::lround((1 - fx) * fy * scale[i]);
+        fp.w[3][j] = (int32_t)std::lround(fx * fy * scale[i]);
+    }
+#endif
+}
+
+
+TextureSampler::TextureSampler(SamplerLayout layout)
+    : layout(layout)
+{
+}
+
+
+void TextureSampler::build(const unsigned char *pixels, int width, int height, int channels)
+{
+    MipChain mips;
+    mips.build(pixels, width, height, channels);
+    load(mips);
+}
+
+
+bool TextureSampler::load(const MipChain &mips)
+{
+    if (mips.levels() == 0 || mips.format())
+        return false;
+
+    level_list.clear();
+    size_t total = 0;
+    for (int i = 0; i < mips.levels(); i++)
+    {
+        const MipLevel &m = mips.level(i);
+        Level l;
+        l.width = m.width;
+        l.height = m.height;
+        l.offset = total;
+        if (layout == SAMPLER_MORTON)
+        {
+            // Partial tiles are padded to 8x8.
+            l.pitch = (m.width + 7) / 8;
+            total += (size_t)l.pitch * ((m.height + 7) / 8) * 64;
+        }
+        else
+        {
+            l.pitch = m.width;
+            total += (size_t)m.width * m.height;
+        }
+        level_list.push_back(l);
+    }
+
+    texels.assign(total, 0);
+    int channels = mips.channels();
+    for (int i = 0; i < mips.levels(); i++)
+    {
+        const MipLevel &m = mips.level(i);
+        const Level &l = level_list[i];
+        uint32_t *dst = texels.data() + l.offset;
+        for (int y = 0; y < m.height; y++)
+        {
+            const unsigned char *src = m.data + (size_t)y * m.width * channels;
+            for (int x = 0; x < m.width; x++, src += channels)
+            {
+                unsigned char rgba[4] = {src[0], 0, 0, 255};
+                for (int c = 1; c < channels; c++)
+                    rgba[c] = src[c];
+                uint32_t texel;
+                memcpy(&texel, rgba, 4);
+                size_t index = layout == SAMPLER_MORTON ? texelRow<true>(l.pitch, y) + texelColumn<true>(x)
+                                                        : texelRow<false>(l.pitch, y) + texelColumn<false>(x);
+                dst[index] = texel;
+            }
+        }
+    }
+    return true;
+}
+
+
+float TextureSampler::lod(float dudx, float dvdx, float dudy, float dvdy) const
+{
+    float w = (float)width(), h = (float)height();
+    float x = std::hypot(dudx * w, dvdx * h), y = std::hypot(dudy * w, dvdy * h);
+    return std::log2(std::max(std::max(x, y), 1e-8f));
+}
+
+
+uint32_t TextureSampler::sample(float u, float v, float lod) const
+{
+    uint32_t out;
+    sample(&u, &v, &lod, 1, &out);
+    return out;
+}
+
+
+void TextureSampler::sample(const float *u, const float *v, const float *lod, size_t n, uint32_t *out) const
+{
+    if (level_list.empty())
+    {
+        std::fill_n(out, n, 0u);
+        return;
+    }
+    for (size_t i = 0; i < n; i += lanes)
+    {
+        int count = (int)std::min(n - i, (size_t)lanes);
+        const float *l = lod ? lod + i : nullptr;
+        if (layout == SAMPLER_MORTON)
+            sampleBlock<true>(u + i, v + i, l, count, out + i);
+        else
+            sampleBlock<false>(u + i, v + i, l, count, out + i);
+    }
+}
+
+
+/**
+ * Sample up to one block of points.
+ *
+ * Per level pass: levels and level weights of every lane (scalar), then
+ * wrapping, footprints and bilinear weights four lanes at a time, then the
+ * fetches. The blends come last.
+ */
+template <bool morton>
+void TextureSampler::sampleBlock(const float *u, const float *v, const float *lod, int n, uint32_t *out) const
+{
+    int passes = filter == SAMPLER_TRILINEAR && lod ? 2 : 1;
+    int last = levels() - 1;
+
+    // Lanes past n sample (0, 0), or are skipped in groups of 4.
+    alignas(16) float s[lanes] = {}, t[lanes] = {};
+    std::copy(u, u + n, s);
+    std::copy(v, v + n, t);
+
+    // Level of each lane and pass, and its weight scaled to 1 << 14.
+    const Level *level[2][lanes];
+    alignas(16) int32_t width[2][lanes], height[2][lanes];
+    alignas(16) float scale[2][lanes];
+    int used = (n + 3) & ~3;
+    for (int i = 0; i < used; i++)
+    {
+        int a = 0, b = 0;
+        float f = 0.0f;
+        if (lod && i < n)
+        {
+            if (passes == 1)
+                a = std::min(std::max((int)(lod[i] + 0.5f), 0), last);
+            else
+            {
+                float l = std::min(std::max(0.0f, lod[i]), (float)last);
+                a = (int)l;
+                b = std::min(a + 1, last);
+                f = l - a;
+            }
+        }
+        level[0][i] = &level_list[a];
+        level[1][i] = &level_list[b];
+        scale[0][i] = (1.0f - f) * 16384.0f;
+        scale[1][i] = f * 16384.0f;
+        for (int p = 0; p < 2; p++)
+        {
+            width[p][i] = level[p][i]->width;
+            height[p][i] = level[p][i]->height;
+        }
+    }
+
+    uint32_t fetched[lanes][8];
+    int16_t weights[lanes][8];
+    Footprint fp;
+    for (int p = 0; p < passes; p++)
+    {
+        for (int g = 0; g < used; g += 4)
+            footprint(s + g, t + g, width[p] + g, height[p] + g, scale[p] + g, wrap == SAMPLER_REPEAT, fp, g);
+
+        for (int i = 0; i < n; i++)
+        {
+            const Level &l = *level[p][i];
+            const uint32_t *base = texels.data() + l.offset;
+            uint32_t *f = fetched[i] + 4 * p;
+            const uint32_t *row0 = base + texelRow<morton>(l.pitch, fp.y0[i]);
+            const uint32_t *row1 = base + texelRow<morton>(l.pitch, fp.y1[i]);
+            size_t col0 = texelColumn<morton>(fp.x0[i]), col1 = texelColumn<morton>(fp.x1[i]);
+            f[0] = row0[col0];
+            f[1] = row0[col1];
+            f[2] = row1[col0];
+            f[3] = row1[col1];
+            for (int k = 0; k < 4; k++)
+                weights[i][4 * p + k] = (int16_t)fp.w[k][i];
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        out[i] = blend(fetched[i], weights[i], 4 * passes);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file texture_sampler.h
+ * CPU texture sampler.
+ *
+ * Samples RGBA8 textures on the CPU the way texture() does in a shader, for
+ * rendering paths without a GPU: repeat or clamp-to-edge wrapping, bilinear
+ * filtering on the nearest mip level or trilinear filtering between two,
+ * with the level chosen from UV derivatives as OpenGL does.
+ *
+ * Texels are stored row by row, or in 8x8 tiles with the texels of each
+ * tile in Morton (Z) order, which usually puts the four texels of a
+ * bilinear footprint in one tile. In bench/bench_sampler (-O2, block
+ * calls, one thread) the tiled layout is the slower one: about 1.2x to 2x
+ * the time of row-major, depending on the machine. Its index arithmetic
+ * costs about 10% even when the texture fits in L1; the rest is likely
+ * that screen rows walk along texture rows, which row-major keeps
+ * sequential for the prefetcher. Row-major is therefore the default.
+ *
+ * Samples are processed in blocks of 8: levels, wrapped coordinates and
+ * weights are computed for the whole block, then the texels are fetched
+ * and each sample blends its 4 (bilinear) or 8 (trilinear) texels with
+ * SSE2 16-bit multiply-adds in fixed point (14 fraction bits).
+ *
+ * Filtering works on the stored values, like a GL_RGBA8 texture; the mip
+ * levels themselves are built in linear light (see mipmap.h).
+ */
+
+#ifndef TEXTURE_SAMPLER_H
+#define TEXTURE_SAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MipChain;
+
+
+/** Texture coordinate wrapping. */
+enum SamplerWrap
+{
+    SAMPLER_REPEAT,  ///< GL_REPEAT.
+    SAMPLER_CLAMP    ///< GL_CLAMP_TO_EDGE.
+};
+
+/** Texture filtering. */
+enum SamplerFilter
+{
+    SAMPLER_BILINEAR,  ///< GL_LINEAR_MIPMAP_NEAREST.
+    SAMPLER_TRILINEAR  ///< GL_LINEAR_MIPMAP_LINEAR.
+};
+
+/** Texel layout in memory. */
+enum SamplerLayout
+{
+    SAMPLER_ROW_MAJOR,  ///< Rows one after the other.
+    SAMPLER_MORTON      ///< 8x8 tiles, Morton order inside a tile.
+};
+
+
+/**
+ * CPU texture sampler.
+ *
+ * Sampling is const and can run on several threads at once.
+ *
+ * Results are packed like packRGBA() in scanline.h (r in the low byte).
+ */
+class TextureSampler
+{
+public:
+    /** Samples processed together. */
+    static const int lanes = 8;
+
+    /**
+     * Constructor.
+     *
+     * @param layout Texel layout.
+     */
+    explicit TextureSampler(SamplerLayout = SAMPLER_ROW_MAJOR);
+
+    /**
+     * Build the mip chain of an image and store it.
+     *
+     * @param pixels Pixels with 1 to 4 channels, first row at v = 0.
+     * @param width Width.
+     * @param height Height.
+     * @param channels Channels per pixel.
+     */
+    void build(const unsigned char *, int, int, int);
+
+    /**
+     * Store an existing mip chain.
+     *
+     * Missing channels are filled in as OpenGL does (GL_RED reads as
+     * (r, 0, 0, 1)).
+     *
+     * @param mips Chain of raw (not block-compressed) levels.
+     * @return False if the chain is empty or compressed.
+     */
+    bool load(const MipChain &);
+
+    /** Set the wrap mode for u and v. */
+    void setWrap(SamplerWrap w) { wrap = w; }
+    /** Set the filter. */
+    void setFilter(SamplerFilter f) { filter = f; }
+
+    /**
+     * Level of detail from the UV derivatives of a pixel.
+     *
+     * @param dudx Change of u one pixel to the right.
+     * @param dvdx Change of v one pixel to the right.
+     * @param dudy Change of u one pixel up.
+     * @param dvdy Change of v one pixel up.
+     * @return log2 of the texel footprint (0 = one texel per pixel).
+     */
+    float lod(float, float, float, float) const;
+
+    /**
+     * Sample one point.
+     *
+     * @param u Texture coordinate.
+     * @param v Texture coordinate.
+     * @param lod Level of detail (see lod()).
+     * @return Packed RGBA.
+     */
+    uint32_t sample(float, float, float = 0.0f) const;
+
+    /**
+     * Sample many points.
+     *
+     * @param u Texture coordinates u.
+     * @param v Texture coordinates v.
+     * @param lod Levels of detail, or nullptr for level 0.
+     * @param n Number of samples.
+     * @param out Receives packed RGBA.
+     */
+    void sample(const float *, const float *, const float *, size_t, uint32_t *) const;
+
+    /** @return Width of level 0. */
+    int width() const { return level_list.empty() ? 0 : level_list[0].width; }
+    /** @return Height of level 0. */
+    int height() const { return level_list.empty() ? 0 : level_list[0].height; }
+    /** @return Number of mip levels. */
+    int levels() const { return (int)level_list.size(); }
+    /** @return Bytes of texel storage (padding included). */
+    size_t bytes() const { return texels.size() * sizeof(uint32_t); }
+
+private:
+    /** One mip level in texels. */
+    struct Level
+    {
+        int width, height;
+        /** Tiles per row (Morton) or texels per row (row-major). */
+        int pitch;
+        size_t offset;
+    };
+
+    SamplerLayout layout;
+    SamplerWrap wrap = SAMPLER_REPEAT;
+    SamplerFilter filter = SAMPLER_TRILINEAR;
+    std::vector<uint32_t> texels;
+    std::vector<Level> level_list;
+
+    template <bool morton>
+    void sampleBlock(const float *, const float *, const float *, int, uint32_t *) const;
+};
+
+#endif
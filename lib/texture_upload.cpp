@@ -0,0 +1,272 @@
+/**
+ * @file texture_upload.cpp
+ * Incremental texture uploads through pixel buffer objects.
+ *
+ * Implements the uploader declared in texture_upload.h.
+ */
+
+#include "texture_upload.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+
+/** Client format of raw levels with 1 to 4 channels. */
+static GLenum rawFormat(int channels)
+{
+    static const GLenum formats[] = {GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    return formats[std::min(std::max(channels, 1), 4)];
+}
+
+/** Offsets in the buffer are kept 16-byte aligned for the copies. */
+static size_t align16(size_t n)
+{
+    return (n + 15) & ~(size_t)15;
+}
+
+
+/**
+ * Bytes of a w x h tile of a level.
+ *
+ * Compressed levels are counted in whole 4x4 blocks.
+ */
+static size_t tileBytes(const MipChain &mips, const MipLevel &l, int w, int h)
+{
+    if (!mips.format())
+        return (size_t)w * h * mips.channels();
+    size_t blocks = (size_t)((l.width + 3) / 4) * ((l.height + 3) / 4);
+    return (size_t)((w + 3) / 4) * ((h + 3) / 4) * (l.size / blocks);
+}
+
+
+/**
+ * Copy a tile out of its level, rows tightly packed.
+ *
+ * @param mips Chain.
+ * @param level Level index.
+ * @param x Left column (multiple of 4 if compressed).
+ * @param y Top row (multiple of 4 if compressed).
+ * @param w Width.
+ * @param h Height.
+ * @param dst Destination.
+ */
+static void copyTile(const MipChain &mips, int level, int x, int y, int w, int h, char *dst)
+{
+    const MipLevel &l = mips.level(level);
+    if (!mips.format())
+    {
+        size_t row = (size_t)w * mips.channels(), stride = (size_t)l.width * mips.channels();
+        const unsigned char *src = l.data + (size_t)y * stride + (size_t)x * mips.channels();
+        for (int r = 0; r < h; r++)
+            memcpy(dst + r * row, src + r * stride, row);
+        return;
+    }
+
+    // Rows of 4x4 blocks.
+    size_t bw = (l.width + 3) / 4, bh = (l.height + 3) / 4, block = l.size / (bw * bh);
+    size_t row = (size_t)((w + 3) / 4) * block, stride = bw * block;
+    const unsigned char *src = l.data + (size_t)(y / 4) * stride + (size_t)(x / 4) * block;
+    for (int r = 0; r < (h + 3) / 4; r++)
+        memcpy(dst + r * row, src + r * stride, row);
+}
+
+
+TextureUploader::TextureUploader(GLsizeiptr budget, int tile, bool async_copy)
+    : budget(std::max(budget, (GLsizeiptr)align16((size_t)tile * tile * 4))),
+      tile_size(tile), async_copy(async_copy), ring(GL_PIXEL_UNPACK_BUFFER, this->budget)
+{
+}
+
+
+TextureUploader::~TextureUploader()
+{
+    if (!copying.done())
+        jobSystem().wait(copying);
+}
+
+
+void TextureUploader::add(GLuint texture, const MipChain &mips, std::function<void()> done)
+{
+    jobs.push_back({texture, &mips, std::move(done)});
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    GLenum format = mips.format() ? mips.format() : rawFormat(mips.channels());
+    for (int i = 0; i < mips.levels(); i++)
+    {
+        const MipLevel &l = mips.level(i);
+        if (mips.format())
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, l.width, l.height, 0, l.size, NULL);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, format, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+
+/**
+ * Fill the current region with the next tiles.
+ *
+ * Tiles are taken in queue order until the region is full; the copy runs
+ * in a job in asynchronous mode.
+ */
+void TextureUploader::prepare()
+{
+    for (Job &j : jobs)
+    {
+        while (j.level < j.mips->levels())
+        {
+            const MipLevel &l = j.mips->level(j.level);
+            int w = std::min(tile_size, l.width - j.x), h = std::min(tile_size, l.height - j.y);
+            size_t size = tileBytes(*j.mips, l, w, h);
+            if (batch_bytes + align16(size) > (size_t)ring.regionSize())
+                goto full;
+
+            batch.push_back({&j, j.level, j.x, j.y, w, h, batch_bytes, size});
+            batch_bytes += align16(size);
+            j.pending++;
+
+            j.x += tile_size;
+            if (j.x >= l.width)
+            {
+                j.x = 0;
+                j.y += tile_size;
+                if (j.y >= l.height)
+                {
+                    j.y = 0;
+                    j.level++;
+                }
+            }
+        }
+    }
+full:
+    if (batch.empty())
+        return;
+
+    // Waits until the GPU is done with the region (fenced regions-1 steps ago).
+    char *base = (char *)ring.begin();
+    auto copy = [this, base]
+    {
+        for (const Tile &t : batch)
+            copyTile(*t.job->mips, t.level, t.x, t.y, t.w, t.h, base + t.offset);
+    };
+    if (async_copy)
+        copying = jobSystem().run(copy);
+    else
+        copy();
+}
+
+
+/**
+ * Issue the uploads of the prepared batch and fence its region.
+ */
+void TextureUploader::submit()
+{
+    if (batch.empty())
+        return;
+    if (!copying.done())
+        jobSystem().wait(copying);
+    ring.flush(0, batch_bytes);
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer());
+
+    GLuint bound = 0;
+    for (const Tile &t : batch)
+    {
+        const MipChain &mips = *t.job->mips;
+        if (t.job->texture != bound)
+        {
+            bound = t.job->texture;
+            glBindTexture(GL_TEXTURE_2D, bound);
+        }
+        // With a buffer bound, the pointer is an offset into it.
+        const void *offset = (const void *)(ring.offset() + t.offset);
+        if (mips.format())
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, t.level, t.x, t.y, t.w, t.h, mips.format(), t.size, offset);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, t.level, t.x, t.y, t.w, t.h, rawFormat(mips.channels()),
+                            GL_UNSIGNED_BYTE, offset);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    ring.fence();
+
+    uploaded += batch_bytes;
+    for (const Tile &t : batch)
+        t.job->pending--;
+    batch.clear();
+    batch_bytes = 0;
+
+    // Jobs complete in queue order.
+    while (!jobs.empty() && jobs.front().pending == 0 && jobs.front().level == jobs.front().mips->levels())
+    {
+        std::function<void()> done = std::move(jobs.front().done);
+        jobs.pop_front();
+        if (done)
+            done();
+    }
+}
+
+
+void TextureUploader::step()
+{
+    if (jobs.empty())
+        return;
+    if (!initialized)
+    {
+        ring.init();
+        initialized = true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (async_copy)
+    {
+        // Issue what was copied during the last frame, then start copying
+        // the next batch.
+        submit();
+        prepare();
+    }
+    else
+    {
+        prepare();
+        submit();
+    }
+    busy_steps++;
+    max_step_ms = std::max(max_step_ms, std::chrono::duration<double, std::milli>(
+                                            std::chrono::steady_clock::now() - start).count());
+}
+
+
+void TextureUploader::flush()
+{
+    while (!jobs.empty())
+        step();
+}
+
+
+void TextureUploader::cancel()
+{
+    if (!copying.done())
+        jobSystem().wait(copying);
+    batch.clear();
+    batch_bytes = 0;
+    jobs.clear();
+}
+
+
+void TextureUploader::release()
+{
+    cancel();
+    if (initialized)
+        ring.release();
+    initialized = false;
+}
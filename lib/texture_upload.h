@@ -0,0 +1,137 @@
+/**
+ * @file texture_upload.h
+ * Incremental texture uploads through pixel buffer objects.
+ *
+ * glTexImage2D from client memory blocks the GL thread while the driver
+ * copies the whole image. The uploader instead copies the mip levels, one
+ * tile at a time, into a ring of pixel unpack buffers (see stream_buffer.h)
+ * and issues glTexSubImage2D from the buffer, which returns at once and
+ * lets the GPU pull the data in the background. Each step() moves at most
+ * one region of the ring, so a large texture is spread over several frames
+ * and no frame pays for all of it.
+ *
+ * With asynchronous copies, the rows for the next step are copied into the
+ * mapped buffer by a job on the job system (see job_system.h) while the
+ * frame is rendered.
+ */
+
+#ifndef TEXTURE_UPLOAD_H
+#define TEXTURE_UPLOAD_H
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <GL/glew.h>
+#include "mipmap.h"
+#include "job_system.h"
+#include "stream_buffer.h"
+
+
+/**
+ * Tiled texture uploader.
+ *
+ * All methods must be called from the GL thread.
+ *
+ * Typical use:
+ *   uploader.add(tex, mips, [] { ... texture complete ... });
+ *   each frame: uploader.step();
+ */
+class TextureUploader
+{
+public:
+    /**
+     * Constructor.
+     *
+     * Does not touch GL; the buffers are created on the first step().
+     *
+     * @param budget Bytes uploaded per step (raised to fit one tile).
+     * @param tile Tile size in texels (multiple of 4).
+     * @param async_copy Copy rows in a job, one step ahead.
+     */
+    explicit TextureUploader(GLsizeiptr = 4 << 20, int = 256, bool = true);
+    ~TextureUploader();
+
+    /**
+     * Queue a texture.
+     *
+     * Allocates every level of the bound texture now; the contents follow
+     * over the next steps. The levels must stay valid until done is called.
+     *
+     * @param texture Texture name (2D, parameters already set).
+     * @param mips Levels to upload (raw or block-compressed).
+     * @param done Called from step() once the last tile was issued.
+     */
+    void add(GLuint, const MipChain &, std::function<void()>);
+
+    /**
+     * Upload the next batch of tiles.
+     *
+     * Call once per frame.
+     */
+    void step();
+
+    /**
+     * Upload everything queued.
+     */
+    void flush();
+
+    /**
+     * Drop queued textures without calling their callbacks.
+     */
+    void cancel();
+
+    /**
+     * Delete the buffers.
+     */
+    void release();
+
+    /** @return True if nothing is queued. */
+    bool idle() const { return jobs.empty(); }
+
+    /** @return Bytes uploaded so far. */
+    size_t bytesUploaded() const { return uploaded; }
+    /** @return Steps that uploaded something. */
+    int steps() const { return busy_steps; }
+    /** @return Longest step in milliseconds (GL thread time). */
+    double maxStepMs() const { return max_step_ms; }
+
+private:
+    /** One queued texture; the cursor walks levels and tiles in order. */
+    struct Job
+    {
+        GLuint texture;
+        const MipChain *mips;
+        std::function<void()> done;
+        int level = 0, x = 0, y = 0;
+        int pending = 0;
+    };
+
+    /** One tile of a batch. */
+    struct Tile
+    {
+        Job *job;
+        int level, x, y, w, h;
+        size_t offset, size;
+    };
+
+    GLsizeiptr budget;
+    int tile_size;
+    bool async_copy;
+    StreamBuffer ring;
+    bool initialized = false;
+
+    std::deque<Job> jobs;
+    /** Tiles copied (or being copied) into the current region. */
+    std::vector<Tile> batch;
+    size_t batch_bytes = 0;
+    JobHandle copying;
+
+    size_t uploaded = 0;
+    int busy_steps = 0;
+    double max_step_ms = 0.0;
+
+    void prepare();
+    void submit();
+};
+
+#endif
@@ -0,0 +1,326 @@
+/**
+ * @file trace.cpp
+ * Pipeline tracing.
+ *
+ * Implements the tracer declared in trace.h.
+ */
+
+#include "trace.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+std::atomic<bool> trace_enabled(false);
+
+
+namespace
+{
+
+/** Spans per thread ring (24 bytes each). */
+const uint64_t ring_capacity = 16384;
+/** Spans traceBegin() can keep open per thread. */
+const int max_open = 32;
+/** Interval of the background writer. */
+const std::chrono::milliseconds flush_interval(100);
+
+struct Span
+{
+    const char *name;
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+/**
+ * Spans of one thread.
+ *
+ * Single producer (the thread) and single consumer (the writer): the
+ * producer only moves head, the consumer only moves tail.
+ */
+struct Ring
+{
+    Span spans[ring_capacity];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<const char *> name{nullptr};
+    /** Name last written to the file (writer only). */
+    const char *written_name = nullptr;
+    int tid;
+};
+
+/**
+ * Tracer state shared by all threads.
+ *
+ * Allocated once and never freed, like the rings: threads still running
+ * at exit may touch them after traceStop().
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Ring *> rings;
+
+    std::mutex file_mutex;
+    FILE *file = nullptr;
+    std::string path;
+    size_t written = 0;
+
+    std::thread writer;
+    std::mutex writer_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+Registry &registry()
+{
+    static Registry *r = new Registry;
+    return *r;
+}
+
+std::atomic<int64_t> epoch_ns(0);
+
+thread_local Ring *thread_ring = nullptr;
+thread_local const char *thread_name = nullptr;
+thread_local struct { const char *name; int64_t start; } open_spans[max_open];
+thread_local int open_depth = 0;
+
+
+int64_t clockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+Ring *ring()
+{
+    if (!thread_ring)
+    {
+        Ring *r = new Ring;
+        r->name = thread_name;
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        r->tid = (int)reg.rings.size() + 1;
+        reg.rings.push_back(r);
+        thread_ring = r;
+    }
+    return thread_ring;
+}
+
+
+void writeString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        char c = *s;
+        if (c == '"' || c == '\\')
+            fputc('\\', f);
+        if ((unsigned char)c < 0x20)
+            c = ' ';
+        fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+
+/** Move the spans of every ring to the file. Caller holds file_mutex. */
+void drain(Registry &reg)
+{
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        rings = reg.rings;
+    }
+
+    FILE *f = reg.file;
+    for (Ring *r : rings)
+    {
+        const char *name = r->name.load(std::memory_order_relaxed);
+        if (name && name != r->written_name)
+        {
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", r->tid);
+            writeString(f, name);
+            fprintf(f, "}}");
+            r->written_name = name;
+        }
+
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i != head; i++)
+        {
+            const Span &s = r->spans[i % ring_capacity];
+            fprintf(f, ",\n{\"name\":");
+            writeString(f, s.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    r->tid, s.start_ns / 1000.0, (s.end_ns - s.start_ns) / 1000.0);
+        }
+        r->tail.store(head, std::memory_order_release);
+        reg.written += head - tail;
+    }
+    fflush(f);
+}
+
+
+void writerLoop()
+{
+    Registry &reg = registry();
+    std::unique_lock<std::mutex> lock(reg.writer_mutex);
+    while (!reg.stopping)
+    {
+        reg.wake.wait_for(lock, flush_interval);
+        std::lock_guard<std::mutex> file_lock(reg.file_mutex);
+        if (reg.file)
+            drain(reg);
+    }
+}
+
+
+/** Starts tracing from CG_TRACE and finishes the file at exit. */
+struct AutoTrace
+{
+    AutoTrace()
+    {
+        if (const char *path = getenv("CG_TRACE"))
+            if (*path)
+                traceStart(path);
+    }
+
+    ~AutoTrace()
+    {
+        traceStop();
+    }
+} auto_trace;
+
+}
+
+
+bool traceStart(const std::string &path)
+{
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.file_mutex);
+    if (reg.file)
+        return true;
+
+    reg.file = fopen(path.c_str(), "w");
+    if (!reg.file)
+    {
+        std::cerr << "Cannot write trace to " << path << std::endl;
+        return false;
+    }
+    reg.path = path;
+    reg.written = 0;
+    fprintf(reg.file, "{\"traceEvents\":[\n");
+    fprintf(reg.file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"cg\"}}");
+
+    if (!thread_name)
+        traceThreadName("main");
+
+    // Spans are relative to the first start, which keeps timestamps small.
+    if (epoch_ns.load() == 0)
+        epoch_ns.store(clockNs());
+
+    reg.stopping = false;
+    reg.writer = std::thread(writerLoop);
+    trace_enabled.store(true);
+    return true;
+}
+
+
+void traceStop()
+{
+    Registry &reg = registry();
+    if (!trace_enabled.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(reg.writer_mutex);
+        reg.stopping = true;
+    }
+    reg.wake.notify_one();
+    if (reg.writer.joinable())
+        reg.writer.join();
+
+    std::lock_guard<std::mutex> lock(reg.file_mutex);
+    drain(reg);
+
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> rings_lock(reg.mutex);
+        for (Ring *r : reg.rings)
+            dropped += r->dropped.exchange(0);
+    }
+
+    fprintf(reg.file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    bool ok = fclose(reg.file) == 0;
+    reg.file = nullptr;
+
+    if (ok)
+        std::cout << "Trace: " << reg.written << " span(s) written to " << reg.path;
+    else
+        std::cerr << "Cannot write trace to " << reg.path;
+    if (dropped)
+        std::cout << " (" << dropped << " dropped, rings full)";
+    std::cout << std::endl;
+}
+
+
+int64_t traceNow()
+{
+    return clockNs() - epoch_ns.load(std::memory_order_relaxed);
+}
+
+
+void traceSpan(const char *name, int64_t start_ns, int64_t end_ns)
+{
+    if (!traceEnabled())
+        return;
+
+    Ring *r = ring();
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (head - r->tail.load(std::memory_order_acquire) >= ring_capacity)
+    {
+        r->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    r->spans[head % ring_capacity] = {name, start_ns, end_ns};
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+
+void traceBegin(const char *name)
+{
+    // The depth is kept even while disabled, so begin/end stay paired if
+    // tracing starts or stops in between.
+    if (open_depth < max_open)
+    {
+        bool on = traceEnabled();
+        open_spans[open_depth].name = on ? name : nullptr;
+        open_spans[open_depth].start = on ? traceNow() : 0;
+    }
+    open_depth++;
+}
+
+
+void traceEnd()
+{
+    if (open_depth == 0)
+        return;
+    open_depth--;
+    if (open_depth < max_open && open_spans[open_depth].name)
+        traceSpan(open_spans[open_depth].name, open_spans[open_depth].start, traceNow());
+}
+
+
+void traceThreadName(const char *name)
+{
+    thread_name = name;
+    if (thread_ring)
+        thread_ring->name.store(name, std::memory_order_relaxed);
+}
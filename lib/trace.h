@@ -0,0 +1,135 @@
+/**
+ * @file trace.h
+ * Pipeline tracing.
+ *
+ * Records named spans (start and duration) from any thread and writes them
+ * as Chrome trace JSON, which ui.perfetto.dev and chrome://tracing open.
+ * Unlike the frame profiler (profiler.h) it follows the whole program:
+ * model import, texture decoding on worker threads, uploads, shader
+ * compilation and draws, each thread on its own track.
+ *
+ * Tracing is off unless CG_TRACE names an output file (or traceStart() is
+ * called). While off, a span costs one relaxed atomic load, so the
+ * instrumentation stays in release builds.
+ *
+ * Each thread writes its spans into its own ring buffer without locks; a
+ * background thread drains the rings into the file every 100 ms and
+ * traceStop() (also run at exit) drains the rest and closes the JSON. If a
+ * ring fills up faster than it is drained, new spans are dropped and
+ * counted.
+ *
+ * Span names are stored as pointers: use string literals (or strings that
+ * live until the end of the program).
+ *
+ * Typical use:
+ *   void loadModel(const std::string &path)
+ *   {
+ *       TRACE_SCOPE("loadModel");
+ *       ...
+ *       traceBegin("bounds");
+ *       ...
+ *       traceEnd();
+ *   }
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+/** Set while tracing; read by the inline functions below. */
+extern std::atomic<bool> trace_enabled;
+
+/** @return True if spans are being recorded. */
+inline bool traceEnabled()
+{
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Start tracing.
+ *
+ * Called at startup with the value of CG_TRACE, if set. Does nothing if
+ * tracing already runs.
+ *
+ * @param path Output JSON file.
+ * @return False if the file cannot be created.
+ */
+bool traceStart(const std::string &);
+
+/** Stop tracing, write the remaining spans and close the file. */
+void traceStop();
+
+/** @return Nanoseconds since the program started (the trace clock). */
+int64_t traceNow();
+
+/**
+ * Record a finished span.
+ *
+ * @param name Span name (string literal).
+ * @param start_ns Start, from traceNow().
+ * @param end_ns End, from traceNow().
+ */
+void traceSpan(const char *, int64_t, int64_t);
+
+/**
+ * Open a span on the calling thread; traceEnd() closes it.
+ *
+ * For spans that do not match a C++ scope. Up to 32 may be open per thread.
+ *
+ * @param name Span name (string literal).
+ */
+void traceBegin(const char *);
+
+/** Close the innermost span opened by traceBegin() on this thread. */
+void traceEnd();
+
+/**
+ * Name the calling thread's track.
+ *
+ * @param name Thread name (string literal).
+ */
+void traceThreadName(const char *);
+
+
+/**
+ * Span covering a C++ scope.
+ */
+class TraceScope
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param name Span name (string literal).
+     */
+    explicit TraceScope(const char *name) : name(traceEnabled() ? name : nullptr)
+    {
+        if (this->name)
+            start = traceNow();
+    }
+
+    ~TraceScope()
+    {
+        if (name)
+            traceSpan(name, start, traceNow());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    int64_t start = 0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/** Trace the rest of the enclosing scope under the given name. */
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,784 @@
+/**
+ * @file triangulate.cpp
+ * Polygon triangulation.
+ *
+ * Implements the triangulator declared in triangulate.h.
+ *
+ * Monotone decomposition follows de Berg et al., "Computational Geometry",
+ * chapter 3. Vertices are swept top to bottom (ties broken by smaller x,
+ * which amounts to a tiny rotation of the plane); outlines are made counter
+ * clockwise and holes clockwise, so the interior is always to the left.
+ */
+
+#include "triangulate.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+/** Vertex types for the sweep. */
+enum { START, END, SPLIT, MERGE, REGULAR_DOWN, REGULAR_UP };
+
+
+/**
+ * Turn direction.
+ *
+ * @return Positive for a left turn a->b->c, negative for a right turn.
+ */
+static inline double cross(double ax, double ay, double bx, double by, double cx, double cy)
+{
+    return (bx - ax) * (cy - by) - (by - ay) * (cx - bx);
+}
+
+
+bool Triangulator::EdgeLess::operator()(int a, int b) const
+{
+    // -1 stands for the sweep point itself (used in queries).
+    double xa = a < 0 ? t->sweep_x : t->xAt(a);
+    double xb = b < 0 ? t->sweep_x : t->xAt(b);
+    if (xa != xb)
+        return xa < xb;
+    return a < b;
+}
+
+
+/**
+ * Sweep order.
+ *
+ * @return True if vertex a comes before vertex b (higher, then left).
+ */
+bool Triangulator::above(int a, int b) const
+{
+    if (py[a] != py[b])
+        return py[a] > py[b];
+    if (px[a] != px[b])
+        return px[a] < px[b];
+    return a < b;
+}
+
+
+/**
+ * Edge position at the sweep line.
+ *
+ * @param e Edge (from e to next[e]).
+ * @return X coordinate where the edge crosses the sweep line.
+ */
+double Triangulator::xAt(int e) const
+{
+    int a = e, b = next[e];
+    if (py[a] == py[b])
+    {
+        // Horizontal edges are slightly tilted by the tie-break, so they
+        // meet the sweep line exactly at the sweep point.
+        return std::min(std::max(sweep_x, std::min(px[a], px[b])), std::max(px[a], px[b]));
+    }
+    return px[a] + (sweep_y - py[a]) * slope[e];
+}
+
+
+/**
+ * Load rings.
+ *
+ * Copies the coordinates and links every ring so that the outline is
+ * counter clockwise and holes are clockwise.
+ *
+ * @param xy Interleaved coordinates.
+ * @param ring_sizes Vertices per ring.
+ * @return False if a ring has less than 3 vertices.
+ */
+bool Triangulator::load(const float *xy, const std::vector<int> &ring_sizes)
+{
+    int n = 0;
+    for (int m : ring_sizes)
+    {
+        if (m < 3)
+            return false;
+        n += m;
+    }
+
+    px.resize(n);
+    py.resize(n);
+    next.resize(n);
+    prev.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        px[i] = xy[2*i];
+        py[i] = xy[2*i+1];
+    }
+
+    int s = 0;
+    for (size_t r = 0; r < ring_sizes.size(); r++)
+    {
+        int m = ring_sizes[r];
+        double area = 0.0;
+        for (int i = 0; i < m; i++)
+        {
+            int a = s + i, b = s + (i + 1) % m;
+            area += px[a] * py[b] - px[b] * py[a];
+        }
+        bool forward = (r == 0) ? area > 0 : area < 0;
+        for (int i = 0; i < m; i++)
+        {
+            int a = s + i, b = s + (i + 1) % m;
+            if (forward)
+            {
+                next[a] = b;
+                prev[b] = a;
+            }
+            else
+            {
+                next[b] = a;
+                prev[a] = b;
+            }
+        }
+        s += m;
+    }
+    return true;
+}
+
+
+void Triangulator::addDiagonal(int a, int b)
+{
+    diagonals.push_back(a);
+    diagonals.push_back(b);
+}
+
+
+/**
+ * Edge directly left of a vertex.
+ *
+ * @param v Vertex at the sweep point.
+ * @return Edge, or -1 if there is none (invalid input).
+ */
+int Triangulator::leftEdge(int v)
+{
+    (void)v;
+    auto it = status.lower_bound(-1);
+    if (it == status.begin())
+        return -1;
+    --it;
+    return *it;
+}
+
+
+/**
+ * Sweep.
+ *
+ * Classifies the vertices and adds the diagonals that split the polygon
+ * into y-monotone pieces.
+ *
+ * @return False if the input is inconsistent (not a simple polygon).
+ */
+bool Triangulator::sweep()
+{
+    int n = (int)px.size();
+
+    type.resize(n);
+    slope.resize(n);
+    for (int v = 0; v < n; v++)
+    {
+        int w = next[v];
+        slope[v] = py[v] != py[w] ? (px[w] - px[v]) / (py[w] - py[v]) : 0.0;
+    }
+    for (int v = 0; v < n; v++)
+    {
+        int p = prev[v], q = next[v];
+        bool pa = above(p, v), qa = above(q, v);
+        bool convex = cross(px[p], py[p], px[v], py[v], px[q], py[q]) > 0;
+        if (!pa && !qa)
+            type[v] = convex ? START : SPLIT;
+        else if (pa && qa)
+            type[v] = convex ? END : MERGE;
+        else
+            type[v] = pa ? REGULAR_DOWN : REGULAR_UP;
+    }
+
+    // The boundary is made of chains that already run top to bottom, from
+    // each local maximum (start/split) down both sides. Only the maxima are
+    // sorted; the chains crossing the sweep line are merged with a small
+    // heap, so ordering costs O(n log k) for k chains instead of O(n log n).
+    // A cursor is a vertex, negated (~v) when the chain follows prev[].
+    auto vertexOf = [](int c) { return c < 0 ? ~c : c; };
+    auto later = [&](int a, int b) { return above(vertexOf(b), vertexOf(a)); };
+    auto bottom = [this](int v) { return type[v] == END || type[v] == MERGE; };
+
+    starts.clear();
+    for (int v = 0; v < n; v++)
+        if (type[v] == START || type[v] == SPLIT)
+            starts.push_back(v);
+    std::sort(starts.begin(), starts.end(), [this](int a, int b) { return above(a, b); });
+
+    order.clear();
+    heap.clear();
+    size_t si = 0;
+    while (si < starts.size() || !heap.empty())
+    {
+        if (si < starts.size() && (heap.empty() || above(starts[si], vertexOf(heap.front()))))
+        {
+            int v = starts[si++];
+            order.push_back(v);
+            heap.push_back(next[v]);
+            std::push_heap(heap.begin(), heap.end(), later);
+            // Minima end the forward chains, so each vertex is output once.
+            if (!bottom(prev[v]))
+            {
+                heap.push_back(~prev[v]);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+            continue;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), later);
+        int c = heap.back(), v = vertexOf(c);
+        order.push_back(v);
+        int w = c < 0 ? prev[v] : next[v];
+        if (above(v, w) && !(c < 0 && bottom(w)))
+        {
+            heap.back() = c < 0 ? ~w : w;
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+        else
+            heap.pop_back();
+    }
+    if ((int)order.size() != n)
+        return false;
+
+    status.clear();
+    status_pos.assign(n, status.end());
+    helper.assign(n, -1);
+    diagonals.clear();
+
+    auto insert = [this](int e, int v) {
+        status_pos[e] = status.insert(e).first;
+        helper[e] = v;
+    };
+    auto remove = [this](int e) {
+        if (status_pos[e] == status.end())
+            return false;
+        status.erase(status_pos[e]);
+        status_pos[e] = status.end();
+        return true;
+    };
+    auto fixMerge = [this](int e, int v) {
+        if (helper[e] >= 0 && type[helper[e]] == MERGE)
+            addDiagonal(v, helper[e]);
+    };
+
+    for (int v : order)
+    {
+        sweep_x = px[v];
+        sweep_y = py[v];
+        int ep = prev[v];
+        int ej;
+
+        switch (type[v])
+        {
+        case START:
+            insert(v, v);
+            break;
+
+        case END:
+            fixMerge(ep, v);
+            if (!remove(ep))
+                return false;
+            break;
+
+        case SPLIT:
+            ej = leftEdge(v);
+            if (ej < 0)
+                return false;
+            addDiagonal(v, helper[ej]);
+            helper[ej] = v;
+            insert(v, v);
+            break;
+
+        case MERGE:
+            fixMerge(ep, v);
+            if (!remove(ep))
+                return false;
+            ej = leftEdge(v);
+            if (ej < 0)
+                return false;
+            fixMerge(ej, v);
+            helper[ej] = v;
+            break;
+
+        case REGULAR_DOWN:
+            fixMerge(ep, v);
+            if (status_pos[ep] == status.end())
+                return false;
+            {
+                // The new edge takes the place of the old one; reuse its node.
+                auto hint = std::next(status_pos[ep]);
+                auto node = status.extract(status_pos[ep]);
+                status_pos[ep] = status.end();
+                node.value() = v;
+                status_pos[v] = status.insert(hint, std::move(node));
+                helper[v] = v;
+            }
+            break;
+
+        case REGULAR_UP:
+            ej = leftEdge(v);
+            if (ej < 0)
+                return false;
+            fixMerge(ej, v);
+            helper[ej] = v;
+            break;
+        }
+    }
+    return status.empty();
+}
+
+
+/**
+ * Next vertex around a face.
+ *
+ * Walking the half-edge u->v with the face on the left, the next vertex is
+ * the first neighbor of v found turning clockwise from the direction v->u.
+ *
+ * @param u Previous vertex.
+ * @param v Current vertex.
+ * @return Next vertex.
+ */
+int Triangulator::nextInFace(int u, int v) const
+{
+    if (adj_head[v] < 0)
+        return next[v];
+
+    double ax = px[u] - px[v], ay = py[u] - py[v];
+    int best = next[v];
+    double best_angle = 1e30;
+
+    auto consider = [&](int w) {
+        double bx = px[w] - px[v], by = py[w] - py[v];
+        double cw = -std::atan2(ax * by - ay * bx, ax * bx + ay * by);
+        if (cw <= 0)
+            cw += 2.0 * M_PI;
+        if (cw < best_angle)
+        {
+            best_angle = cw;
+            best = w;
+        }
+    };
+
+    consider(next[v]);
+    consider(prev[v]);
+    for (int k = adj_head[v]; k >= 0; k = adj_next[k])
+        consider(adj_to[k]);
+    return best;
+}
+
+
+/**
+ * Emit triangle.
+ *
+ * Appends the triangle in counter clockwise order.
+ */
+void Triangulator::emit(std::vector<unsigned> &out, int a, int b, int c) const
+{
+    if (cross(px[a], py[a], px[b], py[b], px[c], py[c]) < 0)
+        std::swap(b, c);
+    out.push_back(a);
+    out.push_back(b);
+    out.push_back(c);
+}
+
+
+/**
+ * Triangulate a y-monotone piece.
+ *
+ * Uses the stack algorithm over the two chains merged from top to bottom.
+ * The piece (counter clockwise) is in the piece member.
+ *
+ * @param out Output indices.
+ */
+void Triangulator::triangulateMonotone(std::vector<unsigned> &out)
+{
+    int k = (int)piece.size();
+    if (k < 3)
+        return;
+    if (k == 3)
+    {
+        emit(out, piece[0], piece[1], piece[2]);
+        return;
+    }
+
+    int top = 0, bottom = 0;
+    for (int i = 1; i < k; i++)
+    {
+        if (above(piece[i], piece[top]))
+            top = i;
+        if (above(piece[bottom], piece[i]))
+            bottom = i;
+    }
+
+    // Counter clockwise from the top runs down the left chain.
+    sorted.clear();
+    chain.clear();
+    sorted.push_back(piece[top]);
+    chain.push_back(0);
+    int l = (top + 1) % k, r = (top + k - 1) % k;
+    while (l != bottom || r != bottom)
+    {
+        if (r == bottom || (l != bottom && above(piece[l], piece[r])))
+        {
+            sorted.push_back(piece[l]);
+            chain.push_back(1);
+            l = (l + 1) % k;
+        }
+        else
+        {
+            sorted.push_back(piece[r]);
+            chain.push_back(2);
+            r = (r + k - 1) % k;
+        }
+    }
+    sorted.push_back(piece[bottom]);
+    chain.push_back(0);
+
+    stack.clear();
+    stack.push_back(0);
+    stack.push_back(1);
+    for (int j = 2; j < k - 1; j++)
+    {
+        int uj = sorted[j];
+        if (chain[j] != chain[stack.back()])
+        {
+            for (size_t i = 0; i + 1 < stack.size(); i++)
+                emit(out, uj, sorted[stack[i]], sorted[stack[i+1]]);
+            stack.clear();
+            stack.push_back(j - 1);
+            stack.push_back(j);
+        }
+        else
+        {
+            int last = stack.back();
+            stack.pop_back();
+            while (!stack.empty())
+            {
+                int t = sorted[stack.back()], m = sorted[last];
+                double c = cross(px[t], py[t], px[m], py[m], px[uj], py[uj]);
+                // Left chain: the middle vertex must bulge left of top->uj.
+                if (chain[j] == 1 ? c <= 0 : c >= 0)
+                    break;
+                emit(out, t, m, uj);
+                last = stack.back();
+                stack.pop_back();
+            }
+            stack.push_back(last);
+            stack.push_back(j);
+        }
+    }
+
+    int un = sorted[k - 1];
+    for (size_t i = 0; i + 1 < stack.size(); i++)
+        emit(out, un, sorted[stack[i]], sorted[stack[i+1]]);
+}
+
+
+/**
+ * Split into monotone pieces and triangulate them.
+ *
+ * Walks every face of the polygon plus diagonals.
+ *
+ * @param out Output indices.
+ * @return False if a face walk does not close (inconsistent diagonals).
+ */
+bool Triangulator::monotonePieces(std::vector<unsigned> &out)
+{
+    int n = (int)px.size();
+    int d = (int)diagonals.size() / 2;
+
+    adj_head.assign(n, -1);
+    adj_next.resize(2 * d);
+    adj_to.resize(2 * d);
+    for (int k = 0; k < 2 * d; k++)
+    {
+        int from = diagonals[k], to = diagonals[k ^ 1];
+        adj_to[k] = to;
+        adj_next[k] = adj_head[from];
+        adj_head[from] = k;
+    }
+
+    seen_edge.assign(n, 0);
+    seen_diag.assign(2 * d, 0);
+
+    // Marks the half-edge u->v; returns false if it was already walked.
+    auto mark = [this](int u, int v) {
+        char *flag = nullptr;
+        if (v == next[u])
+            flag = &seen_edge[u];
+        else
+            for (int k = adj_head[u]; k >= 0; k = adj_next[k])
+                if (adj_to[k] == v)
+                {
+                    flag = &seen_diag[k];
+                    break;
+                }
+        if (!flag || *flag)
+            return false;
+        *flag = 1;
+        return true;
+    };
+
+    auto walk = [&](int a, int b) {
+        piece.clear();
+        int u = a, v = b;
+        do
+        {
+            if (!mark(u, v) || (int)piece.size() > n)
+                return false;
+            piece.push_back(u);
+            int w = nextInFace(u, v);
+            u = v;
+            v = w;
+        } while (u != a || v != b);
+        triangulateMonotone(out);
+        return true;
+    };
+
+    for (int v = 0; v < n; v++)
+        if (!seen_edge[v] && !walk(v, next[v]))
+            return false;
+    for (int k = 0; k < 2 * d; k++)
+        if (!seen_diag[k] && !walk(diagonals[k], diagonals[k ^ 1]))
+            return false;
+    return true;
+}
+
+
+/**
+ * Ear clipping.
+ *
+ * Fallback for input the sweep cannot handle. Holes are first connected to
+ * the outline with bridge edges (two coincident cuts), then ears are cut
+ * one by one. O(n^2).
+ *
+ * @param ring_sizes Vertices per ring (coordinates already loaded).
+ * @param out Output indices.
+ * @return False if no ear could be found (self-intersecting input).
+ */
+bool Triangulator::earClip(const std::vector<int> &ring_sizes, std::vector<unsigned> &out)
+{
+    std::vector<int> &nx = ear_next, &pv = ear_prev, &vx = ear_vertex;
+    nx.clear();
+    pv.clear();
+    vx.clear();
+
+    auto X = [&](int node) { return px[vx[node]]; };
+    auto Y = [&](int node) { return py[vx[node]]; };
+    // Same sign convention as cross(): positive for a left (convex) turn.
+    auto turn = [&](int a, int b, int c) { return cross(X(a), Y(a), X(b), Y(b), X(c), Y(c)); };
+    auto newNode = [&](int v) {
+        vx.push_back(v);
+        nx.push_back(-1);
+        pv.push_back(-1);
+        return (int)vx.size() - 1;
+    };
+    auto inTriangle = [](double ax, double ay, double bx, double by, double cx, double cy,
+                         double x, double y) {
+        double d1 = cross(ax, ay, bx, by, x, y);
+        double d2 = cross(bx, by, cx, cy, x, y);
+        double d3 = cross(cx, cy, ax, ay, x, y);
+        bool neg = d1 < 0 || d2 < 0 || d3 < 0;
+        bool pos = d1 > 0 || d2 > 0 || d3 > 0;
+        return !(neg && pos);
+    };
+    auto locallyInside = [&](int a, int b) {
+        return turn(pv[a], a, nx[a]) > 0
+            ? turn(a, b, nx[a]) <= 0 && turn(a, pv[a], b) <= 0
+            : turn(a, b, pv[a]) > 0 || turn(a, nx[a], b) > 0;
+    };
+
+    // Rings as circular lists, following next[] (outline CCW, holes CW).
+    std::vector<int> hole_start;
+    int s = 0, outer = -1;
+    for (size_t r = 0; r < ring_sizes.size(); r++)
+    {
+        int first = -1, last = -1, v = s;
+        for (int i = 0; i < ring_sizes[r]; i++, v = next[v])
+        {
+            int node = newNode(v);
+            if (first < 0)
+                first = node;
+            else
+            {
+                nx[last] = node;
+                pv[node] = last;
+            }
+            last = node;
+        }
+        nx[last] = first;
+        pv[first] = last;
+        if (r == 0)
+            outer = first;
+        else
+        {
+            // Start each hole at its rightmost vertex.
+            int best = first;
+            for (int p = nx[first]; p != first; p = nx[p])
+                if (X(p) > X(best))
+                    best = p;
+            hole_start.push_back(best);
+        }
+        s += ring_sizes[r];
+    }
+
+    // Bridge holes from right to left with a ray towards +x.
+    std::sort(hole_start.begin(), hole_start.end(), [&](int a, int b) { return X(a) > X(b); });
+    for (int h : hole_start)
+    {
+        double hx = X(h), hy = Y(h), qx = 1e300;
+        int m = -1, p = outer;
+        do
+        {
+            int q = nx[p];
+            if (hy >= Y(p) && hy <= Y(q) && Y(q) != Y(p))
+            {
+                double x = X(p) + (hy - Y(p)) / (Y(q) - Y(p)) * (X(q) - X(p));
+                if (x >= hx && x < qx)
+                {
+                    qx = x;
+                    m = X(p) > X(q) ? p : q;
+                }
+            }
+            p = q;
+        } while (p != outer);
+        if (m < 0)
+            return false;
+
+        // Prefer a vertex inside (h, hit, m) with the smallest angle to the ray.
+        if (qx != hx)
+        {
+            int stop = m;
+            double mx = X(m), my = Y(m), tan_min = 1e300;
+            p = m;
+            do
+            {
+                if (hx <= X(p) && X(p) <= mx && hx != X(p) &&
+                    inTriangle(hx, hy, qx, hy, mx, my, X(p), Y(p)))
+                {
+                    double tan = std::fabs(hy - Y(p)) / (X(p) - hx);
+                    if (locallyInside(p, h) && tan < tan_min)
+                    {
+                        m = p;
+                        tan_min = tan;
+                    }
+                }
+                p = nx[p];
+            } while (p != stop);
+        }
+
+        // Split: m -> h ... (hole) ... h' -> m' -> rest of the outline.
+        int m2 = newNode(vx[m]), h2 = newNode(vx[h]);
+        int mn = nx[m], hp = pv[h];
+        nx[m] = h;   pv[h] = m;
+        nx[m2] = mn; pv[mn] = m2;
+        nx[h2] = m2; pv[m2] = h2;
+        nx[hp] = h2; pv[h2] = hp;
+    }
+
+    auto removeNode = [&](int node) {
+        nx[pv[node]] = nx[node];
+        pv[nx[node]] = pv[node];
+    };
+    auto isEar = [&](int ear) {
+        int a = pv[ear], c = nx[ear];
+        if (turn(a, ear, c) <= 0)
+            return false;
+        for (int p = nx[c]; p != a; p = nx[p])
+        {
+            bool shared = (X(p) == X(a) && Y(p) == Y(a)) || (X(p) == X(ear) && Y(p) == Y(ear)) ||
+                          (X(p) == X(c) && Y(p) == Y(c));
+            if (!shared && turn(pv[p], p, nx[p]) <= 0 &&
+                inTriangle(X(a), Y(a), X(ear), Y(ear), X(c), Y(c), X(p), Y(p)))
+                return false;
+        }
+        return true;
+    };
+
+    int ear = outer, stop = outer;
+    bool filtered = false;
+    while (pv[ear] != nx[ear])
+    {
+        int a = pv[ear], c = nx[ear];
+        if (isEar(ear))
+        {
+            emit(out, vx[a], vx[ear], vx[c]);
+            removeNode(ear);
+            ear = stop = nx[c];
+            filtered = false;
+            continue;
+        }
+        ear = c;
+        if (ear == stop)
+        {
+            // A full pass without ears: drop collinear and repeated
+            // vertices (clipping leaves zero-width bridges) and retry, then
+            // give up.
+            if (filtered)
+                return false;
+            filtered = true;
+            int p = ear, end = ear;
+            bool again;
+            do
+            {
+                again = false;
+                if (turn(pv[p], p, nx[p]) == 0)
+                {
+                    removeNode(p);
+                    p = end = pv[p];
+                    if (nx[p] == pv[p])
+                        break;
+                    again = true;
+                }
+                else
+                    p = nx[p];
+            } while (again || p != end);
+            ear = stop = p;
+        }
+    }
+    return true;
+}
+
+
+bool Triangulator::triangulate(const float *xy, int n, std::vector<unsigned> &indices)
+{
+    static thread_local std::vector<int> single;
+    single.assign(1, n);
+    return triangulate(xy, single, indices);
+}
+
+
+bool Triangulator::triangulate(const float *xy, const std::vector<int> &ring_sizes,
+                               std::vector<unsigned> &indices)
+{
+    indices.clear();
+    fallback = false;
+    if (ring_sizes.empty() || !load(xy, ring_sizes))
+        return false;
+
+    double area = 0.0;
+    for (size_t v = 0; v < px.size(); v++)
+        area += px[v] * py[next[v]] - px[next[v]] * py[v];
+    area *= 0.5;
+
+    if (sweep() && monotonePieces(indices))
+    {
+        // Pieces that were not really monotone overlap; check the area.
+        double sum = 0.0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            int a = indices[i], b = indices[i+1], c = indices[i+2];
+            sum += 0.5 * cross(px[a], py[a], px[b], py[b], px[c], py[c]);
+        }
+        size_t expected = 3 * (px.size() + 2 * (ring_sizes.size() - 1) - 2);
+        if (indices.size() == expected && std::fabs(sum - area) <= 1e-6 * std::fabs(area) + 1e-12)
+            return true;
+    }
+
+    fallback = true;
+    indices.clear();
+    return earClip(ring_sizes, indices);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file triangulate.h
+ * Polygon triangulation.
+ *
+ * Triangulates simple polygons, convex or not, optionally with holes.
+ * The main path splits the polygon into y-monotone pieces with a plane
+ * sweep (O(n log n)) and triangulates each piece in linear time. If the
+ * sweep fails on degenerate input (self-touching outlines, repeated
+ * points), ear clipping with hole bridging is used instead.
+ *
+ * Input orientation does not matter; output triangles are counter
+ * clockwise and index the input vertices.
+ */
+
+#ifndef TRIANGULATE_H
+#define TRIANGULATE_H
+
+#include <set>
+#include <vector>
+
+
+/**
+ * Polygon triangulator.
+ *
+ * Keeps its scratch buffers between calls, so triangulating polygons of
+ * similar size repeatedly does not allocate.
+ */
+class Triangulator
+{
+public:
+    /**
+     * Triangulate a simple polygon.
+     *
+     * @param xy Interleaved coordinates (x0, y0, x1, y1, ...).
+     * @param n Number of vertices.
+     * @param indices Receives 3 indices per triangle (cleared first).
+     * @return True on success.
+     */
+    bool triangulate(const float *, int, std::vector<unsigned> &);
+
+    /**
+     * Triangulate a polygon with holes.
+     *
+     * The vertices of all rings are stored one ring after the other; the
+     * first ring is the outline and the others are holes.
+     *
+     * @param xy Interleaved coordinates of all rings.
+     * @param ring_sizes Number of vertices of each ring.
+     * @param indices Receives 3 indices per triangle (cleared first).
+     * @return True on success.
+     */
+    bool triangulate(const float *, const std::vector<int> &, std::vector<unsigned> &);
+
+    /** @return True if the last call had to fall back to ear clipping. */
+    bool usedFallback() const { return fallback; }
+
+private:
+    /** Sweep status ordering (edges by x at the sweep point). */
+    struct EdgeLess
+    {
+        const Triangulator *t;
+        bool operator()(int, int) const;
+    };
+
+    /** Vertex coordinates. */
+    std::vector<double> px, py;
+    /** Next and previous vertex in the same ring. */
+    std::vector<int> next, prev;
+    /** Inverse slope (dx/dy) of each edge. */
+    std::vector<double> slope;
+    /** Vertex type for the sweep. */
+    std::vector<char> type;
+    /** Vertices sorted from top to bottom. */
+    std::vector<int> order;
+    /** Local maxima and chain cursors while sorting. */
+    std::vector<int> starts, heap;
+    /** Helper vertex of each edge (edge i goes from i to next[i]). */
+    std::vector<int> helper;
+    /** Sweep status. */
+    std::set<int, EdgeLess> status{EdgeLess{this}};
+    /** Position of each edge in the status. */
+    std::vector<std::set<int, EdgeLess>::iterator> status_pos;
+    /** Current sweep point. */
+    double sweep_x = 0, sweep_y = 0;
+    /** Diagonals (pairs of vertices). */
+    std::vector<int> diagonals;
+    /** Diagonal adjacency: first entry per vertex and linked entries. */
+    std::vector<int> adj_head, adj_next, adj_to;
+    /** Visited flags for boundary and diagonal half-edges. */
+    std::vector<char> seen_edge, seen_diag;
+    /** Scratch for one monotone piece. */
+    std::vector<int> piece, sorted, chain, stack;
+    /** Linked list used by ear clipping. */
+    std::vector<int> ear_next, ear_prev, ear_vertex;
+    /** Whether the last call used ear clipping. */
+    bool fallback = false;
+
+    bool above(int, int) const;
+    double xAt(int) const;
+    bool load(const float *, const std::vector<int> &);
+    bool sweep();
+    void addDiagonal(int, int);
+    int leftEdge(int);
+    bool monotonePieces(std::vector<unsigned> &);
+    int nextInFace(int, int) const;
+    void triangulateMonotone(std::vector<unsigned> &);
+    void emit(std::vector<unsigned> &, int, int, int) const;
+    bool earClip(const std::vector<int> &, std::vector<unsigned> &);
+};
+
+#endif
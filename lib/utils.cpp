@@ -8,12 +8,14 @@
  */
 
 #include "utils.h"
+#include "shader_cache.h"
 
 
 /** 
  * Create program.
  *
- * Creates a program from given shader codes.
+ * Creates a program from given shader codes, through the program binary
+ * cache (see shader_cache.h).
  *
  * @param vertex_code String with code for vertex shader.
  * @param fragment_code String with code for fragment shader.
@@ -21,54 +23,5 @@
  */
 int createShaderProgram(const char *vertex_code, const char *fragment_code)
 {
-	
-    int success;
-    char error[512];
-
-    // Request a program and shader slots from GPU
-    int program  = glCreateProgram();
-    int vertex   = glCreateShader(GL_VERTEX_SHADER);
-    int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    
-    // Set shaders source
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-
-    // Compile shaders
-    glCompileShader(vertex);
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-	glGetShaderInfoLog(vertex, 512, NULL, error);
-	std::cout << "ERROR: Shader comilation error: " << error << std::endl;
-    }
-                
-    glCompileShader(fragment);
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-	glGetShaderInfoLog(fragment, 512, NULL, error);
-	std::cout << "ERROR: Shader comilation error: " << error << std::endl;
-    }
-
-    // Attach shader objects to the program
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-
-    // Build program
-    glLinkProgram(program);
-    glGetShaderiv(program, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-	glGetProgramInfoLog(program, 512, NULL, error);
-	std::cout << "ERROR: Program link error: " << error << std::endl;
-    }
-
-    // Get rid of shaders (not needed anymore)
-    glDetachShader(program, vertex);
-    glDetachShader(program, fragment);
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
-    return program;
+    return (int)createCachedShaderProgram(vertex_code, fragment_code);
 }
@@ -15,7 +15,8 @@
 /** 
  * Create program.
  *
- * Creates a program from given shader codes.
+ * Creates a program from given shader codes, through the program binary
+ * cache (see shader_cache.h).
  *
  * @param vertex_code String with code for vertex shader.
  * @param fragment_code String with code for fragment shader.
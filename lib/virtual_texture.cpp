@@ -0,0 +1,892 @@
+/**
+ * @file virtual_texture.cpp
+ * Virtual texturing with tile streaming.
+ *
+ * Implements the tile file builder and the virtual texture declared in
+ * virtual_texture.h.
+ */
+
+#include "virtual_texture.h"
+#include "cache_dir.h"
+#include "mipmap.h"
+#include "trace.h"
+#include "stb_image.h"
+
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+const char *virtualTextureGLSL = R"(
+uniform sampler2D vtPhysical;
+uniform usampler2D vtPageTable;
+uniform vec4 vtLevelInfo[16];   // width, height, page table x, page table y
+uniform int vtLevels;
+uniform float vtPhysicalPages;
+uniform float vtLodBias;
+
+// Must match vt_page_size and vt_border.
+const float vtPageSize = 128.0;
+const float vtBorder = 4.0;
+const float vtContent = vtPageSize - 2.0 * vtBorder;
+
+float vtLevel(vec2 uv)
+{
+    vec2 size = vtLevelInfo[0].xy;
+    vec2 dx = dFdx(uv * size), dy = dFdy(uv * size);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + vtLodBias;
+    return clamp(floor(lod), 0.0, float(vtLevels - 1));
+}
+
+vec2 vtPage(vec2 uv, vec4 info)
+{
+    return min(floor(uv * info.xy / vtContent), ceil(info.xy / vtContent) - 1.0);
+}
+
+vec4 virtualTexture(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    vec4 info = vtLevelInfo[int(vtLevel(uv))];
+    uvec4 entry = texelFetch(vtPageTable, ivec2(info.zw + vtPage(uv, info)), 0);
+
+    // The entry may point to a coarser page while the wanted one loads.
+    vec4 resident = vtLevelInfo[int(entry.z)];
+    vec2 inpage = uv * resident.xy - vtPage(uv, resident) * vtContent;
+    vec2 phys = (vec2(entry.xy) * vtPageSize + vtBorder + inpage) / (vtPhysicalPages * vtPageSize);
+    return textureLod(vtPhysical, phys, 0.0);
+}
+
+uvec4 virtualTextureFeedback(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    float level = vtLevel(uv);
+    return uvec4(uvec2(vtPage(uv, vtLevelInfo[int(level)])), uint(level), 1u);
+}
+)";
+
+
+/** Tile file magic and version. */
+static const char vt_magic[4] = {'C', 'G', 'V', 'T'};
+static const uint32_t vt_version = 1;
+/** Bytes per page (RGBA). */
+static const size_t vt_page_bytes = (size_t)vt_page_size * vt_page_size * 4;
+/** Most levels a tile file may have (also the size of vtLevelInfo). */
+static const int vt_max_levels = 16;
+
+/** Tile file header. */
+struct VtHeader
+{
+    char magic[4];
+    uint32_t version, width, height, page, border, levels;
+};
+
+/** Tile file level table entry. */
+struct VtLevelEntry
+{
+    uint32_t width, height, pages_x, pages_y;
+    uint64_t first;
+};
+
+
+/** Page key: level, page row and page column. */
+static uint64_t pageKey(int level, int x, int y)
+{
+    return ((uint64_t)level << 40) | ((uint64_t)y << 20) | (uint64_t)x;
+}
+
+static int keyLevel(uint64_t key) { return (int)(key >> 40); }
+static int keyY(uint64_t key) { return (int)((key >> 20) & 0xfffff); }
+static int keyX(uint64_t key) { return (int)(key & 0xfffff); }
+
+
+/**
+ * Rows of the source image, converted to RGBA.
+ *
+ * Images stb_image reads are decoded whole; binary PPM files are read
+ * sequentially, keeping only the last rows (the builder asks for rows in
+ * increasing order, going back at most one page border).
+ */
+class SourceRows
+{
+public:
+    int width = 0, height = 0;
+
+    ~SourceRows()
+    {
+        if (image)
+            stbi_image_free(image);
+        if (ppm)
+            fclose(ppm);
+    }
+
+    bool open(const std::string &path)
+    {
+        ppm = fopen(path.c_str(), "rb");
+        if (!ppm)
+            return false;
+        int maxval = 0;
+        if (fgetc(ppm) == 'P' && fgetc(ppm) == '6' && readNumber(width) && readNumber(height) &&
+            readNumber(maxval) && maxval == 255 && width > 0 && height > 0)
+        {
+            line.resize((size_t)width * 3);
+            ring.resize((size_t)width * 4 * ring_rows);
+            return true;
+        }
+        fclose(ppm);
+        ppm = nullptr;
+
+        int n;
+        traceBegin("stbi_load");
+        image = stbi_load(path.c_str(), &width, &height, &n, 4);
+        traceEnd();
+        return image != nullptr;
+    }
+
+    /** @return Row y (RGBA), valid until the next call. */
+    const unsigned char *row(int y)
+    {
+        if (image)
+            return image + (size_t)y * width * 4;
+
+        while (next_row <= y)
+        {
+            unsigned char *dst = &ring[(size_t)(next_row % ring_rows) * width * 4];
+            if (fread(line.data(), 1, line.size(), ppm) != line.size())
+                memset(line.data(), 0, line.size());
+            for (int x = 0; x < width; x++)
+            {
+                dst[4*x] = line[3*x];
+                dst[4*x+1] = line[3*x+1];
+                dst[4*x+2] = line[3*x+2];
+                dst[4*x+3] = 255;
+            }
+            next_row++;
+        }
+        return &ring[(size_t)(y % ring_rows) * width * 4];
+    }
+
+private:
+    static const int ring_rows = vt_page_size + 2 * vt_border;
+    unsigned char *image = nullptr;
+    FILE *ppm = nullptr;
+    std::vector<unsigned char> line, ring;
+    int next_row = 0;
+
+    /** Read a header number, skipping blanks and comments. */
+    bool readNumber(int &v)
+    {
+        int c = fgetc(ppm);
+        while (c == '#' || isspace(c))
+        {
+            if (c == '#')
+                while (c != '\n' && c != EOF)
+                    c = fgetc(ppm);
+            c = fgetc(ppm);
+        }
+        if (!isdigit(c))
+            return false;
+        for (v = 0; isdigit(c); c = fgetc(ppm))
+            v = v * 10 + (c - '0');
+        return true;
+    }
+};
+
+
+/**
+ * Cut one level into pages.
+ *
+ * Works one row of pages at a time, so only a band of rows is in memory.
+ *
+ * @param pages Destination of the level's first page.
+ * @param l Level table entry.
+ * @param row Returns row y of the level (RGBA).
+ */
+static void fillLevel(unsigned char *pages, const VtLevelEntry &l,
+                      const std::function<const unsigned char *(int)> &row)
+{
+    int w = l.width, h = l.height;
+    size_t stride = (size_t)w * 4;
+    std::vector<unsigned char> band(stride * vt_page_size);
+
+    for (uint32_t py = 0; py < l.pages_y; py++)
+    {
+        for (int r = 0; r < vt_page_size; r++)
+        {
+            int y = std::min(std::max((int)py * vt_content - vt_border + r, 0), h - 1);
+            memcpy(&band[r * stride], row(y), stride);
+        }
+
+        for (uint32_t px = 0; px < l.pages_x; px++)
+        {
+            unsigned char *page = pages + ((size_t)py * l.pages_x + px) * vt_page_bytes;
+            int x0 = (int)px * vt_content - vt_border;
+            int from = std::max(x0, 0), to = std::min(x0 + vt_page_size, w);
+            for (int r = 0; r < vt_page_size; r++)
+            {
+                const unsigned char *src = &band[r * stride];
+                unsigned char *dst = page + (size_t)r * vt_page_size * 4;
+                // Inside the image one copy; outside, repeat the edge texel.
+                memcpy(dst + (from - x0) * 4, src + from * 4, (size_t)(to - from) * 4);
+                for (int c = 0; c < from - x0; c++)
+                    memcpy(dst + c * 4, src, 4);
+                for (int c = to - x0; c < vt_page_size; c++)
+                    memcpy(dst + c * 4, src + (w - 1) * 4, 4);
+            }
+        }
+    }
+}
+
+
+/**
+ * Gather row y of a level from its pages.
+ */
+static void gatherRow(const unsigned char *pages, const VtLevelEntry &l, int y, unsigned char *out)
+{
+    int py = y / vt_content, iy = y % vt_content + vt_border;
+    for (uint32_t px = 0; px < l.pages_x; px++)
+    {
+        int n = std::min(vt_content, (int)l.width - (int)px * vt_content);
+        const unsigned char *src = pages + ((size_t)py * l.pages_x + px) * vt_page_bytes +
+                                   ((size_t)iy * vt_page_size + vt_border) * 4;
+        memcpy(out + (size_t)px * vt_content * 4, src, (size_t)n * 4);
+    }
+}
+
+
+bool buildVirtualTexture(const std::string &image, const std::string &path)
+{
+    auto start = std::chrono::steady_clock::now();
+    SourceRows source;
+    if (!source.open(image))
+    {
+        std::cerr << "Cannot read " << image << std::endl;
+        return false;
+    }
+
+    // Halve until one page holds the whole level.
+    std::vector<VtLevelEntry> levels;
+    uint64_t pages = 0;
+    for (int w = source.width, h = source.height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        uint32_t px = (w + vt_content - 1) / vt_content, py = (h + vt_content - 1) / vt_content;
+        levels.push_back({(uint32_t)w, (uint32_t)h, px, py, pages});
+        pages += (uint64_t)px * py;
+        if ((px == 1 && py == 1) || (int)levels.size() == vt_max_levels)
+            break;
+    }
+
+    size_t table_end = sizeof(VtHeader) + levels.size() * sizeof(VtLevelEntry);
+    size_t data = (table_end + 4095) & ~(size_t)4095;
+    size_t size = data + pages * vt_page_bytes;
+
+    // Written through a shared mapping: coarser levels are built from the
+    // pages of finer ones, read back from the same mapping.
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    unsigned char *base = (unsigned char *)p;
+
+    VtHeader h;
+    memcpy(h.magic, vt_magic, 4);
+    h.version = vt_version;
+    h.width = source.width;
+    h.height = source.height;
+    h.page = vt_page_size;
+    h.border = vt_border;
+    h.levels = levels.size();
+    memcpy(base, &h, sizeof(h));
+    memcpy(base + sizeof(h), levels.data(), levels.size() * sizeof(VtLevelEntry));
+
+    fillLevel(base + data, levels[0], [&](int y) { return source.row(y); });
+
+    // Coarser levels: 2x2 average in linear light, like mipmap.cpp.
+    std::vector<unsigned char> a, b, out;
+    std::vector<float> linear(256);
+    for (int i = 0; i < 256; i++)
+        linear[i] = srgbToLinear(i);
+    for (size_t li = 1; li < levels.size(); li++)
+    {
+        const VtLevelEntry &src = levels[li - 1], &dst = levels[li];
+        const unsigned char *src_pages = base + data + src.first * vt_page_bytes;
+        a.resize((size_t)src.pages_x * vt_content * 4);
+        b.resize(a.size());
+        out.resize((size_t)dst.width * 4);
+
+        fillLevel(base + data + dst.first * vt_page_bytes, dst, [&](int y)
+        {
+            gatherRow(src_pages, src, std::min(2 * y, (int)src.height - 1), a.data());
+            gatherRow(src_pages, src, std::min(2 * y + 1, (int)src.height - 1), b.data());
+            for (uint32_t x = 0; x < dst.width; x++)
+            {
+                size_t x0 = 2 * x * 4, x1 = std::min(2 * x + 1, src.width - 1) * 4;
+                for (int c = 0; c < 3; c++)
+                    out[4*x+c] = linearToSrgb(0.25f * (linear[a[x0+c]] + linear[a[x1+c]] +
+                                                       linear[b[x0+c]] + linear[b[x1+c]]));
+                out[4*x+3] = (a[x0+3] + a[x1+3] + b[x0+3] + b[x1+3] + 2) / 4;
+            }
+            return out.data();
+        });
+    }
+
+    bool ok = munmap(p, size) == 0 && std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        std::remove(tmp.c_str());
+    else
+        std::cout << "Virtual texture " << image << ": " << source.width << "x" << source.height << ", "
+                  << levels.size() << " level(s), " << pages << " page(s), built in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+    return ok;
+}
+
+
+std::string virtualTextureFile(const std::string &image)
+{
+    struct stat st;
+    char *real = realpath(image.c_str(), NULL);
+    if (!real || stat(real, &st) != 0)
+    {
+        free(real);
+        return "";
+    }
+    std::string key = std::string(real) + "#" + std::to_string(st.st_size) + "#" + std::to_string(st.st_mtime);
+    free(real);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016zx.vt", std::hash<std::string>()(key));
+    std::string dir = cacheDir("vt"), path = dir + name;
+    if (access(path.c_str(), R_OK) == 0)
+        return path;
+    if (!makeDirs(dir) || !buildVirtualTexture(image, path))
+        return "";
+    return path;
+}
+
+
+VirtualTexture::VirtualTexture(int cache_pages, int feedback_scale, int threads)
+    : cache_pages(std::min(std::max(cache_pages, 2), 256)), feedback_scale(std::max(feedback_scale, 1)),
+      thread_count(std::max(threads, 1))
+{
+}
+
+
+VirtualTexture::~VirtualTexture()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread &t : workers)
+        t.join();
+    if (map)
+        munmap(map, map_size);
+}
+
+
+bool VirtualTexture::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(VtHeader))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    // Validate everything before handing out pointers into the file.
+    const unsigned char *base = (const unsigned char *)p;
+    VtHeader h;
+    memcpy(&h, base, sizeof(h));
+    size_t table_end = sizeof(VtHeader) + (size_t)h.levels * sizeof(VtLevelEntry);
+    size_t data = (table_end + 4095) & ~(size_t)4095;
+    bool ok = memcmp(h.magic, vt_magic, 4) == 0 && h.version == vt_version && h.page == vt_page_size &&
+              h.border == vt_border && h.levels > 0 && h.levels <= (uint32_t)vt_max_levels &&
+              data <= (size_t)st.st_size;
+
+    std::vector<Level> levels;
+    for (uint32_t i = 0; ok && i < h.levels; i++)
+    {
+        VtLevelEntry e;
+        memcpy(&e, base + sizeof(VtHeader) + i * sizeof(VtLevelEntry), sizeof(e));
+        uint64_t end = (e.first + (uint64_t)e.pages_x * e.pages_y) * vt_page_bytes;
+        ok = e.pages_x == (e.width + vt_content - 1) / vt_content && e.pages_y == (e.height + vt_content - 1) / vt_content &&
+             e.pages_x > 0 && e.pages_y > 0 && e.pages_x < (1 << 20) && e.pages_y < (1 << 20) &&
+             end <= (uint64_t)st.st_size - data;
+        levels.push_back({(int)e.width, (int)e.height, (int)e.pages_x, (int)e.pages_y, e.first, 0, 0});
+    }
+    const Level &top = levels.back();
+    if (!ok || top.pages_x * top.pages_y > cache_pages * cache_pages / 2)
+    {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    map = p;
+    map_size = st.st_size;
+    data_offset = data;
+    level_list = levels;
+
+    // Page table layout: level 0, then the other levels stacked to its right.
+    table_w = level_list[0].pages_x;
+    table_h = level_list[0].pages_y;
+    int y = 0;
+    for (size_t i = 1; i < level_list.size(); i++)
+    {
+        level_list[i].table_x = level_list[0].pages_x;
+        level_list[i].table_y = y;
+        y += level_list[i].pages_y;
+        table_w = std::max(table_w, level_list[0].pages_x + level_list[i].pages_x);
+    }
+    table_h = std::max(table_h, y);
+    return true;
+}
+
+
+/**
+ * Pixels of a page in the mapped file.
+ */
+const unsigned char *VirtualTexture::pageData(uint64_t key) const
+{
+    const Level &l = level_list[keyLevel(key)];
+    size_t index = l.first + (size_t)keyY(key) * l.pages_x + keyX(key);
+    return (const unsigned char *)map + data_offset + index * vt_page_bytes;
+}
+
+
+/**
+ * Loader thread body.
+ *
+ * Copies pages out of the mapping; the copy is what faults them in from
+ * disk, so the GL thread never waits for I/O.
+ */
+void VirtualTexture::loaderLoop()
+{
+    for (;;)
+    {
+        uint64_t key;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            key = jobs.front();
+            jobs.pop_front();
+        }
+
+        const unsigned char *src = pageData(key);
+        Loaded page = {key, std::vector<unsigned char>(src, src + vt_page_bytes)};
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(std::move(page));
+    }
+}
+
+
+void VirtualTexture::init()
+{
+    int side = cache_pages * vt_page_size;
+    glGenTextures(1, &physical);
+    glBindTexture(GL_TEXTURE_2D, physical);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Integer texture: must use nearest filtering.
+    glGenTextures(1, &table);
+    glBindTexture(GL_TEXTURE_2D, table);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, table_w, table_h, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    table_data.assign((size_t)table_w * table_h * 4, 0);
+
+    slots.assign(cache_pages * cache_pages, {0, 0, false, false});
+
+    // The coarsest level is the fallback for everything; keep it resident.
+    int top = (int)level_list.size() - 1;
+    for (int y = 0; y < level_list[top].pages_y; y++)
+        for (int x = 0; x < level_list[top].pages_x; x++)
+        {
+            uint64_t key = pageKey(top, x, y);
+            upload(key, pageData(key), true);
+        }
+    rebuildTable();
+
+    for (int i = 0; i < thread_count; i++)
+        workers.emplace_back(&VirtualTexture::loaderLoop, this);
+}
+
+
+void VirtualTexture::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+        done.clear();
+    }
+    work_cv.notify_all();
+    for (std::thread &t : workers)
+        t.join();
+    workers.clear();
+    stopping = false;
+
+    glDeleteTextures(1, &physical);
+    glDeleteTextures(1, &table);
+    glDeleteTextures(1, &feedback_color);
+    glDeleteRenderbuffers(1, &feedback_depth);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteBuffers(2, pbo);
+    physical = table = feedback_color = feedback_depth = fbo = pbo[0] = pbo[1] = 0;
+    feedback_w = feedback_h = 0;
+
+    if (map)
+        munmap(map, map_size);
+    map = nullptr;
+    map_size = 0;
+    level_list.clear();
+    resident.clear();
+    requested.clear();
+    idle = true;
+    slots.clear();
+}
+
+
+void VirtualTexture::beginFeedback(int width, int height)
+{
+    int w = std::max(1, width / feedback_scale), h = std::max(1, height / feedback_scale);
+    if (w != feedback_w || h != feedback_h)
+    {
+        if (!fbo)
+        {
+            glGenFramebuffers(1, &fbo);
+            glGenTextures(1, &feedback_color);
+            glGenRenderbuffers(1, &feedback_depth);
+            glGenBuffers(2, pbo);
+        }
+        glBindTexture(GL_TEXTURE_2D, feedback_color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, w, h, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (GLuint b : pbo)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, b);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * h * 4 * sizeof(uint16_t), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedback_w = w;
+        feedback_h = h;
+        feedback_pending[0] = feedback_pending[1] = false;
+    }
+
+    glGetIntegerv(GL_VIEWPORT, saved_viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, w, h);
+    const GLuint zero[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, zero);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+
+void VirtualTexture::endFeedback()
+{
+    // Copied into the PBO by the GPU; mapped one frame later.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[feedback_index]);
+    glReadPixels(0, 0, feedback_w, feedback_h, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback_pending[feedback_index] = true;
+    feedback_index ^= 1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(saved_viewport[0], saved_viewport[1], saved_viewport[2], saved_viewport[3]);
+}
+
+
+/**
+ * Mark a page and its coarser ancestors as used this frame.
+ *
+ * @param key Page wanted by the feedback.
+ * @param misses Receives pages that are neither resident nor requested.
+ */
+void VirtualTexture::touch(uint64_t key, std::vector<uint64_t> &misses)
+{
+    int level = keyLevel(key), x = keyX(key), y = keyY(key);
+    for (; level < (int)level_list.size(); level++, x /= 2, y /= 2)
+    {
+        const Level &l = level_list[level];
+        x = std::min(x, l.pages_x - 1);
+        y = std::min(y, l.pages_y - 1);
+        uint64_t k = pageKey(level, x, y);
+        auto it = resident.find(k);
+        if (it != resident.end())
+        {
+            if (slots[it->second].last_used == frame)
+                return;  // ancestors already touched
+            slots[it->second].last_used = frame;
+        }
+        else if (requested.insert(k).second)
+            misses.push_back(k);
+    }
+}
+
+
+/**
+ * Collect the pages seen in a feedback buffer.
+ */
+void VirtualTexture::readFeedback(const uint16_t *pixels)
+{
+    std::unordered_set<uint64_t> seen;
+    for (size_t i = 0, n = (size_t)feedback_w * feedback_h; i < n; i++)
+    {
+        const uint16_t *p = pixels + 4 * i;
+        if (p[3] && p[2] < level_list.size())
+            seen.insert(pageKey(p[2], p[0], p[1]));
+    }
+    feedback_pages = seen.size();
+
+    std::vector<uint64_t> misses;
+    for (uint64_t key : seen)
+        touch(key, misses);
+
+    // Coarse pages first: they cover more of the view.
+    std::sort(misses.begin(), misses.end(), [](uint64_t a, uint64_t b) { return keyLevel(a) > keyLevel(b); });
+    if (misses.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint64_t k : misses)
+            jobs.push_back(k);
+        // Requests the view moved away from are not worth loading.
+        while (jobs.size() > (size_t)cache_pages * cache_pages / 4)
+        {
+            requested.erase(jobs.front());
+            jobs.pop_front();
+        }
+    }
+    work_cv.notify_all();
+}
+
+
+/**
+ * Put a page into the physical cache.
+ *
+ * Takes a free slot, or evicts the least recently used page not needed
+ * this frame.
+ *
+ * @return False if every slot is in use this frame.
+ */
+bool VirtualTexture::upload(uint64_t key, const unsigned char *pixels, bool pinned)
+{
+    int best = -1;
+    for (int i = 0; i < (int)slots.size(); i++)
+    {
+        const Slot &s = slots[i];
+        if (!s.used)
+        {
+            best = i;
+            break;
+        }
+        if (!s.pinned && s.last_used < frame && (best < 0 || s.last_used < slots[best].last_used))
+            best = i;
+    }
+    if (best < 0)
+        return false;
+
+    Slot &s = slots[best];
+    if (s.used)
+    {
+        resident.erase(s.key);
+        evictions++;
+    }
+    s = {key, frame, true, pinned};
+    resident[key] = best;
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, physical);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (best % cache_pages) * vt_page_size, (best / cache_pages) * vt_page_size,
+                    vt_page_size, vt_page_size, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    uploads++;
+    table_dirty = true;
+    return true;
+}
+
+
+/**
+ * Rebuild and upload the page table.
+ *
+ * Entries of pages that are not resident copy the entry of their parent,
+ * coarsest level first, so each points to the finest resident ancestor.
+ */
+void VirtualTexture::rebuildTable()
+{
+    for (int level = (int)level_list.size() - 1; level >= 0; level--)
+    {
+        const Level &l = level_list[level];
+        for (int y = 0; y < l.pages_y; y++)
+            for (int x = 0; x < l.pages_x; x++)
+            {
+                unsigned char *e = &table_data[((size_t)(l.table_y + y) * table_w + l.table_x + x) * 4];
+                auto it = resident.find(pageKey(level, x, y));
+                if (it != resident.end())
+                {
+                    e[0] = it->second % cache_pages;
+                    e[1] = it->second / cache_pages;
+                    e[2] = level;
+                    e[3] = 1;
+                }
+                else if (level + 1 < (int)level_list.size())
+                {
+                    const Level &p = level_list[level + 1];
+                    int px = std::min(x / 2, p.pages_x - 1), py = std::min(y / 2, p.pages_y - 1);
+                    memcpy(e, &table_data[((size_t)(p.table_y + py) * table_w + p.table_x + px) * 4], 4);
+                }
+            }
+    }
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, table);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, table_w, table_h, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, table_data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    table_dirty = false;
+}
+
+
+bool VirtualTexture::update(int max_uploads)
+{
+    frame++;
+
+    // The buffer written last frame; its copy has finished by now.
+    if (feedback_pending[feedback_index])
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[feedback_index]);
+        const uint16_t *p = (const uint16_t *)glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)feedback_w * feedback_h * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+        if (p)
+        {
+            readFeedback(p);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedback_pending[feedback_index] = false;
+    }
+
+    std::vector<Loaded> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = std::min(done.size(), (size_t)std::max(max_uploads, 0));
+        std::move(done.begin(), done.begin() + n, std::back_inserter(ready));
+        done.erase(done.begin(), done.begin() + n);
+    }
+    for (Loaded &page : ready)
+    {
+        requested.erase(page.key);
+        if (!upload(page.key, page.pixels.data(), false))
+            dropped++;  // asked for again if still visible
+    }
+
+    if (table_dirty)
+        rebuildTable();
+
+    // Requested pages stay in the set until uploaded. A frame drawn while
+    // idle was asked for by something else (the view may have moved), so
+    // one more frame is needed to read its feedback.
+    bool busy = idle || !requested.empty();
+    idle = !busy;
+    return busy;
+}
+
+
+/**
+ * Set the uniforms of virtualTextureGLSL.
+ *
+ * @param program Program in use.
+ * @param bias Level bias.
+ */
+void VirtualTexture::setUniforms(GLuint program, float bias)
+{
+    float info[vt_max_levels * 4];
+    for (size_t i = 0; i < level_list.size(); i++)
+    {
+        info[4*i] = level_list[i].width;
+        info[4*i+1] = level_list[i].height;
+        info[4*i+2] = level_list[i].table_x;
+        info[4*i+3] = level_list[i].table_y;
+    }
+    glUniform4fv(glGetUniformLocation(program, "vtLevelInfo"), (GLsizei)level_list.size(), info);
+    glUniform1i(glGetUniformLocation(program, "vtLevels"), (GLint)level_list.size());
+    glUniform1f(glGetUniformLocation(program, "vtPhysicalPages"), (float)cache_pages);
+    glUniform1f(glGetUniformLocation(program, "vtLodBias"), bias);
+}
+
+
+void VirtualTexture::bind(GLuint program, GLuint unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, physical);
+    glActiveTexture(GL_TEXTURE0 + unit + 1);
+    glBindTexture(GL_TEXTURE_2D, table);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(program, "vtPhysical"), unit);
+    glUniform1i(glGetUniformLocation(program, "vtPageTable"), unit + 1);
+    setUniforms(program, 0.0f);
+}
+
+
+void VirtualTexture::bindFeedback(GLuint program)
+{
+    // The feedback buffer is feedback_scale times smaller, so its texel
+    // footprints (and levels) come out log2(scale) levels too coarse.
+    setUniforms(program, -std::log2((float)feedback_scale));
+}
+
+
+void VirtualTexture::printStats() const
+{
+    std::cout << "Virtual texture: " << width() << "x" << height() << ", " << level_list.size() << " level(s), "
+              << resident.size() << "/" << slots.size() << " page(s) resident, " << feedback_pages
+              << " in view, " << uploads << " upload(s), " << evictions << " eviction(s), " << dropped
+              << " dropped" << std::endl;
+}
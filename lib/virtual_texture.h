@@ -0,0 +1,259 @@
+/**
+ * @file virtual_texture.h
+ * Virtual texturing with tile streaming.
+ *
+ * Images too large for memory or for one glTexImage2D (16k to 64k texels
+ * per side) are cut into 128x128 pages, mip level by mip level, and stored
+ * in a tile file that is mapped with mmap. Each page holds 120x120 texels
+ * of content plus a 4 texel border copied from its neighbours, so bilinear
+ * filtering never reads across into an unrelated page.
+ *
+ * At run time only the pages the view needs live on the GPU, in a fixed
+ * size physical cache texture managed as an LRU. A page table texture maps
+ * every virtual page to its slot in the cache, or to the closest coarser
+ * page that is resident, so something sensible is always drawn.
+ *
+ * Needed pages are found with a feedback pass: the scene is drawn into a
+ * small integer framebuffer that records, per pixel, the page and level the
+ * sampling shader wants. The result is read back through a PBO one frame
+ * later (no stall), missing pages are read from the tile file on loader
+ * threads, and a few of them are uploaded per frame.
+ *
+ * Shaders include virtualTextureGLSL and call virtualTexture(uv) to sample
+ * and virtualTextureFeedback(uv) in the feedback pass.
+ *
+ * Decoding the source image uses the stb_image implementation compiled in
+ * texture_manager.cpp. Binary PPM (P6) sources are streamed row by row, so
+ * their size is not limited by memory.
+ */
+
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+#include <GL/glew.h>
+
+
+/** Page size in texels, border included. */
+const int vt_page_size = 128;
+/** Border on each side of a page. */
+const int vt_border = 4;
+/** Content texels per page side. */
+const int vt_content = vt_page_size - 2 * vt_border;
+
+/**
+ * GLSL functions for virtual textures (no #version line).
+ *
+ * vec4 virtualTexture(vec2 uv) samples the texture; uvec4
+ * virtualTextureFeedback(vec2 uv) is the value to write in the feedback
+ * pass (to an unsigned integer output).
+ */
+extern const char *virtualTextureGLSL;
+
+
+/**
+ * Build a tile file.
+ *
+ * @param image Source image (anything stb_image reads, or binary PPM).
+ * @param path Tile file to write.
+ * @return False if the image cannot be read or the file written.
+ */
+bool buildVirtualTexture(const std::string &, const std::string &);
+
+/**
+ * Tile file of an image, built on first use.
+ *
+ * Tile files are kept in the cache directory, keyed by the image path,
+ * size and modification time.
+ *
+ * @param image Source image.
+ * @return Tile file path, or an empty string on failure.
+ */
+std::string virtualTextureFile(const std::string &);
+
+
+/**
+ * Virtual texture.
+ *
+ * All methods except the constructor, open() and printStats() must be
+ * called from the GL thread.
+ *
+ * Typical frame:
+ *   vt.beginFeedback(w, h);
+ *   ... draw the scene with the feedback program ...
+ *   vt.endFeedback();
+ *   if (vt.update()) ... draw another frame ...
+ *   vt.bind(program, 0);
+ *   ... draw the scene ...
+ */
+class VirtualTexture
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param cache_pages Pages per side of the physical cache (up to 256).
+     * @param feedback_scale Feedback buffer is the viewport divided by this.
+     * @param threads Loader threads.
+     */
+    explicit VirtualTexture(int = 32, int = 8, int = 2);
+    ~VirtualTexture();
+
+    /**
+     * Map a tile file.
+     *
+     * @param path File written by buildVirtualTexture().
+     * @return False if the file is missing or invalid.
+     */
+    bool open(const std::string &);
+
+    /**
+     * Create the GL objects.
+     *
+     * Loads the coarsest level, which stays resident.
+     */
+    void init();
+
+    /**
+     * Stop the loaders, delete the GL objects and unmap the file.
+     */
+    void release();
+
+    /**
+     * Start the feedback pass.
+     *
+     * Binds the feedback framebuffer and viewport and clears them.
+     *
+     * @param width Viewport width.
+     * @param height Viewport height.
+     */
+    void beginFeedback(int, int);
+
+    /**
+     * End the feedback pass.
+     *
+     * Starts the read back and restores the default framebuffer.
+     */
+    void endFeedback();
+
+    /**
+     * Process the last feedback and upload loaded pages.
+     *
+     * With on-demand redraw, keep drawing frames while this returns true:
+     * pages are still being loaded or uploaded, or the feedback of a frame
+     * drawn after an idle period has not been read yet.
+     *
+     * @param max_uploads Pages uploaded per call.
+     * @return True if more frames are needed to stream in the view.
+     */
+    bool update(int = 16);
+
+    /**
+     * Bind the textures and set the uniforms.
+     *
+     * @param program Program using virtualTextureGLSL (must be in use).
+     * @param unit First of the two texture units used.
+     */
+    void bind(GLuint, GLuint);
+
+    /**
+     * Set the uniforms of the feedback program.
+     *
+     * Biases the level by the feedback scale, so the feedback asks for the
+     * pages the full-size view samples.
+     *
+     * @param program Feedback program (must be in use).
+     */
+    void bindFeedback(GLuint);
+
+    /**
+     * Print residency and streaming statistics.
+     */
+    void printStats() const;
+
+    /** @return Width of the full image. */
+    int width() const { return level_list.empty() ? 0 : level_list[0].width; }
+    /** @return Height of the full image. */
+    int height() const { return level_list.empty() ? 0 : level_list[0].height; }
+
+private:
+    /** One mip level of the tile file. */
+    struct Level
+    {
+        int width, height, pages_x, pages_y;
+        uint64_t first;
+        /** Position of the level in the page table texture. */
+        int table_x, table_y;
+    };
+
+    /** One slot of the physical cache. */
+    struct Slot
+    {
+        uint64_t key;
+        int last_used;
+        bool used, pinned;
+    };
+
+    /** A page read by a loader. */
+    struct Loaded
+    {
+        uint64_t key;
+        std::vector<unsigned char> pixels;
+    };
+
+    int cache_pages, feedback_scale, thread_count;
+
+    // Tile file.
+    void *map = nullptr;
+    size_t map_size = 0;
+    size_t data_offset = 0;
+    std::vector<Level> level_list;
+
+    // GL objects.
+    GLuint physical = 0, table = 0, fbo = 0, feedback_color = 0, feedback_depth = 0;
+    GLuint pbo[2] = {0, 0};
+    int feedback_w = 0, feedback_h = 0, feedback_index = 0;
+    bool feedback_pending[2] = {false, false};
+    GLint saved_viewport[4];
+
+    // Residency (GL thread).
+    std::vector<Slot> slots;
+    std::unordered_map<uint64_t, int> resident;
+    std::unordered_set<uint64_t> requested;
+    std::vector<unsigned char> table_data;
+    int table_w = 0, table_h = 0;
+    bool table_dirty = false;
+    int frame = 0;
+    /** update() returned false last time. */
+    bool idle = true;
+
+    // Loader queue, protected by mutex.
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::deque<uint64_t> jobs;
+    std::vector<Loaded> done;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    // Statistics.
+    int uploads = 0, evictions = 0, dropped = 0;
+    size_t feedback_pages = 0;
+
+    const unsigned char *pageData(uint64_t) const;
+    void loaderLoop();
+    void readFeedback(const uint16_t *);
+    void touch(uint64_t, std::vector<uint64_t> &);
+    bool upload(uint64_t, const unsigned char *, bool);
+    void rebuildTable();
+    void setUniforms(GLuint, float);
+};
+
+#endif
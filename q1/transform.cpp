@@ -189,34 +189,10 @@ void initData()
  * Compile shaders and create the program.
  */
 void initShaders()
-{	
-	program  = glCreateProgram();
-    int vertex   = glCreateShader(GL_VERTEX_SHADER);
-    int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-
-    glLinkProgram(program);
-
-    glDetachShader(program, vertex);
-    glDetachShader(program, fragment);
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
-    // Pega o local da uniform de cor
-    //colorUniformLocation = glGetUniformLocation(program, "triangleColor");
-    //glUniform3fv(colorUniformLocation, 0, currentColor);
-
+{
+    // Request a program and shader slots from GPU (cached binary when possible)
+    program = createShaderProgram(vertex_code, fragment_code);
     glUseProgram(program);
-    // Request a program and shader slots from GPU
-    //program = createShaderProgram(vertex_code, fragment_code);
 }
 
 int main(int argc, char** argv)
@@ -5,6 +5,7 @@
  * Iteratively rotates a rectangle using two modes acording to keyboard key:
  * 1 for around the center of the object;
  * 2 for around coordinate system origin.
+ * Space pauses the rotation.
  * 
  * @author Ricardo Dutra da Silva
  */
@@ -18,6 +19,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "../lib/utils.h"
+#include "../lib/frame_scheduler.h"
 
 
 /* Globals */
@@ -35,8 +37,8 @@ unsigned int VBO;
 
 /** Rotation angle. */
 float angle = 0.0f;
-/** Rotation increment. */
-float angle_inc = 0.05f;
+/** Rotation increment per simulation step (1/60 s). */
+float angle_inc = 0.5f;
 /** Rotation mode. */
 int mode = 1;
 
@@ -72,10 +74,13 @@ const char *fragment_code = "\n"
 void display(void);
 void reshape(int, int);
 void keyboard(unsigned char, int, int);
-void idle(void);
+void update(double);
 void initData(void);
 void initShaders(void);
 
+/** Advances the rotation in fixed steps; frames are drawn only while it runs. */
+FrameScheduler scheduler(update);
+
 /** 
  * Drawing function.
  *
@@ -83,6 +88,8 @@ void initShaders(void);
  */
 void display()
 {
+	scheduler.beginFrame();
+
     	glClearColor(0.2, 0.3, 0.3, 1.0);
     	glClear(GL_COLOR_BUFFER_BIT);
 
@@ -110,6 +117,7 @@ void display()
     	glDrawArrays(GL_TRIANGLES, 0, 6);
 
     	glutSwapBuffers();
+	scheduler.endFrame();
 }
 
 /**
@@ -142,6 +150,9 @@ void keyboard(unsigned char key, int x, int y)
 {
         switch (key)
         {
+		case ' ':
+			scheduler.setAnimating(!scheduler.animating());
+			break;
                 case 27:
                         glutLeaveMainLoop();
                 case 'q':
@@ -162,15 +173,14 @@ void keyboard(unsigned char key, int x, int y)
 
 
 /**
- * Idle function.
+ * Simulation step.
  *
- * Called continuously.
+ * Called by the scheduler for every 1/60 s of animation; the step is
+ * fixed, so its length is not needed.
  */
-void idle()
+void update(double)
 {
     angle = ((angle+angle_inc) < 360.0f) ? angle+angle_inc : 360.0-angle+angle_inc;
-
-    glutPostRedisplay();
 }
 
 
@@ -235,33 +245,9 @@ void initBuffers() {
  */
 void initShaders()
 {
-	program  = glCreateProgram();
-    int vertex   = glCreateShader(GL_VERTEX_SHADER);
-    int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-
-    glLinkProgram(program);
-
-    glDetachShader(program, vertex);
-    glDetachShader(program, fragment);
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
-    // Pega o local da uniform de cor
-    //colorUniformLocation = glGetUniformLocation(program, "triangleColor");
-    //glUniform3fv(colorUniformLocation, 0, currentColor);
-
+    // Request a program and shader slots from GPU (cached binary when possible)
+    program = createShaderProgram(vertex_code, fragment_code);
     glUseProgram(program);
-    // Request a program and shader slots from GPU
-    //program = createShaderProgram(vertex_code, fragment_code);
 }
 
 int main(int argc, char** argv)
@@ -284,7 +270,7 @@ int main(int argc, char** argv)
     	glutReshapeFunc(reshape);
     	glutDisplayFunc(display);
     	glutKeyboardFunc(keyboard);
-    	glutIdleFunc(idle);
+	scheduler.setAnimating(true);
 
 	glutMainLoop();
 }
@@ -534,6 +534,8 @@ int main(int argc, char** argv) {
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include "../lib/batch2d.h"
+#include "../lib/scanline.h"
 
 struct Vec2 {
     float x, y;
@@ -545,6 +547,17 @@ Vec2 rectMin, rectMax;
 bool drawingRect = true, polygonDone = false;
 int clickCount = 0;
 
+// Desenho em lote: retângulo, polígono e recorte saem em no máximo 3 draw calls
+Batch2D batch;
+
+// Preenchimento na CPU (tecla 'f'): o recorte vira spans de pixels,
+// desenhados como linhas horizontais
+bool cpuFill = false;
+int winW = 800, winH = 600;
+ScanlineFiller filler;
+std::vector<Span> fillSpans;
+std::vector<float> clipPixels;
+
 // Converte coordenadas da tela para NDC
 Vec2 screenToNDC(int x, int y) {
     return Vec2((2.0f * x / 800.0f - 1.0f), (1.0f - 2.0f * y / 600.0f));
@@ -586,33 +599,45 @@ void clipPolygon() {
 void display() {
     glClearColor(1, 1, 1, 1);
     glClear(GL_COLOR_BUFFER_BIT);
-    glColor3f(1, 0, 0); // Vermelho para retângulo
+    batch.color(1, 0, 0); // Vermelho para retângulo
 
     if (clickCount >= 2) {
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(rectMin.x, rectMin.y);
-        glVertex2f(rectMin.x, rectMax.y);
-        glVertex2f(rectMax.x, rectMax.y);
-        glVertex2f(rectMax.x, rectMin.y);
-        glEnd();
+        const float rect[] = {
+            rectMin.x, rectMin.y,
+            rectMin.x, rectMax.y,
+            rectMax.x, rectMax.y,
+            rectMax.x, rectMin.y
+        };
+        batch.polyline(rect, 4, true);
     }
 
     if (!polyPoints.empty()) {
-        glColor3f(0, 0, 1); // Azul para polígono
-        glBegin(GL_LINE_LOOP);
-        for (auto& p : polyPoints)
-            glVertex2f(p.x, p.y);
-        glEnd();
+        batch.color(0, 0, 1); // Azul para polígono
+        batch.polyline(&polyPoints[0].x, polyPoints.size(), true);
     }
 
     if (!clippedPoly.empty()) {
-        glColor3f(0, 1, 0); // Verde para polígono recortado
-        glBegin(GL_POLYGON);
-        for (auto& p : clippedPoly)
-            glVertex2f(p.x, p.y);
-        glEnd();
+        batch.color(0, 1, 0); // Verde para polígono recortado
+        if (cpuFill) {
+            // NDC -> pixels, preenche por scanline e volta para NDC
+            clipPixels.clear();
+            for (const Vec2 &p : clippedPoly) {
+                clipPixels.push_back((p.x + 1.0f) * 0.5f * winW);
+                clipPixels.push_back((p.y + 1.0f) * 0.5f * winH);
+            }
+            filler.clear();
+            filler.addRing(clipPixels.data(), clippedPoly.size());
+            filler.spans(FILL_EVEN_ODD, winW, winH, fillSpans);
+            for (const Span &s : fillSpans) {
+                float y = 2.0f * (s.y + 0.5f) / winH - 1.0f;
+                batch.line(2.0f * s.x0 / winW - 1.0f, y, 2.0f * s.x1 / winW - 1.0f, y);
+            }
+        } else {
+            batch.polygon(&clippedPoly[0].x, clippedPoly.size());
+        }
     }
 
+    batch.flush();
     glutSwapBuffers();
 }
 
@@ -639,12 +664,10 @@ void mouse(int button, int state, int x, int y) {
 }
 
 void reshape(int w, int h) {
+    // Coordenadas já estão em NDC (-1 a 1); basta ajustar o viewport
     glViewport(0, 0, w, h);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(-1, 1, -1, 1, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    winW = w;
+    winH = h;
 }
 
 void keyboard(unsigned char key, int x, int y) {
@@ -652,7 +675,12 @@ void keyboard(unsigned char key, int x, int y) {
     switch (key) {
         case 27 : glutLeaveMainLoop(); //exit(0); break;
         case 'q':
-        case 'Q': glutLeaveMainLoop();
+        case 'Q': glutLeaveMainLoop(); break;
+        case 'f':
+        case 'F':
+            cpuFill = !cpuFill;
+            std::cout << "Preenchimento: " << (cpuFill ? "scanline (CPU)" : "triangulos (GPU)") << std::endl;
+            break;
     }
     glutPostRedisplay();
 }
@@ -663,6 +691,7 @@ int main(int argc, char** argv) {
     glutInitWindowSize(800, 600);
     glutCreateWindow("Sutherland-Hodgman Clipping");
     glewInit();
+    batch.init();
     glutDisplayFunc(display);
     glutMouseFunc(mouse);
     glutKeyboardFunc(keyboard);
@@ -8,6 +8,7 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <iostream>
+#include "../lib/shader_cache.h"
 
 // Janela
 int winW = 800, winH = 600;
@@ -38,24 +39,13 @@ void main(){
 )";
 
 GLuint prog, vao, vbo;
+GLsizeiptr vboSize = 0;    // bytes alocados no VBO
+bool circleDirty = true; // recalcula e reenvia o círculo só quando a janela muda
 
 // Compila e linka programa GLSL
 GLuint compileProgram(){
-    auto compile = [&](GLenum type,const char* src){
-        GLuint s = glCreateShader(type);
-        glShaderSource(s,1,&src,nullptr);
-        glCompileShader(s);
-        return s;
-    };
-    GLuint vs = compile(GL_VERTEX_SHADER, vertSrc);
-    GLuint fs = compile(GL_FRAGMENT_SHADER, fragSrc);
-    GLuint p = glCreateProgram();
-    glAttachShader(p,vs);
-    glAttachShader(p,fs);
-    glLinkProgram(p);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    return p;
+    // Binário do programa vem do cache em disco quando possível
+    return createCachedShaderProgram(vertSrc, fragSrc);
 }
 
 // Converte coordenada de pixel para NDC
@@ -83,6 +73,7 @@ e reflete os pontos para os outros sete octantes, garantindo precisão e eficiê
 */
 
 void rasterizeCircle(){
+    circlePoints.clear(); // mantém a capacidade: sem alocação após o primeiro quadro
     int x = 0;
     int y = radius;
     int d = 1 - radius;
@@ -114,15 +105,7 @@ void initGL(){
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
     glGenBuffers(1, &vbo);
-
-    rasterizeCircle();
-
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-                 circlePoints.size()*sizeof(glm::vec2),
-                 circlePoints.data(),
-                 GL_STATIC_DRAW);
-
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
     glEnableVertexAttribArray(0);
 
@@ -134,6 +117,20 @@ void display(){
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if(circleDirty){
+        rasterizeCircle();
+        // Reaproveita o buffer; só realoca se o círculo não couber
+        GLsizeiptr bytes = circlePoints.size()*sizeof(glm::vec2);
+        if(bytes > vboSize){
+            glBufferData(GL_ARRAY_BUFFER, bytes, circlePoints.data(), GL_STATIC_DRAW);
+            vboSize = bytes;
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, circlePoints.data());
+        }
+        circleDirty = false;
+    }
+
     glUseProgram(prog);
     glBindVertexArray(vao);
     glDrawArrays(GL_POINTS, 0, circlePoints.size());
@@ -145,15 +142,9 @@ void display(){
 void reshape(int w,int h){
     winW = w; winH = h;
     glViewport(0,0,w,h);
-    // atualizar círculo em caso de mudança de tamanho
-    circlePoints.clear();
+    // atualizar círculo em caso de mudança de tamanho (no próximo display)
     xc = winW/2; yc = winH/2;
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    rasterizeCircle();
-    glBufferData(GL_ARRAY_BUFFER,
-                 circlePoints.size()*sizeof(glm::vec2),
-                 circlePoints.data(),
-                 GL_STATIC_DRAW);
+    circleDirty = true;
 }
 
 void keyboard(unsigned char key, int x, int y) {
@@ -7,13 +7,17 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "../lib/stream_buffer.h"
+#include "../lib/shader_cache.h"
 
 // Dimensões da janela
 int win_width = 800;
 int win_height = 600;
 
 GLuint program;
-GLuint VAO, VBO;
+
+// Vértices dinâmicos (x, y, z): buffer em anel mapeado, sem realocar por quadro
+StreamVertexArray lines(3 * sizeof(float), 4);
 
 // Shaders
 const char *vertex_code = R"(
@@ -48,22 +52,17 @@ void display() {
     glClear(GL_COLOR_BUFFER_BIT);
 
     if (points.size() == 3) {
-        std::vector<float> vertices = {
-            points[1].x, points[1].y, 0.0f, // O
-            points[0].x, points[0].y, 0.0f, // P
-            points[1].x, points[1].y, 0.0f, // O
-            points[2].x, points[2].y, 0.0f  // Q
-        };
-
-        
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
-        glUseProgram(program);
-        glBindVertexArray(VAO);
+        GLint first;
+        glm::vec3 *v = lines.allocate<glm::vec3>(4, first);
+        v[0] = glm::vec3(points[1], 0.0f); // O
+        v[1] = glm::vec3(points[0], 0.0f); // P
+        v[2] = glm::vec3(points[1], 0.0f); // O
+        v[3] = glm::vec3(points[2], 0.0f); // Q
 
-        glDrawArrays(GL_LINES, 0, 4);
+        glUseProgram(program);
+        lines.draw(GL_LINES, first, 4);
         glBindVertexArray(0);
-        
+        lines.endFrame();
     }
 
     glutSwapBuffers();
@@ -135,42 +134,18 @@ void reshape(int w, int h) {
 
 
 void initShaders()
-{	
-	program  = glCreateProgram();
-    int vertex   = glCreateShader(GL_VERTEX_SHADER);
-    int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-
-    glLinkProgram(program);
-
-    glDetachShader(program, vertex);
-    glDetachShader(program, fragment);
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
+{
+    // Binário do programa vem do cache em disco quando possível
+    program = createCachedShaderProgram(vertex_code, fragment_code);
     glUseProgram(program);
 }
 
 void initBuffers() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    lines.init();
 
     // Configura o layout do buffer para o atributo de posição
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    lines.attribute(0, 3, GL_FLOAT, 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
@@ -7,12 +7,16 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/vector_angle.hpp>
 #include <glm/gtx/norm.hpp>
+#include "../lib/batch2d.h"
 
 using namespace std;
 
 // Armazena os pontos clicados
 vector<glm::vec2> points;
 
+// Desenho em lote (substitui glBegin/glEnd)
+Batch2D batch;
+
 // Função para converter coordenadas da janela para sistema OpenGL
 glm::vec2 screenToWorld(int x, int y, int width, int height) {
     float nx = (2.0f * x) / width - 1.0f;
@@ -53,12 +57,11 @@ void computeVectors() {
 
 void display() {
     glClear(GL_COLOR_BUFFER_BIT);
-    glPointSize(6.0f);
+    batch.pointSize(6.0f);
 
-    glBegin(GL_POINTS);
+    batch.color(1.0f, 1.0f, 1.0f);
     for (const auto& p : points)
-        glVertex2f(p.x, p.y);
-    glEnd();
+        batch.point(p.x, p.y);
 
     // Desenha os vetores u = P - O e v = Q - O
     if (points.size() == 3) {
@@ -66,19 +69,17 @@ void display() {
         glm::vec2 O = points[1];
         glm::vec2 Q = points[2];
 
-        glBegin(GL_LINES);
         // Vetor u (P - O)
-        glColor3f(1.0f, 0.0f, 0.0f);
-        glVertex2f(O.x, O.y);
-        glVertex2f(P.x, P.y);
+        batch.color(1.0f, 0.0f, 0.0f);
+        batch.line(O.x, O.y, P.x, P.y);
 
         // Vetor v (Q - O)
-        glColor3f(0.0f, 1.0f, 0.0f);
-        glVertex2f(O.x, O.y);
-        glVertex2f(Q.x, Q.y);
-        glEnd();
+        batch.color(0.0f, 1.0f, 0.0f);
+        batch.line(O.x, O.y, Q.x, Q.y);
     }
 
+    batch.flush();
+
     glutSwapBuffers();
 }
 
@@ -107,6 +108,7 @@ int main(int argc, char** argv) {
     glutCreateWindow("Geometria com OpenGL");
 
     glewInit();
+    batch.init();
 
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
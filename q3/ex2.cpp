@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "../lib/headless.h"
+#include "../lib/shader_cache.h"
 
 int win_width = 800;
 int win_height = 600;
@@ -37,22 +39,8 @@ void main() {
 )";
 
 void initShaders() {
-    GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-
-    program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-    glLinkProgram(program);
-
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    // Binário do programa vem do cache em disco quando possível
+    program = createCachedShaderProgram(vertex_code, fragment_code);
     glUseProgram(program);
 }
 
@@ -155,36 +143,42 @@ void display() {
 
     glDrawArrays(GL_TRIANGLES, 0, 36);
 
-    glutSwapBuffers();
+    swapBuffers();
 }
 
 void idle() {
     angle += angle_inc;
     if (angle > 360.0f) angle -= 360.0f;
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 void keyboard(unsigned char key, int x, int y) {
     if (key == '1') mode = 1;
     if (key == '2') mode = 2;
-    if (key == 'q' || key == 'Q') glutLeaveMainLoop();
+    if (key == 'q' || key == 'Q') leaveMainLoop();
     if (key == 27) exit(0);
 }
 
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-    glutInitContextVersion(3, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(win_width, win_height);
-    glutCreateWindow("Cubo 3D Transformações");
+    if (!headlessInit(argc, argv)) {
+        glutInit(&argc, argv);
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(win_width, win_height);
+        glutCreateWindow("Cubo 3D Transformações");
+    }
 
     glewInit();
 
     initData();
     initShaders();
 
+    // Sem janela: desenha os quadros em um pbuffer (veja lib/headless.h)
+    if (headless())
+        return headlessRun({display, idle, reshape, keyboard});
+
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
@@ -3,6 +3,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "../lib/headless.h"
+#include "../lib/shader_cache.h"
+#include "../lib/frame_scheduler.h"
 
 #include <iostream>
 
@@ -12,6 +15,21 @@ GLuint VAO, VBO;
 float scale = 1.0f;
 bool increasing = true;
 
+// Passo fixo da animação (1/60 s), independente da taxa de quadros
+void update(double) {
+    // varia a escala de forma suave entre 0.5 e 1.5
+    if (increasing) {
+        scale += 0.01f;
+        if (scale >= 1.5f) increasing = false;
+    } else {
+        scale -= 0.01f;
+        if (scale <= 0.5f) increasing = true;
+    }
+}
+
+// Só redesenha enquanto anima ou quando algo muda (sem idle ocupando a CPU)
+FrameScheduler scheduler(update);
+
 const char* vertexShaderSrc = R"(
 #version 330 core
 layout(location = 0) in vec2 position;
@@ -34,22 +52,8 @@ void main() {
 )";
 
 void compileShaders() {
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    
-    glShaderSource(vertexShader, 1, &vertexShaderSrc, nullptr);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSrc, nullptr);
-    
-    glCompileShader(vertexShader);
-    glCompileShader(fragmentShader);
-
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // Binário do programa vem do cache em disco quando possível
+    shaderProgram = createCachedShaderProgram(vertexShaderSrc, fragmentShaderSrc);
 }
 
 void initData() {
@@ -84,6 +88,7 @@ void initData() {
 }
 
 void display() {
+    scheduler.beginFrame();
     glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -97,19 +102,8 @@ void display() {
 
     glDrawArrays(GL_TRIANGLES, 0, 6);
     
-    glutSwapBuffers();
-}
-
-void idle() {
-    // varia a escala de forma suave entre 0.5 e 1.5
-    if (increasing) {
-        scale += 0.01f;
-        if (scale >= 1.5f) increasing = false;
-    } else {
-        scale -= 0.01f;
-        if (scale <= 0.5f) increasing = true;
-    }
-    glutPostRedisplay();
+    swapBuffers();
+    scheduler.endFrame();
 }
 
 void reshape(int w, int h) {
@@ -118,24 +112,32 @@ void reshape(int w, int h) {
 
 void keyboard(unsigned char key, int x, int y) {
     if (key == 27) exit(0); // ESC para sair
-    if (key == 'q' || key == 'Q') glutLeaveMainLoop();
+    if (key == 'q' || key == 'Q') leaveMainLoop();
+    if (key == ' ') scheduler.setAnimating(!scheduler.animating()); // pausa a animação
 }
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-    glutInitContextVersion(3, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Retângulo com Escala Iterativa");
+    if (!headlessInit(argc, argv)) {
+        glutInit(&argc, argv);
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+        glutInitWindowSize(800, 600);
+        glutCreateWindow("Retângulo com Escala Iterativa");
+    }
 
     glewInit();
 
     compileShaders();
     initData();
 
+    scheduler.setAnimating(true);
+
+    // Sem janela: desenha os quadros em um pbuffer (veja lib/headless.h)
+    if (headless())
+        return headlessRun({display, nullptr, reshape, keyboard});
+
     glutDisplayFunc(display);
-    glutIdleFunc(idle);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
 
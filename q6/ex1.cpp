@@ -4,13 +4,24 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "../lib/headless.h"
+#include "../lib/shader_cache.h"
+#include "../lib/frame_scheduler.h"
 
 int win_width = 800, win_height = 600;
 GLuint program, VAO, VBO;
 float angle = 0.0f;
-float angle_inc = 0.5f;
+float angle_inc = 0.5f; // graus por passo de 1/60 s
 int mode = 3; // modo default: câmera orbitando
 
+// Órbita da câmera: avança em passos fixos, não por quadro desenhado
+void update(double) {
+    angle += angle_inc;
+    if (angle > 360.0f) angle -= 360.0f;
+}
+
+FrameScheduler scheduler(update);
+
 const char* vertex_code = R"(
 #version 330 core
 layout(location = 0) in vec3 position;
@@ -33,19 +44,8 @@ void main() {
 )";
 
 void initShaders() {
-    GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(vertex, 1, &vertex_code, NULL);
-    glShaderSource(fragment, 1, &fragment_code, NULL);
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-
-    program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-    glLinkProgram(program);
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    // Binário do programa vem do cache em disco quando possível
+    program = createCachedShaderProgram(vertex_code, fragment_code);
     glUseProgram(program);
 }
 
@@ -115,6 +115,7 @@ void reshape(int w, int h) {
 }
 
 void display() {
+    scheduler.beginFrame();
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.5, 0.5, 0.5, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -145,39 +146,43 @@ void display() {
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(transform));
 
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glutSwapBuffers();
-}
-
-void idle() {
-    angle += angle_inc;
-    if (angle > 360.0f) angle -= 360.0f;
-    glutPostRedisplay();
+    swapBuffers();
+    scheduler.endFrame();
 }
 
 void keyboard(unsigned char key, int x, int y) {
     if (key == '1') mode = 1;
     if (key == '2') mode = 2;
     if (key == '3') mode = 3;
-    if (key == 'q' || key == 'Q') glutLeaveMainLoop();
+    if (key == ' ') scheduler.setAnimating(!scheduler.animating()); // pausa a animação
+    if (key == 'q' || key == 'Q') leaveMainLoop();
     if (key == 27) exit(0);
+    scheduler.invalidate();
 }
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-    glutInitContextVersion(3, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(win_width, win_height);
-    glutCreateWindow("Cubo com Camera Orbitando");
+    if (!headlessInit(argc, argv)) {
+        glutInit(&argc, argv);
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(win_width, win_height);
+        glutCreateWindow("Cubo com Camera Orbitando");
+    }
 
     glewInit();
     initData();
     initShaders();
 
+    scheduler.setAnimating(true);
+
+    // Sem janela: desenha os quadros em um pbuffer (veja lib/headless.h)
+    if (headless())
+        return headlessRun({display, nullptr, reshape, keyboard});
+
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
-    glutIdleFunc(idle);
 
     glutMainLoop();
     return 0;
@@ -1,11 +1,18 @@
 #include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "../lib/texture_manager.h"
+#include "../lib/shader_cache.h"
+#include "../lib/virtual_texture.h"
+#include "../lib/texture_atlas.h"
+#include "../lib/headless.h"
+#include "../lib/frame_scheduler.h"
 
 // Shader simples
 const char* vertexSrc = R"(
@@ -29,24 +36,69 @@ void main(){
 }
 )";
 
-GLuint shaderProgram, VAO, textureID;
+// Várias imagens numa textura array: a camada vem de cada vértice
+const char* arrayVertexSrc = R"(
+#version 330 core
+layout(location=0) in vec3 aPos;
+layout(location=1) in vec2 aTex;
+layout(location=2) in float aLayer;
+uniform mat4 MVP;
+out vec2 TexCoord;
+flat out float Layer;
+void main(){
+    TexCoord = aTex;
+    Layer = aLayer;
+    gl_Position = MVP * vec4(aPos,1);
+}
+)";
+const char* arrayFragmentSrc = R"(
+#version 330 core
+in vec2 TexCoord;
+flat in float Layer;
+out vec4 FragColor;
+uniform sampler2DArray ourTexture;
+void main(){
+    FragColor = texture(ourTexture, vec3(TexCoord, Layer));
+}
+)";
+
+// Textura virtual: amostra pela tabela de páginas
+const std::string vtFragmentSrc = std::string("#version 330 core\n") + virtualTextureGLSL + R"(
+in vec2 TexCoord;
+out vec4 FragColor;
+void main(){
+    FragColor = virtualTexture(TexCoord);
+}
+)";
+// Passo de feedback: grava a página que cada pixel quer
+const std::string vtFeedbackSrc = std::string("#version 330 core\n") + virtualTextureGLSL + R"(
+in vec2 TexCoord;
+out uvec4 Feedback;
+void main(){
+    Feedback = virtualTextureFeedback(TexCoord);
+}
+)";
+
+GLuint shaderProgram, feedbackProgram, VAO;
+TextureManager textures;  // decodifica a imagem em thread de fundo
+int textureHandle = -1;
+VirtualTexture vt;        // usado com --virtual (imagens grandes)
+bool useVirtual = false;
+std::vector<std::string> images;  // com mais de uma, cada face usa images[face % n]
+TextureAtlas atlas;       // padrão com várias imagens: um atlas só
+TextureArray textureArray;  // com --array
+bool useArray = false;
+GLuint multiTexture = 0;
 float angle = 0;
 
+// Rotação em passos fixos de 1/60 s: a velocidade não depende da taxa de quadros
+void update(double){ angle += 0.5f; }
+FrameScheduler scheduler(update);
+
 // Cria e compila shader
-GLuint compileProgram(){
-    auto compile = [&](GLenum tp, const char* src){
-        GLuint s = glCreateShader(tp);
-        glShaderSource(s,1,&src,nullptr);
-        glCompileShader(s);
-        return s;
-    };
-    GLuint vs = compile(GL_VERTEX_SHADER, vertexSrc);
-    GLuint fs = compile(GL_FRAGMENT_SHADER, fragmentSrc);
-    GLuint p = glCreateProgram();
-    glAttachShader(p,vs); glAttachShader(p,fs);
-    glLinkProgram(p);
-    glDeleteShader(vs); glDeleteShader(fs);
-    return p;
+GLuint compileProgram(const char* fragmentSrc, const char* vertexSrc = ::vertexSrc){
+    // Binário do programa vem do cache em disco quando possível
+    return createCachedShaderProgram(vertexSrc, fragmentSrc);
 }
 
 // Configura cubo (posições + UVs)
@@ -96,6 +148,11 @@ void setupCube(){
         -1,  1,  1,   0, 1,
     };
 
+    // Atlas: leva as UVs de cada face para o retângulo da sua imagem
+    if(images.size()>1 && !useArray)
+        for(int face=0; face<6; face++)
+            atlas.remap(data+face*20+3, 4, 5, face % images.size());
+
     glGenVertexArrays(1,&VAO);
     glBindVertexArray(VAO);
     GLuint VBO; glGenBuffers(1,&VBO);
@@ -107,26 +164,21 @@ void setupCube(){
     // UV
     glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,5*sizeof(float),(void*)(3*sizeof(float)));
     glEnableVertexAttribArray(1);
-}
 
-// Carrega textura com stb_image
-void loadTexture(const char* path){
-    int w,h,ch;
-    unsigned char* img = stbi_load(path,&w,&h,&ch,0);
-    if(!img){ std::cerr<<"Failed to load texture\n"; exit(1); }
-    glGenTextures(1,&textureID);
-    glBindTexture(GL_TEXTURE_2D,textureID);
-    GLenum fmt = (ch==4?GL_RGBA:GL_RGB);
-    glTexImage2D(GL_TEXTURE_2D,0,fmt,w,h,0,fmt,GL_UNSIGNED_BYTE,img);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-    stbi_image_free(img);
+    // Array: camada de cada vértice
+    if(images.size()>1 && useArray){
+        float layers[24];
+        for(int v=0; v<24; v++) layers[v] = float((v/4) % images.size());
+        GLuint layerVBO; glGenBuffers(1,&layerVBO);
+        glBindBuffer(GL_ARRAY_BUFFER,layerVBO);
+        glBufferData(GL_ARRAY_BUFFER,sizeof(layers),layers,GL_STATIC_DRAW);
+        glVertexAttribPointer(2,1,GL_FLOAT,GL_FALSE,sizeof(float),(void*)0);
+        glEnableVertexAttribArray(2);
+    }
 }
 
 void display(){
+    scheduler.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
     glUseProgram(shaderProgram);
@@ -134,45 +186,108 @@ void display(){
     // Matriz MVP
     glm::mat4 P=glm::perspective(glm::radians(45.0f),800.f/600.f,0.1f,100.f);
     glm::mat4 V=glm::translate(glm::mat4(1),glm::vec3(0,0,-5));
-    angle += 0.5f;
     glm::mat4 M=glm::rotate(glm::mat4(1),glm::radians(angle),glm::vec3(1,1,0));
     glm::mat4 MVP = P*V*M;
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"MVP"),1,GL_FALSE,glm::value_ptr(MVP));
 
-    // Texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D,textureID);
-    glUniform1i(glGetUniformLocation(shaderProgram,"ourTexture"),0);
+    if(useVirtual){
+        // Feedback em baixa resolução, depois carrega as páginas pedidas
+        glUseProgram(feedbackProgram);
+        glUniformMatrix4fv(glGetUniformLocation(feedbackProgram,"MVP"),1,GL_FALSE,glm::value_ptr(MVP));
+        vt.bindFeedback(feedbackProgram);
+        vt.beginFeedback(800,600);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_QUADS,0,24);
+        vt.endFeedback();
+        // Parado, continua desenhando até as páginas visíveis chegarem
+        if(vt.update()) scheduler.invalidate();
+        glUseProgram(shaderProgram);
+        vt.bind(shaderProgram,0);
+    } else if(multiTexture){
+        // Todas as faces com um único bind
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(useArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, multiTexture);
+        glUniform1i(glGetUniformLocation(shaderProgram,"ourTexture"),0);
+    } else {
+        // Texture (branca até a imagem terminar de carregar)
+        textures.poll();
+        // Parado, continua desenhando até a textura terminar de subir
+        if(!textures.ready(textureHandle)) scheduler.invalidate();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D,textures.texture(textureHandle));
+        glUniform1i(glGetUniformLocation(shaderProgram,"ourTexture"),0);
+    }
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_QUADS,0,24);  // 6 faces × 4 vértices
-    glutSwapBuffers();
+    swapBuffers();
+    scheduler.endFrame();
 }
 
 void keyboard(unsigned char key, int, int) {
     switch (key) {
         case 'q':
-        case 'Q': glutLeaveMainLoop();
-        case 27: glutLeaveMainLoop(); break;
+        case 'Q': leaveMainLoop();
+        case 27: leaveMainLoop(); break;
+        case 'i': if(useVirtual) vt.printStats(); break;
+        case ' ': scheduler.setAnimating(!scheduler.animating()); break;
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 
 int main(int argc,char** argv){
-    if(argc<2){ std::cerr<<"Uso: "<<argv[0]<<" textura.png\n"; return 1;}
-    glutInit(&argc,argv);
-    glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGBA|GLUT_DEPTH);
-    glutInitWindowSize(800,600);
-    glutCreateWindow("Cubo Texturizado");
+    // Sem janela (--headless WxH --frames N --out dir): contexto em pbuffer
+    headlessInit(argc,argv);
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i],"--virtual")==0) useVirtual = true;
+        else if(strcmp(argv[i],"--array")==0) useArray = true;
+        else if(strcmp(argv[i],"--ops")==0 && i+1<argc){
+            // Processa a imagem nas threads de carga (ex.: --ops resize=0.5,sharpen=0.3)
+            if(!textures.setImageOps(argv[++i])) return 1;
+        }
+        else images.push_back(argv[i]);
+    }
+    if(images.empty()){ std::cerr<<"Uso: "<<argv[0]<<" textura.png [mais.png ...] [--virtual | --array] [--ops blur=2,sharpen=0.5,resize=WxH,gray,gamma=2.2] [--headless WxH --frames N --out dir]\n"; return 1;}
+    if(useVirtual){
+        // Corta a imagem em páginas (só na primeira vez) e mapeia o arquivo
+        std::string file = virtualTextureFile(images[0]);
+        if(file.empty() || !vt.open(file)){ std::cerr<<"Falha ao abrir textura virtual\n"; return 1;}
+    } else if(images.size()>1){
+        // Várias imagens: empacota num atlas (ou camadas de um array)
+        for(const std::string& img : images){
+            if((useArray ? textureArray.add(img) : atlas.add(img)) < 0) return 1;
+        }
+        if(!useArray && !atlas.pack()){ std::cerr<<"Imagens não cabem no atlas\n"; return 1;}
+    } else {
+        // Envia a textura aos poucos (1 MB por quadro via PBO), sem travar a animação
+        textures.setUploadBudget(1 << 20);
+        textureHandle = textures.request(images[0]);
+    }
+    if(!headless()){
+        glutInit(&argc,argv);
+        glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGBA|GLUT_DEPTH);
+        glutInitWindowSize(800,600);
+        glutCreateWindow("Cubo Texturizado");
+    }
     glewInit();
 
-    shaderProgram = compileProgram();
+    if(useVirtual){
+        shaderProgram = compileProgram(vtFragmentSrc.c_str());
+        feedbackProgram = compileProgram(vtFeedbackSrc.c_str());
+        vt.init();
+    } else if(images.size()>1 && useArray){
+        shaderProgram = compileProgram(arrayFragmentSrc, arrayVertexSrc);
+        multiTexture = textureArray.upload();
+    } else {
+        shaderProgram = compileProgram(fragmentSrc);
+        if(images.size()>1) multiTexture = atlas.upload();
+    }
     setupCube();
-    loadTexture(argv[1]);
+    scheduler.setAnimating(true);
+    if(headless()) return headlessRun({display, nullptr, nullptr, keyboard});
     glutKeyboardFunc(keyboard);
     glutDisplayFunc(display);
-    glutIdleFunc(display);
     glutMainLoop();
     return 0;
 }